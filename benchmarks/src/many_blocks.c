@@ -0,0 +1,23 @@
+/* A single function with a few hundred basic blocks: a chain of small
+   loops, each holding a branch, inside an outer loop. It is meant for the
+   dataflow solvers, e.g. with --mao=TESTDF=bench[1]. Round-robin solving
+   of a backward problem moves information by about one block per round,
+   while the worklist solver only revisits blocks whose inputs changed. */
+volatile int v;
+
+#define L(x)     for (i = 0; i < n; ++i) { if (v & (x)) v += i; else v -= x; }
+#define L4(x)    L(x) L(x + 1) L(x + 2) L(x + 3)
+#define L16(x)   L4(x) L4(x + 4) L4(x + 8) L4(x + 12)
+#define L64(x)   L16(x) L16(x + 16) L16(x + 32) L16(x + 48)
+
+int foo(int n) {
+  int i, j;
+  for (j = 0; j < n; ++j) {
+    L64(1)
+  }
+  return v;
+}
+
+int main() {
+  return foo(3);
+}
@@ -0,0 +1,22 @@
+/* Straight-line code with roughly one million entries, spread over 80
+   functions. Each function updates its own variable, so that the compiler
+   does not fold identical functions. */
+#define S(x)     v##x += 1;
+#define S4(x)    S(x) S(x) S(x) S(x)
+#define S16(x)   S4(x) S4(x) S4(x) S4(x)
+#define S64(x)   S16(x) S16(x) S16(x) S16(x)
+#define S256(x)  S64(x) S64(x) S64(x) S64(x)
+#define S1024(x) S256(x) S256(x) S256(x) S256(x)
+#define S4096(x) S1024(x) S1024(x) S1024(x) S1024(x)
+
+#define FOO(x) volatile int v##x; void foo##x(void) { S4096(x) }
+
+#define M8(x) FOO(x##0) FOO(x##1) FOO(x##2) FOO(x##3) \
+              FOO(x##4) FOO(x##5) FOO(x##6) FOO(x##7)
+
+M8(1) M8(2) M8(3) M8(4) M8(5) M8(6) M8(7) M8(8) M8(9) M8(10)
+
+int main() {
+  foo10();
+  return v10;
+}
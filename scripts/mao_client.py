@@ -0,0 +1,46 @@
+#!/usr/bin/python
+
+"""Runs one unit on a mao server, started with --mao=--server=SOCKET.
+Usage: mao_client.py SOCKET INPUT OUTPUT [MAO_OPTIONS]
+MAO_OPTIONS are added to the options of the server for this unit, in the
+format of --mao=, e.g. ZEE:ADDADD=trace[1]. The output of mao is printed,
+and the script exits with the exit status of mao for the unit."""
+
+import os
+import socket
+import sys
+
+_STATUS_PREFIX = "mao-status: "
+
+def _Run(socket_path, input_file, output_file, mao_options):
+  connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  connection.connect(socket_path)
+  connection.sendall("%s\n%s\n%s\n%s\n" % (os.getcwd(), input_file,
+                                           output_file, mao_options))
+  reply = ""
+  while True:
+    data = connection.recv(65536)
+    if not data:
+      break
+    reply += data
+  connection.close()
+
+  # The last line holds the exit status.
+  status_start = reply.rfind(_STATUS_PREFIX)
+  if status_start == -1:
+    sys.stderr.write("Unexpected reply from the mao server\n")
+    return 1
+  sys.stdout.write(reply[:status_start])
+  return int(reply[status_start + len(_STATUS_PREFIX):])
+
+def main(argv):
+  if len(argv) not in (4, 5):
+    sys.stderr.write("Usage: %s SOCKET INPUT OUTPUT [MAO_OPTIONS]\n" % argv[0])
+    sys.exit(1)
+  mao_options = ""
+  if len(argv) == 5:
+    mao_options = argv[4]
+  sys.exit(_Run(argv[1], argv[2], argv[3], mao_options))
+
+if __name__ == "__main__":
+  main(sys.argv)
@@ -0,0 +1,366 @@
+#!/usr/bin/python
+
+"""Measures the throughput of MAO on generated assembly corpora.
+
+Usage: mao_throughput.py [options] MAO
+
+The corpora and pass sets are read from a suite file, by default
+benchmarks/throughput/suite.txt. For each corpus and pass set, MAO is run
+--repeat times. The fastest run gives the wall time, the peak RSS, the
+time of each pass, taken from --timing-json, and the entries per second.
+
+With --baseline, the results are compared against a stored baseline and
+the script exits with status 1 if wall time, peak RSS or the time of a
+pass grew by more than --tolerance. --update-baseline stores the results
+as the new baseline instead. Baselines only compare within one machine."""
+
+import json
+import optparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# Pass times below this many seconds are noise, and never regressions.
+_MIN_PASS_SECONDS = 0.02
+# Same for wall time.
+_MIN_WALL_SECONDS = 0.05
+
+_INSTRUCTIONS = [
+    "movl\t%d(%%rbp), %%eax",
+    "movl\t%%eax, %d(%%rbp)",
+    "addl\t$%d, %%eax",
+    "subl\t$%d, %%edx",
+    "leal\t%d(%%rax,%%rdx,4), %%ecx",
+    "imull\t$%d, %%ecx, %%eax",
+    "cmpl\t$%d, %%eax",
+    "testl\t$%d, %%edx",
+    "movq\t%d(%%rsp), %%rsi",
+    "shll\t$%d, %%edx",
+]
+
+_CONDITIONAL_JUMPS = ["je", "jne", "jl", "jge", "jle", "jg", "jb", "ja"]
+
+
+class Corpus(object):
+  """Parameters of a generated corpus, or the source file to compile it
+  from."""
+
+  def __init__(self, name, params, suite_dir):
+    self.name = name
+    self.source = params.get("source")
+    if self.source:
+      self.source = os.path.join(suite_dir, self.source)
+    self.functions = int(params.get("functions", 100))
+    self.blocks = max(int(params.get("blocks", 10)), 2)
+    self.block_size = max(int(params.get("block_size", 6)), 1)
+    self.jump_tables = float(params.get("jump_tables", 0))
+    self.data = int(params.get("data", 0))
+    self.seed = int(params.get("seed", 1))
+
+  def Generate(self, file_name):
+    """Writes the corpus to file_name. Returns the number of entries."""
+    if self.source:
+      return self._Compile(file_name)
+    rand = random.Random(self.seed)
+    out = open(file_name, "w")
+    entries = 0
+    for function in range(self.functions):
+      lines = self._Function(rand, function)
+      lines += self._Data(rand, function)
+      for line in lines:
+        out.write(line + "\n")
+      entries += len(lines)
+    out.close()
+    return entries
+
+  def _Compile(self, file_name):
+    """Compiles the source with $CC or $CXX -O2 -S, and counts the
+    non-empty lines of the assembly as its entries."""
+    if self.source.endswith(".c"):
+      compiler = os.environ.get("CC", "gcc")
+    else:
+      compiler = os.environ.get("CXX", "g++")
+    command = [compiler, "-O2", "-S", "-o", file_name, self.source]
+    if subprocess.call(command) != 0:
+      sys.stderr.write("Error running command: %s\n" % " ".join(command))
+      sys.exit(1)
+    return len([line for line in open(file_name) if line.strip()])
+
+  def _Function(self, rand, function):
+    name = "f%d" % function
+    lines = ["\t.text",
+             "\t.p2align 4",
+             "\t.globl\t" + name,
+             "\t.type\t%s, @function" % name,
+             name + ":",
+             "\tpushq\t%rbp",
+             "\tmovq\t%rsp, %rbp",
+             "\tmovl\t%edi, %eax"]
+    has_jump_table = rand.random() < self.jump_tables
+    for block in range(self.blocks):
+      lines.append(".L%d_%d:" % (function, block))
+      for _ in range(rand.randint(1, self.block_size)):
+        lines.append("\t" + rand.choice(_INSTRUCTIONS) %
+                     (-4 * rand.randint(1, 16)))
+      if has_jump_table and block == 0:
+        lines += self._JumpTable(rand, function)
+        continue
+      kind = rand.random()
+      if block == self.blocks - 1:
+        continue
+      elif kind < 0.4:
+        # Forward conditional branch.
+        target = rand.randint(block + 1, self.blocks - 1)
+        lines.append("\t%s\t.L%d_%d" % (rand.choice(_CONDITIONAL_JUMPS),
+                                        function, target))
+      elif kind < 0.55:
+        # Back edge, which makes a loop.
+        target = rand.randint(max(block - 8, 0), block)
+        lines.append("\tjne\t.L%d_%d" % (function, target))
+      elif kind < 0.65:
+        target = rand.randint(block + 1, self.blocks - 1)
+        lines.append("\tjmp\t.L%d_%d" % (function, target))
+      elif kind < 0.75:
+        lines.append("\tcall\tf%d" % rand.randint(0, self.functions - 1))
+    lines += ["\tpopq\t%rbp",
+              "\tret",
+              "\t.size\t%s, .-%s" % (name, name)]
+    return lines
+
+  def _JumpTable(self, rand, function):
+    cases = min(self.blocks - 1, 32)
+    table = ".LJT%d" % function
+    lines = ["\tcmpl\t$%d, %%eax" % (cases - 1),
+             "\tja\t.L%d_%d" % (function, self.blocks - 1),
+             "\tmovl\t%eax, %eax",
+             "\tjmp\t*%s(,%%rax,8)" % table,
+             "\t.section\t.rodata",
+             "\t.align 8",
+             table + ":"]
+    for _ in range(cases):
+      lines.append("\t.quad\t.L%d_%d" % (function,
+                                         rand.randint(1, self.blocks - 1)))
+    lines.append("\t.text")
+    return lines
+
+  def _Data(self, rand, function):
+    if not self.data:
+      return []
+    lines = ["\t.data", "\t.align 8", "d%d:" % function]
+    for item in range(self.data):
+      kind = rand.randint(0, 5)
+      if kind == 0:
+        lines.append("\t.long\t%d" % rand.randint(0, 1 << 30))
+      elif kind == 1:
+        lines.append("\t.quad\tf%d" % rand.randint(0, self.functions - 1))
+      elif kind == 2:
+        lines.append("\t.byte\t%d, %d" % (rand.randint(0, 255),
+                                          rand.randint(0, 255)))
+      elif kind == 3:
+        lines.append("\t.string\t\"item %d of d%d\"" % (item, function))
+      elif kind == 4:
+        lines.append("\t.zero\t%d" % rand.randint(1, 64))
+      else:
+        lines.append("\t.align\t%d" % (1 << rand.randint(0, 4)))
+    return lines
+
+
+def _ReadSuite(file_name):
+  corpora = []
+  passsets = []
+  for line in open(file_name):
+    fields = line.split("#")[0].split()
+    if not fields:
+      continue
+    if fields[0] == "corpus" and len(fields) >= 2:
+      params = dict(field.split("=", 1) for field in fields[2:])
+      corpora.append(Corpus(fields[1], params,
+                            os.path.dirname(os.path.abspath(file_name))))
+    elif fields[0] == "passset" and len(fields) == 3:
+      passsets.append((fields[1], fields[2]))
+    else:
+      sys.stderr.write("%s: cannot parse: %s" % (file_name, line))
+      sys.exit(1)
+  return corpora, passsets
+
+
+def _RunOnce(mao, passes, input_file, work_dir):
+  """Runs mao once. Returns (wall seconds, peak RSS in KB, pass times)."""
+  timing_file = os.path.join(work_dir, "timing.json")
+  command = [mao, "--mao=-s", "--mao=--timing-json=" + timing_file]
+  if passes != "-":
+    command.append("--mao=" + passes)
+  command += ["--mao=ASM=o[/dev/null]", "-o", "/dev/null", input_file]
+  devnull = open(os.devnull, "w")
+  start = time.time()
+  child = subprocess.Popen(command, stdout=devnull, stderr=subprocess.PIPE)
+  # Read stderr before waiting, to not block the child on a full pipe.
+  errors = child.stderr.read()
+  (_, status, usage) = os.wait4(child.pid, 0)
+  wall = time.time() - start
+  devnull.close()
+  if status != 0:
+    sys.stderr.write("Error running command: %s\n%s" %
+                     (" ".join(command), errors))
+    sys.exit(1)
+
+  # Add up the time of each pass over all functions.
+  pass_seconds = {}
+  for record in json.load(open(timing_file))["timing"]:
+    path = record["path"]
+    pass_seconds[path] = (pass_seconds.get(path, 0.0) +
+                          record["total_ns"] / 1e9)
+  return wall, usage.ru_maxrss, pass_seconds
+
+
+def _Measure(mao, corpus, entries, input_file, passset, repeat, work_dir):
+  best = None
+  for _ in range(repeat):
+    run = _RunOnce(mao, passset[1], input_file, work_dir)
+    if best is None or run[0] < best[0]:
+      best = run
+  wall, peak_rss_kb, pass_seconds = best
+  passes = {}
+  for path, seconds in pass_seconds.items():
+    passes[path] = {
+        "seconds": seconds,
+        "entries_per_second": entries / seconds if seconds > 0 else 0}
+  return {"corpus": corpus.name,
+          "passset": passset[0],
+          "entries": entries,
+          "wall_seconds": wall,
+          "peak_rss_kb": peak_rss_kb,
+          "entries_per_second": entries / wall if wall > 0 else 0,
+          "passes": passes}
+
+
+def _Grew(value, base, tolerance, minimum):
+  return value > base * (1 + tolerance) and value - base > minimum
+
+
+def _Compare(results, baseline, tolerance):
+  """Prints the changes against baseline. Returns the number of
+  regressions."""
+  regressions = 0
+  for key in sorted(results):
+    if key not in baseline:
+      print "%-32s not in baseline" % key
+      continue
+    result = results[key]
+    base = baseline[key]
+    problems = []
+    if _Grew(result["wall_seconds"], base["wall_seconds"], tolerance,
+             _MIN_WALL_SECONDS):
+      problems.append("wall %.3fs -> %.3fs" % (base["wall_seconds"],
+                                               result["wall_seconds"]))
+    if _Grew(result["peak_rss_kb"], base["peak_rss_kb"], tolerance, 0):
+      problems.append("peak RSS %dKB -> %dKB" % (base["peak_rss_kb"],
+                                                 result["peak_rss_kb"]))
+    for path in sorted(result["passes"]):
+      if path not in base["passes"]:
+        continue
+      seconds = result["passes"][path]["seconds"]
+      base_seconds = base["passes"][path]["seconds"]
+      if _Grew(seconds, base_seconds, tolerance, _MIN_PASS_SECONDS):
+        problems.append("%s %.3fs -> %.3fs" % (path, base_seconds, seconds))
+    change = (result["wall_seconds"] / base["wall_seconds"] - 1
+              if base["wall_seconds"] > 0 else 0)
+    print "%-32s %+6.1f%% %s" % (key, 100 * change,
+                                 "REGRESSION: " + ", ".join(problems)
+                                 if problems else "ok")
+    regressions += len(problems)
+  return regressions
+
+
+def _PrintResults(results):
+  print "%-32s %8s %10s %12s" % ("corpus/passset", "wall [s]", "RSS [MB]",
+                                 "entries/s")
+  for key in sorted(results):
+    result = results[key]
+    print "%-32s %8.3f %10.1f %12.0f" % (key, result["wall_seconds"],
+                                         result["peak_rss_kb"] / 1024.0,
+                                         result["entries_per_second"])
+    passes = result["passes"]
+    for path in sorted(passes, key=lambda p: -passes[p]["seconds"]):
+      print "  %-30s %8.3f %23.0f" % (path, passes[path]["seconds"],
+                                      passes[path]["entries_per_second"])
+
+
+def main(argv):
+  script_dir = os.path.dirname(os.path.abspath(argv[0]))
+  parser = optparse.OptionParser(usage="%prog [options] MAO")
+  parser.add_option("--suite", default=os.path.join(
+      script_dir, "..", "benchmarks", "throughput", "suite.txt"),
+                    help="the corpora and pass sets to run")
+  parser.add_option("--corpus", action="append", default=[],
+                    help="only run the named corpus, may be repeated")
+  parser.add_option("--passset", action="append", default=[],
+                    help="only run the named pass set, may be repeated")
+  parser.add_option("--repeat", type="int", default=3,
+                    help="runs per measurement, the fastest one counts")
+  parser.add_option("--work-dir",
+                    help="where to generate the corpora, kept afterwards")
+  parser.add_option("--results", help="write the results to this file")
+  parser.add_option("--baseline", help="compare against this baseline")
+  parser.add_option("--update-baseline", action="store_true",
+                    help="write the results to --baseline instead")
+  parser.add_option("--tolerance", type="float", default=0.10,
+                    help="allowed growth before a change is a regression")
+  parser.add_option("--generate-only", action="store_true",
+                    help="only generate the corpora into --work-dir")
+  (options, args) = parser.parse_args(argv[1:])
+  if len(args) != 1 and not options.generate_only:
+    parser.error("expected the mao executable")
+  if options.update_baseline and not options.baseline:
+    parser.error("--update-baseline needs --baseline")
+
+  corpora, passsets = _ReadSuite(options.suite)
+  if options.corpus:
+    corpora = [c for c in corpora if c.name in options.corpus]
+  if options.passset:
+    passsets = [p for p in passsets if p[0] in options.passset]
+
+  work_dir = options.work_dir or tempfile.mkdtemp(prefix="mao-throughput-")
+  if not os.path.isdir(work_dir):
+    os.makedirs(work_dir)
+  results = {}
+  try:
+    for corpus in corpora:
+      input_file = os.path.join(work_dir, corpus.name + ".s")
+      entries = corpus.Generate(input_file)
+      print "Generated %s: %d entries" % (input_file, entries)
+      if options.generate_only:
+        continue
+      for passset in passsets:
+        results[corpus.name + "/" + passset[0]] = _Measure(
+            args[0], corpus, entries, input_file, passset, options.repeat,
+            work_dir)
+  finally:
+    if not options.work_dir:
+      shutil.rmtree(work_dir)
+  if options.generate_only:
+    return 0
+
+  _PrintResults(results)
+  if options.results:
+    json.dump(results, open(options.results, "w"), indent=2, sort_keys=True)
+  if options.baseline:
+    if options.update_baseline:
+      json.dump(results, open(options.baseline, "w"), indent=2,
+                sort_keys=True)
+      print "Wrote baseline %s" % options.baseline
+    elif not os.path.exists(options.baseline):
+      print "No baseline %s, create it with --update-baseline" % (
+          options.baseline)
+    elif _Compare(results, json.load(open(options.baseline)),
+                  options.tolerance):
+      return 1
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main(sys.argv))
@@ -0,0 +1,218 @@
+#!/usr/bin/python
+# -*- mode: python -*-
+
+"""Tests the server mode of MAO with the IR cache, see src/MaoBatch.h.
+
+The script starts a server with --ir-cache=1 and checks that
+  - the first request for an input starts a process that reads it, the
+    zygote, and later requests for the input are handed over to it, with
+    the same output as an uncached run of mao,
+  - a changed input starts a new zygote, and so does an input whose
+    zygote was replaced by that of another input,
+  - a zygote that dies while reading its input, here at an .abort
+    directive, makes its requests run uncached, which reports the error
+    to the client,
+  - requests for missing inputs and malformed requests get an error.
+It prints PASS or FAIL for each check, and the time taken by the first,
+uncached, request for the input and by the following cached ones.
+
+Usage: test_mao_server.py [-m mao] [-i input]
+mao is ../bin/mao-x86_64-linux by default. input is the file whose
+requests are timed, a small generated function by default."""
+
+import getopt
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+_STATUS_PREFIX = "mao-status: "
+
+_FUNCTION = """	.text
+	.globl	%(name)s
+	.type	%(name)s, @function
+%(name)s:
+	movl	$1, %%eax
+	addl	$2, %%eax
+	ret
+	.size	%(name)s, .-%(name)s
+"""
+
+def _Request(socket_path, lines):
+  """Sends the request lines to the server. Returns the output of the unit
+  and its exit status, or None if the reply has no status."""
+  connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  connection.connect(socket_path)
+  connection.sendall("".join([line + "\n" for line in lines]))
+  connection.shutdown(socket.SHUT_WR)
+  reply = ""
+  while True:
+    data = connection.recv(65536)
+    if not data:
+      break
+    reply += data
+  connection.close()
+  status_start = reply.rfind(_STATUS_PREFIX)
+  if status_start == -1:
+    return (reply, None)
+  return (reply[:status_start],
+          int(reply[status_start + len(_STATUS_PREFIX):]))
+
+def _RunUnit(socket_path, directory, input_file, output_file, options=""):
+  return _Request(socket_path, [directory, input_file, output_file, options])
+
+def _ReadFile(path):
+  f = open(path)
+  text = f.read()
+  f.close()
+  return text
+
+def _WriteFile(path, text):
+  f = open(path, "w")
+  f.write(text)
+  f.close()
+
+class _Checker(object):
+  def __init__(self):
+    self.failures = 0
+
+  def Check(self, name, ok, detail=""):
+    if ok:
+      print "%-50s PASS" % name
+    else:
+      print "%-50s FAIL %s" % (name, detail)
+      self.failures += 1
+
+def _CountReads(log_path, input_path):
+  """Returns how often the server started a zygote for input_path."""
+  return _ReadFile(log_path).count("mao: reading %s in process" % input_path)
+
+def _WaitForSocket(socket_path, server):
+  for _ in range(100):
+    if os.path.exists(socket_path) or server.poll() is not None:
+      break
+    time.sleep(0.1)
+  return os.path.exists(socket_path)
+
+def _Test(mao, input_file, directory):
+  checker = _Checker()
+  good = os.path.join(directory, "good.s")
+  other = os.path.join(directory, "other.s")
+  bad = os.path.join(directory, "bad.s")
+  _WriteFile(good, _FUNCTION % {"name": "good"})
+  _WriteFile(other, _FUNCTION % {"name": "other"})
+  _WriteFile(bad, (_FUNCTION % {"name": "bad"}) + "\t.abort\n")
+  # The timed input must not have been requested before.
+  if input_file is None:
+    input_file = os.path.join(directory, "timed_input.s")
+    _WriteFile(input_file, _FUNCTION % {"name": "timed"})
+  input_file = os.path.realpath(input_file)
+
+  # The output of uncached runs, to compare the served units with.
+  reference = os.path.join(directory, "reference.s")
+  subprocess.call([mao, "--mao=ASM=o[%s]" % reference, good],
+                  stdout=open(os.devnull, "w"))
+  socket_path = os.path.join(directory, "mao.sock")
+  log_path = os.path.join(directory, "server.log")
+  server = subprocess.Popen([mao, "--mao=-v",
+                             "--mao=--server=%s:--ir-cache=1" % socket_path],
+                            stdout=open(os.devnull, "w"),
+                            stderr=open(log_path, "w"))
+  try:
+    if not _WaitForSocket(socket_path, server):
+      checker.Check("server starts", False, _ReadFile(log_path))
+      return 1
+
+    # The zygote, and the handover of requests to it.
+    output = os.path.join(directory, "out1.s")
+    (_, status) = _RunUnit(socket_path, directory, "good.s", output)
+    checker.Check("first request", status == 0 and
+                  _ReadFile(output) == _ReadFile(reference))
+    output = os.path.join(directory, "out2.s")
+    (_, status) = _RunUnit(socket_path, directory, good, output,
+                           "ZEE=trace[0]")
+    checker.Check("request handed over to the zygote",
+                  status == 0 and _ReadFile(output) == _ReadFile(reference))
+    checker.Check("one zygote for an unchanged input",
+                  _CountReads(log_path, good) == 1)
+
+    # A changed input starts a new zygote.
+    _WriteFile(good, _ReadFile(good) + (_FUNCTION % {"name": "added"}))
+    (_, status) = _RunUnit(socket_path, directory, good, output)
+    checker.Check("changed input", status == 0 and
+                  _ReadFile(output).find("added:") != -1)
+    checker.Check("new zygote for a changed input",
+                  _CountReads(log_path, good) == 2)
+
+    # With --ir-cache=1, the zygote for other.s replaces the one for
+    # good.s.
+    _RunUnit(socket_path, directory, other, output)
+    (_, status) = _RunUnit(socket_path, directory, good, output)
+    checker.Check("least recently used zygote evicted",
+                  status == 0 and _CountReads(log_path, good) == 3)
+
+    # The zygote for bad.s dies, and the request runs uncached.
+    (reply, status) = _RunUnit(socket_path, directory, bad, output)
+    checker.Check("fallback for a zygote that dies",
+                  status not in (0, None) and reply.find(".abort") != -1,
+                  reply)
+    (_, status) = _RunUnit(socket_path, directory, good, output)
+    checker.Check("served after the fallback", status == 0)
+
+    (_, status) = _RunUnit(socket_path, directory, "missing.s", output)
+    checker.Check("missing input", status not in (0, None))
+    (reply, status) = _Request(socket_path, [directory])
+    checker.Check("malformed request", status == 1 and
+                  reply.find("malformed request") != -1)
+
+    # The time taken by the parse, and by cached requests.
+    output = os.path.join(directory, "timed.s")
+    times = []
+    for _ in range(4):
+      start = time.time()
+      (_, status) = _RunUnit(socket_path, directory, input_file, output)
+      times.append(time.time() - start)
+      if status != 0:
+        checker.Check("timed requests", False, input_file)
+        break
+    else:
+      print "uncached request: %.3f s, cached requests: %s" % (
+          times[0], ", ".join(["%.3f s" % t for t in times[1:]]))
+  finally:
+    os.kill(server.pid, signal.SIGTERM)
+    server.wait()
+
+  return checker.failures != 0
+
+def main(argv):
+  mao = os.path.join(os.path.dirname(os.path.abspath(argv[0])),
+                     "..", "bin", "mao-x86_64-linux")
+  input_file = None
+  try:
+    opts, args = getopt.getopt(argv[1:], "m:i:")
+  except getopt.GetoptError:
+    print __doc__
+    sys.exit(2)
+  if args:
+    print __doc__
+    sys.exit(2)
+  for opt, value in opts:
+    if opt == "-m":
+      mao = value
+    elif opt == "-i":
+      input_file = value
+
+  # The server identifies inputs by their real path.
+  directory = os.path.realpath(tempfile.mkdtemp())
+  try:
+    failed = _Test(os.path.abspath(mao), input_file, directory)
+  finally:
+    shutil.rmtree(directory)
+  sys.exit(failed)
+
+if __name__ == "__main__":
+  main(sys.argv)
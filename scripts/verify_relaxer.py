@@ -1,11 +1,12 @@
 #!/usr/bin/python2.4
 # -*- mode: python -*-
 
-"""This script will run MAO on an assembly file and compare the functionsizes
+"""This script will run MAO on assembly files and compare the functionsizes
 calculated by the relaxer with the sizes reported by readelf on the assembled
-file. All temporary files are deleted. If verbose_error is True, a line is
-printed for each function that is unsuccessfully verified. If no such function
-is found by MAO, the rror message is
+files. MAO also checks each native relaxation against the gas relaxer. All
+temporary files are deleted. If verbose_error is True, a line is printed for
+each function that is unsuccessfully verified. If no such function is found by
+MAO, the rror message is
 
 "functionname ERROR: Unable to find function in MAO."
 
@@ -15,10 +16,13 @@ If the sizes differ the error message is
 
 Additionally, the script assumes that in the directory containing the script
 there are binaries named mao and as-orig which are the MAO and original GAS
-binaries, respectively. It also calls readelf to read the symbols of the object
-file."""
+binaries, respectively. Other binaries can be given with -m and -a. It also
+calls readelf to read the symbols of the object file.
 
+Usage: verify_relaxer.py [-m mao] [-a as-orig] inputfile..."""
 
+
+import getopt
 import os
 import sys
 import re
@@ -57,12 +61,12 @@ def _RunCheck(command, stdin=None, stdout=None, stderr=None, env=None):
 
 ################################################################################
 # Run mao on the inputfile and return a map with the reported function sizes.
-# Assumes that command "mao" exists in the current directory.
 ################################################################################
-def GetMaoSizes(inputfile, basedir):
+def GetMaoSizes(inputfile, mao):
   # Run mao and get the sizes from the report
-  cmd = [os.path.join(basedir, "mao"), "--mao:ASM=o[/dev/null]", \
-           "--mao=TEST=relax[1],cfg[0],lsg[0]", "--mao=RELAX=stat[1]", inputfile]
+  cmd = [mao, "--mao:ASM=o[/dev/null]", \
+           "--mao=TEST=relax[1],cfg[0],lsg[0]",
+           "--mao=RELAX=stat[1]+native[1]+verify_native[1]", inputfile]
   output = _RunCheck(cmd, stdout=subprocess.PIPE)
   mao_function_sizes = {}
   for outputline in output.split('\n'):
@@ -75,14 +79,13 @@ def GetMaoSizes(inputfile, basedir):
 
 
 ################################################################################
-# Assemble the inputfile with the command as-orig and uses readelf to get the
+# Assemble the inputfile with the original gas and uses readelf to get the
 # reported functionsizes from the object files.
-# Assumes that command "as-orig" exists in the current directory.
 ################################################################################
-def GetReadelfSizes(inputfile, basedir):
+def GetReadelfSizes(inputfile, as_orig):
   (fd, o_tempfile) = tempfile.mkstemp(suffix=".o")
   os.close(fd)
-  as_cmd = [os.path.join(basedir, "as-orig"), "-o", o_tempfile, inputfile]
+  as_cmd = [as_orig, "-o", o_tempfile, inputfile]
   _RunCheck(as_cmd)
   readelf_cmd = ["readelf", "--wide", "-s", o_tempfile]
   readelf_output = _RunCheck(readelf_cmd, stdout=subprocess.PIPE)
@@ -98,21 +101,10 @@ def GetReadelfSizes(inputfile, basedir):
 
 
 
-def main(argv):
-  in_file = ""
-  if len(argv) != 2:
-    print "Usage: " + argv[0] + " inputfile"
-    sys.exit(1)
-
-  # If True, print a line for each unsuccessfully verified function
-  verbose_errors = True
-  # If True, print a line for each verified function
-  verbose_all    = True
-
-  in_file = argv[1]
-
-  mao_sizes     = GetMaoSizes(in_file, os.path.join(os.path.dirname(argv[0])))
-  readelf_sizes = GetReadelfSizes(in_file, os.path.join(os.path.dirname(argv[0])))
+def VerifyFile(in_file, mao, as_orig, verbose_errors, verbose_all):
+  """Returns True if the sizes of all functions of in_file match."""
+  mao_sizes     = GetMaoSizes(in_file, mao)
+  readelf_sizes = GetReadelfSizes(in_file, as_orig)
 
   found_error    = False
   # Iterate over the function found in the object file
@@ -141,6 +133,34 @@ def main(argv):
     # Make sure errors are logged, and return value is correct
     if not function_ok:
       found_error = True
+  return not found_error
+
+
+def main(argv):
+  basedir = os.path.dirname(argv[0])
+  mao = os.path.join(basedir, "mao")
+  as_orig = os.path.join(basedir, "as-orig")
+  opts, in_files = getopt.getopt(argv[1:], 'm:a:')
+  for (flag, value) in opts:
+    if flag == '-m':
+      mao = value
+    elif flag == '-a':
+      as_orig = value
+  if not in_files:
+    print "Usage: " + argv[0] + " [-m mao] [-a as-orig] inputfile..."
+    sys.exit(1)
+
+  # If True, print a line for each unsuccessfully verified function
+  verbose_errors = True
+  # If True, print a line for each verified function
+  verbose_all    = True
+
+  found_error = False
+  for in_file in in_files:
+    if len(in_files) > 1:
+      print in_file
+    if not VerifyFile(in_file, mao, as_orig, verbose_errors, verbose_all):
+      found_error = True
 
   # Return
   if found_error:
@@ -28,6 +28,8 @@
 
 #include <map>
 #include <list>
+#include <string>
+#include <vector>
 #include <algorithm>
 
 #include "opcodes/i386-opc.h"
@@ -107,11 +109,11 @@ class GenDefUseEntry {
   }
   char *op_str() { return op_str_; }
   unsigned int       op_mask;
-  BitString reg_mask;
-  BitString reg_mask8;
-  BitString reg_mask16;
-  BitString reg_mask32;
-  BitString reg_mask64;
+  RegisterMask reg_mask;
+  RegisterMask reg_mask8;
+  RegisterMask reg_mask16;
+  RegisterMask reg_mask32;
+  RegisterMask reg_mask64;
   struct flags_ {
     bool  CF :1;
     bool  PF :1;
@@ -197,7 +199,7 @@ void ReadSideEffects(const char *fname, MnemMap &mnem_map) {
     GenDefUseEntry *e = new GenDefUseEntry(strdup(mnem));
     mnem_map[strdup(mnem)] = e;
 
-    BitString *mask = &e->reg_mask;
+    RegisterMask *mask = &e->reg_mask;
 
     bool eflags=false;
     while (p && *p && (p < end)) {
@@ -279,7 +281,59 @@ void ReadSideEffects(const char *fname, MnemMap &mnem_map) {
   fclose(f);
 }
 
-static void PrintRegMask(FILE *def, BitString &mask) {
+// Opcode properties, emitted as a bit per property into gen-opcodes.h, so
+// that InstructionEntry can test them with a single load. The opcodes are
+// given by their sanitized names.
+struct OpcodeProperty {
+  const char *name;
+  const char *description;
+  const char *opcodes[48];
+};
+
+static OpcodeProperty opcode_properties[] = {
+  { "OPP_JUMP", "Unconditional jumps",
+    { "jmp", "ljmp", NULL } },
+  { "OPP_COND_JUMP", "Conditional jumps, including jcxz and loop",
+    { "jo", "jno", "jb", "jc", "jnae", "jnb", "jnc", "jae", "je", "jz",
+      "jne", "jnz", "jbe", "jna", "jnbe", "ja", "js", "jns", "jp", "jpe",
+      "jnp", "jpo", "jl", "jnge", "jnl", "jge", "jle", "jng", "jnle", "jg",
+      // jcxz vs. jecxz is chosen on the basis of the address size prefix.
+      "jcxz", "jecxz", "jrcxz",
+      "loop", "loopz", "loope", "loopnz", "loopne", NULL } },
+  { "OPP_CALL", "Calls",
+    { "call", "lcall", "vmcall", "syscall", "vmmcall", NULL } },
+  { "OPP_RETURN", "Returns",
+    { "ret", "lret", "retf", "iret", "sysret", NULL } },
+  { "OPP_PREDICATED", "Conditional moves",
+    { "cmovo", "cmovno", "cmovb", "cmovc", "cmovnae", "cmovae", "cmovnc",
+      "cmovnb", "cmove", "cmovz", "cmovne", "cmovnz", "cmovbe", "cmovna",
+      "cmova", "cmovnbe", "cmovs", "cmovns", "cmovp", "cmovnp", "cmovl",
+      "cmovnge", "cmovge", "cmovnl", "cmovle", "cmovng", "cmovg", "cmovnle",
+      "fcmovb", "fcmovnae", "fcmove", "fcmovbe", "fcmovna", "fcmovu",
+      "fcmovae", "fcmovnb", "fcmovne", "fcmova", "fcmovnbe", "fcmovnu",
+      NULL } },
+};
+static const int num_opcode_properties =
+    sizeof(opcode_properties) / sizeof(opcode_properties[0]);
+
+// Returns the properties of the opcode with the given sanitized name, and
+// counts the opcodes found in found_opcodes.
+static unsigned int GetOpcodeProperties(const char *name,
+                                        int *found_opcodes) {
+  unsigned int properties = 0;
+  for (int i = 0; i < num_opcode_properties; ++i) {
+    for (const char *const *opcode = opcode_properties[i].opcodes; *opcode;
+         ++opcode) {
+      if (!strcmp(*opcode, name)) {
+        properties |= 1 << i;
+        ++*found_opcodes;
+      }
+    }
+  }
+  return properties;
+}
+
+static void PrintRegMask(FILE *def, const RegisterMask &mask) {
   mask.PrintInitializer(def);
 }
 
@@ -297,6 +351,10 @@ int main(int argc, char *const argv[]) {
   int  lineno = 0;
   char lastname[2048];
   char sanitized_name[2048];
+  // The properties of each opcode, and the names for the table comments.
+  std::vector<unsigned int> properties(1, 0);
+  std::vector<std::string> property_names(1, "invalid");
+  int found_opcodes = 0;
 
   // Options processing
   //
@@ -416,14 +474,13 @@ int main(int argc, char *const argv[]) {
           "} MaoOpcodeTable[] = {\n"
           "  { OP_invalid, \"invalid\" },\n");
 
-  // TODO(martint): Update 256 to use the number of actual registers.
   fprintf(def,
           "// DO NOT EDIT - this file is automatically "
           "generated by GenOpcodes\n//\n"
           "#ifndef GEN_DEFS_MAODEFS_H_\n"
           "#define GEN_DEFS_MAODEFS_H_\n"
-          "#define BNULL BitString(256, 4, 0x0ull, 0x0ull, 0x0ull, 0x0ull)\n"
-          "#define BALL  BitString(256, 4, -1ull, -1ull, -1ull, -1ull)\n"
+          "#define BNULL RegisterMask()\n"
+          "#define BALL  (~RegisterMask())\n"
           "DefEntry def_entries [] = {\n"
           "  { OP_invalid, 0, BNULL, BNULL, BNULL, BNULL, BNULL },\n");
 
@@ -432,8 +489,8 @@ int main(int argc, char *const argv[]) {
           "generated by GenOpcodes\n//\n"
           "#ifndef GEN_USES_MAODEFS_H_\n"
           "#define GEN_USES_MAODEFS_H_\n"
-          "#define BNULL BitString(256, 4, 0x0ull, 0x0ull, 0x0ull, 0x0ull)\n"
-          "#define BALL  BitString(256, 4, -1ull, -1ull, -1ull, -1ull)\n"
+          "#define BNULL RegisterMask()\n"
+          "#define BALL  (~RegisterMask())\n"
           "UseEntry use_entries [] = {\n"
           "  { OP_invalid, 0, BNULL, BNULL, BNULL, BNULL, BNULL },\n");
   // Read through the instruction description file, isolate the first
@@ -487,6 +544,9 @@ int main(int argc, char *const argv[]) {
     if (strcmp(name, lastname)) {
       fprintf(out, "  OP_%s,\n", sanitized_name);
       fprintf(table, "  { OP_%s, \t\"%s\" },\n", sanitized_name, name);
+      properties.push_back(GetOpcodeProperties(sanitized_name,
+                                               &found_opcodes));
+      property_names.push_back(name);
 
       /* Emit def entry */
       MnemMap::iterator def_it = mnem_def_map.find(sanitized_name);
@@ -570,11 +630,42 @@ int main(int argc, char *const argv[]) {
                 (*it).second->op_str());
     }
 
+  // All opcodes given a property must exist, as the predicates using the
+  // properties would silently fail for them otherwise.
+  int property_opcodes = 0;
+  for (int i = 0; i < num_opcode_properties; ++i) {
+    for (const char *const *opcode = opcode_properties[i].opcodes; *opcode;
+         ++opcode)
+      ++property_opcodes;
+  }
+  if (found_opcodes != property_opcodes) {
+    fprintf(stderr, "Opcodes with properties are missing from: %s\n",
+            op_table);
+    exit(1);
+  }
+  if (num_opcode_properties > 8) {
+    fprintf(stderr, "Too many opcode properties for unsigned char\n");
+    exit(1);
+  }
+
   fprintf(out, "};  // MaoOpcode\n\n"
+          "// Properties of the opcodes, see InstructionEntry.\n"
+          "enum MaoOpcodeProperty {\n");
+  for (int i = 0; i < num_opcode_properties; ++i)
+    fprintf(out, "  %s = 1 << %d,  // %s\n", opcode_properties[i].name, i,
+            opcode_properties[i].description);
+  fprintf(out, "};\n\n"
+          "// The properties of each opcode, indexed by MaoOpcode.\n"
+          "extern const unsigned char MaoOpcodeProperties[];\n\n"
           "MaoOpcode GetOpcode(const char *opcode);\n"
           "#endif  // GEN_OPCODES_H_\n");
 
   fprintf(table, "  { OP_invalid, 0 }\n");
+  fprintf(table, "};\n\n"
+          "const unsigned char MaoOpcodeProperties[] = {\n");
+  for (size_t i = 0; i < properties.size(); ++i)
+    fprintf(table, "  0x%02x,  // %s\n", properties[i],
+            property_names[i].c_str());
   fprintf(table, "};\n"
           "#endif  // GEN_OPCODES_TABLE_MAODEFS_H_\n");
 
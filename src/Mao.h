@@ -25,12 +25,15 @@
 #include <math.h>
 #include <stdio.h>
 
+#include "MaoAnalysis.h"
 #include "MaoDebug.h"
+#include "MaoFunctionCache.h"
 #include "MaoOptions.h"
 #include "MaoUnit.h"
 #include "MaoPasses.h"
 #include "MaoCFG.h"
 #include "MaoDefs.h"
+#include "MaoDominators.h"
 #include "MaoLoops.h"
 #include "MaoRelax.h"
 #include "MaoPlugin.h"
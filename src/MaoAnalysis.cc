@@ -0,0 +1,118 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include "Mao.h"
+#include "MaoAnalysis.h"
+#include "MaoDominators.h"
+
+//
+// Class: MaoAnalyses
+//
+
+// Returns the cached tree of the given kind, building it if needed.
+static DominatorTree *GetDominatorTree(MaoUnit *unit, Function *function,
+                                       MaoAnalysisKind kind) {
+  MaoMutexLock lock(function->cache_mutex());
+  if (function->dominators(kind) == NULL) {
+    CFG *cfg = CFG::GetCFG(unit, function);
+    MaoTimerScope timer(kind == ANALYSIS_DOMINATORS ? "DOM" : "PDOM",
+                        function);
+    function->set_dominators(
+        kind, new DominatorTree(cfg, kind == ANALYSIS_POST_DOMINATORS));
+  }
+  return function->dominators(kind);
+}
+
+DominatorTree *MaoAnalyses::GetDominators(MaoUnit *unit, Function *function) {
+  return GetDominatorTree(unit, function, ANALYSIS_DOMINATORS);
+}
+
+DominatorTree *MaoAnalyses::GetPostDominators(MaoUnit *unit,
+                                              Function *function) {
+  return GetDominatorTree(unit, function, ANALYSIS_POST_DOMINATORS);
+}
+
+Liveness *MaoAnalyses::GetLiveness(MaoUnit *unit, Function *function) {
+  MaoMutexLock lock(function->cache_mutex());
+  if (function->dataflow(ANALYSIS_LIVENESS) == NULL) {
+    CFG *cfg = CFG::GetCFG(unit, function);
+    MaoTimerScope timer("LIVENESS", function);
+    Liveness *liveness = new Liveness(unit, function, cfg);
+    liveness->Solve();
+    function->set_dataflow(ANALYSIS_LIVENESS, liveness);
+  }
+  return static_cast<Liveness *>(function->dataflow(ANALYSIS_LIVENESS));
+}
+
+ReachingDefs *MaoAnalyses::GetReachingDefs(MaoUnit *unit, Function *function) {
+  MaoMutexLock lock(function->cache_mutex());
+  if (function->dataflow(ANALYSIS_REACHING_DEFS) == NULL) {
+    CFG *cfg = CFG::GetCFG(unit, function);
+    MaoTimerScope timer("RDEFS", function);
+    ReachingDefs *reaching_defs = new ReachingDefs(unit, function, cfg);
+    reaching_defs->Solve();
+    function->set_dataflow(ANALYSIS_REACHING_DEFS, reaching_defs);
+  }
+  return static_cast<ReachingDefs *>(
+      function->dataflow(ANALYSIS_REACHING_DEFS));
+}
+
+void MaoAnalyses::Compute(MaoUnit *unit, Function *function,
+                          MaoAnalysisSet used) {
+  if (used.Contains(ANALYSIS_CFG))
+    CFG::GetCFG(unit, function);
+  if (used.Contains(ANALYSIS_LSG))
+    LoopStructureGraph::GetLSG(unit, function);
+  if (used.Contains(ANALYSIS_DOMINATORS))
+    GetDominators(unit, function);
+  if (used.Contains(ANALYSIS_POST_DOMINATORS))
+    GetPostDominators(unit, function);
+  if (used.Contains(ANALYSIS_LIVENESS))
+    GetLiveness(unit, function);
+  if (used.Contains(ANALYSIS_REACHING_DEFS))
+    GetReachingDefs(unit, function);
+}
+
+void MaoAnalyses::Invalidate(Function *function, MaoAnalysisSet preserved) {
+  if (preserved.IsAll())
+    return;
+  MaoMutexLock lock(function->cache_mutex());
+  // Dropping the CFG drops everything built on it, see Function::set_cfg.
+  if (!preserved.Contains(ANALYSIS_CFG)) {
+    function->set_cfg(NULL);
+    return;
+  }
+  if (!preserved.Contains(ANALYSIS_LSG))
+    function->set_lsg(NULL);
+  if (!preserved.Contains(ANALYSIS_DOMINATORS))
+    function->set_dominators(ANALYSIS_DOMINATORS, NULL);
+  if (!preserved.Contains(ANALYSIS_POST_DOMINATORS))
+    function->set_dominators(ANALYSIS_POST_DOMINATORS, NULL);
+  if (!preserved.Contains(ANALYSIS_LIVENESS))
+    function->set_dataflow(ANALYSIS_LIVENESS, NULL);
+  if (!preserved.Contains(ANALYSIS_REACHING_DEFS))
+    function->set_dataflow(ANALYSIS_REACHING_DEFS, NULL);
+}
+
+void MaoAnalyses::InvalidateAll(MaoUnit *unit, MaoAnalysisSet preserved) {
+  if (preserved.IsAll())
+    return;
+  for (MaoUnit::ConstFunctionIterator iter = unit->ConstFunctionBegin();
+       iter != unit->ConstFunctionEnd(); ++iter)
+    Invalidate(*iter, preserved);
+}
@@ -0,0 +1,103 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Analysis results cached per function.
+// Classes:
+//   MaoAnalysisSet - A set of analysis kinds.
+//   MaoAnalyses    - Returns the cached analyses of a function, computing
+//                    them if needed, and drops them when they are out of
+//                    date.
+//
+// The CFG and the loop structure graph are cached by CFG::GetCFG() and
+// LoopStructureGraph::GetLSG(). MaoAnalyses adds the dominator trees and
+// the solved liveness and reaching definitions problems:
+//
+//   Liveness *liveness = MaoAnalyses::GetLiveness(unit_, function_);
+//
+// Passes declare the analyses they use and the ones they keep valid, see
+// MaoPass. After a pass has run on a function, the results it did not
+// preserve are dropped. A pass that does not declare anything is taken to
+// change the IR, and to keep only the CFG, the loop structure graph and
+// the dominator trees, which passes that change the control flow
+// invalidate themselves with CFG::InvalidateCFG(). Passes that update the
+// CFG in place declare that they invalidate the others instead.
+//
+// The other analyses refer to the blocks of the CFG, so they are dropped
+// together with it.
+//
+#ifndef MAOANALYSIS_H_
+#define MAOANALYSIS_H_
+
+class DominatorTree;
+class Function;
+class Liveness;
+class MaoUnit;
+class ReachingDefs;
+
+enum MaoAnalysisKind {
+  ANALYSIS_CFG = 0,
+  ANALYSIS_LSG,
+  ANALYSIS_DOMINATORS,
+  ANALYSIS_POST_DOMINATORS,
+  ANALYSIS_LIVENESS,
+  ANALYSIS_REACHING_DEFS,
+  NUM_ANALYSES
+};
+
+class MaoAnalysisSet {
+ public:
+  MaoAnalysisSet() : bits_(0) { }
+
+  // Returns the set of all analyses.
+  static MaoAnalysisSet All() {
+    return MaoAnalysisSet((1U << NUM_ANALYSES) - 1);
+  }
+
+  void Add(MaoAnalysisKind kind) { bits_ |= 1U << kind; }
+  void Remove(MaoAnalysisKind kind) { bits_ &= ~(1U << kind); }
+  bool Contains(MaoAnalysisKind kind) const { return bits_ & (1U << kind); }
+  bool IsAll() const { return bits_ == All().bits_; }
+
+ private:
+  explicit MaoAnalysisSet(unsigned int bits) : bits_(bits) { }
+
+  unsigned int bits_;
+};
+
+class MaoAnalyses {
+ public:
+  // Return the dominator and post-dominator trees of the CFG returned by
+  // CFG::GetCFG(unit, function).
+  static DominatorTree *GetDominators(MaoUnit *unit, Function *function);
+  static DominatorTree *GetPostDominators(MaoUnit *unit, Function *function);
+
+  // Return the solved problem for the function, using the CFG returned by
+  // CFG::GetCFG(unit, function).
+  static Liveness *GetLiveness(MaoUnit *unit, Function *function);
+  static ReachingDefs *GetReachingDefs(MaoUnit *unit, Function *function);
+
+  // Computes the analyses in used that are not cached yet.
+  static void Compute(MaoUnit *unit, Function *function, MaoAnalysisSet used);
+  // Drops the results of the function that are not in preserved.
+  static void Invalidate(Function *function, MaoAnalysisSet preserved);
+  // Drops the results of all functions of the unit that are not in
+  // preserved.
+  static void InvalidateAll(MaoUnit *unit, MaoAnalysisSet preserved);
+};
+
+#endif  // MAOANALYSIS_H_
@@ -0,0 +1,120 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "MaoArena.h"
+#include "MaoDebug.h"
+
+//
+// Class: MaoArena
+//
+
+const size_t MaoArena::kDefaultBlockSize;
+const size_t MaoArena::kAlignment;
+
+static void FreeBlocks(std::vector<char *> *blocks) {
+  for (std::vector<char *>::iterator iter = blocks->begin();
+       iter != blocks->end(); ++iter) {
+    free(*iter);
+  }
+  blocks->clear();
+}
+
+MaoArena::MaoArena(size_t block_size)
+    : block_size_(block_size), next_(NULL), end_(NULL), bytes_allocated_(0),
+      bytes_reserved_(0) {
+}
+
+MaoArena::~MaoArena() {
+  FreeBlocks(&blocks_);
+  FreeBlocks(&spare_blocks_);
+  FreeBlocks(&large_blocks_);
+}
+
+void *MaoArena::AllocateBlock(size_t size) {
+  if (size == block_size_ && !spare_blocks_.empty()) {
+    blocks_.push_back(spare_blocks_.back());
+    spare_blocks_.pop_back();
+    return blocks_.back();
+  }
+  char *block = static_cast<char *>(malloc(size));
+  MAO_RASSERT_MSG(block, "Out of memory allocating %lu bytes",
+                  static_cast<unsigned long>(size));
+  if (size == block_size_) {
+    blocks_.push_back(block);
+  } else {
+    large_blocks_.push_back(block);
+  }
+  bytes_reserved_ += size;
+  return block;
+}
+
+void MaoArena::Reset() {
+  MaoMutexLock lock(&mutex_);
+  spare_blocks_.insert(spare_blocks_.end(), blocks_.begin(), blocks_.end());
+  blocks_.clear();
+  FreeBlocks(&large_blocks_);
+  next_ = end_ = NULL;
+  bytes_allocated_ = 0;
+  bytes_reserved_ = spare_blocks_.size() * block_size_;
+}
+
+void *MaoArena::Allocate(size_t size) {
+  size = (size + kAlignment - 1) & ~(kAlignment - 1);
+  if (size == 0)
+    size = kAlignment;
+
+  MaoMutexLock lock(&mutex_);
+  bytes_allocated_ += size;
+
+  // Large objects get a block of their own, so that they do not waste
+  // the rest of the current block.
+  if (size > block_size_ / 4)
+    return AllocateBlock(size);
+
+  if (static_cast<size_t>(end_ - next_) < size) {
+    next_ = static_cast<char *>(AllocateBlock(block_size_));
+    end_ = next_ + block_size_;
+  }
+  void *result = next_;
+  next_ += size;
+  return result;
+}
+
+void *MaoArena::AllocateZeroed(size_t size) {
+  void *result = Allocate(size);
+  memset(result, 0, size);
+  return result;
+}
+
+char *MaoArena::StrDup(const char *str) {
+  MAO_ASSERT(str);
+  size_t length = strlen(str) + 1;
+  char *copy = static_cast<char *>(Allocate(length));
+  memcpy(copy, str, length);
+  return copy;
+}
+
+char *MaoArena::StrNDup(const char *str, size_t length) {
+  MAO_ASSERT(str);
+  char *copy = static_cast<char *>(Allocate(length + 1));
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
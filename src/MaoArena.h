@@ -0,0 +1,91 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Arena allocation for the IR.
+// Classes:
+//   MaoArena - A bump allocator. Memory is handed out from large blocks
+//              and is only released, all at once, when the arena is
+//              destroyed or reset.
+//
+// Each MaoUnit owns an arena that holds its entries, the i386_insn
+// copies and expressions of the instructions, and the label names and
+// verbatim source lines. Each Function owns a smaller one for the basic
+// blocks and edges of its CFG. Objects placed in the arena must not be
+// freed individually.
+//
+#ifndef MAOARENA_H_
+#define MAOARENA_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "MaoThreads.h"
+
+class MaoArena {
+ public:
+  static const size_t kDefaultBlockSize = 256 * 1024;
+
+  explicit MaoArena(size_t block_size = kDefaultBlockSize);
+  ~MaoArena();
+
+  // Returns size bytes of uninitialized memory, aligned to kAlignment.
+  void *Allocate(size_t size);
+
+  // Returns size bytes of zeroed memory, aligned to kAlignment.
+  void *AllocateZeroed(size_t size);
+
+  // Returns a copy of str that lives in the arena.
+  char *StrDup(const char *str);
+  // Returns a NUL terminated copy of the first length bytes of str.
+  char *StrNDup(const char *str, size_t length);
+
+  // Makes all memory handed out so far available again. The blocks are
+  // kept for reuse, except for those of large objects.
+  void Reset();
+
+  // Returns the number of bytes handed out by the arena.
+  size_t bytes_allocated() const { return bytes_allocated_; }
+  // Returns the number of bytes reserved from the system.
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+ private:
+  static const size_t kAlignment = 16;
+
+  // Allocates a new block that can hold at least size bytes.
+  void *AllocateBlock(size_t size);
+
+  const size_t block_size_;
+  // Blocks of block_size_ bytes in use, and those freed by Reset().
+  std::vector<char *> blocks_;
+  std::vector<char *> spare_blocks_;
+  // Blocks holding a single large object.
+  std::vector<char *> large_blocks_;
+  // Free space in the current block.
+  char *next_;
+  char *end_;
+
+  size_t bytes_allocated_;
+  size_t bytes_reserved_;
+
+  // Function passes may create entries on several threads.
+  MaoMutex mutex_;
+
+  MaoArena(const MaoArena &);
+  MaoArena &operator=(const MaoArena &);
+};
+
+#endif  // MAOARENA_H_
@@ -0,0 +1,640 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MaoBatch.h"
+#include "MaoDebug.h"
+
+// Longest line in a unit list or a request.
+static const int kMaxLineLength = 2 * PATH_MAX + 2;
+
+//
+// Class: MaoBatch
+//
+
+MaoBatch::MaoBatch(MaoOptions *options, UnitParser parser,
+                   UnitOptimizer optimizer, int argc, const char **argv)
+    : options_(options), parser_(parser), optimizer_(optimizer),
+      argc_(argc), argv_(argv), listen_fd_(-1), clock_(0) {
+  MAO_ASSERT(argc >= 1);
+}
+
+int MaoBatch::RunUnit(const Request &request, MaoUnit *unit, int out_fd) {
+  // Buffered output would otherwise be printed by the child as well.
+  fflush(stdout);
+  fflush(stderr);
+
+  pid_t pid = fork();
+  MAO_RASSERT_MSG(pid >= 0, "Unable to fork: %s", strerror(errno));
+  if (pid == 0) {
+    if (out_fd != -1) {
+      dup2(out_fd, STDOUT_FILENO);
+      dup2(out_fd, STDERR_FILENO);
+      close(out_fd);
+    }
+    if (!request.directory.empty() && chdir(request.directory.c_str()) != 0) {
+      fprintf(stderr, "Unable to change to %s: %s\n",
+              request.directory.c_str(), strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    if (!request.options.empty())
+      options_->Parse(argv_[0], request.options.c_str());
+    std::string asm_pass = "ASM=o[" + request.output + "]";
+    options_->Parse(argv_[0], asm_pass.c_str());
+
+    if (unit == NULL) {
+      std::vector<const char *> argv(argv_, argv_ + argc_);
+      argv.push_back(request.input.c_str());
+      unit = parser_(options_, argv.size(), &argv[0]);
+    }
+    exit(optimizer_(options_, unit));
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    MAO_RASSERT_MSG(errno == EINTR, "Unable to wait for unit %s: %s",
+                    request.input.c_str(), strerror(errno));
+  }
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  return 128 + WTERMSIG(status);
+}
+
+int MaoBatch::RunList(const char *file_name) {
+  // Read the whole list first. A unit that exits flushes the stdio
+  // streams it inherited, which would move the read position of the list.
+  std::vector<Request> units;
+  FILE *list = fopen(file_name, "r");
+  MAO_RASSERT_MSG(list, "Unable to open unit list %s", file_name);
+  char line[kMaxLineLength];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), list)) {
+    ++line_number;
+    char *input = strtok(line, " \t\n");
+    if (input == NULL || input[0] == '#')
+      continue;
+    char *output = strtok(NULL, " \t\n");
+    MAO_RASSERT_MSG(output, "%s:%d: Expected an input and an output file",
+                    file_name, line_number);
+    Request unit;
+    unit.input = input;
+    unit.output = output;
+    units.push_back(unit);
+  }
+  fclose(list);
+
+  int failed = 0;
+  for (std::vector<Request>::const_iterator iter = units.begin();
+       iter != units.end(); ++iter) {
+    int status = RunUnit(*iter, NULL, -1);
+    if (status != 0) {
+      fprintf(stderr, "mao: %s failed with status %d\n",
+              iter->input.c_str(), status);
+      ++failed;
+    }
+  }
+
+  if (options_->verbose())
+    fprintf(stderr, "mao: ran %d units, %d failed\n",
+            static_cast<int>(units.size()), failed);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Reads a line from stream into line, without the newline.
+static bool ReadRequestLine(FILE *stream, char *line, int size,
+                            bool may_be_empty) {
+  if (!fgets(line, size, stream))
+    return false;
+  char *newline = strchr(line, '\n');
+  if (newline == NULL)
+    return false;
+  *newline = '\0';
+  return may_be_empty || line[0] != '\0';
+}
+
+bool MaoBatch::ReadRequest(int fd, Request *request) {
+  char directory[kMaxLineLength], input[kMaxLineLength];
+  char output[kMaxLineLength], options[kMaxLineLength];
+
+  // Read through a copy of fd, so that closing the stream keeps fd open.
+  FILE *stream = fdopen(dup(fd), "r");
+  if (stream == NULL)
+    return false;
+  bool complete =
+      ReadRequestLine(stream, directory, sizeof(directory), false) &&
+      ReadRequestLine(stream, input, sizeof(input), false) &&
+      ReadRequestLine(stream, output, sizeof(output), false) &&
+      ReadRequestLine(stream, options, sizeof(options), true);
+  fclose(stream);
+  if (!complete)
+    return false;
+  request->directory = directory;
+  request->input = input;
+  request->output = output;
+  request->options = options;
+  return true;
+}
+
+// Tells the client that its request could not be read.
+static void ReplyMalformed(int fd) {
+  const char message[] = "mao: malformed request\n";
+  write(fd, message, sizeof(message) - 1);
+}
+
+void MaoBatch::Reply(int fd, int status) {
+  char reply[32];
+  int length = snprintf(reply, sizeof(reply), "mao-status: %d\n", status);
+  write(fd, reply, length);
+  close(fd);
+}
+
+void MaoBatch::HandleConnection(int fd) {
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  MAO_RASSERT_MSG(pid >= 0, "Unable to fork: %s", strerror(errno));
+  if (pid == 0) {
+    CloseServerSockets(fd);
+    Request request;
+    if (!ReadRequest(fd, &request)) {
+      ReplyMalformed(fd);
+      Reply(fd, EXIT_FAILURE);
+      _exit(EXIT_SUCCESS);
+    }
+    Reply(fd, RunUnit(request, NULL, fd));
+    _exit(EXIT_SUCCESS);
+  }
+  close(fd);
+}
+
+void MaoBatch::HandleRequest(int fd, const Request &request) {
+  // Each request is handled by a process of its own, so that requests
+  // run in parallel.
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  MAO_RASSERT_MSG(pid >= 0, "Unable to fork: %s", strerror(errno));
+  if (pid == 0) {
+    CloseServerSockets(fd);
+    Reply(fd, RunUnit(request, NULL, fd));
+    _exit(EXIT_SUCCESS);
+  }
+  close(fd);
+}
+
+// Returns the FNV-1a hash of the contents of the file, or false if it
+// cannot be read.
+static bool HashFile(const char *path, unsigned long long *hash) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  *hash = 14695981039346656037ULL;
+  char buffer[65536];
+  ssize_t length;
+  while ((length = read(fd, buffer, sizeof(buffer))) != 0) {
+    if (length < 0) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return false;
+    }
+    for (ssize_t i = 0; i < length; ++i) {
+      *hash ^= static_cast<unsigned char>(buffer[i]);
+      *hash *= 1099511628211ULL;
+    }
+  }
+  close(fd);
+  return true;
+}
+
+void MaoBatch::StartLookup(int fd) {
+  int result_fds[2];
+  if (pipe(result_fds) != 0) {
+    HandleConnection(fd);
+    return;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  MAO_RASSERT_MSG(pid >= 0, "Unable to fork: %s", strerror(errno));
+  if (pid == 0) {
+    close(result_fds[0]);
+    CloseServerSockets(fd);
+    // The result is the fields of the request, the absolute path of the
+    // input and its hash, each followed by a NUL. It is empty if the
+    // request is malformed, which is reported to the client here.
+    Request request;
+    if (!ReadRequest(fd, &request)) {
+      ReplyMalformed(fd);
+      Reply(fd, EXIT_FAILURE);
+      _exit(EXIT_SUCCESS);
+    }
+    std::string input = request.input;
+    if (input[0] != '/')
+      input = request.directory + "/" + input;
+    char path[PATH_MAX];
+    unsigned long long hash = 0;
+    if (realpath(input.c_str(), path) == NULL || !HashFile(path, &hash))
+      path[0] = '\0';
+    char hash_text[32];
+    snprintf(hash_text, sizeof(hash_text), "%llx", hash);
+    std::string result = request.directory + '\0' + request.input + '\0' +
+        request.output + '\0' + request.options + '\0' + path + '\0' +
+        hash_text + '\0';
+    const char *data = result.data();
+    size_t size = result.size();
+    while (size > 0) {
+      ssize_t written = write(result_fds[1], data, size);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        break;
+      data += written;
+      size -= written;
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  close(result_fds[1]);
+  Lookup lookup;
+  lookup.fd = fd;
+  lookup.result_fd = result_fds[0];
+  lookups_.push_back(lookup);
+}
+
+void MaoBatch::FinishLookup(const Lookup &lookup) {
+  // The child writes the whole result before it exits, so this only
+  // waits for the rest of a result that is already being written.
+  std::string result;
+  char buffer[4096];
+  ssize_t length;
+  while ((length = read(lookup.result_fd, buffer, sizeof(buffer))) != 0) {
+    if (length < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    result.append(buffer, length);
+  }
+  close(lookup.result_fd);
+
+  std::vector<std::string> fields;
+  size_t start = 0, end;
+  while ((end = result.find('\0', start)) != std::string::npos) {
+    fields.push_back(result.substr(start, end - start));
+    start = end + 1;
+  }
+  if (fields.size() != 6) {
+    // The child has replied already, or died.
+    close(lookup.fd);
+    return;
+  }
+  Request request;
+  request.directory = fields[0];
+  request.input = fields[1];
+  request.output = fields[2];
+  request.options = fields[3];
+  if (!fields[4].empty()) {
+    Zygote *zygote = GetZygote(lookup.fd, request, fields[4],
+                               strtoull(fields[5].c_str(), NULL, 16));
+    if (zygote != NULL && SendToZygote(zygote, lookup.fd, request))
+      return;
+  }
+  HandleRequest(lookup.fd, request);
+}
+
+MaoBatch::Zygote *MaoBatch::GetZygote(int fd, const Request &request,
+                                      const std::string &path,
+                                      unsigned long long hash) {
+  ++clock_;
+  std::list<Zygote>::iterator least_recent = zygotes_.end();
+  for (std::list<Zygote>::iterator iter = zygotes_.begin();
+       iter != zygotes_.end(); ++iter) {
+    if (iter->path == path) {
+      if (iter->hash == hash) {
+        iter->last_used = clock_;
+        return &*iter;
+      }
+      // The input has changed since it was read.
+      StopZygote(iter, false);
+      break;
+    }
+    // Zygotes that still have to take requests over are not evicted.
+    if (iter->pending.empty() &&
+        (least_recent == zygotes_.end() ||
+         iter->last_used < least_recent->last_used))
+      least_recent = iter;
+  }
+  if (static_cast<int>(zygotes_.size()) >= options_->ir_cache_size() &&
+      least_recent != zygotes_.end())
+    StopZygote(least_recent, false);
+
+  int control_fds[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, control_fds) != 0)
+    return NULL;
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  MAO_RASSERT_MSG(pid >= 0, "Unable to fork: %s", strerror(errno));
+  if (pid == 0) {
+    close(control_fds[0]);
+    close(fd);
+    CloseServerSockets(-1);
+    RunZygote(control_fds[1], path, request.directory);
+  }
+  close(control_fds[1]);
+
+  Zygote zygote;
+  zygote.path = path;
+  zygote.hash = hash;
+  zygote.pid = pid;
+  zygote.control_fd = control_fds[0];
+  zygote.last_used = clock_;
+  zygotes_.push_back(zygote);
+  if (options_->verbose())
+    fprintf(stderr, "mao: reading %s in process %d\n", path.c_str(), pid);
+  return &zygotes_.back();
+}
+
+bool MaoBatch::SendToZygote(Zygote *zygote, int fd, const Request &request) {
+  std::string payload = request.directory + '\0' + request.output + '\0' +
+      request.options + '\0';
+  struct iovec data;
+  data.iov_base = const_cast<char *>(payload.data());
+  data.iov_len = payload.size();
+
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+  // Do not wait for a zygote that has fallen behind.
+  if (sendmsg(zygote->control_fd, &message, MSG_DONTWAIT) !=
+      static_cast<ssize_t>(payload.size()))
+    return false;
+  // Keep the connection until the zygote has taken it over, to be able
+  // to run the request uncached if the zygote dies.
+  zygote->pending.push_back(std::make_pair(fd, request));
+  return true;
+}
+
+bool MaoBatch::ReadAcknowledgements(Zygote *zygote) {
+  char acks[64];
+  ssize_t count = read(zygote->control_fd, acks, sizeof(acks));
+  if (count < 0 && errno == EINTR)
+    return true;
+  if (count <= 0)
+    return false;
+  for (ssize_t i = 0; i < count && !zygote->pending.empty(); ++i) {
+    close(zygote->pending.front().first);
+    zygote->pending.pop_front();
+  }
+  return true;
+}
+
+void MaoBatch::StopZygote(std::list<Zygote>::iterator zygote, bool died) {
+  // A live zygote runs the requests already sent before it sees the end
+  // of the control socket and exits.
+  close(zygote->control_fd);
+  for (PendingRequests::const_iterator iter = zygote->pending.begin();
+       iter != zygote->pending.end(); ++iter) {
+    if (died)
+      HandleRequest(iter->first, iter->second);
+    else
+      close(iter->first);
+  }
+  zygotes_.erase(zygote);
+}
+
+void MaoBatch::CloseServerSockets(int keep_fd) {
+  // Otherwise a zygote would not see the end of its control socket while
+  // another child of the server is running.
+  if (listen_fd_ != -1)
+    close(listen_fd_);
+  for (std::list<Zygote>::const_iterator iter = zygotes_.begin();
+       iter != zygotes_.end(); ++iter) {
+    close(iter->control_fd);
+    for (PendingRequests::const_iterator pending = iter->pending.begin();
+         pending != iter->pending.end(); ++pending) {
+      if (pending->first != keep_fd)
+        close(pending->first);
+    }
+  }
+  for (std::list<Lookup>::const_iterator iter = lookups_.begin();
+       iter != lookups_.end(); ++iter) {
+    close(iter->result_fd);
+    if (iter->fd != keep_fd)
+      close(iter->fd);
+  }
+}
+
+void MaoBatch::RunZygote(int control_fd, const std::string &input,
+                         const std::string &directory) {
+  // Keep what reading the input prints, to replay it to every client.
+  FILE *log = tmpfile();
+  MAO_RASSERT_MSG(log, "Unable to create a temporary file: %s",
+                  strerror(errno));
+  dup2(fileno(log), STDOUT_FILENO);
+  dup2(fileno(log), STDERR_FILENO);
+  if (!directory.empty() && chdir(directory.c_str()) != 0)
+    _exit(EXIT_FAILURE);
+
+  std::vector<const char *> argv(argv_, argv_ + argc_);
+  argv.push_back(input.c_str());
+  MaoUnit *unit = parser_(options_, argv.size(), &argv[0]);
+
+  fflush(stdout);
+  fflush(stderr);
+  std::string parse_output;
+  rewind(log);
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), log)) > 0)
+    parse_output.append(buffer, length);
+  fclose(log);
+  int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+  dup2(null_fd, STDERR_FILENO);
+  close(null_fd);
+
+  // The handlers of the requests are not waited for.
+  signal(SIGCHLD, SIG_IGN);
+  for (;;) {
+    // The directory, the output and the options.
+    char payload[3 * kMaxLineLength];
+    struct iovec data;
+    data.iov_base = payload;
+    data.iov_len = sizeof(payload) - 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(control_fd, &message, 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      _exit(EXIT_SUCCESS);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    MAO_RASSERT(header != NULL && header->cmsg_type == SCM_RIGHTS);
+    int fd;
+    memcpy(&fd, CMSG_DATA(header), sizeof(int));
+    payload[received] = '\0';
+
+    Request request;
+    request.directory = payload;
+    request.input = input;
+    request.output = payload + request.directory.size() + 1;
+    request.options = payload + request.directory.size() +
+        request.output.size() + 2;
+
+    pid_t pid = fork();
+    MAO_RASSERT_MSG(pid >= 0, "Unable to fork: %s", strerror(errno));
+    if (pid == 0) {
+      signal(SIGCHLD, SIG_DFL);
+      close(control_fd);
+      write(fd, parse_output.data(), parse_output.size());
+      Reply(fd, RunUnit(request, unit, fd));
+      _exit(EXIT_SUCCESS);
+    }
+    close(fd);
+    char ack = 0;
+    write(control_fd, &ack, 1);
+  }
+}
+
+int MaoBatch::Serve(const char *socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  MAO_RASSERT_MSG(strlen(socket_path) < sizeof(address.sun_path),
+                  "Socket path too long: %s", socket_path);
+  strcpy(address.sun_path, socket_path);
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  MAO_RASSERT_MSG(listen_fd_ >= 0, "Unable to create socket: %s",
+                  strerror(errno));
+  // Remove the socket of an earlier server.
+  unlink(socket_path);
+  MAO_RASSERT_MSG(bind(listen_fd_,
+                       reinterpret_cast<struct sockaddr *>(&address),
+                       sizeof(address)) == 0,
+                  "Unable to bind to %s: %s", socket_path, strerror(errno));
+  MAO_RASSERT_MSG(listen(listen_fd_, SOMAXCONN) == 0,
+                  "Unable to listen on %s: %s", socket_path, strerror(errno));
+
+  // A client that goes away must not kill the unit writing to it.
+  signal(SIGPIPE, SIG_IGN);
+  if (options_->verbose())
+    fprintf(stderr, "mao: serving on %s\n", socket_path);
+
+  for (;;) {
+    // Wait for a connection, for a zygote to take requests over, or for
+    // the result of a lookup.
+    std::vector<struct pollfd> poll_fds(1);
+    poll_fds[0].fd = listen_fd_;
+    poll_fds[0].events = POLLIN;
+    for (std::list<Zygote>::const_iterator iter = zygotes_.begin();
+         iter != zygotes_.end(); ++iter) {
+      struct pollfd poll_fd;
+      poll_fd.fd = iter->control_fd;
+      poll_fd.events = POLLIN;
+      poll_fds.push_back(poll_fd);
+    }
+    for (std::list<Lookup>::const_iterator iter = lookups_.begin();
+         iter != lookups_.end(); ++iter) {
+      struct pollfd poll_fd;
+      poll_fd.fd = iter->result_fd;
+      poll_fd.events = POLLIN;
+      poll_fds.push_back(poll_fd);
+    }
+    if (poll(&poll_fds[0], poll_fds.size(), -1) < 0) {
+      MAO_RASSERT_MSG(errno == EINTR, "Unable to poll: %s", strerror(errno));
+      continue;
+    }
+
+    // Reap the handlers of finished requests, and zygotes that exited.
+    while (waitpid(-1, NULL, WNOHANG) > 0) { }
+
+    size_t index = 1;
+    for (std::list<Zygote>::iterator iter = zygotes_.begin();
+         iter != zygotes_.end(); ++index) {
+      std::list<Zygote>::iterator zygote = iter++;
+      if (poll_fds[index].revents != 0 && !ReadAcknowledgements(&*zygote)) {
+        if (options_->verbose())
+          fprintf(stderr, "mao: process %d for %s exited\n", zygote->pid,
+                  zygote->path.c_str());
+        StopZygote(zygote, true);
+      }
+    }
+
+    // The other lookups stay in lookups_ while one is finished, so that
+    // the processes it starts close their connections.
+    for (std::list<Lookup>::iterator iter = lookups_.begin();
+         iter != lookups_.end(); ++index) {
+      std::list<Lookup>::iterator lookup = iter++;
+      if (poll_fds[index].revents != 0) {
+        Lookup ready = *lookup;
+        lookups_.erase(lookup);
+        FinishLookup(ready);
+      }
+    }
+
+    if (!(poll_fds[0].revents & POLLIN))
+      continue;
+    int fd = accept(listen_fd_, NULL, NULL);
+    if (fd < 0) {
+      MAO_RASSERT_MSG(errno == EINTR || errno == ECONNABORTED,
+                      "Unable to accept on %s: %s", socket_path,
+                      strerror(errno));
+      continue;
+    }
+    // The request is read in a child process, so that a slow client does
+    // not hold up the others.
+    if (options_->ir_cache_size() > 0)
+      StartLookup(fd);
+    else
+      HandleConnection(fd);
+  }
+  return EXIT_FAILURE;
+}
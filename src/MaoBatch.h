@@ -0,0 +1,190 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Running many units in one mao process.
+// Classes:
+//   MaoBatch - Runs a list of units, or serves units over a Unix socket.
+//
+// Starting mao registers the passes, parses the options, loads the
+// plugins and reads the register tables. MaoBatch does this once, and
+// then runs every unit in a child process forked from the initialized
+// process. gas and the MAO IR keep their state in globals; each child
+// starts from a clean copy of that state and its changes vanish when it
+// exits, so units cannot see each other, and a unit that fails does not
+// take the others down.
+//
+// Batch mode:
+//   mao --mao=--batch=units.txt:PASSES [assembler-options]
+//   units.txt holds one "input output" pair per line. Empty lines and
+//   lines starting with '#' are skipped. mao exits with 1 if any unit
+//   failed.
+//
+// Server mode:
+//   mao --mao=--server=/tmp/mao.sock:PASSES [assembler-options]
+//   Each connection runs one unit. The client sends four lines: its
+//   working directory, the input file, the output file, and mao options
+//   for this unit only, in the format of --mao=, or an empty line. The
+//   options are parsed after those of the server, so a client can add
+//   passes or change their options. The server sends back what the unit
+//   printed, followed by a last line "mao-status: N" with the exit status
+//   of the unit, and closes the connection. Units run in parallel. The
+//   server runs until it is killed. scripts/mao_client.py is a client.
+//
+// In both modes the ASM pass is added to the passes of each unit, writing
+// to the output file, so PASSES should not contain ASM. The assembler
+// options are passed to every unit and should not name input files.
+//
+// IR cache:
+//   mao --mao=--server=/tmp/mao.sock:--ir-cache=N:PASSES
+//   The server keeps up to N inputs parsed. The first request for an
+//   input forks a process that reads it, a "zygote", which then forks a
+//   child for every request with the same input, so the children start
+//   with the IR and the gas state already built and skip the parse. What
+//   the parse printed is replayed to every client. Inputs are matched by
+//   absolute path and a hash of their contents; a zygote for an input
+//   that has changed is stopped, and so is the least recently used one
+//   when N are running. If a zygote fails to read its input, its requests
+//   run uncached, which reports the error to the client. Each request
+//   still gets its own mao options, parsed in the child, so requests that
+//   try different passes on the same input share the zygote. Options that
+//   change how the input is read have no effect on a cached input.
+//   Requests are read, and their input hashed, by a child process of the
+//   server, so that a large input does not hold up other clients.
+//   The parsed inputs live only as long as the server; they are not
+//   written to disk. The IR points into the state of gas, and the passes
+//   and the relaxer call back into gas, so a file would have to hold all
+//   of that state. `make test-server` runs scripts/test_mao_server.py,
+//   which checks the zygotes, the handover and the fallback to uncached
+//   runs, and times the requests.
+//
+#ifndef MAOBATCH_H_
+#define MAOBATCH_H_
+
+#include <sys/types.h>
+
+#include <deque>
+#include <list>
+#include <string>
+#include <utility>
+
+#include "MaoOptions.h"
+
+class MaoUnit;
+
+class MaoBatch {
+ public:
+  // Reads one unit, given the gas command line.
+  typedef MaoUnit *(*UnitParser)(MaoOptions *options,
+                                 int argc, const char **argv);
+  // Runs the passes on a unit returned by the parser. Returns the exit
+  // status of mao.
+  typedef int (*UnitOptimizer)(MaoOptions *options, MaoUnit *unit);
+
+  // argv holds argv[0] and the assembler options shared by all units.
+  MaoBatch(MaoOptions *options, UnitParser parser, UnitOptimizer optimizer,
+           int argc, const char **argv);
+
+  // Runs the units listed in file_name. Returns the exit status of mao.
+  int RunList(const char *file_name);
+  // Serves units on the Unix socket socket_path. Does not return unless
+  // setting up the socket fails.
+  int Serve(const char *socket_path);
+
+ private:
+  struct Request {
+    std::string directory;
+    std::string input;
+    std::string output;
+    // The mao options of the request, see Server mode above.
+    std::string options;
+  };
+  typedef std::deque<std::pair<int, Request> > PendingRequests;
+
+  // A connection whose request is being read, and its input hashed, by a
+  // child process, which writes the result to result_fd.
+  struct Lookup {
+    int fd;
+    int result_fd;
+  };
+
+  // A process that has read one input and runs the requests for it.
+  struct Zygote {
+    // The absolute path of the input, and the hash of its contents.
+    std::string        path;
+    unsigned long long hash;
+    pid_t              pid;
+    // The server end of a socket pair. Requests are sent with the
+    // connection attached, and the zygote answers each with one byte once
+    // it has taken the connection over.
+    int                control_fd;
+    // Connections sent but not yet taken over, in the order sent.
+    PendingRequests    pending;
+    unsigned long long last_used;
+  };
+
+  // Runs a unit in a child process and returns its exit status. The child
+  // runs in request.directory, unless it is empty. If unit is not NULL,
+  // the child runs the passes on it instead of reading request.input. If
+  // out_fd is not -1, the output of the unit goes to out_fd.
+  int RunUnit(const Request &request, MaoUnit *unit, int out_fd);
+  // Reads a request from the connection fd.
+  bool ReadRequest(int fd, Request *request);
+  // Sends the last line of the reply and closes fd.
+  void Reply(int fd, int status);
+  // Reads the request of the connection fd and runs it without the IR
+  // cache, in a new process.
+  void HandleConnection(int fd);
+  // Runs request without the IR cache, in a new process, and replies.
+  void HandleRequest(int fd, const Request &request);
+
+  // Starts a child process that reads the request of the connection fd
+  // and hashes its input, and adds it to lookups_.
+  void StartLookup(int fd);
+  // Takes the result of a lookup and hands the request to a zygote, or
+  // runs it uncached.
+  void FinishLookup(const Lookup &lookup);
+
+  // Returns the zygote for the input at path, with the given hash,
+  // starting one if needed. fd is the connection of request.
+  Zygote *GetZygote(int fd, const Request &request, const std::string &path,
+                    unsigned long long hash);
+  // Hands the connection fd over to zygote. Returns false if it is gone.
+  bool SendToZygote(Zygote *zygote, int fd, const Request &request);
+  // Processes the answers of a zygote. Returns false if it has exited.
+  bool ReadAcknowledgements(Zygote *zygote);
+  // Stops sending requests to a zygote, which exits once it has run the
+  // ones already sent. If it died, its pending requests run uncached.
+  void StopZygote(std::list<Zygote>::iterator zygote, bool died);
+  // Closes the server's sockets in a child process, except keep_fd.
+  void CloseServerSockets(int keep_fd);
+  // The main loop of a zygote. Does not return.
+  void RunZygote(int control_fd, const std::string &input,
+                 const std::string &directory);
+
+  MaoOptions   *options_;
+  UnitParser    parser_;
+  UnitOptimizer optimizer_;
+  int           argc_;
+  const char  **argv_;
+  int           listen_fd_;
+  std::list<Zygote> zygotes_;
+  std::list<Lookup> lookups_;
+  // Counts requests, to find the least recently used zygote.
+  unsigned long long clock_;
+};
+
+#endif  // MAOBATCH_H_
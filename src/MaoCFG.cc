@@ -18,7 +18,9 @@
 
 
 #include <stdio.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "Mao.h"
 
@@ -56,6 +58,17 @@ void BasicBlock::AddEntry(MaoEntry *entry) {
   last_entry_ = entry;
 }
 
+bool BasicBlock::RemoveInEdge(BasicBlockEdge *edge) {
+  for (EdgeIterator iter = in_edges_.begin(); iter != in_edges_.end();
+       ++iter) {
+    if (*iter == edge) {
+      in_edges_.erase(iter);
+      return true;
+    }
+  }
+  return false;
+}
+
 bool BasicBlock::DirectlyPreceeds(const BasicBlock *basicblock) const {
   // Make sure that if they are linked, both point correctly!
   MAO_ASSERT(basicblock->last_entry()->next() == NULL ||
@@ -75,12 +88,16 @@ bool BasicBlock::DirectlyFollows(const BasicBlock *basicblock) const {
 }
 
 CFG *CFG::GetCFG(MaoUnit *mao, Function *function, bool conservative) {
+  MaoMutexLock lock(function->cache_mutex());
   // If a CFG is associated with the function, and it was build with the
   // same flags, we can reuse it. Otherwise rebuild it.
   if (function->cfg() == NULL ||
       function->cfg()->conservative() != conservative) {
-    // Build it!
-    CFG *cfg = new CFG(mao);
+    // Build it! Dropping the previous CFG first lets the new one reuse
+    // the memory of its blocks and edges.
+    MaoTimerScope timer("CFG", function);
+    function->set_cfg(NULL);
+    CFG *cfg = new CFG(mao, function->cfg_arena());
     CreateCFG(mao, function, cfg, conservative);
     function->set_cfg(cfg);
   }
@@ -89,15 +106,167 @@ CFG *CFG::GetCFG(MaoUnit *mao, Function *function, bool conservative) {
 }
 
 CFG *CFG::GetCFGIfExists(const MaoUnit *mao, Function *function) {
+  MaoMutexLock lock(function->cache_mutex());
   return function->cfg();
 }
 
 void CFG::InvalidateCFG(Function *function) {
+  MaoMutexLock lock(function->cache_mutex());
   // Memory is deallocated in the set_cfg routine.
   function->set_cfg(NULL);
 }
 
 
+void CFG::InsertBefore(BasicBlock *bb, MaoEntry *position, MaoEntry *entry) {
+  MAO_ASSERT(entry->IsInstruction() && !CFGBuilder::EndsBasicBlock(entry));
+  MAO_ASSERT_MSG(position != bb->first_entry() ||
+                 position->Type() != MaoEntry::LABEL,
+                 "Cannot insert before the label starting a basic block");
+  position->LinkBefore(entry);
+  if (position == bb->first_entry())
+    bb->set_first_entry(entry);
+}
+
+void CFG::InsertAfter(BasicBlock *bb, MaoEntry *position, MaoEntry *entry) {
+  MAO_ASSERT(entry->IsInstruction() && !CFGBuilder::EndsBasicBlock(entry));
+  MAO_ASSERT_MSG(position != bb->last_entry() ||
+                 !CFGBuilder::EndsBasicBlock(position),
+                 "Cannot insert after the jump ending a basic block");
+  position->LinkAfter(entry);
+  if (position == bb->last_entry())
+    bb->set_last_entry(entry);
+}
+
+void CFG::DeleteInstruction(BasicBlock *bb, MaoEntry *entry) {
+  MAO_ASSERT(entry->IsInstruction() && !CFGBuilder::EndsBasicBlock(entry));
+  MAO_ASSERT_MSG(bb->first_entry() != bb->last_entry(),
+                 "Cannot delete the only entry of a basic block");
+  if (entry == bb->first_entry())
+    bb->set_first_entry(entry->next());
+  if (entry == bb->last_entry())
+    bb->set_last_entry(entry->prev());
+  mao_unit_->DeleteEntry(entry);
+}
+
+// Drops the analyses built on the CFG of function that the incremental
+// updates do not keep.
+static void DropStructuralAnalyses(Function *function) {
+  MaoAnalysisSet preserved = MaoAnalysisSet::All();
+  preserved.Remove(ANALYSIS_LSG);
+  preserved.Remove(ANALYSIS_DOMINATORS);
+  preserved.Remove(ANALYSIS_POST_DOMINATORS);
+  MaoAnalyses::Invalidate(function, preserved);
+}
+
+BasicBlock *CFG::SplitBasicBlock(BasicBlock *bb, MaoEntry *entry) {
+  MAO_ASSERT(entry != bb->first_entry());
+  Function *function = entry->function();
+  LabelEntry *label;
+  if (entry->Type() == MaoEntry::LABEL) {
+    label = static_cast<LabelEntry *>(entry);
+  } else {
+    label = mao_unit_->CreateLabel(MaoUnit::BBNameGen::GetUniqueName(),
+                                   function, entry->subsection());
+    label->set_from_assembly(false);
+    entry->LinkBefore(label);
+  }
+  BasicBlock *new_bb = SplitBasicBlockAtLabel(bb, label);
+  DropStructuralAnalyses(function);
+  return new_bb;
+}
+
+BasicBlock *CFG::SplitBasicBlockAtLabel(BasicBlock *bb, LabelEntry *label) {
+  MAO_ASSERT(label != bb->first_entry());
+  BasicBlock *new_bb = CreateBasicBlock(label->name());
+  MapBasicBlock(new_bb);
+
+  // Remap the pointers
+  new_bb->set_first_entry(label);
+  new_bb->set_last_entry(bb->last_entry());
+  bb->set_last_entry(label->prev());
+
+  // Move all the out edges
+  for (BasicBlock::EdgeIterator edge_iter = bb->BeginOutEdges();
+       edge_iter != bb->EndOutEdges();
+       edge_iter = bb->EraseOutEdge(edge_iter)) {
+    BasicBlockEdge *edge = *edge_iter;
+    edge->set_source(new_bb);
+    new_bb->AddOutEdge(edge);
+  }
+
+  // Link the two basic blocks with a fall through edge
+  Link(bb, new_bb, true);
+
+  return new_bb;
+}
+
+void CFG::RetargetBranch(BasicBlock *bb, BasicBlock *old_target,
+                         BasicBlock *new_target) {
+  InstructionEntry *branch = bb->GetLastInstruction();
+  MAO_ASSERT(branch && branch == bb->last_entry());
+  MAO_ASSERT(branch->HasTarget() && !branch->IsIndirectJump());
+  // Labels created by MAO, e.g., by SplitBasicBlock, are not in the label
+  // map of the unit.
+  MaoEntry *first = new_target->first_entry();
+  MAO_ASSERT_MSG(first && first->Type() == MaoEntry::LABEL,
+                 "Basic block %d does not start with a label",
+                 new_target->id());
+  mao_unit_->SetBranchTarget(branch, static_cast<LabelEntry *>(first));
+  DropStructuralAnalyses(branch->function());
+
+  for (BasicBlock::EdgeIterator edge_iter = bb->BeginOutEdges();
+       edge_iter != bb->EndOutEdges(); ++edge_iter) {
+    BasicBlockEdge *edge = *edge_iter;
+    if (!edge->fall_through() && edge->dest() == old_target) {
+      MAO_RASSERT(old_target->RemoveInEdge(edge));
+      edge->set_dest(new_target);
+      new_target->AddInEdge(edge);
+      return;
+    }
+  }
+  MAO_ASSERT_MSG(false, "No edge from basic block %d to %d", bb->id(),
+                 old_target->id());
+}
+
+// Returns a name for bb that does not depend on how the CFG was built:
+// the ids of its first and last entries, or its label if it has none.
+static std::string BasicBlockKey(const BasicBlock *bb) {
+  if (bb->first_entry() == NULL)
+    return bb->label();
+  char key[32];
+  snprintf(key, sizeof(key), "%d-%d", bb->first_entry()->id(),
+           bb->last_entry()->id());
+  return key;
+}
+
+// Returns the basic blocks and edges of cfg, one string each, sorted.
+static std::vector<std::string> DescribeCFG(const CFG *cfg) {
+  std::vector<std::string> description;
+  FORALL_CFG_BB(cfg, it) {
+    std::string bb = BasicBlockKey(*it);
+    description.push_back(bb);
+    for (BasicBlock::ConstEdgeIterator edge = (*it)->BeginOutEdges();
+         edge != (*it)->EndOutEdges(); ++edge) {
+      description.push_back(bb + " -> " + BasicBlockKey((*edge)->dest()) +
+                            ((*edge)->fall_through() ? " (fall through)" : ""));
+    }
+    for (BasicBlock::ConstEdgeIterator edge = (*it)->BeginInEdges();
+         edge != (*it)->EndInEdges(); ++edge) {
+      description.push_back(bb + " <- " + BasicBlockKey((*edge)->source()) +
+                            ((*edge)->fall_through() ? " (fall through)" : ""));
+    }
+  }
+  std::sort(description.begin(), description.end());
+  return description;
+}
+
+bool CFG::MatchesRebuiltCFG(Function *function) const {
+  MaoArena arena;
+  CFG rebuilt(mao_unit_, &arena);
+  CreateCFG(mao_unit_, function, &rebuilt, conservative());
+  return DescribeCFG(this) == DescribeCFG(&rebuilt);
+}
+
 void CFG::Print(FILE *out) const {
   // TODO(nvachhar): Emit a text representation of the CFG
 }
@@ -170,7 +339,7 @@ MAO_DEFINE_OPTIONS(CFG, "Builds the control flow graph", 4) {
 CFGBuilder::CFGBuilder(MaoUnit *mao_unit, Function *function, CFG *CFG,
                        bool conservative)
     : MaoFunctionPass("CFG", GetStaticOptionPass("CFG"), mao_unit, function),
-      CFG_(CFG), next_id_(0), cfg_stat_(NULL) {
+      CFG_(CFG), cfg_stat_(NULL) {
   MAO_ASSERT(CFG_ != NULL);
   split_basic_blocks_ = GetOptionBool("callsplit");
   respect_orig_labels_= GetOptionBool("respect_orig_labels");
@@ -179,6 +348,7 @@ CFGBuilder::CFGBuilder(MaoUnit *mao_unit, Function *function, CFG *CFG,
     respect_orig_labels_ = true;
   if (GetOptionBool("collect_stats")) {
     // check if a stat object already exists?
+    MaoMutexLock lock(unit_->GetStats()->mutex());
     if (unit_->GetStats()->HasStat("CFG")) {
       cfg_stat_ = static_cast<CFGStat *>(unit_->GetStats()->GetStat("CFG"));
     } else {
@@ -291,9 +461,8 @@ bool CFGBuilder::Go() {
         } else {
           target = CFG_->FindBasicBlock(label);
           if (target == NULL) {
-            CFG::LabelToBBMap::iterator target_ptr =
-                label_to_bb_map_.find(label);
-            if (target_ptr == label_to_bb_map_.end()) {
+            BasicBlock **target_ptr = label_to_bb_map_.Find(label);
+            if (target_ptr == NULL) {
               // Create a new basic block for the label found as a jump target.
               // Here we can check if this label is defined in this basic block
               // Check if the label_entry exists in MAO UNIT
@@ -309,7 +478,7 @@ bool CFGBuilder::Go() {
               target = CreateBasicBlock(label);
               CFG_->MapBasicBlock(target);
             } else {
-              target = target_ptr->second;
+              target = *target_ptr;
               if (strcmp(label, target->label())) {
                 bool current_is_target = (target == current);
                 target = BreakUpBBAtLabel(target,
@@ -403,27 +572,7 @@ bool CFGBuilder::EndsBasicBlock(MaoEntry *entry) {
 }
 
 BasicBlock *CFGBuilder::BreakUpBBAtLabel(BasicBlock *bb, LabelEntry *label) {
-  BasicBlock *new_bb = CreateBasicBlock(label->name());
-  CFG_->MapBasicBlock(new_bb);
-
-  // Remap the pointers
-  new_bb->set_first_entry(label);
-  new_bb->set_last_entry(bb->last_entry());
-  bb->set_last_entry(label->prev());
-
-  // Move all the out edges
-  for (BasicBlock::EdgeIterator edge_iter = bb->BeginOutEdges();
-       edge_iter != bb->EndOutEdges();
-       edge_iter = bb->EraseOutEdge(edge_iter)) {
-    BasicBlockEdge *edge = *edge_iter;
-    edge->set_source(new_bb);
-    new_bb->AddOutEdge(edge);
-  }
-
-  // Link the two basic blocks with a fall through edge
-  Link(bb, new_bb, true);
-
-  return new_bb;
+  return CFG_->SplitBasicBlockAtLabel(bb, label);
 }
 
 // Given a label at the start of a jump-table, return the targets found
@@ -662,7 +811,7 @@ bool CFGBuilder::IsTablePattern4(InstructionEntry *entry,
   if (entry->IsIndirectJump() && entry->IsRegisterOperand(0)) {
     const reg_entry *r_ri = entry->GetRegisterOperand(0);
     const reg_entry *r_rb = NULL;
-    BitString rmask;
+    RegisterMask rmask;
 
     // get the two instructions
     MaoEntry *prev_iter = entry->prev();
@@ -694,7 +843,8 @@ bool CFGBuilder::IsTablePattern4(InstructionEntry *entry,
       // according to the ABI.
       // The AMD64 ABI convertion used on Linux uses the following registers
       // %rdi, %rsi, %rdx, %rcv, %r8 and %r9 (and also their subregisters)
-      BitString abi_calling_convention_mask = GetCallingConventionDefMask();
+      RegisterMask abi_calling_convention_mask =
+          GetCallingConventionDefMask();
       rmask = GetMaskForRegister(r_rb);
       if (!(abi_calling_convention_mask & rmask).IsNull()) {
         Trace(3, "Found a conflict between input paramter register and r_rb");
@@ -722,7 +872,7 @@ bool CFGBuilder::IsTablePattern4(InstructionEntry *entry,
         // Check if instruction is defining register r_b
         if (e_iter->IsInstruction()) {
           InstructionEntry *i_entry = e_iter->AsInstruction();
-          BitString imask = GetRegisterDefMask(i_entry);
+          RegisterMask imask = GetRegisterDefMask(i_entry);
           if (imask.IsUndef()) {
             return false;
           }
@@ -984,16 +1134,16 @@ void InitCFG() {
 
 
 void CFGBuilder::CFGStat::Print(FILE *out) {
-  if (number_of_direct_jumps_)
-    fprintf(out, "CFG: Direct  jumps:      %7d\n", number_of_direct_jumps_);
-  if (number_of_indirect_jumps_)
-    fprintf(out, "CFG: Indirect jumps:     %7d (%d unresolved)\n",
-            number_of_indirect_jumps_, number_of_unresolved_jumps_);
-  if (number_of_jump_table_patterns_)
-    fprintf(out, "CFG: Jump table patterns:%7d\n",
-            number_of_jump_table_patterns_);
-  if (number_of_vaarg_patterns_)
-    fprintf(out, "CFG: VA_ARG patterns    :%7d\n", number_of_vaarg_patterns_);
-  if (number_of_tail_calls_)
-    fprintf(out, "CFG: Tail calls         :%7d\n", number_of_tail_calls_);
+  if (direct_jumps_->value())
+    fprintf(out, "CFG: Direct  jumps:      %7lld\n", direct_jumps_->value());
+  if (indirect_jumps_->value())
+    fprintf(out, "CFG: Indirect jumps:     %7lld (%lld unresolved)\n",
+            indirect_jumps_->value(), unresolved_jumps_->value());
+  if (jump_table_patterns_->value())
+    fprintf(out, "CFG: Jump table patterns:%7lld\n",
+            jump_table_patterns_->value());
+  if (vaarg_patterns_->value())
+    fprintf(out, "CFG: VA_ARG patterns    :%7lld\n", vaarg_patterns_->value());
+  if (tail_calls_->value())
+    fprintf(out, "CFG: Tail calls         :%7lld\n", tail_calls_->value());
 }
@@ -44,6 +44,19 @@
 //
 //  // Invalidate the CFG
 //  CFG::InvalidateCFG(function_);
+//
+// Passes that only insert or delete instructions that do not end a basic
+// block, split blocks or retarget branches can make these edits through
+// the CFG instead, which keeps it valid, e.g.:
+//  cfg->InsertBefore(bb, insn, unit_->CreateNop(function_));
+//
+// Splitting blocks and retargeting branches change the edges, so the
+// passes doing so must drop the loop structure graph and the dominator
+// trees, see MaoPass::InvalidatesAnalysis(). The TEST pass option
+// verify_cfg checks an updated CFG against a rebuilt one.
+//
+// The basic blocks and edges live in an arena of the function, which is
+// reset, and its memory reused, when the CFG is invalidated.
 
 #ifndef MAOCFG_H_
 #define MAOCFG_H_
@@ -54,10 +67,13 @@
 #include <set>
 #include <vector>
 
+#include "MaoArena.h"
 #include "MaoDebug.h"
+#include "MaoMemory.h"
 #include "MaoPasses.h"
 #include "MaoUtil.h"
 #include "MaoStats.h"
+#include "MaoStrings.h"
 
 class MaoEntry;
 class InstructionEntry;
@@ -73,8 +89,16 @@ class LabelEntry;
 typedef int BasicBlockID;
 
 // A basic block edge is a possible path between two basic blocks.
-class BasicBlockEdge {
+class BasicBlockEdge
+    : public MaoMemoryTracked<BasicBlockEdge, MaoMemory::BASIC_BLOCK_EDGE> {
  public:
+  // Edges are allocated in the arena of the CFG, see BasicBlock.
+  static void *operator new(size_t size, MaoArena *arena) {
+    return arena->Allocate(size);
+  }
+  static void operator delete(void *edge, MaoArena *arena) { }
+  static void operator delete(void *edge) { }
+
   // Creates an edge between source and destination. fall_through
   // means that the edge is not created by an explicit control
   // transfer instruction.
@@ -98,12 +122,22 @@ class BasicBlockEdge {
 
 // A basic block holds a series of entries which have one entry point
 // (the first entry), and one exit point (last entry).
-class BasicBlock {
+class BasicBlock
+    : public MaoMemoryTracked<BasicBlock, MaoMemory::BASIC_BLOCK> {
  public:
   typedef std::vector<BasicBlockEdge *> EdgeList;
   typedef EdgeList::iterator EdgeIterator;
   typedef EdgeList::const_iterator ConstEdgeIterator;
 
+  // Basic blocks are allocated in the arena of their CFG:
+  //   new (arena) BasicBlock(...)
+  // Deleting a basic block only runs its destructor.
+  static void *operator new(size_t size, MaoArena *arena) {
+    return arena->Allocate(size);
+  }
+  static void operator delete(void *bb, MaoArena *arena) { }
+  static void operator delete(void *bb) { }
+
   // Creates a basic block with the name 'label', which should be the
   // first label of the basic block. Id and label must be unique within
   // the CFG.
@@ -157,6 +191,9 @@ class BasicBlock {
     return out_edges_.erase(pos);
   }
 
+  // Removes edge from the in edges. Returns false if it is not one.
+  bool RemoveInEdge(BasicBlockEdge *edge);
+
   // Entry iterators.
   EntryIterator EntryBegin() const;
   EntryIterator EntryEnd() const;
@@ -246,13 +283,15 @@ class BasicBlock {
 // "<SINK>". The source is always the first basic block of the CFG and
 // all exit points lead to the sink.
 //
-class CFG {
+class CFG : public MaoMemoryTracked<CFG, MaoMemory::CFG_GRAPH> {
  public:
   typedef std::vector<BasicBlock *> BBVector;
-  typedef std::map<const char *, BasicBlock *, ltstr> LabelToBBMap;
-  explicit CFG(MaoUnit *mao_unit) : mao_unit_(mao_unit),
-                                    num_external_jumps_(0),
-                                    num_unresolved_indirect_jumps_(0) {
+  typedef StringHashMap<BasicBlock *> LabelToBBMap;
+  // The basic blocks and edges are allocated in arena.
+  CFG(MaoUnit *mao_unit, MaoArena *arena) : mao_unit_(mao_unit),
+                                            arena_(arena),
+                                            num_external_jumps_(0),
+                                            num_unresolved_indirect_jumps_(0) {
     labels_to_jumptargets_.clear();
   }
   ~CFG() {
@@ -285,25 +324,66 @@ class CFG {
   void Print() const { Print(stdout); }
   void Print(FILE *out) const;
 
-  // Adds a basic block to the CFG.
-  void AddBasicBlock(BasicBlock *bb) { basic_blocks_.push_back(bb); }
+  // Creates a basic block with the next id and adds it to the CFG.
+  BasicBlock *CreateBasicBlock(const char *label) {
+    BasicBlock *bb = new (arena_) BasicBlock(basic_blocks_.size(), label);
+    basic_blocks_.push_back(bb);
+    return bb;
+  }
+  // Creates an edge from source to dest.
+  BasicBlockEdge *Link(BasicBlock *source, BasicBlock *dest,
+                       bool fall_through) {
+    BasicBlockEdge *edge =
+        new (arena_) BasicBlockEdge(source, dest, fall_through);
+    source->AddOutEdge(edge);
+    dest->AddInEdge(edge);
+    return edge;
+  }
   // Puts the basic block in the map from label to basic block.
   // TODO(martint): Should be done automatically when creating a basic block.
   void MapBasicBlock(BasicBlock *bb) {
-    MAO_RASSERT(basic_block_map_.insert(std::make_pair(bb->label(),
-                                                       bb)).second);
+    MAO_RASSERT(basic_block_map_.Insert(bb->label(), bb));
   }
 
+  // Incremental updates.
+  //
+  // These edit the IR and keep the CFG valid. The dataflow results are
+  // not updated; passes using these must not declare that they preserve
+  // them. SplitBasicBlock and RetargetBranch drop the loop structure
+  // graph and the dominator trees of the function, which are rebuilt when
+  // they are asked for again.
+  //
+  // Links entry, an instruction that does not end a basic block, before
+  // or after position in bb. Position must not be the label starting bb
+  // (for InsertBefore), or a jump ending it (for InsertAfter).
+  void InsertBefore(BasicBlock *bb, MaoEntry *position, MaoEntry *entry);
+  void InsertAfter(BasicBlock *bb, MaoEntry *position, MaoEntry *entry);
+  // Deletes entry, an instruction in bb that does not end it. bb must
+  // hold other entries.
+  void DeleteInstruction(BasicBlock *bb, MaoEntry *entry);
+  // Splits bb before entry. The returned block starts with entry if it is
+  // a label, and with a new label linked before entry otherwise, so that
+  // it can be branched to and a rebuilt CFG splits it in the same place.
+  // The out edges of bb move to the new block, which bb falls through to.
+  BasicBlock *SplitBasicBlock(BasicBlock *bb, MaoEntry *entry);
+  // Changes the direct jump ending bb from old_target to new_target,
+  // which must start with a label.
+  void RetargetBranch(BasicBlock *bb, BasicBlock *old_target,
+                      BasicBlock *new_target);
+
+  // Returns true if the CFG has the same basic blocks and edges as one
+  // built from scratch for function. Blocks are matched by their entries,
+  // as the labels of blocks that do not start with one are generated.
+  bool MatchesRebuiltCFG(Function *function) const;
+
   // Returns the basic block of a given id. Assumes that an basic block with
   // the id exists.
   BasicBlock *GetBasicBlock(BasicBlockID id) { return basic_blocks_[id]; }
   // Finds a basic block for a given label, or returns NULL if one has not
   // already exists.
   BasicBlock *FindBasicBlock(const char *label) {
-    LabelToBBMap::iterator bb = basic_block_map_.find(label);
-    if (bb == basic_block_map_.end())
-      return NULL;
-    return bb->second;
+    BasicBlock **bb = basic_block_map_.Find(label);
+    return bb ? *bb : NULL;
   }
 
   // Iterators for the basic blocks.
@@ -383,6 +463,7 @@ class CFG {
 
  private:
   MaoUnit *mao_unit_;
+  MaoArena *arena_;
   LabelToBBMap basic_block_map_;
   BBVector basic_blocks_;
 
@@ -401,6 +482,11 @@ class CFG {
   LabelsToJumpTableTargets labels_to_jumptargets_;
 
   bool conservative_;  // CFG build with conservative flag.
+
+  // Splits bb before label, which starts the returned block, without
+  // dropping any analyses. Used while building the CFG.
+  BasicBlock *SplitBasicBlockAtLabel(BasicBlock *bb, LabelEntry *label);
+  friend class CFGBuilder;
 };
 
 // Convenience Macros for BB iteration
@@ -419,23 +505,18 @@ class CFGBuilder : public MaoFunctionPass {
              bool conservative = false);
   bool Go();
 
+  // Returns true if entry is the last entry of its basic block.
+  static bool EndsBasicBlock(MaoEntry *entry);
+
  private:
   BasicBlock *CreateBasicBlock(const char *label) {
-    BasicBlock *bb = new BasicBlock(next_id_, label);
-    CFG_->AddBasicBlock(bb);
-    next_id_++;
-    return bb;
+    return CFG_->CreateBasicBlock(label);
   }
 
   static bool BelongsInBasicBlock(const MaoEntry *entry);
-  bool EndsBasicBlock(MaoEntry *entry);
 
-  static BasicBlockEdge *Link(BasicBlock *source, BasicBlock *dest,
-                              bool fallthrough) {
-    BasicBlockEdge *edge = new BasicBlockEdge(source, dest, fallthrough);
-    source->AddOutEdge(edge);
-    dest->AddInEdge(edge);
-    return edge;
+  void Link(BasicBlock *source, BasicBlock *dest, bool fallthrough) {
+    CFG_->Link(source, dest, fallthrough);
   }
 
   BasicBlock *BreakUpBBAtLabel(BasicBlock *bb, LabelEntry *label);
@@ -458,7 +539,6 @@ class CFGBuilder : public MaoFunctionPass {
   bool IsTailCall(InstructionEntry *entry) const;
 
   CFG      *CFG_;
-  BasicBlockID  next_id_;
   CFG::LabelToBBMap label_to_bb_map_;
   bool      split_basic_blocks_ : 1;
   bool      respect_orig_labels_ : 1;
@@ -467,29 +547,35 @@ class CFGBuilder : public MaoFunctionPass {
   // Class for holding statistics about a CFG. The state is kept
   // between CFG objects, and the stats is presented at the end of the
   // MAO run. Only used when the stat option is given.
-  class CFGStat : public Stat {
+  class CFGStat : public GroupStat {
    public:
-    CFGStat() : number_of_direct_jumps_(0), number_of_indirect_jumps_(0),
-                number_of_jump_table_patterns_(0), number_of_vaarg_patterns_(0),
-                number_of_tail_calls_(0), number_of_unresolved_jumps_(0)
+    CFGStat() : GroupStat("CFG"),
+                direct_jumps_(Counter("direct_jumps")),
+                indirect_jumps_(Counter("indirect_jumps")),
+                jump_table_patterns_(Counter("jump_table_patterns")),
+                vaarg_patterns_(Counter("vaarg_patterns")),
+                tail_calls_(Counter("tail_calls")),
+                unresolved_jumps_(Counter("unresolved_jumps"))
     {;}
     ~CFGStat() {;}
-    void FoundDirectJump()        { ++number_of_direct_jumps_; }
-    void FoundIndirectJump()      { ++number_of_indirect_jumps_; }
-    void FoundJumpTablePattern()  { ++number_of_jump_table_patterns_; }
-    void FoundVaargPattern()      { ++number_of_vaarg_patterns_; }
-    void FoundTailCall()          { ++number_of_tail_calls_; }
-    void FoundUnresolvedJump()    { ++number_of_unresolved_jumps_; }
+    // The counters are shared by all CFGs, which can be built on several
+    // threads at once.
+    void FoundDirectJump()        { direct_jumps_->Inc(); }
+    void FoundIndirectJump()      { indirect_jumps_->Inc(); }
+    void FoundJumpTablePattern()  { jump_table_patterns_->Inc(); }
+    void FoundVaargPattern()      { vaarg_patterns_->Inc(); }
+    void FoundTailCall()          { tail_calls_->Inc(); }
+    void FoundUnresolvedJump()    { unresolved_jumps_->Inc(); }
 
     virtual void Print(FILE *out);
 
    private:
-    int number_of_direct_jumps_;
-    int number_of_indirect_jumps_;
-    int number_of_jump_table_patterns_;
-    int number_of_vaarg_patterns_;
-    int number_of_tail_calls_;
-    int number_of_unresolved_jumps_;
+    StatCounter *direct_jumps_;
+    StatCounter *indirect_jumps_;
+    StatCounter *jump_table_patterns_;
+    StatCounter *vaarg_patterns_;
+    StatCounter *tail_calls_;
+    StatCounter *unresolved_jumps_;
   };
 
   CFGStat *cfg_stat_;
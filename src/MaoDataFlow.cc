@@ -15,8 +15,9 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
 
-#include <map>
-#include <set>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "Mao.h"
 
@@ -25,12 +26,9 @@ DFProblem::DFProblem(MaoUnit *unit,
                      const CFG  *cfg,
                      enum DFProblemDirection direction)
     : unit_(unit), function_(function), cfg_(cfg), solved_(false),
-      direction_(direction) {}
-
-bool DFProblem::Solve() {
-  // TODO(martint): Updated code to use Trace() if possible.
-  fprintf(stderr, "Inside DFProblem::Solve\n");
+      direction_(direction), num_iterations_(0), num_visits_(0) {}
 
+bool DFProblem::Solve(enum DFSolver solver) {
   // Terminology used inside this function:
   //    In order to create names that work in both forward
   //    and backwards problem the names "entry" and "exit" are used
@@ -40,98 +38,190 @@ bool DFProblem::Solve() {
 
   // Algorithm used to solve the DF problem:
   // for i <- 1 to N
-  //    initialize node i
-  // while (sets are still changing)
-  //   for i <- 1 to N
-  //     recompute sets at node i
+  //    initialize node i and mark it pending
+  // while (nodes are pending)
+  //   for i <- 1 to N in visit order
+  //     if node i is pending, recompute its sets, and mark the nodes
+  //     that depend on its exit set pending if that set changed.
+  //
+  // With DF_RoundRobin every node is pending in every round, which
+  // is the classic iterative algorithm. With DF_Worklist the nodes are
+  // visited in reverse postorder for forward problems and postorder
+  // for backward problems, so that a node is usually visited after the
+  // nodes it depends on. An acyclic CFG is then solved in one round,
+  // and each further round is caused by a back edge.
 
   MAO_ASSERT_MSG(!solved_, "Problem is already solved.");
   MAO_ASSERT(function_);
   MAO_ASSERT(cfg_);
 
-  // TODO(martint): Only one is actually needed if we are low on memory.
-  std::map<const BasicBlock *, BitString> entry_map;
-  std::map<const BasicBlock *, BitString> exit_map;
+  // Do not try to solve a problem that has zero-length bit sets.
+  if (num_bits_ <= 0) {
+    solved_ = true;
+    return solved_;
+  }
 
-  std::map<const BasicBlock *, BitString> gen_map;
-  std::map<const BasicBlock *, BitString> kill_map;
+  // All state is indexed by basic block id, which is dense in the CFG.
+  int num_blocks = cfg_->GetNumOfNodes();
+  StateVector entry_sets(num_blocks, GetInitialEntryState());
+  StateVector exit_sets(num_blocks, BitString(num_bits_));
+  StateVector gen_sets(num_blocks, BitString(num_bits_));
+  StateVector kill_sets(num_blocks, BitString(num_bits_));
 
-  // Do not try to solve a problem that has zero-length bit sets.
-  if (num_bits_ > 0) {
-    bool dirty;
-    int num_iterations = 0;
+  std::vector<const BasicBlock *> order;
+  ComputeOrder(solver, &order);
+  MAO_ASSERT(static_cast<int>(order.size()) == num_blocks);
 
-    // Initialize all to empty sets.
-    FORALL_CFG_BB(cfg_, it) {
-      const BasicBlock *bb = *it;
-      // Generate initial values for our states and gen/kill sets.
-      entry_map[bb] = GetInitialEntryState();
-      gen_map[bb] = CreateGenSet(*bb);
-      kill_map[bb] = CreateKillSet(*bb);
-      exit_map[bb] = Transfer(entry_map[bb],
-                              gen_map[bb],
-                              kill_map[bb]);
-    }
+  // Maps a basic block id to its position in order.
+  std::vector<int> position(num_blocks);
+  for (int i = 0; i < num_blocks; ++i) {
+    position[order[i]->id()] = i;
+  }
+
+  // Generate initial values for our states and gen/kill sets.
+  FORALL_CFG_BB(cfg_, it) {
+    const BasicBlock *bb = *it;
+    BasicBlockID id = bb->id();
+    MAO_ASSERT(id >= 0 && id < num_blocks);
+    gen_sets[id] = CreateGenSet(*bb);
+    kill_sets[id] = CreateKillSet(*bb);
+    exit_sets[id] = Transfer(entry_sets[id], gen_sets[id], kill_sets[id]);
+  }
 
-    // Loop until convergance.
-    do {
-      dirty = false;
-      // TODO(martint): Think about the order you iterate on.
-      FORALL_CFG_BB(cfg_, it) {
-        const BasicBlock *bb = *it;
-        std::set<BitString *> confluence_set;
-        if (direction_ == DF_Backward) {
-          // For backwards problems, confluence_set = successors.
-          for (BasicBlock::ConstEdgeIterator eiter = bb->BeginOutEdges();
-               eiter != bb->EndOutEdges(); ++eiter) {
-            MAO_ASSERT((*eiter)->source() == *it);
-            MAO_ASSERT((*eiter)->dest() != NULL);
-            confluence_set.insert(&exit_map[(*eiter)->dest()]);
-          }
-        } else if (direction_ == DF_Forward) {
-          // For forward problems, confluence_set = predecessors.
-          for (BasicBlock::ConstEdgeIterator eiter = bb->BeginInEdges();
-               eiter != bb->EndInEdges(); ++eiter) {
-            MAO_ASSERT((*eiter)->dest() == *it);
-            MAO_ASSERT((*eiter)->source() != NULL);
-            confluence_set.insert(&exit_map[(*eiter)->source()]);
-          }
+  // Nodes to recompute, by position in order.
+  std::vector<bool> pending(num_blocks, true);
+  int num_pending = num_blocks;
+  BitString entry_new(num_bits_);
+
+  num_iterations_ = 0;
+  num_visits_ = 0;
+  while (num_pending > 0) {
+    bool changed = false;
+    for (int i = 0; i < num_blocks; ++i) {
+      if (!pending[i]) continue;
+      pending[i] = false;
+      --num_pending;
+
+      const BasicBlock *bb = order[i];
+      BasicBlockID id = bb->id();
+      // For backwards problems the entry set merges the successors,
+      // for forward problems the predecessors.
+      BasicBlock::ConstEdgeIterator eiter, eend;
+      if (direction_ == DF_Backward) {
+        eiter = bb->BeginOutEdges();
+        eend = bb->EndOutEdges();
+      } else {
+        eiter = bb->BeginInEdges();
+        eend = bb->EndInEdges();
+      }
+      if (eiter == eend) continue;
+
+      ++num_visits_;
+      bool first = true;
+      for (; eiter != eend; ++eiter) {
+        const BasicBlock *neighbor = direction_ == DF_Backward ?
+            (*eiter)->dest() : (*eiter)->source();
+        MAO_ASSERT(neighbor != NULL);
+        if (first) {
+          entry_new = exit_sets[neighbor->id()];
+          first = false;
         } else {
-          // Problem should either be DF_Backward or DF_Forward.
-          MAO_ASSERT(false);
-        }
-        if (confluence_set.size() > 0) {
-          BitString entry_new = Confluence(confluence_set);
-          // Update if changed.
-          if (!(entry_new == entry_map[bb])) {
-            entry_map[bb] = entry_new;
-            dirty = true;
-
-            // Calculate the new exit state.
-            BitString exit_new = Transfer(entry_map[bb],
-                                          gen_map[bb],
-                                          kill_map[bb]);
-            // No need to compare the new value, just overwrite the old
-            // value even if its identical to the previous value.
-            exit_map[bb] = exit_new;
-          }
+          Confluence(&entry_new, exit_sets[neighbor->id()]);
         }
       }
-      ++num_iterations;
-      MAO_ASSERT(num_iterations <= kMaxNumberOfIterations);
-    } while (dirty);
 
-    fprintf(stderr, "Num iterations :%d\n", num_iterations);
+      // Update if changed.
+      if (entry_new == entry_sets[id]) continue;
+      entry_sets[id] = entry_new;
+      changed = true;
+      BitString exit_new = Transfer(entry_sets[id],
+                                    gen_sets[id],
+                                    kill_sets[id]);
+      if (exit_new == exit_sets[id]) continue;
+      exit_sets[id].Swap(&exit_new);
+
+      // The nodes that merge this exit set must be recomputed.
+      if (solver == DF_RoundRobin) continue;
+      if (direction_ == DF_Backward) {
+        eiter = bb->BeginInEdges();
+        eend = bb->EndInEdges();
+      } else {
+        eiter = bb->BeginOutEdges();
+        eend = bb->EndOutEdges();
+      }
+      for (; eiter != eend; ++eiter) {
+        const BasicBlock *dependent = direction_ == DF_Backward ?
+            (*eiter)->source() : (*eiter)->dest();
+        int pos = position[dependent->id()];
+        if (!pending[pos]) {
+          pending[pos] = true;
+          ++num_pending;
+        }
+      }
+    }
+    ++num_iterations_;
+    MAO_ASSERT(num_iterations_ <= kMaxNumberOfIterations);
+    if (solver == DF_RoundRobin && changed) {
+      pending.assign(num_blocks, true);
+      num_pending = num_blocks;
+    }
   }
+
   // Save the result.
-  df_solution_ = entry_map;
+  df_solution_.swap(entry_sets);
   solved_ = true;
   return solved_;
 }
 
+void DFProblem::ComputeOrder(enum DFSolver solver,
+                             std::vector<const BasicBlock *> *order) const {
+  order->clear();
+  order->reserve(cfg_->GetNumOfNodes());
+  if (solver == DF_RoundRobin) {
+    FORALL_CFG_BB(cfg_, it) {
+      order->push_back(*it);
+    }
+    return;
+  }
+
+  // Iterative depth first search from the source, recording the blocks
+  // in postorder. The stack holds each open block with the next out edge
+  // to follow.
+  std::vector<bool> visited(cfg_->GetNumOfNodes(), false);
+  std::vector<std::pair<const BasicBlock *,
+                        BasicBlock::ConstEdgeIterator> > stack;
+  const BasicBlock *source = cfg_->Source();
+  visited[source->id()] = true;
+  stack.push_back(std::make_pair(source, source->BeginOutEdges()));
+  while (!stack.empty()) {
+    const BasicBlock *bb = stack.back().first;
+    BasicBlock::ConstEdgeIterator &eiter = stack.back().second;
+    if (eiter == bb->EndOutEdges()) {
+      order->push_back(bb);
+      stack.pop_back();
+      continue;
+    }
+    const BasicBlock *dest = (*eiter)->dest();
+    ++eiter;
+    if (!visited[dest->id()]) {
+      visited[dest->id()] = true;
+      stack.push_back(std::make_pair(dest, dest->BeginOutEdges()));
+    }
+  }
+
+  if (direction_ == DF_Forward)
+    std::reverse(order->begin(), order->end());
+
+  // Blocks not reachable from the source still get a solution.
+  FORALL_CFG_BB(cfg_, it) {
+    if (!visited[(*it)->id()])
+      order->push_back(*it);
+  }
+}
+
 // Debug function to print out internal state on stderr.
-void DFProblem::DumpState(std::map<const BasicBlock *, BitString> in_map,
-                          std::map<const BasicBlock *, BitString> out_map) {
+void DFProblem::DumpState(const StateVector &in_sets,
+                          const StateVector &out_sets) {
   // Print out the state at a given moment:
   //  - function name
   // Loop over basic blocks and print
@@ -142,18 +232,19 @@ void DFProblem::DumpState(std::map<const BasicBlock *, BitString> in_map,
   // Loop over function and generate gen sets
   FORALL_CFG_BB(cfg_, it) {
     const BasicBlock *bb = *it;
-    if (!in_map.find(bb)->second.IsNull()
-        || !out_map.find(bb)->second.IsNull()) {
+    const BitString &in_set = in_sets[bb->id()];
+    const BitString &out_set = out_sets[bb->id()];
+    if (!in_set.IsNull() || !out_set.IsNull()) {
       fprintf(stderr, "bb: %s\n", bb->label());
     }
-    if (!in_map.find(bb)->second.IsNull()) {
+    if (!in_set.IsNull()) {
       fprintf(stderr, "in : ");
-      in_map.find(bb)->second.Print();
+      in_set.Print();
       fprintf(stderr, "\n");
     }
-    if (!out_map.find(bb)->second.IsNull()) {
+    if (!out_set.IsNull()) {
       fprintf(stderr, "out: ");
-      out_map.find(bb)->second.Print();
+      out_set.Print();
       fprintf(stderr, "\n");
     }
   }
@@ -163,33 +254,8 @@ BitString DFProblem::Transfer(const BitString& inset,
                               const BitString& gen,
                               const BitString& kill) const {
   // out = gen U ( in - kill)
-  return gen | (inset - kill);
-}
-
-// Dataset holds the successors.
-BitString DFProblem::Union(const std::set<BitString *> &dataset) const {
-  // out = U{p=succ()} live[p]
-  MAO_ASSERT(dataset.size() > 0);
-  std::set<BitString *>::const_iterator iter = dataset.begin();
-  BitString out_set = **iter;
-  ++iter;
-  while (iter != dataset.end()) {
-    out_set = out_set | **iter;
-    ++iter;
-  }
-  return out_set;
-}
-
-// Dataset holds the successors.
-BitString DFProblem::Intersect(const std::set<BitString *> &dataset) const {
-  // out = I{p=succ()} live[p]
-  MAO_ASSERT(dataset.size() > 0);
-  std::set<BitString *>::const_iterator iter = dataset.begin();
-  BitString out_set = **iter;
-  ++iter;
-  while (iter != dataset.end()) {
-    out_set = out_set & **iter;
-    ++iter;
-  }
-  return out_set;
+  BitString out(inset);
+  out -= kill;
+  out |= gen;
+  return out;
 }
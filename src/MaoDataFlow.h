@@ -23,8 +23,7 @@
 #ifndef MAODATAFLOW_H_
 #define MAODATAFLOW_H_
 
-#include <map>
-#include <set>
+#include <vector>
 
 #include "MaoCFG.h"
 #include "MaoUnit.h"
@@ -39,6 +38,16 @@ class DFProblem {
     DF_Backward,
   };
 
+  // Strategies for visiting the basic blocks.
+  enum DFSolver {
+    // Visits the blocks in reverse postorder (forward problems) or
+    // postorder (backward problems), and only those whose inputs have
+    // changed since their last visit.
+    DF_Worklist,
+    // Visits all blocks in CFG order until no set changes.
+    DF_RoundRobin,
+  };
+
   DFProblem(MaoUnit *unit,
             Function *function,
             const CFG *cfg,
@@ -48,19 +57,26 @@ class DFProblem {
 
   // Solves the problem instance. Returns true on success.
   // Should only be called once per problem.
-  bool Solve();
+  bool Solve(enum DFSolver solver = DF_Worklist);
+
+  // Number of passes over the blocks made by Solve(), and number of
+  // blocks for which the entry set was recomputed.
+  int num_iterations() const { return num_iterations_; }
+  int num_visits() const { return num_visits_; }
 
  protected:
   // Accessors to query about the solution.
   // The in-set is only available for forward problems.
-  BitString GetInSet(const BasicBlock& bb) const {
+  const BitString &GetInSet(const BasicBlock& bb) const {
     MAO_ASSERT(direction_ == DF_Forward);
-    return df_solution_.find(&bb)->second;
+    MAO_ASSERT(bb.id() < static_cast<int>(df_solution_.size()));
+    return df_solution_[bb.id()];
   }
   // The out-set is only available for backward problems.
-  BitString GetOutSet(const BasicBlock& bb) const {
+  const BitString &GetOutSet(const BasicBlock& bb) const {
     MAO_ASSERT(direction_ == DF_Backward);
-    return df_solution_.find(&bb)->second;
+    MAO_ASSERT(bb.id() < static_cast<int>(df_solution_.size()));
+    return df_solution_[bb.id()];
   };
 
   // Functions needed by the solver. Must be implemented
@@ -73,12 +89,17 @@ class DFProblem {
                              const BitString& gen,
                              const BitString& kill) const;
 
-  // Confluence function.
-  virtual BitString Confluence(const std::set<BitString *> &dataset) const = 0;
+  // Confluence function. Merges data into result, which holds the
+  // exit set of the first neighbor on entry.
+  virtual void Confluence(BitString *result, const BitString &data) const = 0;
   // Utility functions that can be used in problem instance to implement
   // Confluence()
-  BitString Union(const std::set<BitString *> &dataset) const;
-  BitString Intersect(const std::set<BitString *> &dataset) const;
+  void Union(BitString *result, const BitString &data) const {
+    *result |= data;
+  }
+  void Intersect(BitString *result, const BitString &data) const {
+    *result &= data;
+  }
 
   // The number of bits (size) each bitstring has.
   // Should be set in the constructor.
@@ -95,19 +116,28 @@ class DFProblem {
   bool solved_;
 
  private:
+  typedef std::vector<BitString> StateVector;
+
   // For backwards problem, save the output sets.
   // For forward problems, save the input sets.
-  std::map<const BasicBlock *, BitString> df_solution_;
+  // Indexed by basic block id.
+  StateVector df_solution_;
 
   // Forward or backward problem?
   enum DFProblemDirection direction_;
 
+  int num_iterations_;
+  int num_visits_;
+
   // Max number of iterations to try when looking for convergence.
   static const int kMaxNumberOfIterations = 1000;
 
+  // Fills order with the blocks in the order the solver visits them.
+  void ComputeOrder(enum DFSolver solver,
+                    std::vector<const BasicBlock *> *order) const;
+
   // Helper functions to help debugging.
-  void DumpState(std::map<const BasicBlock *, BitString> in_map,
-                 std::map<const BasicBlock *, BitString> out_map);
+  void DumpState(const StateVector &in_sets, const StateVector &out_sets);
 };
 
 
@@ -40,25 +40,25 @@ class RegProps {
   }
 
   const reg_entry  *reg() { return reg_; }
-  BitString        &mask() { return mask_; }
-  BitString        &sub_regs() { return sub_regs_; }
-  BitString        &parent_regs() { return parent_regs_; }
+  RegisterMask     &mask() { return mask_; }
+  RegisterMask     &sub_regs() { return sub_regs_; }
+  RegisterMask     &parent_regs() { return parent_regs_; }
   const char       *name() { return reg_->reg_name; }
   int              num() { return num_; }
 
-  void        AddSubReg(BitString &bstr) {
-    sub_regs_ = sub_regs_ | bstr;
+  void        AddSubReg(const RegisterMask &bstr) {
+    sub_regs_ |= bstr;
   }
-  void        AddParentReg(BitString &bstr) {
-    parent_regs_ = parent_regs_ | bstr;
+  void        AddParentReg(const RegisterMask &bstr) {
+    parent_regs_ |= bstr;
   }
 
  private:
   const reg_entry *  reg_;
   int                num_;
-  BitString          mask_;
-  BitString          sub_regs_;
-  BitString          parent_regs_;
+  RegisterMask       mask_;
+  RegisterMask       sub_regs_;
+  RegisterMask       parent_regs_;
 };
 
 // Maintain maps to allow fast register (property) lookup by
@@ -104,6 +104,9 @@ int reg_max = 0;
 void ReadRegisterTable() {
   int i;
   for (i = 0; ; ++i) {
+    MAO_RASSERT_MSG(i < kMaxNumberOfRegisters,
+                    "More than %d registers do not fit in a register mask",
+                    kMaxNumberOfRegisters);
     RegProps *r = new RegProps(&i386_regtab[i], i);
 
     reg_name_map[i386_regtab[i].reg_name] = r;
@@ -198,21 +201,14 @@ void AddSubRegs(const char *r64, const char *r32,
 // corresponding RegProps and additionally
 // set the mask's subregs found in the RegProps
 //
-void FillSubRegs(BitString *mask) {
+void FillSubRegs(RegisterMask *mask) {
   if (mask->IsNonNull() && !mask->IsUndef()) {
-    // Loop over bitstring (4 * 64 = 256 bits)
-    for (int i = 0; i < 4; i++)
-      if (mask->GetWord(i))
-        for (int j = 0; j < 64; j++) {
-          if (i*64+j >= reg_max)
-            break;
-
-          if (mask->Get(i*64+j)) {
-            RegProps *r = reg_num_map.find(i*64+j)->second;
-            MAO_ASSERT(r);
-            *mask = *mask | r->sub_regs();
-          }
-        }
+    for (int i = mask->NextSetBit(0); i != -1 && i < reg_max;
+         i = mask->NextSetBit(i + 1)) {
+      RegProps *r = reg_num_map.find(i)->second;
+      MAO_ASSERT(r);
+      *mask |= r->sub_regs();
+    }
   }
 }
 
@@ -220,21 +216,14 @@ void FillSubRegs(BitString *mask) {
 // corresponding RegProps and additionally
 // set the mask's parent regs found in the RegProps
 //
-void FillParentRegs(BitString *mask) {
+void FillParentRegs(RegisterMask *mask) {
   if (mask->IsNonNull() && !mask->IsUndef()) {
-    // Loop over bitstring (4 * 64 = 256 bits)
-    for (int i = 0; i < 4; i++)
-      if (mask->GetWord(i))
-        for (int j = 0; j < 64; j++) {
-          if (i*64+j >= reg_max)
-            break;
-
-          if (mask->Get(i*64+j)) {
-            RegProps *r = reg_num_map.find(i*64+j)->second;
-            MAO_ASSERT(r);
-            *mask = *mask | r->parent_regs();
-          }
-        }
+    for (int i = mask->NextSetBit(0); i != -1 && i < reg_max;
+         i = mask->NextSetBit(i + 1)) {
+      RegProps *r = reg_num_map.find(i)->second;
+      MAO_ASSERT(r);
+      *mask |= r->parent_regs();
+    }
   }
 }
 
@@ -331,9 +320,9 @@ void InitRegisters() {
 // For a given register name, return it's
 // sub-register mask.
 //
-BitString GetMaskForRegister(const reg_entry *reg) {
+RegisterMask GetMaskForRegister(const reg_entry *reg) {
   if (!reg)
-    return BitString(256, 4, 0x0ull, 0x0ull, 0x0ull, 0x0ull);
+    return RegisterMask();
 
   RegProps *rprops = reg_ptr_map.find(reg)->second;
   MAO_ASSERT(rprops);
@@ -346,12 +335,12 @@ BitString GetMaskForRegister(const reg_entry *reg) {
 //
 // If expand_mask is true, the mask includes all parent and child registers
 // of the defined registers.
-BitString GetRegisterDefMask(const InstructionEntry *insn,
-                             bool expand_mask) {
+RegisterMask GetRegisterDefMask(const InstructionEntry *insn,
+                                bool expand_mask) {
   DefEntry *e = &def_entries[insn->op()];
   MAO_ASSERT(e->opcode == insn->op());
 
-  BitString mask = e->reg_mask;
+  RegisterMask mask = e->reg_mask;
 
   //TODO: Do not blindly apply the operand width based masks
   //The masks are blindly applied because in certain instructions
@@ -359,16 +348,16 @@ BitString GetRegisterDefMask(const InstructionEntry *insn,
   //the opcode and the previous system of determining it based
   //on the type of the operand fails.
   //
-  mask = mask | e->reg_mask8;
-  mask = mask | e->reg_mask16;
-  mask = mask | e->reg_mask32;
-  mask = mask | e->reg_mask64;
+  mask |= e->reg_mask8;
+  mask |= e->reg_mask16;
+  mask |= e->reg_mask32;
+  mask |= e->reg_mask64;
 
   for (int op = 0; op < 5 && op < insn->NumOperands(); ++op) {
     if (e->op_mask & (1 << op)) {
       if (insn->IsRegisterOperand(op)) {
         const reg_entry *reg = insn->GetRegisterOperand(op);
-        mask = mask | GetMaskForRegister(reg);
+        mask |= GetMaskForRegister(reg);
        }
     }
   }
@@ -381,7 +370,7 @@ BitString GetRegisterDefMask(const InstructionEntry *insn,
   if ( (insn->NumOperands() == 1) &&
        (insn->IsRegisterOperand(0)) &&
        (e->op_mask & (1 << 1)) ) {
-    mask = mask | GetMaskForRegister(insn->GetRegisterOperand(0));
+    mask |= GetMaskForRegister(insn->GetRegisterOperand(0));
   }
 
   DefEntry *prefix_entry = NULL;
@@ -391,8 +380,7 @@ BitString GetRegisterDefMask(const InstructionEntry *insn,
     prefix_entry = &def_entries[OP_repne];
 
   if (prefix_entry != NULL) {
-    BitString prefix_mask = prefix_entry->reg_mask;
-    mask = mask | prefix_mask;
+    mask |= prefix_entry->reg_mask;
   }
   if (expand_mask) {
     FillSubRegs(&mask);
@@ -407,12 +395,12 @@ BitString GetRegisterDefMask(const InstructionEntry *insn,
 //
 // If expand_mask is true, the mask includes all parent and child registers
 // of the defined registers.
-BitString GetRegisterUseMask(const InstructionEntry *insn,
-                             bool expand_mask) {
+RegisterMask GetRegisterUseMask(const InstructionEntry *insn,
+                                bool expand_mask) {
   UseEntry *e = &use_entries[insn->op()];
   MAO_ASSERT(e->opcode == insn->op());
 
-  BitString mask = e->reg_mask;
+  RegisterMask mask = e->reg_mask;
 
   //TODO: Do not blindly apply the operand width based masks
   //The masks are blindly applied because in certain instructions
@@ -420,23 +408,23 @@ BitString GetRegisterUseMask(const InstructionEntry *insn,
   //the opcode and the previous system of determining it based
   //on the type of the operand fails.
   //
-  mask = mask | e->reg_mask8;
-  mask = mask | e->reg_mask16;
-  mask = mask | e->reg_mask32;
-  mask = mask | e->reg_mask64;
+  mask |= e->reg_mask8;
+  mask |= e->reg_mask16;
+  mask |= e->reg_mask32;
+  mask |= e->reg_mask64;
 
   for (int op = 0; op < 5 && op < insn->NumOperands(); ++op) {
     if (e->op_mask & (1 << op)) {
       if (insn->IsRegisterOperand(op)) {
-        mask = mask | GetMaskForRegister(insn->GetRegisterOperand(op));
+        mask |= GetMaskForRegister(insn->GetRegisterOperand(op));
        }
     }
   }
   if (insn->HasBaseRegister() && (e->op_mask & REG_OP_BASE)) {
-    mask = mask | GetMaskForRegister(insn->GetBaseRegister());
+    mask |= GetMaskForRegister(insn->GetBaseRegister());
   }
   if (insn->HasIndexRegister() && (e->op_mask & REG_OP_INDEX)) {
-    mask = mask | GetMaskForRegister(insn->GetIndexRegister());
+    mask |= GetMaskForRegister(insn->GetIndexRegister());
   }
   UseEntry *prefix_entry = NULL;
   if (insn->HasPrefix (REPE_PREFIX_OPCODE))
@@ -445,8 +433,7 @@ BitString GetRegisterUseMask(const InstructionEntry *insn,
     prefix_entry = &use_entries[OP_repne];
 
   if (prefix_entry != NULL) {
-    BitString prefix_mask = prefix_entry->reg_mask;
-    mask = mask | prefix_mask;
+    mask |= prefix_entry->reg_mask;
   }
   if (expand_mask) {
     FillSubRegs(&mask);
@@ -510,8 +497,8 @@ std::set<const reg_entry *> GetUsedRegisters(InstructionEntry *insn) {
 
 // Returns a mask for the live in registers.
 // TODO(martint): Take the ABI into considerations
-BitString GetCallingConventionDefMask() {
-  BitString mask;
+RegisterMask GetCallingConventionDefMask() {
+  RegisterMask mask;
   const char *amd64_abi_input_regs[] = {
     "rdi", "rsi", "rdx", "rcx", "r8", "r9", "xmm0", "xmm1", "xmm2",
     "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"};
@@ -521,7 +508,7 @@ BitString GetCallingConventionDefMask() {
     MAO_ASSERT(!(mask ==
                  (mask | GetMaskForRegister(
                      GetRegFromName(amd64_abi_input_regs[i])))));
-    mask = mask | GetMaskForRegister(GetRegFromName(amd64_abi_input_regs[i]));
+    mask |= GetMaskForRegister(GetRegFromName(amd64_abi_input_regs[i]));
   }
   return mask;
 }
@@ -529,13 +516,13 @@ BitString GetCallingConventionDefMask() {
 
 // Print register mask.
 //
-void PrintRegistersInRegisterMask(FILE *f, BitString mask, const char *title) {
+void PrintRegistersInRegisterMask(FILE *f, const RegisterMask &mask,
+                                  const char *title) {
   if (title)
     fprintf(f, "%s: ", title);
-  for (int i = 0; i < 255; i++) {
-    if (mask.Get(i)) {
-      fprintf(f, "%s ", reg_num_map[i]->name());
-    }
+  for (int i = mask.NextSetBit(0); i != -1 && i < 255;
+       i = mask.NextSetBit(i + 1)) {
+    fprintf(f, "%s ", reg_num_map[i]->name());
   }
   fprintf(f, "\n");
 }
@@ -569,14 +556,14 @@ bool       RegistersOverlap(const reg_entry *reg1,
 
 // All bits in child must be set in parent
 //
-bool       RegistersContained(BitString &parent,
-                              BitString &child) {
+bool       RegistersContained(const RegisterMask &parent,
+                              const RegisterMask &child) {
   return (parent & child) == child;
 }
 
 bool       IsParent(const reg_entry *parent,
                     const reg_entry *child) {
-  BitString  parents = GetParentRegs(child);
+  RegisterMask parents = GetParentRegs(child);
   // is parent in parents?
   RegProps *preg = reg_ptr_map.find(parent)->second;
   return ((preg->mask() & parents).IsNonNull());
@@ -589,7 +576,7 @@ bool       IsParentNum(int parent,
 }
 
 
-BitString  GetParentRegs(const reg_entry *reg) {
+RegisterMask GetParentRegs(const reg_entry *reg) {
   RegProps *p1 = reg_ptr_map.find(reg)->second;
   MAO_ASSERT(p1);
   return p1->parent_regs();
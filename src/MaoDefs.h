@@ -22,6 +22,7 @@
 
 #include <set>
 
+#include "MaoRegSet.h"
 #include "MaoUtil.h"
 
 // This should be included, but since its not guraded, it will generate errors
@@ -42,15 +43,21 @@
 
 #define  USE_OP_ALL (REG_OP0 | REG_OP1 | REG_OP2 | REG_OP3 | REG_OP4 | REG_OP5 | REG_OP_BASE | REG_OP_INDEX)
 
+// Register masks have one bit per register, numbered in the order of the
+// binutils register table. GetNumberOfRegisters() must not exceed
+// kMaxNumberOfRegisters.
+const int kMaxNumberOfRegisters = 256;
+typedef RegSet<kMaxNumberOfRegisters> RegisterMask;
+
 // more are possible...
 struct DefEntry {
   int           opcode;      // matches table gen-opcodes.h
   unsigned int  op_mask;     // if insn defs operand(s)
-  BitString     reg_mask;    // if insn defs register(s)
-  BitString     reg_mask8;   //   for  8-bit addressing modes
-  BitString     reg_mask16;  //   for 16-bit addressing modes
-  BitString     reg_mask32;  //   for 32-bit addressing modes
-  BitString     reg_mask64;  //   for 64-bit addressing modes
+  RegisterMask  reg_mask;    // if insn defs register(s)
+  RegisterMask  reg_mask8;   //   for  8-bit addressing modes
+  RegisterMask  reg_mask16;  //   for 16-bit addressing modes
+  RegisterMask  reg_mask32;  //   for 32-bit addressing modes
+  RegisterMask  reg_mask64;  //   for 64-bit addressing modes
 };
 
 // Should possibly using the same struct for both.
@@ -58,11 +65,11 @@ struct DefEntry {
 struct UseEntry {
   int           opcode;      // matches table gen-opcodes.h
   unsigned int  op_mask;     // if insn defs operand(s)
-  BitString     reg_mask;    // if insn defs register(s)
-  BitString     reg_mask8;   //   for  8-bit addressing modes
-  BitString     reg_mask16;  //   for 16-bit addressing modes
-  BitString     reg_mask32;  //   for 32-bit addressing modes
-  BitString     reg_mask64;  //   for 64-bit addressing modes
+  RegisterMask  reg_mask;    // if insn defs register(s)
+  RegisterMask  reg_mask8;   //   for  8-bit addressing modes
+  RegisterMask  reg_mask16;  //   for 16-bit addressing modes
+  RegisterMask  reg_mask32;  //   for 32-bit addressing modes
+  RegisterMask  reg_mask64;  //   for 64-bit addressing modes
 };
 
 extern DefEntry def_entries[];
@@ -72,36 +79,36 @@ extern UseEntry use_entries[];
 class InstructionEntry;
 
 void InitRegisters();
-BitString  GetRegisterDefMask(const InstructionEntry *insn,
-                              bool expand_mask = false);
+RegisterMask GetRegisterDefMask(const InstructionEntry *insn,
+                                bool expand_mask = false);
 
-BitString  GetRegisterUseMask(const InstructionEntry *insn,
-                              bool expand_mask = false);
+RegisterMask GetRegisterUseMask(const InstructionEntry *insn,
+                                bool expand_mask = false);
 
 std::set<const reg_entry *> GetDefinedRegisters(InstructionEntry *insn);
 std::set<const reg_entry *> GetUsedRegisters(InstructionEntry *insn);
 
-BitString  GetCallingConventionDefMask();
+RegisterMask GetCallingConventionDefMask();
 
-void       PrintRegistersInRegisterMask(FILE *f, BitString mask,
+void       PrintRegistersInRegisterMask(FILE *f, const RegisterMask &mask,
                                         const char *title = NULL);
-BitString  GetMaskForRegister(const reg_entry *reg);
+RegisterMask GetMaskForRegister(const reg_entry *reg);
 bool       DefinesSubReg(reg_entry *reg,
                          reg_entry *sub_reg);
 bool       RegistersOverlap(const reg_entry *reg1,
                             const reg_entry *reg2);
-bool       RegistersContained(BitString &parent,
-                              BitString &child);
+bool       RegistersContained(const RegisterMask &parent,
+                              const RegisterMask &child);
 bool       IsParent(const reg_entry *parent,
                     const reg_entry *child);
 bool       IsParentNum(int parent,
                        int child);
-BitString  GetParentRegs(const reg_entry *reg);
+RegisterMask GetParentRegs(const reg_entry *reg);
 
 bool       IsRegDefined(InstructionEntry *insn, const reg_entry *reg);
 
-void FillSubRegs(BitString *mask);
-void FillParentRegs(BitString *mask);
+void FillSubRegs(RegisterMask *mask);
+void FillParentRegs(RegisterMask *mask);
 
 // Provide pointer to
 //   %rip  for 64-bit compiles
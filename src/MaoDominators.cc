@@ -0,0 +1,236 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+
+#include <utility>
+
+#include "MaoDominators.h"
+
+//
+// Class: DominatorTree
+//
+
+DominatorTree::DominatorTree(CFG *cfg, bool post)
+    : post_(post), root_(post ? cfg->Sink() : cfg->Source()),
+      blocks_(cfg->Begin(), cfg->End()),
+      idom_(blocks_.size(), NULL),
+      children_(blocks_.size()),
+      pre_order_(blocks_.size(), -1),
+      post_order_(blocks_.size(), -1),
+      frontiers_computed_(false) {
+  for (size_t i = 0; i < blocks_.size(); ++i)
+    MAO_ASSERT(blocks_[i]->id() == static_cast<BasicBlockID>(i));
+
+  BBVector order;
+  ComputeReversePostOrder(&order);
+  ComputeImmediateDominators(order);
+  NumberTree(order);
+}
+
+void DominatorTree::GetSuccessors(const BasicBlock *bb,
+                                  BBVector *successors) const {
+  successors->clear();
+  if (post_) {
+    for (BasicBlock::ConstEdgeIterator iter = bb->BeginInEdges();
+         iter != bb->EndInEdges(); ++iter)
+      successors->push_back((*iter)->source());
+  } else {
+    for (BasicBlock::ConstEdgeIterator iter = bb->BeginOutEdges();
+         iter != bb->EndOutEdges(); ++iter)
+      successors->push_back((*iter)->dest());
+  }
+}
+
+void DominatorTree::GetPredecessors(const BasicBlock *bb,
+                                    BBVector *predecessors) const {
+  predecessors->clear();
+  if (post_) {
+    for (BasicBlock::ConstEdgeIterator iter = bb->BeginOutEdges();
+         iter != bb->EndOutEdges(); ++iter)
+      predecessors->push_back((*iter)->dest());
+  } else {
+    for (BasicBlock::ConstEdgeIterator iter = bb->BeginInEdges();
+         iter != bb->EndInEdges(); ++iter)
+      predecessors->push_back((*iter)->source());
+  }
+}
+
+void DominatorTree::ComputeReversePostOrder(BBVector *order) const {
+  // The search is iterative, since functions can have more blocks than
+  // the stack of a pass thread has frames. Each stack element holds a
+  // block and the index of the next successor to visit.
+  std::vector<BBVector> successors(blocks_.size());
+  std::vector<bool> visited(blocks_.size(), false);
+  std::vector<std::pair<BasicBlock *, size_t> > stack;
+  BBVector post_order;
+
+  visited[Index(root_)] = true;
+  GetSuccessors(root_, &successors[Index(root_)]);
+  stack.push_back(std::make_pair(root_, 0));
+  while (!stack.empty()) {
+    BasicBlock *bb = stack.back().first;
+    const BBVector &bb_successors = successors[Index(bb)];
+    if (stack.back().second < bb_successors.size()) {
+      BasicBlock *successor = bb_successors[stack.back().second++];
+      if (!visited[Index(successor)]) {
+        visited[Index(successor)] = true;
+        GetSuccessors(successor, &successors[Index(successor)]);
+        stack.push_back(std::make_pair(successor, 0));
+      }
+    } else {
+      post_order.push_back(bb);
+      stack.pop_back();
+    }
+  }
+  order->assign(post_order.rbegin(), post_order.rend());
+}
+
+// Returns the nearest common dominator of a and b, given the dominators
+// found so far and the reverse post order numbers of the blocks.
+static BasicBlock *Intersect(BasicBlock *a, BasicBlock *b,
+                             const DominatorTree::BBVector &idom,
+                             const std::vector<int> &rpo_number) {
+  while (a != b) {
+    while (rpo_number[a->id()] > rpo_number[b->id()])
+      a = idom[a->id()];
+    while (rpo_number[b->id()] > rpo_number[a->id()])
+      b = idom[b->id()];
+  }
+  return a;
+}
+
+void DominatorTree::ComputeImmediateDominators(const BBVector &order) {
+  std::vector<int> rpo_number(blocks_.size(), -1);
+  for (size_t i = 0; i < order.size(); ++i)
+    rpo_number[Index(order[i])] = i;
+
+  // The reachable predecessors of the blocks, by position in order.
+  std::vector<BBVector> predecessors(order.size());
+  for (size_t i = 1; i < order.size(); ++i) {
+    BBVector all;
+    GetPredecessors(order[i], &all);
+    for (BBVector::const_iterator iter = all.begin(); iter != all.end();
+         ++iter) {
+      if (rpo_number[Index(*iter)] >= 0)
+        predecessors[i].push_back(*iter);
+    }
+  }
+
+  // Until the loop is done, the root is its own dominator, which ends
+  // the walks in Intersect().
+  idom_[Index(root_)] = root_;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1; i < order.size(); ++i) {
+      BasicBlock *new_idom = NULL;
+      for (BBVector::const_iterator iter = predecessors[i].begin();
+           iter != predecessors[i].end(); ++iter) {
+        // Skip predecessors not processed yet.
+        if (idom_[Index(*iter)] == NULL)
+          continue;
+        new_idom = new_idom == NULL ?
+            *iter : Intersect(*iter, new_idom, idom_, rpo_number);
+      }
+      MAO_ASSERT(new_idom);
+      if (idom_[Index(order[i])] != new_idom) {
+        idom_[Index(order[i])] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  idom_[Index(root_)] = NULL;
+}
+
+void DominatorTree::NumberTree(const BBVector &order) {
+  for (size_t i = 1; i < order.size(); ++i)
+    children_[Index(idom_[Index(order[i])])].push_back(order[i]);
+
+  int pre_number = 0;
+  int post_number = 0;
+  std::vector<std::pair<BasicBlock *, size_t> > stack;
+  pre_order_[Index(root_)] = pre_number++;
+  stack.push_back(std::make_pair(root_, 0));
+  while (!stack.empty()) {
+    BasicBlock *bb = stack.back().first;
+    const BBVector &children = children_[Index(bb)];
+    if (stack.back().second < children.size()) {
+      BasicBlock *child = children[stack.back().second++];
+      pre_order_[Index(child)] = pre_number++;
+      stack.push_back(std::make_pair(child, 0));
+    } else {
+      post_order_[Index(bb)] = post_number++;
+      stack.pop_back();
+    }
+  }
+}
+
+const DominatorTree::BBVector &DominatorTree::Frontier(
+    const BasicBlock *bb) const {
+  MaoMutexLock lock(&frontier_mutex_);
+  if (!frontiers_computed_) {
+    ComputeFrontiers();
+    frontiers_computed_ = true;
+  }
+  return frontiers_[Index(bb)];
+}
+
+void DominatorTree::ComputeFrontiers() const {
+  // A join point is in the frontier of the blocks on the paths up the
+  // tree from each of its predecessors to its immediate dominator.
+  frontiers_.resize(blocks_.size());
+  BBVector predecessors;
+  for (BBVector::const_iterator bb = blocks_.begin(); bb != blocks_.end();
+       ++bb) {
+    if (!IsReachable(*bb))
+      continue;
+    GetPredecessors(*bb, &predecessors);
+    if (predecessors.size() < 2)
+      continue;
+    for (BBVector::const_iterator iter = predecessors.begin();
+         iter != predecessors.end(); ++iter) {
+      if (!IsReachable(*iter))
+        continue;
+      for (BasicBlock *runner = *iter; runner != idom_[Index(*bb)];
+           runner = idom_[Index(runner)]) {
+        // Only the current block is added, so duplicates are adjacent.
+        BBVector &frontier = frontiers_[Index(runner)];
+        if (frontier.empty() || frontier.back() != *bb)
+          frontier.push_back(*bb);
+      }
+    }
+  }
+}
+
+void DominatorTree::Print(FILE *out) const {
+  fprintf(out, "%s tree:\n", post_ ? "Post-dominator" : "Dominator");
+  for (BBVector::const_iterator bb = blocks_.begin(); bb != blocks_.end();
+       ++bb) {
+    if (!IsReachable(*bb)) {
+      fprintf(out, "  bb%d: unreachable\n", (*bb)->id());
+      continue;
+    }
+    BasicBlock *idom = ImmediateDominator(*bb);
+    fprintf(out, "  bb%d: idom %d, frontier:", (*bb)->id(),
+            idom ? idom->id() : -1);
+    const BBVector &frontier = Frontier(*bb);
+    for (BBVector::const_iterator iter = frontier.begin();
+         iter != frontier.end(); ++iter)
+      fprintf(out, " %d", (*iter)->id());
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,133 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+
+// Dominator and post-dominator trees.
+// Classes:
+//   DominatorTree - The (post-)dominator tree of a CFG, with constant time
+//                   dominance queries and the dominance frontiers.
+//
+// The trees are cached per function, like the CFG:
+//
+//   DominatorTree *dom = MaoAnalyses::GetDominators(unit_, function_);
+//   if (dom->Dominates(header, bb)) ...
+//
+// The post-dominator tree is rooted at the sink of the CFG, which all
+// exits lead to. Blocks that cannot reach the sink, such as those in
+// endless loops, are unreachable in the post-dominator tree, and blocks
+// that cannot be reached from the source are unreachable in the
+// dominator tree. Unreachable blocks dominate nothing and are dominated
+// by nothing.
+//
+#ifndef MAODOMINATORS_H_
+#define MAODOMINATORS_H_
+
+#include <stdio.h>
+#include <vector>
+
+#include "MaoCFG.h"
+#include "MaoThreads.h"
+
+class DominatorTree {
+ public:
+  typedef std::vector<BasicBlock *> BBVector;
+
+  // Computes the dominators of the blocks in cfg, or its post-dominators
+  // if post is true. The tree refers to the blocks, and must be dropped
+  // with the CFG.
+  DominatorTree(CFG *cfg, bool post);
+
+  bool post() const { return post_; }
+  // Returns the source of the CFG, or the sink for post-dominators.
+  BasicBlock *root() const { return root_; }
+
+  bool IsReachable(const BasicBlock *bb) const {
+    return pre_order_[Index(bb)] >= 0;
+  }
+
+  // Returns the immediate (post-)dominator of bb, or NULL for the root
+  // and unreachable blocks.
+  BasicBlock *ImmediateDominator(const BasicBlock *bb) const {
+    return idom_[Index(bb)];
+  }
+
+  // Returns true if a (post-)dominates b. Blocks dominate themselves.
+  // The tree is numbered in depth first order, so this only compares the
+  // intervals of a and b.
+  bool Dominates(const BasicBlock *a, const BasicBlock *b) const {
+    int ia = Index(a);
+    int ib = Index(b);
+    return pre_order_[ia] >= 0 && pre_order_[ib] >= 0 &&
+        pre_order_[ia] <= pre_order_[ib] &&
+        post_order_[ib] <= post_order_[ia];
+  }
+  bool StrictlyDominates(const BasicBlock *a, const BasicBlock *b) const {
+    return a != b && Dominates(a, b);
+  }
+
+  // Returns the blocks bb immediately (post-)dominates.
+  const BBVector &Children(const BasicBlock *bb) const {
+    return children_[Index(bb)];
+  }
+
+  // Returns the (post-)dominance frontier of bb. The frontiers of all
+  // blocks are computed on the first call.
+  const BBVector &Frontier(const BasicBlock *bb) const;
+
+  void Print() const { Print(stdout); }
+  void Print(FILE *out) const;
+
+ private:
+  int Index(const BasicBlock *bb) const {
+    MAO_ASSERT(bb->id() >= 0 && bb->id() < static_cast<int>(blocks_.size()));
+    return bb->id();
+  }
+
+  // Returns the reachable blocks in reverse post order of a depth first
+  // search from the root.
+  void ComputeReversePostOrder(BBVector *order) const;
+  // Sets idom_ with the algorithm of Cooper, Harvey and Kennedy.
+  void ComputeImmediateDominators(const BBVector &order);
+  // Sets children_ and numbers the tree for Dominates().
+  void NumberTree(const BBVector &order);
+  void ComputeFrontiers() const;
+
+  // The blocks bb has edges to, or from for post-dominators.
+  void GetSuccessors(const BasicBlock *bb, BBVector *successors) const;
+  // The blocks that have edges to bb, or from bb for post-dominators.
+  void GetPredecessors(const BasicBlock *bb, BBVector *predecessors) const;
+
+  const bool post_;
+  BasicBlock *root_;
+  // Indexed by the ids of the blocks.
+  BBVector blocks_;
+  BBVector idom_;
+  std::vector<BBVector> children_;
+  // Depth first numbering of the tree, -1 for unreachable blocks.
+  std::vector<int> pre_order_;
+  std::vector<int> post_order_;
+
+  // Computed on demand, guarded by frontier_mutex_.
+  mutable std::vector<BBVector> frontiers_;
+  mutable bool frontiers_computed_;
+  mutable MaoMutex frontier_mutex_;
+
+  DominatorTree(const DominatorTree &);
+  DominatorTree &operator=(const DominatorTree &);
+};
+
+#endif  // MAODOMINATORS_H_
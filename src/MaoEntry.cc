@@ -16,8 +16,8 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
 
-#include <iostream>
-#include <sstream>
+#include <stdio.h>
+
 #include <string>
 
 #include "Mao.h"
@@ -27,17 +27,27 @@
 #include "struc-symbol.h"
 #include "tc-i386-helper.h"
 
+// Appends the decimal form of value to out. The entries are printed by
+// appending to one string, so this avoids building a stream per number.
+static void AppendInt(long long value, std::string *out) {
+  char buffer[24];
+  int length = snprintf(buffer, sizeof(buffer), "%lld", value);
+  out->append(buffer, length);
+}
+
 //
 // Class: MaoEntry
 //
 
 MaoEntry::MaoEntry(unsigned int line_number, const char *line_verbatim,
                    MaoUnit *maounit) :
-    maounit_(maounit), id_(0), next_(NULL), prev_(NULL),
-    line_number_(line_number) {
+    maounit_(maounit), id_(0), next_(NULL), prev_(NULL), function_(NULL),
+    subsection_(NULL), line_number_(line_number),
+    line_verbatim_length_(kTerminated) {
   if (line_verbatim) {
     MAO_ASSERT(strlen(line_verbatim) < MAX_VERBATIM_ASSEMBLY_STRING_LENGTH);
-    line_verbatim_ = strdup(line_verbatim);
+    MAO_ASSERT(maounit_);
+    line_verbatim_ = maounit_->arena()->StrDup(line_verbatim);
   } else {
     line_verbatim_ = 0;
   }
@@ -46,6 +56,43 @@ MaoEntry::MaoEntry(unsigned int line_number, const char *line_verbatim,
 MaoEntry::~MaoEntry() {
 }
 
+const unsigned int MaoEntry::kTerminated;
+
+const char *const MaoEntry::line_verbatim() const {
+  if (line_verbatim_length_ == kTerminated)
+    return line_verbatim_;
+  // Function passes may ask for the line on several threads.
+  MaoMutexLock lock(maounit_->mutex());
+  if (line_verbatim_length_ != kTerminated) {
+    line_verbatim_ = maounit_->arena()->StrNDup(line_verbatim_,
+                                                line_verbatim_length_);
+    // Readers that do not take the lock check the length first.
+    __sync_synchronize();
+    line_verbatim_length_ = kTerminated;
+  }
+  return line_verbatim_;
+}
+
+MaoStringPiece MaoEntry::line_verbatim_span() const {
+  MaoStringPiece span;
+  MaoMutexLock lock(maounit_->mutex());
+  span.data = line_verbatim_;
+  if (line_verbatim_ == NULL)
+    span.length = 0;
+  else if (line_verbatim_length_ == kTerminated)
+    span.length = strlen(line_verbatim_);
+  else
+    span.length = line_verbatim_length_;
+  return span;
+}
+
+void MaoEntry::set_line_verbatim_span(const char *text, size_t length) {
+  MAO_ASSERT(text);
+  MAO_ASSERT(length < kTerminated);
+  line_verbatim_ = text;
+  line_verbatim_length_ = length;
+}
+
 // Returns the flag code of the closest instruction entry that precedes this
 // entry. This is a virtual method which is overridden by the InstructionEntry
 // class and so if the entry is an instruction entry, it simply returns the flag
@@ -72,9 +119,8 @@ enum flag_code MaoEntry::GetFlag() const {
 #define FAKE_LABEL_NAME "L0\001"
 #endif
 
-std::string MaoEntry::GetDotOrSymbol(symbolS *symbol) const {
-  std::string out_string;
-
+std::string &MaoEntry::DotOrSymbolToString(symbolS *symbol,
+                                          std::string *out) const {
   const char *symbol_name = S_GET_NAME(symbol);
   MAO_ASSERT(symbol_name);
   if (strcmp(symbol_name, FAKE_LABEL_NAME) == 0) {
@@ -83,16 +129,16 @@ std::string MaoEntry::GetDotOrSymbol(symbolS *symbol) const {
     if (S_GET_SEGMENT(symbol) == expr_section ||
         S_GET_SEGMENT(symbol) == absolute_section) {
       // sy_value containts an expression. Return it as a string.
-      out_string = "(";
-      ExpressionToString(&symbol->sy_value, &out_string);
-      out_string.append(")");
+      out->append("(");
+      ExpressionToString(&symbol->sy_value, out);
+      out->append(")");
     } else {
-      out_string = ".";
+      out->append(".");
     }
   } else {
-    out_string = symbol_name;
+    out->append(symbol_name);
   }
-  return out_string;
+  return *out;
 }
 
 
@@ -256,35 +302,23 @@ const std::string &MaoEntry::ExpressionToStringImp(
     // SUPPORTED
       /* X_add_number (a constant expression).  */
     case O_constant:
-      {
-        std::ostringstream int_string;
-        if (immedate)
-          out->append("$");
-        int_string << expr->X_add_number;
-        out->append(int_string.str());
-      }
+      if (immedate)
+        out->append("$");
+      AppendInt(expr->X_add_number, out);
       break;
       /* X_add_symbol + X_add_number.  */
     case O_symbol:
-      {
-        std::ostringstream exp_string;
-        if (immedate)
-          exp_string << "$";
-        if (expr->X_add_symbol) {
-          exp_string << GetDotOrSymbol(expr->X_add_symbol);
-          if (reloc != NULL) {
-            std::string s;
-            exp_string << RelocToString(*reloc, &s);
-          }
-          if (expr->X_add_number != 0) {
-            exp_string << "+";
-          }
-        }
-        if (expr->X_add_number != 0) {
-          exp_string << expr->X_add_number;
-        }
-        out->append(exp_string.str());
+      if (immedate)
+        out->append("$");
+      if (expr->X_add_symbol) {
+        DotOrSymbolToString(expr->X_add_symbol, out);
+        if (reloc != NULL)
+          RelocToString(*reloc, out);
+        if (expr->X_add_number != 0)
+          out->append("+");
       }
+      if (expr->X_add_number != 0)
+        AppendInt(expr->X_add_number, out);
       break;
 
     case O_add:             /* (X_add_symbol +  X_op_symbol) + X_add_number.  */
@@ -306,58 +340,44 @@ const std::string &MaoEntry::ExpressionToStringImp(
     case O_gt:              /* (X_add_symbol >  X_op_symbol) + X_add_number.  */
     case O_logical_and:     /* (X_add_symbol && X_op_symbol) + X_add_number.  */
     case O_logical_or:      /* (X_add_symbol || X_op_symbol) + X_add_number.  */
-      {
-        std::ostringstream exp_string;
-        if (immedate)
-          exp_string << "$";
-        if (expr->X_add_symbol) {
-          exp_string << GetDotOrSymbol(expr->X_add_symbol);
-          if (reloc != NULL) {
-            std::string s;
-            exp_string << RelocToString(*reloc, &s);
-          }
-          // When GOTPCREL is used, the second symbol is implicit and
-          // should not be printed.
-          if (reloc == NULL ||
-              (*reloc != BFD_RELOC_32_PCREL && *reloc != BFD_RELOC_32)) {
-            if (expr->X_op_symbol) {
-              exp_string << OpToString(expr->X_op);
-              exp_string << GetDotOrSymbol(expr->X_op_symbol);
-              if (expr->X_add_number != 0) {
-                exp_string << "+";
-              }
-            }
+      if (immedate)
+        out->append("$");
+      if (expr->X_add_symbol) {
+        DotOrSymbolToString(expr->X_add_symbol, out);
+        if (reloc != NULL)
+          RelocToString(*reloc, out);
+        // When GOTPCREL is used, the second symbol is implicit and
+        // should not be printed.
+        if (reloc == NULL ||
+            (*reloc != BFD_RELOC_32_PCREL && *reloc != BFD_RELOC_32)) {
+          if (expr->X_op_symbol) {
+            out->append(OpToString(expr->X_op));
+            DotOrSymbolToString(expr->X_op_symbol, out);
+            if (expr->X_add_number != 0)
+              out->append("+");
           }
         }
-        if (expr->X_add_number != 0) {
-          exp_string << expr->X_add_number;
-        }
-        out->append(exp_string.str());
       }
+      if (expr->X_add_number != 0)
+        AppendInt(expr->X_add_number, out);
       break;
       /* A register (X_add_number is register number).  */
     case O_register:
-      {
-        std::ostringstream exp_string;
-        exp_string << "%" << i386_regtab[expr->X_add_number].reg_name;
-        out->append(exp_string.str());
-      }
+      out->append("%");
+      out->append(i386_regtab[expr->X_add_number].reg_name);
       break;
 
     case O_uminus:        /* (- X_add_symbol) + X_add_number.  */
     case O_bit_not:       /* (~ X_add_symbol) + X_add_number.  */
     case O_logical_not:   /* (! X_add_symbol) + X_add_number.  */
-      {
-        std::ostringstream exp_string;
-        if (immedate)
-          exp_string << "$";
-        exp_string << "(" << OpToString(expr->X_op)
-                   << GetDotOrSymbol(expr->X_add_symbol) << ")";
-        if (expr->X_add_number != 0) {
-          exp_string << expr->X_add_number;
-        }
-        out->append(exp_string.str());
-      }
+      if (immedate)
+        out->append("$");
+      out->append("(");
+      out->append(OpToString(expr->X_op));
+      DotOrSymbolToString(expr->X_add_symbol, out);
+      out->append(")");
+      if (expr->X_add_number != 0)
+        AppendInt(expr->X_add_number, out);
       break;
     // UNSUPPORTED
     /* An illegal expression.  */
@@ -426,18 +446,22 @@ void MaoEntry::Spaces(unsigned int n, FILE *outfile) const {
 }
 
 std::string &MaoEntry::SourceInfoToString(std::string *out) const {
-  std::ostringstream stream;
-  stream << "\t# id: "
-         << id()
-         << ", l: "
-         << line_number()
-         << "\t";
+  out->append("\t# id: ");
+  AppendInt(id(), out);
+  out->append(", l: ");
+  AppendInt(line_number(), out);
+  out->append("\t");
   if (0 && line_verbatim())  // TODO(rhundt): Invent option for this
-    stream << line_verbatim();
-  out->append(stream.str());
+    out->append(line_verbatim());
   return *out;
 }
 
+void MaoEntry::PrintEntry(FILE *out) const {
+  std::string s;
+  EntryToString(&s);
+  MaoTraceBuffer::Write(out, s);
+}
+
 void MaoEntry::Unlink() {
   MaoEntry *prev = prev_, *next = next_;
   if (prev != NULL) {
@@ -513,14 +537,29 @@ MaoEntry *MaoEntry::GetLastEntry(MaoEntry *entry) const {
   return last_entry;
 }
 
+void MaoEntry::AdoptChain(MaoEntry *first, MaoEntry *last) const {
+  for (MaoEntry *e = first; ; e = e->next()) {
+    if (e->function() == NULL)
+      e->set_function(function_);
+    if (e->subsection() == NULL)
+      e->set_subsection(subsection_);
+    if (e == last)
+      break;
+  }
+}
+
 // Link a chain of instructions (one or more) before the current instruction.
 // Function and subsection pointers are updated in case the instructions
 // are inserted at the beginning of such a unit.
 void MaoEntry::LinkBefore(MaoEntry *entry) {
   MAO_ASSERT(entry != NULL);
+  // The previous entry may be outside of the function, see
+  // MaoFunctionPassManager::Go().
+  MaoMutexLock lock(maounit_->mutex());
 
   // Find the last entry in the chain.
   MaoEntry *last_entry = GetLastEntry(entry);
+  AdoptChain(entry, last_entry);
 
   // Set prev and next pointers.
   last_entry->set_next(this);
@@ -532,14 +571,14 @@ void MaoEntry::LinkBefore(MaoEntry *entry) {
   this->set_prev(last_entry);
 
   // Do we need to update the function?
-  Function *function = maounit_->GetFunction(this);
+  Function *function = function_;
   if (function &&
       function->first_entry() == this) {
     function->set_first_entry(entry);
   }
 
   // Do we need to update the subsection?
-  SubSection *subsection = maounit_->GetSubSection(this);
+  SubSection *subsection = subsection_;
   MAO_ASSERT(subsection);
   if (subsection->first_entry() == this) {
     subsection->set_first_entry(entry);
@@ -551,9 +590,13 @@ void MaoEntry::LinkBefore(MaoEntry *entry) {
 // are inserted at the end of such a unit.
 void MaoEntry::LinkAfter(MaoEntry *entry) {
   MAO_ASSERT(entry != NULL);
+  // The next entry may be outside of the function, see
+  // MaoFunctionPassManager::Go().
+  MaoMutexLock lock(maounit_->mutex());
 
   // Find the last entry in the chain.
   MaoEntry *last_entry = GetLastEntry(entry);
+  AdoptChain(entry, last_entry);
 
   last_entry->set_next(next());
   entry->set_prev(this);
@@ -563,14 +606,14 @@ void MaoEntry::LinkAfter(MaoEntry *entry) {
   set_next(entry);
 
   // Do we need to update the function?
-  Function *function = maounit_->GetFunction(this);
+  Function *function = function_;
   if (function &&  // Not all entries are part of a function.
       function->last_entry() == this) {
     function->set_last_entry(last_entry);
   }
 
   // Do we need to update the subsection?
-  SubSection *subsection = maounit_->GetSubSection(this);
+  SubSection *subsection = subsection_;
   MAO_ASSERT(subsection);
   if (subsection->last_entry() == this) {
     subsection->set_last_entry(last_entry);
@@ -664,12 +707,19 @@ InstructionEntry *MaoEntry::prevInstruction() {
 // Class: LabelEntry
 //
 
-void LabelEntry::PrintEntry(FILE *out) const {
+LabelEntry::LabelEntry(const char *const name,
+                       unsigned int line_number,
+                       const char *const line_verbatim,
+                       MaoUnit *maounit)
+    : MaoEntry(line_number, line_verbatim, maounit),
+      name_(maounit->strings()->Intern(name)), from_assembly_(true) { }
+
+std::string &LabelEntry::EntryToString(std::string *out) const {
   MAO_ASSERT(name_);
-  std::string s;
-  ToString(&s);
-  MaoEntry::SourceInfoToString(&s);
-  fprintf(out, "%s\n", s.c_str());
+  ToString(out);
+  SourceInfoToString(out);
+  out->append("\n");
+  return *out;
 }
 
 
@@ -779,14 +829,14 @@ const char *DirectiveEntry::GetOperandSeparator() const {
   return ", ";
 }
 
-void DirectiveEntry::PrintEntry(::FILE *out) const {
-  std::string s;
-  s.append("\t");
-  s.append(GetOpcodeName());
-  s.append("\t");
-  OperandsToString(&s, GetOperandSeparator());
-  SourceInfoToString(&s);
-  fprintf(out, "%s\n", s.c_str());
+std::string &DirectiveEntry::EntryToString(std::string *out) const {
+  out->append("\t");
+  out->append(GetOpcodeName());
+  out->append("\t");
+  OperandsToString(out, GetOperandSeparator());
+  SourceInfoToString(out);
+  out->append("\n");
+  return *out;
 }
 
 std::string &DirectiveEntry::ToString(std::string *out) const {
@@ -825,12 +875,9 @@ const std::string &DirectiveEntry::OperandToString(const Operand &operand,
     case STRING:
       out->append(operand.data.str->c_str());
       break;
-    case INT: {
-      std::ostringstream int_string;
-      int_string << operand.data.i;
-      out->append(int_string.str());
+    case INT:
+      AppendInt(operand.data.i, out);
       break;
-    }
     case SYMBOL:
       out->append(S_GET_NAME(operand.data.sym));
       break;
@@ -840,10 +887,8 @@ const std::string &DirectiveEntry::OperandToString(const Operand &operand,
     case EXPRESSION_RELOC:
       ExpressionToString(operand.data.expr_reloc.expr, out);
       // Append the relocation to the string here!
-      if (operand.data.expr_reloc.reloc != _dummy_first_bfd_reloc_code_real) {
-        std::string reloc;
-        out->append(RelocToString(operand.data.expr_reloc.reloc, &reloc));
-      }
+      if (operand.data.expr_reloc.reloc != _dummy_first_bfd_reloc_code_real)
+        RelocToString(operand.data.expr_reloc.reloc, out);
       break;
     case EMPTY_OPERAND:
       // Nothing to do
@@ -1022,6 +1067,7 @@ int InstructionEntry::AddPrefix(unsigned int prefix) {
     if (!instruction_->prefix[q])
       ++instruction_->prefixes;
     instruction_->prefix[q] |= prefix;
+    InvalidateSize();
   } else {
     MAO_ASSERT_MSG(false, "same type of prefix used twice");
   }
@@ -1035,11 +1081,13 @@ InstructionEntry::InstructionEntry(i386_insn *instruction,
                                    const char* line_verbatim,
                                    MaoUnit *maounit) :
     MaoEntry(line_number, line_verbatim, maounit), code_flag_(code_flag),
-    execution_count_valid_(false), execution_count_(0) {
+    execution_count_valid_(false), execution_count_(0),
+    size_(kUnknownSize), size_relaxable_(false) {
   op_ = GetOpcode(instruction->tm.name);
   MAO_ASSERT(op_ != OP_invalid);
   MAO_ASSERT(instruction);
   instruction_ = CreateInstructionCopy(instruction);
+  MaoMemory::Allocated(MaoMemory::I386_INSN, sizeof(i386_insn));
 
   // Here we can make sure that the prefixes are correct!
   unsigned int prefix;
@@ -1073,17 +1121,18 @@ InstructionEntry::InstructionEntry(i386_insn *instruction,
   }
 }
 
+// The instruction and its expressions live in the arena of the unit.
 InstructionEntry::~InstructionEntry() {
   MAO_ASSERT(instruction_);
-  FreeInstruction();
+  MaoMemory::Freed(MaoMemory::I386_INSN, sizeof(i386_insn));
 }
 
-void InstructionEntry::PrintEntry(FILE *out) const {
-  std::string s;
-  InstructionToString(&s);
-  ProfileToString(&s);
-  SourceInfoToString(&s);
-  fprintf(out, "%s\n", s.c_str());
+std::string &InstructionEntry::EntryToString(std::string *out) const {
+  InstructionToString(out);
+  ProfileToString(out);
+  SourceInfoToString(out);
+  out->append("\n");
+  return *out;
 }
 
 
@@ -1110,47 +1159,6 @@ const char *InstructionEntry::op_str() const {
   return(instruction_->tm.name);
 }
 
-// This deallocates memory allocated in CreateInstructionCopy().
-void InstructionEntry::FreeInstruction() {
-  MAO_ASSERT(instruction_);
-  for (unsigned int i = 0; i < instruction_->operands; i++) {
-    if (IsImmediateOperand(instruction_, i)) {
-      delete instruction_->op[i].imms;
-    }
-    if (IsMemOperand(instruction_, i)) {
-      delete instruction_->op[i].disps;
-    }
-  }
-  for (unsigned int i = 0; i < 2; i++) {
-    delete instruction_->seg[i];
-  }
-
-  // Registers are shared, and should not be freed.
-  //   - instruction_->base_reg;
-  //   - instruction_->index_reg;
-  //   - instruction_->op[*].regs;
-
-  delete instruction_;
-}
-
-bool InstructionEntry::IsPredicated() const {
-  const MaoOpcode opcode_is_predicated[] =  {
-    OP_cmovo,   OP_cmovno,  OP_cmovb,   OP_cmovc,    OP_cmovnae,
-    OP_cmovae,  OP_cmovnc,  OP_cmovnb,  OP_cmove,    OP_cmovz,
-    OP_cmovne,  OP_cmovnz,  OP_cmovbe,  OP_cmovna,   OP_cmova,
-    OP_cmovnbe, OP_cmovs,   OP_cmovns,  OP_cmovp,    OP_cmovnp,
-    OP_cmovl,   OP_cmovnge, OP_cmovge,  OP_cmovnl,   OP_cmovle,
-    OP_cmovng,  OP_cmovg,   OP_cmovnle, OP_fcmovb,   OP_fcmovnae,
-    OP_fcmove,  OP_fcmovbe, OP_fcmovna, OP_fcmovu,   OP_fcmovae,
-    OP_fcmovnb, OP_fcmovne, OP_fcmova,  OP_fcmovnbe, OP_fcmovnu
-  };
-
-  if (IsInList(op(), opcode_is_predicated,
-               sizeof(opcode_is_predicated)/sizeof(MaoOpcode)))
-    return true;
-  return false;
-}
-
 bool InstructionEntry::IsMemOperand(const i386_insn *instruction,
                                   const unsigned int op_index) {
   MAO_ASSERT(instruction->operands > op_index);
@@ -1256,11 +1264,37 @@ void InstructionEntry::SetImmediateIntOperand(const unsigned int op_index,
       ins->types[op_index].bitfield.imm64 = 1;
       break;
   }
-  if (ins->op[op_index].imms)
-    delete ins->op[op_index].imms;
-  ins->op[op_index].imms = new expressionS();
+  ins->op[op_index].imms = static_cast<expressionS *>(
+      maounit_->arena()->AllocateZeroed(sizeof(expressionS)));
   ins->op[op_index].imms->X_op = O_constant;
   ins->op[op_index].imms->X_add_number = value;
+  InvalidateSize();
+}
+
+void InstructionEntry::SetImmediateExpression(const unsigned int op_index,
+                                              const expressionS &value) {
+  MAO_ASSERT(instruction_->operands > op_index &&
+             instruction_->op[op_index].imms != NULL);
+  *instruction_->op[op_index].imms = value;
+  InvalidateSize();
+}
+
+std::pair<int, bool> InstructionEntry::SizeOfInstruction() {
+  if (size_ == kUnknownSize) {
+    X86InstructionSizeHelper size_helper(instruction_);
+    std::pair<int, bool> size = size_helper.SizeOfInstruction(code_flag_);
+    size_ = size.first;
+    size_relaxable_ = size.second;
+  }
+  return std::make_pair(size_, size_relaxable_);
+}
+
+bool InstructionEntry::CachedSizeIsCurrent() const {
+  if (size_ == kUnknownSize)
+    return true;
+  X86InstructionSizeHelper size_helper(instruction_);
+  std::pair<int, bool> size = size_helper.SizeOfInstruction(code_flag_);
+  return size.first == size_ && size.second == size_relaxable_;
 }
 
 
@@ -1268,7 +1302,8 @@ void InstructionEntry::SetImmediateIntOperand(const unsigned int op_index,
 expressionS *InstructionEntry::CreateExpressionCopy(expressionS *in_exp) {
   if (!in_exp)
     return NULL;
-  expressionS *new_exp = new expressionS;
+  expressionS *new_exp = static_cast<expressionS *>(
+      maounit_->arena()->Allocate(sizeof(expressionS)));
   memcpy(new_exp, in_exp, sizeof(expressionS));
   MAO_ASSERT(new_exp->X_add_number == in_exp->X_add_number);
   return new_exp;
@@ -1402,6 +1437,7 @@ void InstructionEntry::SetOperand(int op1,
     i1->log2_scale_factor = i2->log2_scale_factor;
   }
   i1->reloc[op1] = i2->reloc[op2];
+  InvalidateSize();
 }
 
 bool InstructionEntry::CompareMemOperand(int op1,
@@ -1471,8 +1507,6 @@ bool InstructionEntry::CompareMemOperand(int op1,
 // segment-override:signed-offset(base,index,scale)
 std::string &InstructionEntry::MemoryOperandToString(std::string *out,
                                                      int op_index) const {
-  std::ostringstream string_stream;
-
   // Find out the correct segment index. The index is based on the number
   // of memory operands in the instruction.
   int seg_index = op_index;
@@ -1493,7 +1527,7 @@ std::string &InstructionEntry::MemoryOperandToString(std::string *out,
   int scale[] = { 1, 2, 4, 8 };
 
   if (jumpabsolute) {
-    string_stream << "*";
+    out->append("*");
   }
 
   // segment-override:
@@ -1502,11 +1536,11 @@ std::string &InstructionEntry::MemoryOperandToString(std::string *out,
     // incorrectly gives ds as the segement. We need to work
     // around this here. See tc-i386.c check_string() for details.
     if (instruction_->tm.operand_types[op_index].bitfield.esseg) {
-      string_stream << "%es:";
+      out->append("%es:");
     } else {
-      string_stream << "%"
-                    << segment_override
-                    << ":";
+      out->append("%");
+      out->append(segment_override);
+      out->append(":");
     }
   }
 
@@ -1517,9 +1551,7 @@ std::string &InstructionEntry::MemoryOperandToString(std::string *out,
       operand_type.bitfield.disp32s ||
       operand_type.bitfield.disp64) {
     const enum bfd_reloc_code_real reloc = instruction_->reloc[op_index];
-    std::string expr_string;
-    ExpressionToStringDisp(expr, &expr_string, &reloc);
-    string_stream << expr_string;
+    ExpressionToStringDisp(expr, out, &reloc);
   }
 
   // (base,index,scale)
@@ -1566,20 +1598,21 @@ std::string &InstructionEntry::MemoryOperandToString(std::string *out,
 
 
   if (instruction_->base_reg || instruction_->index_reg)
-    string_stream << "(";
-  if (instruction_->base_reg)
-    string_stream << "%"
-                  << base_reg_name;
-  if (instruction_->index_reg)
-    string_stream << ",%"
-                  << instruction_->index_reg->reg_name;
-  if (instruction_->log2_scale_factor)
-    string_stream << ","
-                  << scale[instruction_->log2_scale_factor];
+    out->append("(");
+  if (instruction_->base_reg) {
+    out->append("%");
+    out->append(base_reg_name);
+  }
+  if (instruction_->index_reg) {
+    out->append(",%");
+    out->append(instruction_->index_reg->reg_name);
+  }
+  if (instruction_->log2_scale_factor) {
+    out->append(",");
+    AppendInt(scale[instruction_->log2_scale_factor], out);
+  }
   if (instruction_->base_reg || instruction_->index_reg)
-    string_stream << ")";
-
-  out->append(string_stream.str());
+    out->append(")");
   return *out;
 }
 
@@ -1622,6 +1655,8 @@ InstructionEntry::GetAssemblyInstructionName(std::string *out) const {
   #endif
 
   bool no_suffix = false;
+  // The name is appended to what is already in out.
+  const size_t name_start = out->size();
 
   // fdiv and fsub have different opcodes in intel and at&t syntax. They
   // are also bug-compatible with older compilers/tools, making the
@@ -1631,28 +1666,28 @@ InstructionEntry::GetAssemblyInstructionName(std::string *out) const {
   // syntax that we output, we need to handle these instruction
   // in a special way.
   if (instruction_->tm.base_opcode >= 0xdcf8 &&
-      instruction_->tm.base_opcode <= (0xdcf8 + 7)) *out = "fdivr";
+      instruction_->tm.base_opcode <= (0xdcf8 + 7)) out->append("fdivr");
   else if (instruction_->tm.base_opcode >= 0xdcf0 &&
-           instruction_->tm.base_opcode <= (0xdcf0 + 7)) *out = "fdiv";
+           instruction_->tm.base_opcode <= (0xdcf0 + 7)) out->append("fdiv");
   else if (instruction_->tm.base_opcode >= 0xdef8 &&
-           instruction_->tm.base_opcode <= (0xdef8 + 7)) *out = "fdivrp";
+           instruction_->tm.base_opcode <= (0xdef8 + 7)) out->append("fdivrp");
   else if (instruction_->tm.base_opcode >= 0xdef0 &&
-           instruction_->tm.base_opcode <= (0xdef0 + 7)) *out = "fdivp";
+           instruction_->tm.base_opcode <= (0xdef0 + 7)) out->append("fdivp");
   else if (instruction_->tm.base_opcode >= 0xdce8 &&
-           instruction_->tm.base_opcode <= (0xdce8 + 7)) *out = "fsubr";
+           instruction_->tm.base_opcode <= (0xdce8 + 7)) out->append("fsubr");
   else if (instruction_->tm.base_opcode >= 0xdce0 &&
-           instruction_->tm.base_opcode <= (0xdce0 + 7)) *out = "fsub";
+           instruction_->tm.base_opcode <= (0xdce0 + 7)) out->append("fsub");
   else if (instruction_->tm.base_opcode >= 0xdee8 &&
-           instruction_->tm.base_opcode <= (0xdee8 + 7)) *out = "fsubrp";
+           instruction_->tm.base_opcode <= (0xdee8 + 7)) out->append("fsubrp");
   else if (instruction_->tm.base_opcode >= 0xdee0 &&
-           instruction_->tm.base_opcode <= (0xdee0 + 7)) *out = "fsubp";
-  else if (instruction_->tm.base_opcode == 0xfbe) *out = "movsb";
-  else if (instruction_->tm.base_opcode == 0xfbf) *out = "movsw";
+           instruction_->tm.base_opcode <= (0xdee0 + 7)) out->append("fsubp");
+  else if (instruction_->tm.base_opcode == 0xfbe) out->append("movsb");
+  else if (instruction_->tm.base_opcode == 0xfbf) out->append("movsw");
   else if (instruction_->tm.base_opcode == 0x63 &&
            ((GetRexPrefix() & REX_W) || op() == OP_movsx))
-    *out = "movsl";
-  else if (instruction_->tm.base_opcode == 0xfb6) *out = "movzb";
-  else if (instruction_->tm.base_opcode == 0xfb7) *out = "movzw";
+    out->append("movsl");
+  else if (instruction_->tm.base_opcode == 0xfb6) out->append("movzb");
+  else if (instruction_->tm.base_opcode == 0xfb7) out->append("movzw");
   else
     out->append(instruction_->tm.name);
 
@@ -1668,7 +1703,7 @@ InstructionEntry::GetAssemblyInstructionName(std::string *out) const {
       };
       if (!IsInList(op(), supress_l_prefix,
                     sizeof(supress_l_prefix)/sizeof(MaoOpcode))) {
-        out->insert(out->begin(), 'l');
+        out->insert(out->begin() + name_start, 'l');
       }
       // For these instructions, the suggested l prefix should
       // be translated to a t suffix.
@@ -2105,9 +2140,7 @@ std::string &InstructionEntry::InstructionToString(std::string *out) const {
 
   // Gets the name of the assembly instruction, including
   // suffixes.
-  std::string instruction_name;
-  GetAssemblyInstructionName(&instruction_name);
-  out->append(instruction_name);
+  GetAssemblyInstructionName(out);
   out->append("\t");
 
   // Loop over operands
@@ -2184,17 +2217,19 @@ std::string &InstructionEntry::InstructionToString(std::string *out) const {
 }
 
 std::string &InstructionEntry::ProfileToString(std::string *out) const {
-  std::ostringstream string_stream;
-  if (execution_count_valid_)
-    string_stream << "\t# ecount=" << execution_count_;
-  out->append(string_stream.str());
+  if (execution_count_valid_) {
+    out->append("\t# ecount=");
+    AppendInt(execution_count_, out);
+  }
   return *out;
 }
 
-// From an instruction given by gas, allocate new memory and populate the
-// members.
+// From an instruction given by gas, allocate new memory in the arena of the
+// unit and populate the members. Registers are shared, and not copied.
 i386_insn *InstructionEntry::CreateInstructionCopy(i386_insn *in_inst) {
-  i386_insn *new_inst = new i386_insn;
+  MaoArena *arena = maounit_->arena();
+  i386_insn *new_inst =
+      static_cast<i386_insn *>(arena->Allocate(sizeof(i386_insn)));
   MAO_ASSERT(new_inst);
 
   // Copy all non-pointer data
@@ -2204,12 +2239,12 @@ i386_insn *InstructionEntry::CreateInstructionCopy(i386_insn *in_inst) {
   for (unsigned int i = 0; i < new_inst->operands; i++) {
     // Select the correct part of the operand union.
     if (IsImmediateOperand(in_inst, i)) {
-      new_inst->op[i].imms = new expressionS;
-      MAO_ASSERT(new_inst->op[i].imms);
+      new_inst->op[i].imms =
+          static_cast<expressionS *>(arena->Allocate(sizeof(expressionS)));
       *new_inst->op[i].imms = *in_inst->op[i].imms;
     } else if (IsMemOperand(in_inst, i) && in_inst->op[i].disps) {
-      new_inst->op[i].disps = new expressionS;
-      MAO_ASSERT(new_inst->op[i].disps);
+      new_inst->op[i].disps =
+          static_cast<expressionS *>(arena->Allocate(sizeof(expressionS)));
       *new_inst->op[i].disps = *in_inst->op[i].disps;
     } else if (IsRegisterOperand(in_inst, i)) {
       new_inst->op[i].regs = in_inst->op[i].regs;
@@ -2221,10 +2256,10 @@ i386_insn *InstructionEntry::CreateInstructionCopy(i386_insn *in_inst) {
   // Segment overrides
   for (unsigned int i = 0; i < 2; i++) {
     if (in_inst->seg[i]) {
-      seg_entry *tmp_seg = new seg_entry;
-      MAO_ASSERT(tmp_seg);
+      seg_entry *tmp_seg =
+          static_cast<seg_entry *>(arena->Allocate(sizeof(seg_entry)));
       MAO_ASSERT(strlen(in_inst->seg[i]->seg_name) < MAX_SEGMENT_NAME_LENGTH);
-      tmp_seg->seg_name = strdup(in_inst->seg[i]->seg_name);
+      tmp_seg->seg_name = arena->StrDup(in_inst->seg[i]->seg_name);
       tmp_seg->seg_prefix = in_inst->seg[i]->seg_prefix;
       new_inst->seg[i] = tmp_seg;
     }
@@ -2243,24 +2278,6 @@ bool InstructionEntry::IsInList(MaoOpcode opcode, const MaoOpcode list[],
 }
 
 
-bool InstructionEntry::HasFallThrough() const {
-  if (IsReturn()) return false;
-  if (!HasTarget()) return true;
-  if (IsCall()) return true;
-  if (IsCondJump()) return true;
-  return false;
-}
-
-bool InstructionEntry::HasTarget() const {
-  const MaoOpcode insn[] = {OP_jmp, OP_ljmp};
-  if (IsInList(op(), insn, sizeof(insn)/sizeof(MaoOpcode)))
-    return true;
-  if (IsCondJump())
-    return true;
-
-  return false;
-}
-
 const char *InstructionEntry::GetTarget() const {
   //
   for (unsigned int i =0; i < instruction_->operands; i++) {
@@ -2281,13 +2298,6 @@ const char *InstructionEntry::GetTarget() const {
 }
 
 
-bool InstructionEntry::IsJump() const {
-  const MaoOpcode jumps[] = {
-    OP_jmp, OP_ljmp
-  };
-  return IsInList(op(), jumps, sizeof(jumps)/sizeof(MaoOpcode));
-}
-
 bool InstructionEntry::IsIndirectJump() const {
   // Jump instructions always have one operand
   MAO_ASSERT(!IsJump() || instruction_->operands == 1);
@@ -2296,30 +2306,6 @@ bool InstructionEntry::IsIndirectJump() const {
 }
 
 
-bool InstructionEntry::IsCondJump() const {
-  static const MaoOpcode cond_jumps[] = {
-    // Conditional jumps.
-    OP_jo,  OP_jno, OP_jb,   OP_jc,  OP_jnae, OP_jnb,  OP_jnc, OP_jae, OP_je,
-    OP_jz,  OP_jne, OP_jnz,  OP_jbe, OP_jna,  OP_jnbe, OP_ja,  OP_js,  OP_jns,
-    OP_jp,  OP_jpe, OP_jnp,  OP_jpo, OP_jl,   OP_jnge, OP_jnl, OP_jge, OP_jle,
-    OP_jng,  OP_jnle, OP_jg,
-
-    // jcxz vs. jecxz is chosen on the basis of the address size prefix.
-    OP_jcxz, OP_jecxz, OP_jecxz, OP_jrcxz,
-
-    // loop variants
-    OP_loop, OP_loopz, OP_loope, OP_loopnz, OP_loopne
-  };
-  return IsInList(op(), cond_jumps, sizeof(cond_jumps)/sizeof(MaoOpcode));
-}
-
-bool InstructionEntry::IsCall() const {
-  const MaoOpcode calls[] = {
-    OP_call, OP_lcall, OP_vmcall, OP_syscall, OP_vmmcall
-  };
-  return IsInList(op(), calls, sizeof(calls)/sizeof(MaoOpcode));
-}
-
 bool InstructionEntry::IsThunkCall() const {
   if (!IsCall())
     return false;
@@ -2327,13 +2313,6 @@ bool InstructionEntry::IsThunkCall() const {
   return (strstr(target, "get_pc_thunk") != NULL);
 }
 
-bool InstructionEntry::IsReturn() const {
-  const MaoOpcode rets[] = {
-    OP_ret, OP_lret, OP_retf, OP_iret, OP_sysret
-  };
-  return IsInList(op(), rets, sizeof(rets)/sizeof(MaoOpcode));
-}
-
 bool InstructionEntry::IsAdd() const {
   return op() == OP_add;
 }
@@ -41,19 +41,33 @@ extern "C" {
 #include "gen-opcodes.h"
 #include "irlink.h"
 
+#include "MaoArena.h"
 #include "MaoDebug.h"
+#include "MaoMemory.h"
 #include "MaoTypes.h"
 
 // Forward declarations.
 class MaoUnit;
+class Function;
+class SubSection;
 class DirectiveEntry;
 class InstructionEntry;
 class LabelEntry;
 
 // Base class for all types of entries in the MaoUnit. Example of entries
 // are Labels, Directives, and Instructions.
+// Entries are allocated in the arena of their MaoUnit:
+//   new (unit->arena()) LabelEntry(...)
+// The memory is released when the unit is destroyed. Deleting an entry only
+// runs its destructor.
 class MaoEntry {
  public:
+  static void *operator new(size_t size, MaoArena *arena) {
+    return arena->Allocate(size);
+  }
+  static void operator delete(void *entry, MaoArena *arena) { }
+  static void operator delete(void *entry) { }
+
   // Types of possible entries.
   enum EntryType {
     UNDEFINED = 0,
@@ -68,8 +82,11 @@ class MaoEntry {
 
   // Returns a string representation of the entry into out.
   virtual std::string &ToString(std::string *out) const = 0;
+  // Appends the assembly line for the entry, including the trailing newline,
+  // to out. This is the text the assembly pass writes.
+  virtual std::string &EntryToString(std::string *out) const = 0;
   // Prints the entry to FILE *out.
-  virtual void PrintEntry(FILE *out = stderr) const = 0;
+  void PrintEntry(FILE *out = stderr) const;
   // Prints the information corresponding to this entry in the input assembly
   // file.
   std::string &SourceInfoToString(std::string *out) const;
@@ -87,6 +104,15 @@ class MaoEntry {
   // Sets the id of this entry.
   void set_id(const EntryID id) {id_ = id;}
 
+  // Returns the function this entry belongs to, or NULL.
+  Function *function() const { return function_; }
+  // Sets the function this entry belongs to.
+  void set_function(Function *function) { function_ = function; }
+  // Returns the subsection this entry belongs to, or NULL.
+  SubSection *subsection() const { return subsection_; }
+  // Sets the subsection this entry belongs to.
+  void set_subsection(SubSection *subsection) { subsection_ = subsection; }
+
   // Is this an instruction entry?
   bool IsInstruction() const { return Type() == INSTRUCTION; }
   // Is this a label entry?
@@ -137,8 +163,15 @@ class MaoEntry {
                int max_bytes_to_skip = 0);
   // Returns the line number of this entry in the assembly file.
   unsigned int line_number() const { return line_number_; }
-  // Returns the original assembly line verbatim.
-  const char *const line_verbatim() const { return line_verbatim_; }
+  // Returns the original assembly line verbatim. With --mmap-input, this
+  // copies the line out of the input file the first time it is called.
+  const char *const line_verbatim() const;
+  // Returns the original assembly line without copying it. The text is
+  // not NUL terminated. data is NULL if there is no line.
+  MaoStringPiece line_verbatim_span() const;
+  // Makes the entry refer to text in a mapped input file, see
+  // MaoSourceFile. The text must outlive the entry.
+  void set_line_verbatim_span(const char *text, size_t length);
 
   // Returns the symbols name from an expressionS *.
   const char *GetSymbolnameFromExpression(expressionS *expr) const;
@@ -146,11 +179,11 @@ class MaoEntry {
  protected:
   // Helper function to indent.
   void Spaces(unsigned int n, FILE *outfile) const;
-  // Gets symbolname. Understands the temporary symbolname
+  // Appends the symbol name to out. Understands the temporary symbolname
   // that should be translated to a dot.
-  std::string GetDotOrSymbol(symbolS *symbol) const;
+  std::string &DotOrSymbolToString(symbolS *symbol, std::string *out) const;
 
-  // Returns a string representation of a reloc.
+  // Appends the string representation of a reloc to out.
   const std::string &RelocToString(const enum bfd_reloc_code_real reloc,
                                    std::string *out) const;
 
@@ -178,11 +211,21 @@ class MaoEntry {
   MaoEntry *next_;
   MaoEntry *prev_;
 
+  // The function and subsection containing this entry. Kept up to date by
+  // MaoUnit, so that looking them up does not need a map.
+  Function   *function_;
+  SubSection *subsection_;
+
   // Line number assembly was found in the original file.
   const unsigned int line_number_;
+  // The length of line_verbatim_ if it points into a mapped input file,
+  // or kTerminated if it is a NUL terminated copy.
+  mutable unsigned int line_verbatim_length_;
   // A verbatim copy of the assembly instruction this entry is
-  // generated from. Might be NULL for some entries.
-  const char *line_verbatim_;
+  // generated from, or the line holding it in a mapped input file. Might
+  // be NULL for some entries.
+  mutable const char *line_verbatim_;
+  static const unsigned int kTerminated = ~0U;
 
   // This flag is true for entries that have been added
   // by mao.
@@ -200,23 +243,25 @@ class MaoEntry {
 
   // Return the last entry in a chain.
   MaoEntry *GetLastEntry(MaoEntry *entry) const;
+  // Places the entries from first to last (both inclusive) in the function
+  // and subsection of this entry, unless they already belong to one.
+  void AdoptChain(MaoEntry *first, MaoEntry *last) const;
 };
 
 // Class to represent a label in an assembly file.
-class LabelEntry : public MaoEntry {
+class LabelEntry
+    : public MaoEntry,
+      public MaoMemoryTracked<LabelEntry, MaoMemory::LABEL_ENTRY> {
  public:
   LabelEntry(const char *const name,
              unsigned int line_number,
              const char *const line_verbatim,
-             MaoUnit *maounit)
-      : MaoEntry(line_number, line_verbatim, maounit),
-        name_(strdup(name)), from_assembly_(true) { }
-  ~LabelEntry() { delete name_; }
+             MaoUnit *maounit);
 
   // Returns the string form of this label.
   virtual std::string &ToString(std::string *out) const;
-  // Prints the label entry.
-  virtual void PrintEntry(FILE *out = stderr) const;
+  // Appends the assembly line for the label entry to out.
+  virtual std::string &EntryToString(std::string *out) const;
   // Prints the internal representation of this label entry.
   virtual void PrintIR(FILE *out) const;
   virtual EntryType Type() const { return LABEL; }
@@ -239,7 +284,9 @@ class LabelEntry : public MaoEntry {
 };
 
 // Class to represent assembler directives.
-class DirectiveEntry : public MaoEntry {
+class DirectiveEntry
+    : public MaoEntry,
+      public MaoMemoryTracked<DirectiveEntry, MaoMemory::DIRECTIVE_ENTRY> {
   // examples of directives:
   //  .file "filename.c"
   //  .text
@@ -430,8 +477,8 @@ class DirectiveEntry : public MaoEntry {
 
   // Returns a string representation of this directive entry.
   virtual std::string &ToString(std::string *out) const;
-  // Prints this directive entry to FILE *out.
-  virtual void PrintEntry(::FILE *out = stderr) const;
+  // Appends the assembly line for this directive entry to out.
+  virtual std::string &EntryToString(std::string *out) const;
   // Prints this directive entry to FILE *out.
   virtual void PrintIR(::FILE *out) const;
   virtual MaoEntry::EntryType  Type() const;
@@ -471,7 +518,10 @@ class DirectiveEntry : public MaoEntry {
 
 
 // Class to represent an assembly instruction.
-class InstructionEntry : public MaoEntry {
+class InstructionEntry
+    : public MaoEntry,
+      public MaoMemoryTracked<InstructionEntry,
+                              MaoMemory::INSTRUCTION_ENTRY> {
  public:
   static const unsigned int kMaxRegisterNameLength = MAX_REGISTER_NAME_LENGTH;
 
@@ -481,8 +531,8 @@ class InstructionEntry : public MaoEntry {
   ~InstructionEntry();
   // Returns a string representation of this instruction entry.
   virtual std::string &ToString(std::string *out) const;
-  // Prints this instruction  entry into FILE *out.
-  virtual void PrintEntry(FILE *out = stderr) const;
+  // Appends the assembly line for this instruction entry to out.
+  virtual std::string &EntryToString(std::string *out) const;
   // Prints the internal representation of this instruction.
   virtual void PrintIR(FILE *out) const;
   virtual MaoEntry::EntryType  Type() const;
@@ -512,31 +562,41 @@ class InstructionEntry : public MaoEntry {
   // Returns the opcode of this instruction.
   MaoOpcode   op() const { return op_; }
   // Sets the opcode of this instruction.
-  void        set_op(MaoOpcode op) { op_ = op; }
+  void        set_op(MaoOpcode op) { op_ = op; InvalidateSize(); }
 
   // Property methods.
   //
+  // Returns if the opcode has any of the given MaoOpcodeProperty bits.
+  // The properties are generated by GenOpcodes.
+  bool HasOpcodeProperty(unsigned int properties) const {
+    return MaoOpcodeProperties[op()] & properties;
+  }
   // Returns if this instruction has a target label.
-  bool HasTarget() const;
+  bool HasTarget() const {
+    return HasOpcodeProperty(OPP_JUMP | OPP_COND_JUMP);
+  }
   // Returns if this instruction has a fallthrough (another instruction that
   // follows it to which control can get transfered after this instruction).
-  bool HasFallThrough() const;
+  bool HasFallThrough() const {
+    return !HasOpcodeProperty(OPP_JUMP | OPP_RETURN);
+  }
   // Returns if this is a control transfer instruction.
   bool IsControlTransfer() const {
-    return HasTarget() || IsCall() || IsReturn();
+    return HasOpcodeProperty(OPP_JUMP | OPP_COND_JUMP | OPP_CALL |
+                             OPP_RETURN);
   }
   // Returns if this is an indirect jump instruction.
   bool IsIndirectJump() const;
   // Returns if this is a conditional jump instruction.
-  bool IsCondJump() const;
+  bool IsCondJump() const { return HasOpcodeProperty(OPP_COND_JUMP); }
   // Returns if this is a jump instruction.
-  bool IsJump() const;
+  bool IsJump() const { return HasOpcodeProperty(OPP_JUMP); }
   // Returns if this is a call instruction.
-  bool IsCall() const;
+  bool IsCall() const { return HasOpcodeProperty(OPP_CALL); }
   // Returns if this is a 'thunk call' (one used to find the current IP).
   bool IsThunkCall() const;
   // Returns if this is a return instruction.
-  bool IsReturn() const;
+  bool IsReturn() const { return HasOpcodeProperty(OPP_RETURN); }
   // Returns if this is an add instruction.
   bool IsAdd() const;
   // Returns if this is a move instruction.
@@ -546,7 +606,7 @@ class InstructionEntry : public MaoEntry {
   // Returns if this is a lock instruction.
   bool IsLock() const { return op() == OP_lock; }
   // Returns if this is a predicated instruction (conditional moves).
-  bool IsPredicated() const;
+  bool IsPredicated() const { return HasOpcodeProperty(OPP_PREDICATED); }
 
   // Returns the number of operands to this instruction.
   int NumOperands() const {
@@ -647,6 +707,13 @@ class InstructionEntry : public MaoEntry {
     MAO_ASSERT(HasDisplacement(op_index));
     return instruction_->op[op_index].disps;
   }
+  // Replaces the displacement field of this instruction. disp must
+  // outlive the instruction.
+  void SetDisplacement(const int op_index, expressionS *disp) {
+    MAO_ASSERT(HasDisplacement(op_index));
+    instruction_->op[op_index].disps = disp;
+    InvalidateSize();
+  }
   // Returns if the op1 operand of this instruction and the op2 operand of
   // instruction i2 are both memory operands and they are equal.
   bool CompareMemOperand(int op1, InstructionEntry *i2, int op2) const;
@@ -722,6 +789,16 @@ class InstructionEntry : public MaoEntry {
   // Returns the flag that indicates if this is a 64 bit, 32 bit or 16 bit code.
   enum flag_code GetFlag() const { return code_flag_; }
 
+  // Returns the size of the instruction, and if it is a relaxable branch,
+  // as X86InstructionSizeHelper::SizeOfInstruction() does. The size is
+  // cached until a method that changes the instruction is called, so code
+  // must not change instruction() directly.
+  std::pair<int, bool> SizeOfInstruction();
+  // Returns false if the cached size differs from the size of
+  // instruction(), i.e., if the instruction was changed directly. See
+  // the verify_sizes option of RELAX.
+  bool CachedSizeIsCurrent() const;
+
   // Returns 0 if attempting to add a prefix where one from the same
   // class already exists, 1 if non rep/repne added, 2 if rep/repne
   // added.
@@ -750,6 +827,10 @@ class InstructionEntry : public MaoEntry {
   void SetImmediateIntOperand(const unsigned int op_index,
                               int bit_size,
                               int value);
+  // Sets the expression of the immediate operand op_index to value,
+  // keeping its type.
+  void SetImmediateExpression(const unsigned int op_index,
+                              const expressionS &value);
 
  private:
   i386_insn *instruction_;
@@ -765,12 +846,18 @@ class InstructionEntry : public MaoEntry {
   bool execution_count_valid_;
   long execution_count_;
 
-  // Allocates memory for a new instruction and populates it.
-  // The instruction passed from gas might not be allocated
+  // The cached result of SizeOfInstruction(), unless size_ is kUnknownSize.
+  static const int kUnknownSize = -1;
+  int  size_;
+  bool size_relaxable_;
+  // Called by the methods that change the instruction.
+  void InvalidateSize() { size_ = kUnknownSize; }
+
+  // Allocates memory for a new instruction in the arena of the unit and
+  // populates it. The instruction passed from gas might not be allocated
   // until the end of the program.
   i386_insn *CreateInstructionCopy(i386_insn *in_inst);
-  // Allocates memory for a register entry to be used
-  // in the instruction.
+  // Allocates a copy of an expression in the arena of the unit.
   expressionS *CreateExpressionCopy(expressionS *in_exp);
   bool EqualExpressions(expressionS *expression1,
                         expressionS *expression2) const;
@@ -778,8 +865,6 @@ class InstructionEntry : public MaoEntry {
 
 
   reg_entry *CopyRegEntry(const reg_entry *in_reg);
-  // Frees all allocated memory for this instruction.
-  void FreeInstruction();
   bool IsInList(const MaoOpcode opcode, const MaoOpcode list[],
                 const unsigned int number_of_elements) const;
   std::string &MemoryOperandToString(std::string *out,
@@ -790,7 +875,7 @@ class InstructionEntry : public MaoEntry {
   std::string &PrintRexPrefix(std::string *out, int prefix) const;
   unsigned char GetRexPrefix() const;
 
-  // Returns the instruction op string, including any suffix.
+  // Appends the instruction op string, including any suffix, to out.
   std::string &GetAssemblyInstructionName(std::string *out) const;
 };
 // An iterator over list of entries. This class uses the prev/next of the
@@ -61,10 +61,20 @@ void Function::Print(FILE *out) {
 }
 
 void Function::set_cfg(CFG *cfg) {
+  // The loop structure graph, the dominator trees and the dataflow results
+  // refer to the blocks of the previous CFG.
+  set_lsg(NULL);
+  set_dominators(ANALYSIS_DOMINATORS, NULL);
+  set_dominators(ANALYSIS_POST_DOMINATORS, NULL);
+  for (int i = 0; i < kNumDataFlowAnalyses; ++i)
+    set_dataflow(static_cast<MaoAnalysisKind>(ANALYSIS_LIVENESS + i), NULL);
   // Deallocate any previous CFG.
   if (cfg_ != NULL) {
     delete cfg_;
   }
+  // The arena can only be reused once all CFGs built in it are gone.
+  if (cfg == NULL)
+    cfg_arena_.Reset();
   cfg_ = cfg;
 }
 
@@ -75,3 +85,15 @@ void Function::set_lsg(LoopStructureGraph *lsg) {
   }
   lsg_ = lsg;
 }
+
+void Function::set_dominators(MaoAnalysisKind kind, DominatorTree *tree) {
+  DominatorTree *&slot = dominators_[DominatorIndex(kind)];
+  delete slot;
+  slot = tree;
+}
+
+void Function::set_dataflow(MaoAnalysisKind kind, DFProblem *problem) {
+  DFProblem *&slot = dataflow_[DataFlowIndex(kind)];
+  delete slot;
+  slot = problem;
+}
@@ -25,12 +25,17 @@
 #ifndef MAOFUNCTION_H_
 #define MAOFUNCTION_H_
 
+#include "MaoAnalysis.h"
 #include "MaoCFG.h"
 #include "MaoEntry.h"
 #include "MaoLoops.h"
 #include "MaoSection.h"
+#include "MaoThreads.h"
 #include "MaoTypes.h"
 
+class DFProblem;
+class DominatorTree;
+
 // Function class
 // A function is defined as a sequence of instructions from a
 // label matching a symbol with the type Function to the next function,
@@ -45,12 +50,16 @@ class Function {
   explicit Function(const std::string &name, const FunctionID id,
                     SubSection *subsection) :
       name_(name), id_(id), first_entry_(NULL), last_entry_(NULL),
-      subsection_(subsection), cfg_(NULL), lsg_(NULL) {}
+      subsection_(subsection), next_label_number_(0),
+      cfg_arena_(kCFGArenaBlockSize), cfg_(NULL), lsg_(NULL) {
+    dominators_[0] = dominators_[1] = NULL;
+    for (int i = 0; i < kNumDataFlowAnalyses; ++i)
+      dataflow_[i] = NULL;
+  }
 
   ~Function() {
     // Deallocate memory.
     set_cfg(NULL);
-    set_lsg(NULL);
   }
   // Sets the first entry of the function.
   void set_first_entry(MaoEntry *entry) { first_entry_ = entry;}
@@ -99,6 +108,10 @@ class Function {
     return subsection_;
   }
 
+  // Returns a new number for a label created by MAO in this function.
+  // Numbering labels per function keeps the generated names independent
+  // of the order in which the functions are processed.
+  int NextLabelNumber() { return next_label_number_++; }
 
  private:
   // These methods are to be used by the respective analyses to cache
@@ -117,6 +130,38 @@ class Function {
                                                         Function *function,
                                                         bool conservative);
 
+  // Returns the dominator tree of the given kind, ANALYSIS_DOMINATORS or
+  // ANALYSIS_POST_DOMINATORS, or NULL.
+  DominatorTree *dominators(MaoAnalysisKind kind) const {
+    return dominators_[DominatorIndex(kind)];
+  }
+  // Sets the dominator tree (NULL for no one) of the given kind.
+  void set_dominators(MaoAnalysisKind kind, DominatorTree *tree);
+  static int DominatorIndex(MaoAnalysisKind kind) {
+    MAO_ASSERT(kind == ANALYSIS_DOMINATORS ||
+               kind == ANALYSIS_POST_DOMINATORS);
+    return kind == ANALYSIS_POST_DOMINATORS;
+  }
+
+  // Returns the solved dataflow problem of the given kind, or NULL.
+  DFProblem *dataflow(MaoAnalysisKind kind) const {
+    return dataflow_[DataFlowIndex(kind)];
+  }
+  // Sets the solved dataflow problem (NULL for no one) of the given kind.
+  void set_dataflow(MaoAnalysisKind kind, DFProblem *problem);
+  static int DataFlowIndex(MaoAnalysisKind kind) {
+    MAO_ASSERT(kind >= ANALYSIS_LIVENESS && kind < NUM_ANALYSES);
+    return kind - ANALYSIS_LIVENESS;
+  }
+  friend class MaoAnalyses;
+
+  // Guards the cached analysis results when passes run on several threads.
+  MaoMutex *cache_mutex() { return &cache_mutex_; }
+
+  // Holds the basic blocks and edges of the CFG. It is reset when the CFG
+  // is dropped.
+  MaoArena *cfg_arena() { return &cfg_arena_; }
+
   // Name of the function, as given by the function symbol.
   const std::string name_;
 
@@ -131,13 +176,25 @@ class Function {
   // Pointer to subsection that this function starts in.
   SubSection *subsection_;
 
+  // Number of the next label created by MAO in this function.
+  int next_label_number_;
+
   /////////////////////////////////////////
   // members populated by analysis passes
 
+  // Most functions have a few dozen basic blocks, which fit in a block.
+  static const size_t kCFGArenaBlockSize = 16 * 1024;
+  MaoArena cfg_arena_;
   // Pointer to CFG, if one is build for the function.
   CFG *cfg_;
   // Pointer to Loop Structure Graph, if one is build for the function.
   LoopStructureGraph *lsg_;
+  // The dominator and post-dominator trees, if computed, see MaoAnalyses.
+  DominatorTree *dominators_[2];
+  // The solved dataflow problems, if computed, see MaoAnalyses.
+  static const int kNumDataFlowAnalyses = NUM_ANALYSES - ANALYSIS_LIVENESS;
+  DFProblem *dataflow_[kNumDataFlowAnalyses];
+  MaoMutex cache_mutex_;
 };
 
 // Convenience macros
@@ -0,0 +1,404 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <algorithm>
+
+#include "Mao.h"
+#include "MaoFunctionCache.h"
+
+// Files start with this tag and the key, which tells stale and partly
+// written files from valid ones, followed by the length of the text that
+// was hashed and that text.
+static const char kFileTag[] = "MAOFC 2 ";
+static const char kFileSuffix[] = ".mao";
+
+// Numbered labels are written as kLabelMark number kLabelMark, the prefix
+// of the labels MAO generates in the function as kGeneratedMark.
+static const char kLabelMark = '\001';
+static const char kGeneratedMark = '\002';
+
+static unsigned long long HashString64(const std::string &text,
+                                       unsigned long long hash) {
+  for (std::string::const_iterator iter = text.begin(); iter != text.end();
+       ++iter) {
+    hash ^= static_cast<unsigned char>(*iter);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Returns a 128 bit hash of text, as hexadecimal digits. The halves are
+// FNV-1a hashes with different offset bases.
+static std::string HashKey(const std::string &text) {
+  unsigned long long low = HashString64(text, 14695981039346656037ULL);
+  unsigned long long high = HashString64(text, ~low ^ 0x6d616f6663616368ULL);
+  char buffer[33];
+  snprintf(buffer, sizeof(buffer), "%016llx%016llx", high, low);
+  return buffer;
+}
+
+// Appends the modification time and size of the file at path to out.
+// Returns false if there is no such file.
+static bool AppendFileIdentity(const char *path, std::string *out) {
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return false;
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), " %lld %lld\n",
+           static_cast<long long>(st.st_mtime),
+           static_cast<long long>(st.st_size));
+  *out += path;
+  *out += buffer;
+  return true;
+}
+
+// Appends the hash of the contents of the file at path to out, or a mark
+// if it cannot be read, in which case the pass reading it fails as well.
+static void AppendFileContents(const std::string &path, std::string *out) {
+  *out += path;
+  FILE *file = fopen(path.c_str(), "r");
+  if (!file) {
+    *out += " unreadable\n";
+    return;
+  }
+  std::string contents;
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    contents.append(buffer, size);
+  fclose(file);
+  *out += ' ';
+  *out += HashKey(contents);
+  *out += '\n';
+}
+
+// Returns the options with the output file of the ASM pass removed, as it
+// does not change the code.
+static std::string OptionsWithoutOutput(const char *options) {
+  std::string result(options ? options : "");
+  static const char kOutput[] = "ASM=o[";
+  size_t pos = 0;
+  while ((pos = result.find(kOutput, pos)) != std::string::npos) {
+    pos += sizeof(kOutput) - 1;
+    size_t end = result.find(']', pos);
+    if (end == std::string::npos)
+      break;
+    result.erase(pos, end - pos);
+  }
+  return result;
+}
+
+static bool IsLabelChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' ||
+      c == '$';
+}
+
+// Returns the prefix of the labels MAO generates in function, see
+// MaoUnit::BBNameGen.
+static std::string GeneratedLabelPrefix(const Function *function) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), ".L__mao_label_%d_", function->id());
+  return buffer;
+}
+
+//
+// Class: MaoFunctionCache
+//
+
+MaoFunctionCache::MaoFunctionCache(MaoUnit *unit, const char *dir,
+                                   long long max_size,
+                                   const std::vector<std::string> &input_files)
+    : unit_(unit), dir_(dir), max_size_(max_size), enabled_(true) {
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    fprintf(stderr, "Unable to create %s\n", dir);
+  configuration_ = MAO_VERSION;
+  configuration_ += unit->Is64BitMode() ? " 64\n" : " 32\n";
+  configuration_ += OptionsWithoutOutput(unit->mao_options()->option_string());
+  configuration_ += '\n';
+
+  // MAO_VERSION does not change with the sources, but the binary is
+  // linked again whenever they do.
+  if (!AppendFileIdentity("/proc/self/exe", &configuration_)) {
+    fprintf(stderr, "Unable to identify the mao binary, not using the "
+            "function cache\n");
+    enabled_ = false;
+  }
+  const std::vector<std::string> &plugins = GetLoadedPlugins();
+  for (std::vector<std::string>::const_iterator iter = plugins.begin();
+       iter != plugins.end(); ++iter) {
+    if (!AppendFileIdentity(iter->c_str(), &configuration_))
+      enabled_ = false;
+  }
+  for (std::vector<std::string>::const_iterator iter = input_files.begin();
+       iter != input_files.end(); ++iter)
+    AppendFileContents(*iter, &configuration_);
+
+  GroupStat *stat = unit->GetStats()->GetGroupStat("FUNCTION_CACHE");
+  hits_ = stat->Counter("hits");
+  misses_ = stat->Counter("misses");
+  stores_ = stat->Counter("stores");
+  evictions_ = stat->Counter("evictions");
+}
+
+void MaoFunctionCache::LookUp() {
+  if (!enabled_)
+    return;
+  for (MaoUnit::ConstFunctionIterator iter = unit_->ConstFunctionBegin();
+       iter != unit_->ConstFunctionEnd(); ++iter) {
+    Function *function = *iter;
+    if (!InOneSubSection(function))
+      continue;
+    CachedFunction &cached = functions_[function];
+
+    std::string text;
+    for (MaoEntry *entry = function->first_entry(); entry;
+         entry = entry->next()) {
+      if (entry->Type() == MaoEntry::LABEL) {
+        const char *name = static_cast<LabelEntry *>(entry)->name();
+        if (name[0] == '.' && name[1] == 'L')
+          cached.labels.push_back(name);
+      }
+      entry->EntryToString(&text);
+      if (entry == function->last_entry())
+        break;
+    }
+    cached.key_text = configuration_;
+    cached.key_text += '\0';
+    cached.key_text += function->GetSection()->name();
+    cached.key_text += '\0';
+    Normalize(function, cached, text, &cached.key_text);
+    cached.key = HashKey(cached.key_text);
+
+    std::string denormalized;
+    if (ReadFile(cached, &cached.text) &&
+        Denormalize(function, cached, cached.text, &denormalized)) {
+      cached.cached = true;
+      // The modification time orders the files for eviction.
+      utime(Path(cached.key).c_str(), NULL);
+      hits_->Inc();
+    } else {
+      cached.text.clear();
+      misses_->Inc();
+    }
+  }
+}
+
+bool MaoFunctionCache::IsCached(const Function *function) const {
+  std::map<const Function *, CachedFunction>::const_iterator iter =
+      functions_.find(function);
+  return iter != functions_.end() && iter->second.cached;
+}
+
+void MaoFunctionCache::PrintFunction(Function *function, std::string *out) {
+  std::map<const Function *, CachedFunction>::iterator iter =
+      functions_.find(function);
+  if (iter != functions_.end() && iter->second.cached) {
+    MAO_RASSERT(Denormalize(function, iter->second, iter->second.text, out));
+    return;
+  }
+
+  std::string text;
+  for (MaoEntry *entry = function->first_entry(); entry;
+       entry = entry->next()) {
+    entry->EntryToString(&text);
+    if (entry == function->last_entry())
+      break;
+  }
+  out->append(text);
+
+  // Functions created by the passes, and functions split over several
+  // subsections, have no key.
+  if (iter == functions_.end() || iter->second.stored)
+    return;
+  CachedFunction &cached = iter->second;
+  char length[32];
+  snprintf(length, sizeof(length), "%lu\n",
+           static_cast<unsigned long>(cached.key_text.size()));
+  std::string file = kFileTag + cached.key + "\n" + length + cached.key_text;
+  Normalize(function, cached, text, &file);
+  if (WriteFile(Path(cached.key), file))
+    stores_->Inc();
+  cached.stored = true;
+}
+
+bool MaoFunctionCache::InOneSubSection(const Function *function) {
+  MaoEntry *first = function->first_entry();
+  for (MaoEntry *entry = first; entry; entry = entry->next()) {
+    if (entry->subsection() != first->subsection())
+      return false;
+    if (entry == function->last_entry())
+      return true;
+  }
+  return false;
+}
+
+void MaoFunctionCache::Evict() {
+  DIR *dir = opendir(dir_.c_str());
+  if (!dir)
+    return;
+  // Pairs of modification time and name, and the total size.
+  std::vector<std::pair<time_t, std::string> > files;
+  std::map<std::string, long long> sizes;
+  long long total_size = 0;
+  size_t suffix_length = sizeof(kFileSuffix) - 1;
+  while (struct dirent *dirent = readdir(dir)) {
+    std::string name(dirent->d_name);
+    if (name.size() <= suffix_length ||
+        name.compare(name.size() - suffix_length, suffix_length,
+                     kFileSuffix) != 0)
+      continue;
+    struct stat st;
+    if (stat((dir_ + "/" + name).c_str(), &st) != 0)
+      continue;
+    files.push_back(std::make_pair(st.st_mtime, name));
+    sizes[name] = st.st_size;
+    total_size += st.st_size;
+  }
+  closedir(dir);
+
+  if (total_size <= max_size_)
+    return;
+  std::sort(files.begin(), files.end());
+  for (std::vector<std::pair<time_t, std::string> >::const_iterator iter =
+           files.begin();
+       iter != files.end() && total_size > max_size_; ++iter) {
+    // Another build may have removed the file already.
+    if (unlink((dir_ + "/" + iter->second).c_str()) == 0)
+      evictions_->Inc();
+    total_size -= sizes[iter->second];
+  }
+}
+
+void MaoFunctionCache::Normalize(const Function *function,
+                                 const CachedFunction &cached,
+                                 const std::string &text,
+                                 std::string *out) const {
+  std::map<std::string, int> numbers;
+  for (int i = cached.labels.size() - 1; i >= 0; --i)
+    numbers[cached.labels[i]] = i;
+  std::string prefix = GeneratedLabelPrefix(function);
+
+  size_t pos = 0;
+  while (pos < text.size()) {
+    if (!IsLabelChar(text[pos])) {
+      out->push_back(text[pos++]);
+      continue;
+    }
+    size_t end = pos;
+    while (end < text.size() && IsLabelChar(text[end]))
+      ++end;
+    std::string token(text, pos, end - pos);
+    std::map<std::string, int>::const_iterator number = numbers.find(token);
+    if (number != numbers.end()) {
+      char buffer[16];
+      snprintf(buffer, sizeof(buffer), "%c%d%c", kLabelMark, number->second,
+               kLabelMark);
+      out->append(buffer);
+    } else if (token.compare(0, prefix.size(), prefix) == 0) {
+      out->push_back(kGeneratedMark);
+      out->append(token, prefix.size(), std::string::npos);
+    } else {
+      out->append(token);
+    }
+    pos = end;
+  }
+}
+
+bool MaoFunctionCache::Denormalize(const Function *function,
+                                   const CachedFunction &cached,
+                                   const std::string &text,
+                                   std::string *out) const {
+  std::string prefix = GeneratedLabelPrefix(function);
+  size_t pos = 0;
+  while (pos < text.size()) {
+    char c = text[pos++];
+    if (c == kGeneratedMark) {
+      out->append(prefix);
+    } else if (c == kLabelMark) {
+      size_t end = text.find(kLabelMark, pos);
+      if (end == std::string::npos)
+        return false;
+      unsigned int number = atoi(text.c_str() + pos);
+      if (number >= cached.labels.size())
+        return false;
+      out->append(cached.labels[number]);
+      pos = end + 1;
+    } else {
+      out->push_back(c);
+    }
+  }
+  return true;
+}
+
+std::string MaoFunctionCache::Path(const std::string &key) const {
+  return dir_ + "/" + key + kFileSuffix;
+}
+
+// Reads the text stored under the key of cached, without the tag line and
+// the key text. Returns false if the stored key text differs.
+bool MaoFunctionCache::ReadFile(const CachedFunction &cached,
+                                std::string *text) const {
+  FILE *file = fopen(Path(cached.key).c_str(), "r");
+  if (!file)
+    return false;
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    text->append(buffer, size);
+  fclose(file);
+
+  char length[32];
+  snprintf(length, sizeof(length), "%lu\n",
+           static_cast<unsigned long>(cached.key_text.size()));
+  std::string header = kFileTag + cached.key + "\n" + length;
+  if (text->compare(0, header.size(), header) != 0 ||
+      text->compare(header.size(), cached.key_text.size(),
+                    cached.key_text) != 0)
+    return false;
+  text->erase(0, header.size() + cached.key_text.size());
+  return true;
+}
+
+// Writes a temporary file and renames it, so that builds running at the
+// same time never read a partly written file.
+bool MaoFunctionCache::WriteFile(const std::string &path,
+                                 const std::string &text) const {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", getpid());
+  std::string temporary = path + suffix;
+  FILE *file = fopen(temporary.c_str(), "w");
+  if (!file)
+    return false;
+  bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+  ok = fclose(file) == 0 && ok;
+  if (ok && rename(temporary.c_str(), path.c_str()) == 0)
+    return true;
+  unlink(temporary.c_str());
+  return false;
+}
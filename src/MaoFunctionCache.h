@@ -0,0 +1,131 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// A cache of optimized functions shared by builds.
+// Classes:
+//   MaoFunctionCache - Looks up and stores the output of functions in a
+//                      directory.
+//
+// With --mao=--function-cache=DIR, each function is keyed by a hash of its
+// entries, as printed, of the mao options, of the contents of the files
+// the passes read, such as profiles, and of the identity of the mao binary
+// and of the loaded plugins, i.e., their modification times and sizes.
+// The hashed text is stored with the function and compared on a hit, so
+// that a collision of the hashes is a miss. On a hit the function passes
+// skip the function, and the ASM pass prints the text stored by the run
+// that optimized it. On a miss the text the ASM pass prints for the
+// function is stored.
+// Local labels defined in the function are numbered in the order they
+// are defined, both in the key and in the stored text, so that a function
+// still hits when the compiler numbers its labels differently, e.g.,
+// because a function before it changed.
+// Function passes that run serially may depend on the layout of the
+// whole unit, or on state such as the seed of rand(), and disable the
+// cache. The output of unit passes for a function is assumed to depend
+// only on that function and on the files they declare with
+// MaoPass::ReadsFile(). Function passes cannot declare files, so the
+// functions_file of SCHEDULER is not part of the key. Functions split
+// over several subsections, e.g., by a jump table in .rodata, are not
+// cached.
+//
+#ifndef MAOFUNCTIONCACHE_H_
+#define MAOFUNCTIONCACHE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+class Function;
+class MaoUnit;
+class StatCounter;
+
+class MaoFunctionCache {
+ public:
+  // Uses the directory dir, creating it if needed. The files in it are
+  // evicted, least recently used first, once they take more than max_size
+  // bytes. input_files are the files the passes read.
+  MaoFunctionCache(MaoUnit *unit, const char *dir, long long max_size,
+                   const std::vector<std::string> &input_files);
+
+  // Computes the keys of the functions of the unit and reads the text of
+  // those that are in the cache. Call before running the passes.
+  void LookUp();
+
+  // Returns true if the text of the function was found by LookUp().
+  // The passes need not run on such functions.
+  bool IsCached(const Function *function) const;
+
+  // Appends the text of the function to out, taking it from the cache if
+  // it was found, and storing it otherwise.
+  void PrintFunction(Function *function, std::string *out);
+
+  // Removes the least recently used files once the directory is too big.
+  void Evict();
+
+  // Returns true if all entries of the function are in one subsection.
+  // Only such functions are cached, as the ASM pass prints the entries of
+  // a subsection in one go.
+  static bool InOneSubSection(const Function *function);
+
+ private:
+  struct CachedFunction {
+    CachedFunction() : cached(false), stored(false) { }
+    // The name of the file holding the function.
+    std::string key;
+    // The text that key is the hash of.
+    std::string key_text;
+    // The local labels defined in the input, in order.
+    std::vector<std::string> labels;
+    // The stored text, with the labels replaced by their numbers.
+    std::string text;
+    bool cached;
+    bool stored;
+  };
+
+  // Replaces the local labels of function in text by their numbers.
+  void Normalize(const Function *function, const CachedFunction &cached,
+                 const std::string &text, std::string *out) const;
+  // Undoes Normalize(). Returns false if text is not valid.
+  bool Denormalize(const Function *function, const CachedFunction &cached,
+                   const std::string &text, std::string *out) const;
+
+  std::string Path(const std::string &key) const;
+  bool ReadFile(const CachedFunction &cached, std::string *text) const;
+  bool WriteFile(const std::string &path, const std::string &text) const;
+
+  MaoUnit *unit_;
+  std::string dir_;
+  long long max_size_;
+  // The mao options, which select and configure the passes, and the
+  // identities of the binaries and input files.
+  std::string configuration_;
+  // False if the identity of the mao binary is unknown, in which case
+  // nothing is looked up or stored.
+  bool enabled_;
+  std::map<const Function *, CachedFunction> functions_;
+
+  StatCounter *hits_;
+  StatCounter *misses_;
+  StatCounter *stores_;
+  StatCounter *evictions_;
+
+  MaoFunctionCache(const MaoFunctionCache &);
+  MaoFunctionCache &operator=(const MaoFunctionCache &);
+};
+
+#endif  // MAOFUNCTIONCACHE_H_
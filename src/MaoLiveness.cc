@@ -22,55 +22,65 @@ Liveness::Liveness(MaoUnit *unit,
                    Function *function,
                    const CFG *cfg)
     : DFProblem(unit, function, cfg, DF_Backward) {
-  // TODO(martint): Now GetRegisterDefMask() returns 256, no matter
-  // how many registers there are. This should be fixed so we dont
-  // waste space. Since we cant compare strings of different length,
-  // we hardcode the num_bits_ to 256 here.
-  // num_bits_ = GetNumberOfRegisters()
-  num_bits_ = 256;
+  // The solver works on BitStrings with one bit per register.
+  num_bits_ = RegisterMask::kNumBits;
+}
+
+// Converts between the register masks used inside the blocks and the
+// bitstrings used by the solver.
+static BitString ToBitString(const RegisterMask &mask) {
+  BitString bits(RegisterMask::kNumBits);
+  for (int i = mask.NextSetBit(0); i != -1; i = mask.NextSetBit(i + 1))
+    bits.Set(i);
+  return bits;
+}
+
+static RegisterMask ToRegisterMask(const BitString &bits) {
+  RegisterMask mask;
+  for (int i = bits.NextSetBit(0); i != -1; i = bits.NextSetBit(i + 1))
+    mask.Set(i);
+  return mask;
 }
 
 // Gen set for Liveness:
 //  - The set of variables used in bb before any assignment.
 BitString Liveness::CreateGenSet(const BasicBlock& bb) {
-  BitString current_set(num_bits_);  // Defaults to no regisers.
+  RegisterMask current_set;  // Defaults to no regisers.
   // Move backwards. remove defs, then add uses
   for (ReverseEntryIterator entry = bb.RevEntryBegin();
        entry != bb.RevEntryEnd(); ++entry) {
     if ((*entry)->IsInstruction()) {
       InstructionEntry *insn = (*entry)->AsInstruction();
-      BitString def_mask = GetRegisterDefMask(insn, true);
-      BitString use_mask = GetRegisterUseMask(insn, true);
-      current_set = Transfer(current_set, use_mask, def_mask);
+      current_set -= GetRegisterDefMask(insn, true);
+      current_set |= GetRegisterUseMask(insn, true);
     }
   }
-  return current_set;
+  return ToBitString(current_set);
 }
 
 // Kill set for Liveness:
 //  - The set of variables assigned a value in bb before any use.
 BitString Liveness::CreateKillSet(const BasicBlock& bb) {
-  BitString current_set(num_bits_);  // Defaults to no regisers.
+  RegisterMask current_set;  // Defaults to no regisers.
   for (ReverseEntryIterator entry = bb.RevEntryBegin();
        entry != bb.RevEntryEnd(); ++entry) {
     if ((*entry)->IsInstruction()) {
       InstructionEntry *insn = (*entry)->AsInstruction();
-      BitString def_mask = GetRegisterDefMask(insn, true);
-      BitString use_mask = GetRegisterUseMask(insn, true);
-      current_set = Transfer(current_set, def_mask, use_mask);
+      current_set -= GetRegisterUseMask(insn, true);
+      current_set |= GetRegisterDefMask(insn, true);
     }
   }
-  return current_set;
+  return ToBitString(current_set);
 }
 
 
 // Return all the registers that are live AFTER the given instruction.
-BitString Liveness::GetLive(const BasicBlock& bb,
-                            const InstructionEntry& insn) {
+RegisterMask Liveness::GetLive(const BasicBlock& bb,
+                               const InstructionEntry& insn) {
   MAO_ASSERT(solved_);
   // Start by getting the end of the bb, then move backwards until we
   // reach insn
-  BitString current_set = GetOutSet(bb);
+  RegisterMask current_set = ToRegisterMask(GetOutSet(bb));
 
   // Use iterators!
   for (ReverseEntryIterator entry = bb.RevEntryBegin();
@@ -81,9 +91,8 @@ BitString Liveness::GetLive(const BasicBlock& bb,
       if (curr_insn == &insn)
         break;
       // remove defs, then add uses
-      BitString def_mask = GetRegisterDefMask(curr_insn, true);
-      BitString use_mask = GetRegisterUseMask(curr_insn, true);
-      current_set = Transfer(current_set, use_mask, def_mask);
+      current_set -= GetRegisterDefMask(curr_insn, true);
+      current_set |= GetRegisterUseMask(curr_insn, true);
     }
   }
   return current_set;
@@ -22,6 +22,7 @@
 
 #include "MaoCFG.h"
 #include "MaoDataFlow.h"
+#include "MaoDefs.h"
 #include "MaoUnit.h"
 #include "MaoUtil.h"
 
@@ -41,17 +42,17 @@ class Liveness : public DFProblem {
            Function *function,
            const CFG *cfg);
   // Returns the live registers of a given instruction.
-  // The information is stored in a bitstring, indexed by register number.
-  // A set bit means the register is live.
-  BitString GetLive(const BasicBlock& bb, const InstructionEntry& insn);
+  // The information is stored in a register mask, indexed by register
+  // number. A set bit means the register is live.
+  RegisterMask GetLive(const BasicBlock& bb, const InstructionEntry& insn);
  private:
   BitString CreateGenSet(const BasicBlock& bb);
   BitString CreateKillSet(const BasicBlock& bb);
 
   BitString GetInitialEntryState() {return BitString(num_bits_);}
 
-  BitString Confluence(const std::set<BitString *> &dataset) const {
-    return Union(dataset);
+  void Confluence(BitString *result, const BitString &data) const {
+    Union(result, data);
   }
 };
 
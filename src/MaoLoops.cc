@@ -16,12 +16,11 @@
 //   Free Software Foundation Inc.,
 //   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
+#include <limits.h>
 #include <stdio.h>
-#include <list>
-#include <map>
-#include <set>
-#include <vector>
 #include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "Mao.h"
 
@@ -31,19 +30,14 @@ namespace {
 // Union/Find algorithm after Tarjan, R.E., 1983, Data Structures
 // and Network Algorithms.
 //
-class UnionFindNode {
+// The nodes are numbered from 0 to size-1, and the sets are kept in a
+// flat array of parent indices.
+//
+class UnionFind {
   public:
-  UnionFindNode() : parent_(NULL), bb_(NULL), loop_(NULL), dfs_(0) {
-  }
-
-  // Initialize this node
-  //
-  void Init(BasicBlock *bb, int dfs_number) {
-    MAO_ASSERT(bb);
-
-    parent_ = this;
-    bb_     = bb;
-    dfs_    = dfs_number;
+  explicit UnionFind(int size) : parent_(size) {
+    for (int i = 0; i < size; ++i)
+      parent_[i] = i;
   }
 
   // Union/Find Algorithm - The find routine
@@ -52,55 +46,31 @@ class UnionFindNode {
   // visited and collapsed once, however, deep nests would still
   // result in significant traversals)
   //
-  UnionFindNode *FindSet() {
-    MAO_ASSERT(parent());
-    MAO_ASSERT(bb());
-
-    typedef std::list<UnionFindNode *> NodeListType;
-    NodeListType nodeList;
-
-    UnionFindNode *node = this;
-    while (node != node->parent()) {
-      if (node->parent() != node->parent()->parent())
-        nodeList.push_back(node);
-      node = node->parent();
+  int FindSet(int node) {
+    int root = node;
+    while (parent_[root] != root)
+      root = parent_[root];
+
+    // Path Compression, all nodes on the path point to the root
+    while (parent_[node] != root) {
+      int next = parent_[node];
+      parent_[node] = root;
+      node = next;
     }
-
-    // Path Compression, all nodes' parents point to the 1st level parent
-    NodeListType::iterator iter = nodeList.begin();
-    NodeListType::iterator end  = nodeList.end();
-    for (; iter != end; iter++)
-      (*iter)->set_parent(node->parent());
-
-    return node;
+    return root;
   }
 
   // Union/Find Algorithm - The union routine
   //
-  // We rely on path compression
+  // Links the set represented by node to the one of parent. We rely on
+  // path compression.
   //
-  void Union(UnionFindNode *B) {
-    MAO_ASSERT(B);
-
-    set_parent(B);
+  void Union(int node, int parent) {
+    parent_[node] = parent;
   }
 
-
-  // Getters/Setters
-  //
-  UnionFindNode *parent() { return parent_; }
-  BasicBlock    *bb()     { return bb_; }
-  SimpleLoop    *loop()   { return loop_; }
-  int            dfs()    { return dfs_; }
-
-  void           set_parent(UnionFindNode *parent) { parent_ = parent; }
-  void           set_loop(SimpleLoop *loop) { loop_ = loop; }
-
   private:
-  UnionFindNode *parent_;
-  BasicBlock    *bb_;
-  SimpleLoop    *loop_;
-  int            dfs_;
+  std::vector<int> parent_;
 };
 
 
@@ -120,12 +90,16 @@ class UnionFindNode {
 //
 //   Most of the variable names and identifiers are taken literally
 //   from this paper (and the original Tarjan paper mentioned above)
+//
+//   All per node data is kept in vectors indexed by the DFS number,
+//   or by the id of the basic block, so that functions with many
+//   thousands of blocks are processed in near linear time.
 //-------------------------------------------------------------------
 
 class HavlakLoopFinder {
  public:
   HavlakLoopFinder(const CFG *cfg, LoopStructureGraph *lsg) :
-    CFG_(cfg), current_(0), lsg_(lsg) {
+    CFG_(cfg), lsg_(lsg) {
     MAO_ASSERT(CFG_);
     MAO_ASSERT(lsg_);
   }
@@ -143,13 +117,14 @@ class HavlakLoopFinder {
     int                size = CFG_->GetNumOfNodes();
     if (!size) return;
 
-    IntSetVector       nonBackPreds(size);
-    IntListVector      backPreds(size);
-    IntVector          header(size);
+    IntVectorVector    nonBackPreds(size);
+    IntVectorVector    backPreds(size);
     CharVector         type(size);
     IntVector          last(size);
-    NodeVector         nodes(size);
-    BasicBlockMap      number;
+    BasicBlockVector   nodes(size);
+    LoopVector         loops(size);
+    IntVector          number(size);
+    UnionFind          sets(size);
     int                w;
 
     // Step a:
@@ -159,24 +134,12 @@ class HavlakLoopFinder {
     //
     for (CFG::BBVector::const_iterator bb_iter = CFG_->Begin();
          bb_iter != CFG_->End(); ++bb_iter) {
-      number[*bb_iter] = kUnvisited;
+      MAO_ASSERT((*bb_iter)->id() < size);
+      number[(*bb_iter)->id()] = kUnvisited;
     }
 
-    current_ = 0;
     DFS(*CFG_->Begin(), &nodes, &number, &last);
 
-    // DEBUG code - leave it in here for now
-    // for (std::list<BasicBlock *>::iterator bb_iter =
-    //       CFG_->GetBasicBlocks()->begin();
-    //     bb_iter != CFG_->GetBasicBlocks()->end(); ++bb_iter) {
-    //  fprintf(stderr,
-    //          "Number[bb%d]=%d last[%d]=%d\n",
-    //          (*bb_iter)->index(), number[*bb_iter],
-    //          (*bb_iter)->index(), last[number[*bb_iter]]
-    //          );
-    // }
-
-
     // Step b:
     //   - iterate over all nodes.
     //
@@ -185,36 +148,37 @@ class HavlakLoopFinder {
     //
     //   - check incoming edges 'v' and add them to either
     //     - the list of backedges (backpreds) or
-    //     - the list of non-backedges (nonBackPreds)
+    //     - the set of non-backedges (nonBackPreds), kept as a sorted
+    //       vector without duplicates
     //
     for (w = 0; w < size; w++) {
-      header[w] = 0;
       type[w] = BB_NONHEADER;
 
-        BasicBlock *node_w = nodes[w].bb();
-        if (!node_w) {
-          type[w] = BB_DEAD;
-          continue;  // dead BB
-        }
+      BasicBlock *node_w = nodes[w];
+      if (!node_w) {
+        type[w] = BB_DEAD;
+        continue;  // dead BB
+      }
 
-        for (BasicBlock::ConstEdgeIterator inedges = node_w->BeginInEdges();
-             inedges != node_w->EndInEdges(); ++inedges) {
-          BasicBlockEdge *edge   = *inedges;
-          BasicBlock     *node_v = edge->source();
+      for (BasicBlock::ConstEdgeIterator inedges = node_w->BeginInEdges();
+           inedges != node_w->EndInEdges(); ++inedges) {
+        BasicBlockEdge *edge   = *inedges;
+        BasicBlock     *node_v = edge->source();
 
-          int v = number[ node_v ];
-          if (v == kUnvisited) continue;  // dead node
+        int v = number[node_v->id()];
+        if (v == kUnvisited) continue;  // dead node
 
-          if (IsAncestor(w, v, last))
-            backPreds[w].push_back(v);
-          else
-            nonBackPreds[w].insert(v);
-        }
+        if (IsAncestor(w, v, last))
+          backPreds[w].push_back(v);
+        else
+          nonBackPreds[w].push_back(v);
+      }
+      std::sort(nonBackPreds[w].begin(), nonBackPreds[w].end());
+      nonBackPreds[w].erase(std::unique(nonBackPreds[w].begin(),
+                                        nonBackPreds[w].end()),
+                            nonBackPreds[w].end());
     }
 
-    // Start node is root of all other loops
-    header[0] = 0;
-
     // Step c:
     //
     // The outer loop, unchanged from Tarjan. It does nothing except
@@ -227,38 +191,44 @@ class HavlakLoopFinder {
     // we ensure that inner loop headers will be processed before the
     // headers for surrounding loops.
     //
+    // Membership in P and in nonBackPreds[w] is tested by marking the
+    // nodes with the current header w.
+    //
+    IntVector P;
+    IntVector in_P(size, -1);
+    IntVector in_nonBackPreds(size, -1);
     for (w = size-1; w >= 0; w--) {
-      NodeList  P;
-      BasicBlock *node_w = nodes[w].bb();
+      BasicBlock *node_w = nodes[w];
       if (!node_w) continue;  // dead BB
 
       // Step d:
-      IntList::iterator back_pred_iter  = backPreds[w].begin();
-      IntList::iterator back_pred_end   = backPreds[w].end();
-      for (; back_pred_iter != back_pred_end; back_pred_iter++) {
+      P.clear();
+      for (IntVector::const_iterator back_pred_iter = backPreds[w].begin();
+           back_pred_iter != backPreds[w].end(); ++back_pred_iter) {
         int v = *back_pred_iter;
-        if ( v!= w)
-          P.push_back(nodes[v].FindSet());
-        else
+        if (v != w) {
+          int x = sets.FindSet(v);
+          if (in_P[x] != w) {
+            in_P[x] = w;
+            P.push_back(x);
+          }
+        } else {
           type[w] = BB_SELF;
+        }
       }
 
-      // copy P to worklist
-      //
-      NodeList worklist;
-      NodeList::iterator niter  = P.begin();
-      NodeList::iterator nend   = P.end();
-      for ( ;  niter != nend; niter++ )
-        worklist.push_back(*niter);
-
-      if ( P.size() != 0 )
+      if (P.size() != 0)
         type[w] = BB_REDUCIBLE;
 
-      // work the list...
+      for (IntVector::const_iterator iter = nonBackPreds[w].begin();
+           iter != nonBackPreds[w].end(); ++iter)
+        in_nonBackPreds[*iter] = w;
+
+      // work the list, which is P itself: every node added to P is
+      // appended to it, and is worked after the ones before it.
       //
-      while (worklist.size()) {
-        UnionFindNode x = *worklist.front();
-        worklist.pop_front();
+      for (size_t worklist = 0; worklist < P.size(); ++worklist) {
+        int x = P[worklist];
 
         // Step e:
         //
@@ -272,28 +242,26 @@ class HavlakLoopFinder {
         // The algorithm has degenerated. Break and
         // return in this case
         //
-        int non_back_size = nonBackPreds[x.dfs()].size();
+        int non_back_size = nonBackPreds[x].size();
         if (non_back_size > kMaxNonBackPreds) {
           lsg_->KillAll();
           return;
         }
 
-        IntSet::iterator non_back_pred_iter = nonBackPreds[x.dfs()].begin();
-        IntSet::iterator non_back_pred_end  = nonBackPreds[x.dfs()].end();
-        for (; non_back_pred_iter != non_back_pred_end; non_back_pred_iter++) {
-          UnionFindNode  y     = nodes[*non_back_pred_iter];
-          UnionFindNode *ydash = y.FindSet();
+        // x is never w, so nonBackPreds[x] does not change in the loop.
+        for (int i = 0; i < non_back_size; ++i) {
+          int ydash = sets.FindSet(nonBackPreds[x][i]);
 
-          if (!IsAncestor(w, ydash->dfs(), last)) {
+          if (!IsAncestor(w, ydash, last)) {
             type[w] = BB_IRREDUCIBLE;
-            nonBackPreds[w].insert(ydash->dfs());
+            if (in_nonBackPreds[ydash] != w) {
+              in_nonBackPreds[ydash] = w;
+              nonBackPreds[w].push_back(ydash);
+            }
           } else {
-            if (ydash->dfs() != w) {
-              NodeList::iterator nfind = find(P.begin(), P.end(), ydash);
-              if (nfind == P.end()) {
-                worklist.push_back(ydash);
-                P.push_back(ydash);
-              }
+            if (ydash != w && in_P[ydash] != w) {
+              in_P[ydash] = w;
+              P.push_back(ydash);
             }
           }
         }
@@ -306,15 +274,13 @@ class HavlakLoopFinder {
         SimpleLoop* loop = lsg_->CreateNewLoop();
 
         loop->set_header(node_w, true);
-        IntList::iterator backp_iter  = backPreds[w].begin();
-        loop->set_bottom(nodes[*backp_iter].bb());
+        loop->set_bottom(nodes[backPreds[w].front()]);
         loop->set_is_reducible(type[w] != BB_IRREDUCIBLE);
 
         // At this point, one can set attributes to the loop, such as:
         //
         // the bottom node:
-        //    IntList::iterator iter  = backPreds[w].begin();
-        //    loop bottom is: nodes[*backp_iter].node);
+        //    nodes[backPreds[w].front()]
         //
         // the number of backedges:
         //    backPreds[w].size()
@@ -324,22 +290,21 @@ class HavlakLoopFinder {
         //
         // TODO(rhundt): Define those interfaces in the Loop Forest
         //
-        nodes[w].set_loop(loop);
+        loops[w] = loop;
 
-        for (niter = P.begin(); niter != P.end(); niter++) {
-          UnionFindNode  *node = (*niter);
-          MAO_ASSERT(node);
+        for (IntVector::const_iterator niter = P.begin(); niter != P.end();
+             ++niter) {
+          int node = *niter;
           MAO_ASSERT(type[w] != BB_NONHEADER);
 
           // Add nodes to loop descriptor
-          header[node->dfs()] = w;
-          node->Union(&nodes[w]);
+          sets.Union(node, w);
 
           // Nested loops are not added, but linked together
-          if (node->loop())
-            node->loop()->set_parent(loop);
+          if (loops[node])
+            loops[node]->set_parent(loop);
           else
-            loop->AddNode(node->bb());
+            loop->AddNode(nodes[node]);
         }
 
         lsg_->AddLoop(loop);
@@ -365,14 +330,10 @@ class HavlakLoopFinder {
   // Local types used for Havlak algorithm, all carefully
   // selected to guarantee minimal complexity ;-)
   //
-  typedef std::vector<UnionFindNode>          NodeVector;
-  typedef std::map<BasicBlock*, int>          BasicBlockMap;
-  typedef std::list<int>                      IntList;
-  typedef std::set<int>                       IntSet;
-  typedef std::list<UnionFindNode*>           NodeList;
-  typedef std::vector<IntList>                IntListVector;
-  typedef std::vector<IntSet>                 IntSetVector;
+  typedef std::vector<BasicBlock*>            BasicBlockVector;
+  typedef std::vector<SimpleLoop*>            LoopVector;
   typedef std::vector<int>                    IntVector;
+  typedef std::vector<IntVector>              IntVectorVector;
   typedef std::vector<char>                   CharVector;
 
   //
@@ -399,33 +360,46 @@ class HavlakLoopFinder {
   // DFS
   //
   // DESCRIPTION:
-  // Simple depth first traversal along out edges with node numbering
+  // Simple depth first traversal along out edges with node numbering.
+  // nodes maps the numbers to the basic blocks, and number the ids of
+  // the basic blocks to the numbers. The traversal keeps its own stack,
+  // as functions can have more blocks than the thread stack has frames.
   //
-  void DFS(BasicBlock      *a,
-           NodeVector      *nodes,
-           BasicBlockMap   *number,
-           IntVector       *last) {
+  void DFS(BasicBlock       *a,
+           BasicBlockVector *nodes,
+           IntVector        *number,
+           IntVector        *last) {
     MAO_ASSERT(a);
 
-    (*nodes)[current_].Init(a, current_);
-    (*number)[a] = current_;
-    current_++;
-
-    for (BasicBlock::ConstEdgeIterator outedges = a->BeginOutEdges();
-         outedges != a->EndOutEdges(); ++outedges) {
-      BasicBlock *target = (*outedges)->dest();
-
-      if ((*number)[target] == kUnvisited)
-        DFS(target, nodes, number, last);
+    typedef std::pair<BasicBlock *, BasicBlock::ConstEdgeIterator> Frame;
+    std::vector<Frame> stack;
+    int current = 0;
+
+    (*nodes)[current] = a;
+    (*number)[a->id()] = current++;
+    stack.push_back(Frame(a, a->BeginOutEdges()));
+    while (!stack.empty()) {
+      BasicBlock *bb = stack.back().first;
+      if (stack.back().second != bb->EndOutEdges()) {
+        BasicBlock *target = (*stack.back().second)->dest();
+        ++stack.back().second;
+
+        if ((*number)[target->id()] == kUnvisited) {
+          (*nodes)[current] = target;
+          (*number)[target->id()] = current++;
+          stack.push_back(Frame(target, target->BeginOutEdges()));
+        }
+      } else {
+        (*last)[(*number)[bb->id()]] = current-1;
+        stack.pop_back();
+      }
     }
-    (*last)[(*number)[a]] = current_-1;
   }
 
   //
   // member vars
   //
   const CFG          *CFG_;      // current control flow graph
-  int                 current_;  // node id/number
   LoopStructureGraph *lsg_;      // loop forest
 };  // HavlakLoopFinder
 
@@ -478,7 +452,9 @@ LoopStructureGraph *LoopStructureGraph::GetLSG(MaoUnit *mao,
                                                Function *function,
                                                bool conservative) {
   MAO_ASSERT(function != NULL);
+  MaoMutexLock lock(function->cache_mutex());
   if (function->lsg() == NULL) {
+    MaoTimerScope timer("LFIND", function);
     LoopStructureGraph *LSG = new LoopStructureGraph;
     LoopFinderPass finder(mao, function, LSG, conservative);
     finder.Go();
@@ -46,7 +46,8 @@
 // a candidate for transformations, and what not.
 //
 //
-class SimpleLoop {
+class SimpleLoop
+    : public MaoMemoryTracked<SimpleLoop, MaoMemory::SIMPLE_LOOP> {
   public:
   typedef std::set<BasicBlock *> BasicBlockSet;
   typedef std::set<SimpleLoop *> LoopSet;
@@ -0,0 +1,162 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MaoMemory.h"
+#include "MaoThreads.h"
+
+namespace {
+
+const char *const category_names[MaoMemory::NUM_CATEGORIES] = {
+  "LabelEntry",
+  "DirectiveEntry",
+  "InstructionEntry",
+  "i386_insn",
+  "CFG",
+  "BasicBlock",
+  "BasicBlockEdge",
+  "SimpleLoop",
+  "frag",
+  "BitString",
+};
+
+long long live_count[MaoMemory::NUM_CATEGORIES];
+long long live_bytes[MaoMemory::NUM_CATEGORIES];
+long long peak_bytes[MaoMemory::NUM_CATEGORIES];
+
+// RSS samples of one pass.
+struct PassMemory {
+  PassMemory() : runs(0), max_rss_kb(0), growth_kb(0) { }
+  int       runs;
+  // Largest RSS seen after a run of the pass.
+  long long max_rss_kb;
+  // How much the peak RSS grew during runs of the pass.
+  long long growth_kb;
+};
+
+typedef std::vector<std::pair<std::string, PassMemory> > PassMemoryList;
+
+PassMemoryList pass_memory;
+MaoMutex pass_memory_mutex;
+long long start_peak_rss_kb = 0;
+long long last_peak_rss_kb = 0;
+// The last pass during which the peak RSS grew.
+std::string peak_pass;
+
+long long CurrentRSSKb() {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == NULL)
+    return 0;
+  long long size, resident = 0;
+  if (fscanf(statm, "%lld %lld", &size, &resident) != 2)
+    resident = 0;
+  fclose(statm);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+long long PeakRSSKb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return usage.ru_maxrss;
+}
+
+}  // namespace
+
+//
+// Class: MaoMemory
+//
+
+bool MaoMemory::enabled_ = false;
+
+void MaoMemory::Enable() {
+  enabled_ = true;
+  start_peak_rss_kb = last_peak_rss_kb = PeakRSSKb();
+}
+
+void MaoMemory::Add(Category category, long long bytes, int count) {
+  __sync_fetch_and_add(&live_count[category], count);
+  long long live = __sync_add_and_fetch(&live_bytes[category], bytes);
+  long long peak = peak_bytes[category];
+  while (live > peak) {
+    if (__sync_bool_compare_and_swap(&peak_bytes[category], peak, live))
+      break;
+    peak = peak_bytes[category];
+  }
+}
+
+void MaoMemory::SamplePass(const char *pass_name) {
+  if (!enabled_)
+    return;
+  long long rss_kb = CurrentRSSKb();
+  long long peak_rss_kb = PeakRSSKb();
+
+  // When function passes run on several threads, the growth is charged
+  // to whichever pass samples first.
+  MaoMutexLock lock(&pass_memory_mutex);
+  PassMemoryList::iterator iter = pass_memory.begin();
+  while (iter != pass_memory.end() && iter->first != pass_name)
+    ++iter;
+  if (iter == pass_memory.end())
+    iter = pass_memory.insert(pass_memory.end(),
+                              std::make_pair(std::string(pass_name),
+                                             PassMemory()));
+  PassMemory &memory = iter->second;
+  ++memory.runs;
+  if (rss_kb > memory.max_rss_kb)
+    memory.max_rss_kb = rss_kb;
+  if (peak_rss_kb > last_peak_rss_kb) {
+    memory.growth_kb += peak_rss_kb - last_peak_rss_kb;
+    last_peak_rss_kb = peak_rss_kb;
+    peak_pass = pass_name;
+  }
+}
+
+void MaoMemory::PrintReport(FILE *out) {
+  MaoMutexLock lock(&pass_memory_mutex);
+  long long peak_rss_kb = PeakRSSKb();
+  fprintf(out, "Memory high-water report\n");
+  fprintf(out, "  Peak RSS: %.1lf MB (%.1lf MB before the passes)",
+          peak_rss_kb / 1024.0, start_peak_rss_kb / 1024.0);
+  if (!peak_pass.empty())
+    fprintf(out, ", reached during pass %s", peak_pass.c_str());
+  fprintf(out, "\n");
+
+  fprintf(out, "  %-12s %6s %14s %14s\n", "Pass", "Runs", "Max RSS [MB]",
+          "Peak +[MB]");
+  for (PassMemoryList::const_iterator iter = pass_memory.begin();
+       iter != pass_memory.end(); ++iter) {
+    fprintf(out, "  %-12s %6d %14.1lf %14.1lf%s\n", iter->first.c_str(),
+            iter->second.runs, iter->second.max_rss_kb / 1024.0,
+            iter->second.growth_kb / 1024.0,
+            iter->first == peak_pass ? "  <- peak" : "");
+  }
+
+  fprintf(out, "  %-18s %12s %14s %14s\n", "Category", "Live",
+          "Live [bytes]", "Peak [bytes]");
+  for (int i = 0; i < NUM_CATEGORIES; ++i) {
+    fprintf(out, "  %-18s %12lld %14lld %14lld\n", category_names[i],
+            live_count[i], live_bytes[i], peak_bytes[i]);
+  }
+}
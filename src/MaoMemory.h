@@ -0,0 +1,95 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+// Memory accounting.
+// Classes:
+//   MaoMemory        - Live counts and bytes per category of IR object,
+//                      and resident set size samples at pass boundaries.
+//   MaoMemoryTracked - Base class that accounts for the objects of a class.
+//
+// With --memory-report, MAO counts the objects and bytes alive for each
+// category below, and samples the resident set size (RSS) after every
+// pass. At the end it prints the peak RSS, the pass during which it was
+// reached, the RSS growth per pass, and the live and peak bytes per
+// category. The accounting is off, and costs a single test per object,
+// unless the option is given. It only covers the objects listed here;
+// the rest of the RSS is gas, the arena and the standard library.
+//
+#ifndef MAOMEMORY_H_
+#define MAOMEMORY_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+class MaoMemory {
+ public:
+  enum Category {
+    LABEL_ENTRY = 0,
+    DIRECTIVE_ENTRY,
+    INSTRUCTION_ENTRY,
+    I386_INSN,             // The copy of the gas instruction of an entry.
+    CFG_GRAPH,
+    BASIC_BLOCK,
+    BASIC_BLOCK_EDGE,
+    SIMPLE_LOOP,
+    FRAG,                  // Fragments built by the relaxer.
+    BITSTRING,             // Objects, and the heap words of long strings.
+    NUM_CATEGORIES
+  };
+
+  static bool enabled() { return enabled_; }
+  // Turns the accounting on and samples the RSS the passes start from.
+  // Must be called before any tracked object is created.
+  static void Enable();
+
+  // Accounts for count objects of the given category taking bytes.
+  static void Allocated(Category category, size_t bytes, int count = 1) {
+    if (enabled_)
+      Add(category, bytes, count);
+  }
+  static void Freed(Category category, size_t bytes, int count = 1) {
+    if (enabled_)
+      Add(category, -static_cast<long long>(bytes), -count);
+  }
+
+  // Samples the RSS after a run of the named pass.
+  static void SamplePass(const char *pass_name);
+
+  // Prints the high-water report.
+  static void PrintReport(FILE *out);
+
+ private:
+  static void Add(Category category, long long bytes, int count);
+
+  static bool enabled_;
+};
+
+// Classes derive from MaoMemoryTracked<Class, Category> to account for
+// their objects, e.g.,
+//   class BasicBlock
+//       : public MaoMemoryTracked<BasicBlock, MaoMemory::BASIC_BLOCK> {
+template <typename T, MaoMemory::Category C>
+class MaoMemoryTracked {
+ protected:
+  MaoMemoryTracked() { MaoMemory::Allocated(C, sizeof(T)); }
+  MaoMemoryTracked(const MaoMemoryTracked &) {
+    MaoMemory::Allocated(C, sizeof(T));
+  }
+  ~MaoMemoryTracked() { MaoMemory::Freed(C, sizeof(T)); }
+};
+
+#endif  // MAOMEMORY_H_
@@ -51,6 +51,32 @@ void MaoOptions::ProvideHelp(bool exit_after, bool always) {
           "-s            scan for, and load, plugin .so's\n"
           "-T            output timing information for passes\n"
           "--plugin      load the specified plugin\n"
+          "--batch       run the units listed in the specified file\n"
+          "--server      serve units on the specified Unix socket\n"
+          "--ir-cache    keep the specified number of inputs parsed in "
+          "server mode,\n"
+          "              for as long as the server runs\n"
+          "--timing-json write time per pass and function to the "
+          "specified file as JSON\n"
+          "--timing-csv  write time per pass and function to the "
+          "specified file as CSV\n"
+          "--stats-json  write the statistics of the passes to the "
+          "specified file as JSON\n"
+          "              instead of printing them\n"
+          "--perf-counters count cycles, instructions, cache and branch "
+          "misses per pass\n"
+          "              (implies -T)\n"
+          "--memory-report print live IR objects per type and the RSS "
+          "growth per pass\n"
+          "--mmap-input  map the input files instead of copying the text "
+          "of each\n"
+          "              instruction\n"
+          "--function-cache reuse the output of unchanged functions, "
+          "stored in the\n"
+          "              specified directory\n"
+          "--function-cache-size limit the function cache to the "
+          "specified number of MB\n"
+          "              (256 by default)\n"
           "\n"
           "Passes are specified in execution order, following this pattern:\n"
           "  PASSES  := PASS[:PASS]*\n"
@@ -100,12 +126,16 @@ void MaoOptions::TimerPrint() {
   for (OptionVector::iterator it = option_array_list->begin();
        it != option_array_list->end(); ++it) {
     if ((*it)->timer()->Triggered()) {
-      fprintf(stderr, "  Pass: %-12s %5.1lf [sec] %5.1lf%%\n",
+      fprintf(stderr, "  Pass: %-12s %10.6lf [sec] %5.1lf%%",
 	      (*it)->name(), (*it)->timer()->GetSecs(),
-	      100.0 * (*it)->timer()->GetSecs() / total_secs);
+	      total_secs > 0 ?
+	      100.0 * (*it)->timer()->GetSecs() / total_secs : 0.0);
+      if (MaoPerfCounters::enabled())
+        MaoPerfCounters::Print(stderr, (*it)->timer()->counts());
+      fprintf(stderr, "\n");
     }
   }
-  fprintf(stderr, "Total accounted for: %5.1lf [sec]\n", total_secs );
+  fprintf(stderr, "Total accounted for: %10.6lf [sec]\n", total_secs );
 }
 
 
@@ -174,6 +204,13 @@ void MaoOptions::TimerStop(const char *pass_name) {
   entry->timer()->Stop();
 }
 
+void MaoOptions::TimerAdd(const char *pass_name, long long nanoseconds) {
+  static MaoMutex timer_mutex;
+  MaoMutexLock lock(&timer_mutex);
+  MaoOptionArray *entry = FindOptionArray(pass_name);
+  entry->timer()->Add(nanoseconds);
+}
+
 static char *NextStringToken(const char *arg, const char **next, char *token_buff) {
   const char *p = arg;
   int i = 0;
@@ -378,12 +415,79 @@ void MaoOptions::Parse(const char *argv0,
       } else if (arg[0] == 'T') {
         set_timer_print();
         ++arg;
+      } else if (!strncmp(arg, "-stats-json", 11)) {
+        arg += 11;
+        GobbleGarbage(arg, &arg);
+        char *file = NextToken(arg, &arg, token_buff);
+        if (collect)
+          stats_json_file_ = strdup(file);
+      } else if (!strncmp(arg, "-memory-report", 14)) {
+        if (collect) {
+          memory_report_ = true;
+          MaoMemory::Enable();
+        }
+        arg += 14;
+      } else if (!strncmp(arg, "-mmap-input", 11)) {
+        if (collect)
+          mmap_input_ = true;
+        arg += 11;
+      } else if (!strncmp(arg, "-perf-counters", 14)) {
+        // The counters are opened by the process running the unit.
+        set_perf_counters();
+        set_timer_print();
+        arg += 14;
       } else if (!strncmp(arg, "-plugin", 7)) {
         arg += 7;
         GobbleGarbage(arg, &arg);
         char *plugin = NextToken(arg, &arg, token_buff);
         if (collect)
           LoadPlugin(plugin, verbose());
+      } else if (!strncmp(arg, "-batch", 6)) {
+        arg += 6;
+        GobbleGarbage(arg, &arg);
+        char *file = NextToken(arg, &arg, token_buff);
+        if (collect)
+          batch_file_ = strdup(file);
+      } else if (!strncmp(arg, "-server", 7)) {
+        arg += 7;
+        GobbleGarbage(arg, &arg);
+        char *socket = NextToken(arg, &arg, token_buff);
+        if (collect)
+          server_socket_ = strdup(socket);
+      } else if (!strncmp(arg, "-ir-cache", 9)) {
+        arg += 9;
+        GobbleGarbage(arg, &arg);
+        char *size = NextToken(arg, &arg, token_buff);
+        if (collect)
+          ir_cache_size_ = atoi(size);
+      } else if (!strncmp(arg, "-function-cache-size", 20)) {
+        arg += 20;
+        GobbleGarbage(arg, &arg);
+        char *size = NextToken(arg, &arg, token_buff);
+        if (collect)
+          function_cache_size_ = atoll(size) << 20;
+      } else if (!strncmp(arg, "-function-cache", 15)) {
+        arg += 15;
+        GobbleGarbage(arg, &arg);
+        char *dir = NextToken(arg, &arg, token_buff);
+        if (collect)
+          function_cache_dir_ = strdup(dir);
+      } else if (!strncmp(arg, "-timing-json", 12)) {
+        arg += 12;
+        GobbleGarbage(arg, &arg);
+        char *file = NextToken(arg, &arg, token_buff);
+        if (collect) {
+          timing_json_file_ = strdup(file);
+          MaoTiming::set_enabled(true);
+        }
+      } else if (!strncmp(arg, "-timing-csv", 11)) {
+        arg += 11;
+        GobbleGarbage(arg, &arg);
+        char *file = NextToken(arg, &arg, token_buff);
+        if (collect) {
+          timing_csv_file_ = strdup(file);
+          MaoTiming::set_enabled(true);
+        }
       } else {
         fprintf(stderr, "Invalid Option starting with: %s\n", arg);
         ++arg;
@@ -480,9 +584,8 @@ void MaoOptions::Parse(const char *argv0,
                 GetFunctionPass(pass_name.c_str());
             if (func_creator) {
               if (!func_pass_man) {
-                MaoOptionMap *func_options = new MaoOptionMap;
-                InitializeOptionMap(func_options, FindOptionArray("PASSMAN"));
-                func_pass_man = new MaoFunctionPassManager(func_options, unit);
+                func_pass_man = new MaoFunctionPassManager(
+                    GetStaticOptionPass("PASSMAN"), unit);
                 pass_man->LinkPass(func_pass_man);
               }
               func_pass_man->LinkPass(std::make_pair(func_creator, options));
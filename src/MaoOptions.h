@@ -21,11 +21,13 @@
 #include <map>
 #include <string>
 
-#include <unistd.h>
-#include <sys/times.h>
+#include <stdio.h>
 #include <strings.h>
+#include <unistd.h>
 
 #include "MaoDebug.h"
+#include "MaoPerfCounters.h"
+#include "MaoTiming.h"
 
 class MaoOption;
 class MaoPassManager;
@@ -54,43 +56,60 @@ struct MaoOption {
 typedef std::map<std::string, MaoOptionValue> MaoOptionMap;
 
 // Time for pass executions. There is one timer for each pass, if
-// a pass runs multiple times, the times are accumulated.
+// a pass runs multiple times, the times are accumulated. Times are in
+// nanoseconds of the monotonic clock. If hardware performance counters
+// are open, Start() and Stop() also accumulate their counts.
 //
 class MaoTimer {
  public:
- MaoTimer() : total_(0), triggered_(false) { }
+  MaoTimer() : total_(0), triggered_(false) {
+    for (int i = 0; i < MaoPerfCounters::NUM_COUNTERS; ++i)
+      counts_[i] = 0;
+  }
 
   void Start() {
-    struct tms t;
     triggered_ = true;
-    start_ = times(&t);;
+    if (MaoPerfCounters::enabled())
+      MaoPerfCounters::Read(start_counts_);
+    start_ = MaoTiming::Now();
   }
 
   void Stop() {
-    struct tms t;
-    total_ += (times(&t) - start_);
+    total_ += MaoTiming::Now() - start_;
+    if (MaoPerfCounters::enabled()) {
+      long long stop_counts[MaoPerfCounters::NUM_COUNTERS];
+      MaoPerfCounters::Read(stop_counts);
+      for (int i = 0; i < MaoPerfCounters::NUM_COUNTERS; ++i)
+        counts_[i] += stop_counts[i] - start_counts_[i];
+    }
+  }
+
+  // Adds time measured elsewhere, e.g., by a thread running a pass on a
+  // single function. The counters only count the main thread, so such
+  // time comes without counts.
+  void Add(long long nanoseconds) {
+    triggered_ = true;
+    total_ += nanoseconds;
   }
 
   void Print(FILE *f) {
-    static long ticks = 0;
-    if (!ticks)
-      ticks = sysconf(_SC_CLK_TCK);
-    fprintf(f, "%5.1lf [sec]", 1.0 * total_ / ticks);
+    fprintf(f, "%10.6lf [sec]", GetSecs());
   }
 
   double GetSecs() {
-    static long ticks = 0;
-    if (!ticks)
-      ticks = sysconf(_SC_CLK_TCK);
-    return 1.0 * total_ / ticks;
+    return total_ / 1e9;
   }
 
+  const long long *counts() const { return counts_; }
+
   bool Triggered() const { return triggered_; }
 
  private:
-  clock_t total_;
-  clock_t start_;
-  bool    triggered_;
+  long long total_;
+  long long start_;
+  long long counts_[MaoPerfCounters::NUM_COUNTERS];
+  long long start_counts_[MaoPerfCounters::NUM_COUNTERS];
+  bool      triggered_;
 };
 
 // This is how to define options, build up an array consisting of
@@ -168,7 +187,14 @@ class MaoOptionArray {
 class MaoOptions {
  public:
   MaoOptions() : help_(false), verbose_(false),
-                 timer_print_(false),
+                 timer_print_(false), perf_counters_(false),
+                 memory_report_(false),
+                 batch_file_(NULL), server_socket_(NULL),
+                 ir_cache_size_(0), mmap_input_(false),
+                 function_cache_dir_(NULL),
+                 function_cache_size_(256LL << 20),
+                 timing_json_file_(NULL), timing_csv_file_(NULL),
+                 stats_json_file_(NULL),
                  mao_options_(NULL) {
   }
 
@@ -198,15 +224,41 @@ class MaoOptions {
 
   void        TimerStart(const char *pass_name);
   void        TimerStop(const char *pass_name);
+  // Thread-safe way to account time to a pass.
+  void        TimerAdd(const char *pass_name, long long nanoseconds);
   static void TimerPrint();
 
   const bool help() const { return help_; }
   const bool timer_print() const { return timer_print_; }
+  // Whether to count hardware events per pass, see MaoPerfCounters.
+  const bool perf_counters() const { return perf_counters_; }
+  // Whether to print the memory report, see MaoMemory.
+  const bool memory_report() const { return memory_report_; }
   const bool verbose() const { return verbose_; }
+  // The list of units to run in batch mode, or NULL.
+  const char *batch_file() const { return batch_file_; }
+  // The socket to serve units on in server mode, or NULL.
+  const char *server_socket() const { return server_socket_; }
+  // The number of parsed inputs kept in server mode, see MaoBatch.
+  int ir_cache_size() const { return ir_cache_size_; }
+  // Whether entries refer to mapped input files, see MaoSourceFile.
+  bool mmap_input() const { return mmap_input_; }
+  // The directory of the cache of optimized functions, or NULL, and its
+  // size limit in bytes, see MaoFunctionCache.
+  const char *function_cache_dir() const { return function_cache_dir_; }
+  long long function_cache_size() const { return function_cache_size_; }
+  // The options collected so far, as given.
+  const char *option_string() const { return mao_options_; }
+  // The files to write the per pass and function timing to, or NULL.
+  const char *timing_json_file() const { return timing_json_file_; }
+  const char *timing_csv_file() const { return timing_csv_file_; }
+  // The file to write the statistics of the passes to, or NULL.
+  const char *stats_json_file() const { return stats_json_file_; }
 
   void set_verbose() { verbose_ = true; }
   void set_help(bool value) { help_ = value; }
   void set_timer_print() { timer_print_ = true; }
+  void set_perf_counters() { perf_counters_ = true; }
 
  private:
   void InitializeOptionMap(MaoOptionMap *options, MaoOptionArray *pass_opts);
@@ -214,6 +266,17 @@ class MaoOptions {
   bool help_;
   bool verbose_;
   bool timer_print_;
+  bool perf_counters_;
+  bool memory_report_;
+  const char *batch_file_;
+  const char *server_socket_;
+  int ir_cache_size_;
+  bool mmap_input_;
+  const char *function_cache_dir_;
+  long long function_cache_size_;
+  const char *timing_json_file_;
+  const char *timing_csv_file_;
+  const char *stats_json_file_;
   char *mao_options_;
 };
 
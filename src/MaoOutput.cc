@@ -0,0 +1,61 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "MaoDebug.h"
+#include "MaoOutput.h"
+
+//
+// Class: MaoOutputBuffer
+//
+
+const size_t MaoOutputBuffer::kFlushSize;
+const size_t MaoOutputBuffer::kSlackSize;
+
+MaoOutputBuffer::MaoOutputBuffer(const char *file_name)
+    : file_name_(file_name), bytes_written_(0) {
+  fd_ = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  MAO_RASSERT_MSG(fd_ >= 0, "Unable to open %s for writing: %s",
+                  file_name, strerror(errno));
+  buffer_.reserve(kFlushSize + kSlackSize);
+}
+
+MaoOutputBuffer::~MaoOutputBuffer() {
+  Flush();
+  close(fd_);
+}
+
+void MaoOutputBuffer::Flush() {
+  const char *data = buffer_.data();
+  size_t remaining = buffer_.size();
+  while (remaining > 0) {
+    ssize_t written = write(fd_, data, remaining);
+    if (written < 0 && errno == EINTR)
+      continue;
+    MAO_RASSERT_MSG(written > 0, "Unable to write to %s: %s",
+                    file_name_, strerror(errno));
+    data += written;
+    remaining -= written;
+    bytes_written_ += written;
+  }
+  // clear() keeps the capacity, so the next round does not allocate.
+  buffer_.clear();
+}
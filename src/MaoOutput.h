@@ -0,0 +1,69 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Buffered output.
+// Classes:
+//   MaoOutputBuffer - Collects text in one large string and writes it to
+//                     a file with write(2) in big chunks.
+//
+// The assembly pass formats every entry straight into the buffer, so
+// writing a unit does not go through stdio and, once the buffer has
+// reached its working size, does not allocate memory.
+//
+#ifndef MAOOUTPUT_H_
+#define MAOOUTPUT_H_
+
+#include <stddef.h>
+#include <string>
+
+class MaoOutputBuffer {
+ public:
+  // Opens file_name for writing, creating or truncating it.
+  explicit MaoOutputBuffer(const char *file_name);
+  // Flushes the buffer and closes the file.
+  ~MaoOutputBuffer();
+
+  // Returns the string to append output to.
+  std::string *buffer() { return &buffer_; }
+
+  // Writes the buffer out once it holds at least kFlushSize bytes.
+  void FlushIfFull() {
+    if (buffer_.size() >= kFlushSize)
+      Flush();
+  }
+  // Writes out everything in the buffer.
+  void Flush();
+
+  // Returns the number of bytes written to the file so far.
+  long long bytes_written() const { return bytes_written_; }
+
+ private:
+  static const size_t kFlushSize = 1024 * 1024;
+  // Room left past kFlushSize, so that the entry which crosses the
+  // flush size normally fits without growing the buffer.
+  static const size_t kSlackSize = 64 * 1024;
+
+  const char *file_name_;
+  int fd_;
+  std::string buffer_;
+  long long bytes_written_;
+
+  MaoOutputBuffer(const MaoOutputBuffer &);
+  MaoOutputBuffer &operator=(const MaoOutputBuffer &);
+};
+
+#endif  // MAOOUTPUT_H_
@@ -18,10 +18,13 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include <algorithm>
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "Mao.h"
 
@@ -48,30 +51,46 @@ MaoAction::MaoAction(const char *name, MaoOptionMap *options, MaoUnit *unit)
 
 MaoAction::~MaoAction() { }
 
+// Formats a trace line of the action, see MaoTraceBuffer.
+static void WriteTrace(const char *name, const char *fmt, va_list args,
+                       bool newline) {
+  char buffer[1024];
+  std::string text("[");
+  text += name;
+  text += "]\t";
+  va_list copy;
+  va_copy(copy, args);
+  int size = vsnprintf(buffer, sizeof(buffer), fmt, copy);
+  va_end(copy);
+  if (size < static_cast<int>(sizeof(buffer))) {
+    text += buffer;
+  } else {
+    std::vector<char> large(size + 1);
+    vsnprintf(&large[0], large.size(), fmt, args);
+    text += &large[0];
+  }
+  if (newline)
+    text += "\n";
+  MaoTraceBuffer::Write(stderr, text);
+  fflush(stderr);
+}
+
 void MaoAction::Trace(unsigned int level, const char *fmt, ...) const {
   if (level > tracing_level()) return;
 
-  fprintf(stderr, "[%s]\t", name());
-
   va_list argList;
   va_start(argList, fmt);
-  vfprintf(stderr, fmt, argList);
+  WriteTrace(name(), fmt, argList, true);
   va_end(argList);
-
-  fprintf(stderr, "\n");
-  fflush(stderr);
 }
 
 void MaoAction::TraceC(unsigned int level, const char *fmt, ...) const {
   if (level > tracing_level()) return;
 
-  fprintf(stderr, "[%s]\t", name());
-
   va_list argList;
   va_start(argList, fmt);
-  vfprintf(stderr, fmt, argList);
+  WriteTrace(name(), fmt, argList, false);
   va_end(argList);
-  fflush(stderr);
 }
 
 void MaoAction::TraceReplace(unsigned int level,
@@ -148,26 +167,39 @@ class PassDebugAction : public MaoDebugAction {
 };
 
 static PassDebugAction *pass_debug_action = NULL;
+static MaoMutex pass_debug_action_mutex;
 
 
 // MaoPass
 //
 MaoPass::MaoPass(const char *name, MaoOptionMap *options, MaoUnit *unit)
-  : MaoAction(name, options, unit), redundants(NULL)
-{}
+  : MaoAction(name, options, unit), redundants(NULL),
+    reports_ir_changes_(false), ir_changed_(false) {
+  // Passes that change the control flow invalidate the CFG themselves.
+  PreservesAnalysis(ANALYSIS_CFG);
+  PreservesAnalysis(ANALYSIS_LSG);
+  PreservesAnalysis(ANALYSIS_DOMINATORS);
+  PreservesAnalysis(ANALYSIS_POST_DOMINATORS);
+}
 
 MaoPass::~MaoPass() { }
 
 bool MaoPass::Run() {
+  pass_debug_action_mutex.Lock();
   if (!pass_debug_action)
     pass_debug_action = new PassDebugAction(name());
   else
     pass_debug_action->set_pass_name(name());
+  pass_debug_action_mutex.Unlock();
+
+  // Each pass object collects its own list, so passes running on
+  // different functions at the same time do not share it.
   redundants = new std::list<MaoEntry *>();
 
   int ret = Go();
 
-  // Now delete all the collected redundant instructions.
+  // Now delete all the collected redundant instructions. DeleteEntry
+  // takes the lock of the unit.
   for (std::list<MaoEntry *>::iterator it = redundants->begin();
        it != redundants->end(); ++it) {
     unit_->DeleteEntry(*it);
@@ -181,6 +213,13 @@ bool MaoPass::Run() {
 void MaoPass::MarkInsnForDelete(MaoEntry *insn) {
   MAO_ASSERT(redundants);
   redundants->push_back(insn);
+  MarkIRChanged();
+}
+
+MaoAnalysisSet MaoPass::preserved_analyses() const {
+  if (reports_ir_changes_ && !ir_changed_)
+    return MaoAnalysisSet::All();
+  return preserved_analyses_;
 }
 
 // MaoFunctionPass
@@ -222,7 +261,9 @@ bool MaoFunctionPass::Run() {
       cfg->DumpVCG(buff);
     }
 
+    MaoAnalyses::Compute(unit_, function_, used_analyses());
     success = MaoPass::Run();
+    MaoAnalyses::Invalidate(function_, preserved_analyses());
 
     if (da_cfg_) {
       CFG *cfg = CFG::GetCFG(unit_, function_);
@@ -304,12 +345,18 @@ bool AssemblyPass::Go() {
 
   Trace(1, "Generate Assembly File: %s", output_file_name);
 
-  FILE *outfile = fopen(output_file_name, "w");
-  MAO_ASSERT(outfile);
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
 
-  unit_->PrintMaoUnit(outfile);
+  MaoOutputBuffer out(output_file_name);
+  unit_->PrintMaoUnit(&out);
+  out.Flush();
 
-  fclose(outfile);
+  gettimeofday(&end, NULL);
+  double seconds = (end.tv_sec - start.tv_sec) +
+      (end.tv_usec - start.tv_usec) / 1e6;
+  Trace(1, "Wrote %lld bytes in %.3f s (%.1f MB/s)", out.bytes_written(),
+        seconds, seconds > 0 ? out.bytes_written() / seconds / 1e6 : 0.0);
   return true;
 }
 
@@ -368,15 +415,19 @@ bool DumpSymbolTablePass::Go() {
 
 // TestPass
 //
-// A pass that can (optionally) run CFG, LSG, Relaxer. Useful
-// for testing
+// A pass that can (optionally) run CFG, LSG, Relaxer and the dominator
+// analyses, and check an incrementally updated CFG. Useful for testing
 //
-MAO_DEFINE_OPTIONS(TEST, "A test pass that can optionally run the CFG, LSG "\
-                   "and the relaxer",  3) {
+MAO_DEFINE_OPTIONS(TEST, "A test pass that can optionally run the CFG, LSG, "\
+                   "the relaxer and the dominator analyses",  5) {
   OPTION_BOOL("cfg", false, "Run CFG pass (note that CFG runs automatically "
               "in the Relaxer and the LSG pass.)"),
   OPTION_BOOL("lsg", true, "Run LSG pass."),
   OPTION_BOOL("relax", true, "Run Relaxer pass."),
+  OPTION_BOOL("dom", false, "Compute the dominator and post-dominator trees "
+              "and their dominance frontiers."),
+  OPTION_BOOL("verify_cfg", false, "Check that the cached CFG, as updated "
+              "by the previous passes, matches one built from scratch."),
 };
 
 TestPass::TestPass(MaoOptionMap *options, MaoUnit *mao_unit,
@@ -384,57 +435,204 @@ TestPass::TestPass(MaoOptionMap *options, MaoUnit *mao_unit,
   : MaoFunctionPass("TEST", options, mao_unit, function),
     cfg_(GetOptionBool("cfg")),
     lsg_(GetOptionBool("lsg")),
-    relax_(GetOptionBool("relax")) {
+    relax_(GetOptionBool("relax")),
+    dom_(GetOptionBool("dom")),
+    verify_cfg_(GetOptionBool("verify_cfg")) {
 }
 
 bool TestPass::Go() {
   Trace(3,
-        "Running TEST on function \"%s\" with options cfg=%d lsg=%d relax=%d",
-        function_->name().c_str(), cfg_, lsg_, relax_);
-
+        "Running TEST on function \"%s\" with options cfg=%d lsg=%d relax=%d "
+        "dom=%d", function_->name().c_str(), cfg_, lsg_, relax_, dom_);
+
+  // Check the CFG left by the previous passes, if they built one.
+  if (verify_cfg_) {
+    CFG *cfg = CFG::GetCFGIfExists(unit_, function_);
+    if (cfg != NULL) {
+      MAO_RASSERT_MSG(cfg->MatchesRebuiltCFG(function_),
+                      "The CFG of function %s differs from a rebuilt one",
+                      function_->name().c_str());
+      Trace(1, "The CFG of function %s matches a rebuilt one",
+            function_->name().c_str());
+    }
+  }
   if (cfg_)
     CFG::GetCFG(unit_, function_);
   if (lsg_)
     LoopStructureGraph::GetLSG(unit_, function_);
   if (relax_)
     MaoRelaxer::GetSizeMap(unit_, function_->GetSection());
+  if (dom_) {
+    // The frontiers are computed on the first query.
+    DominatorTree *dom = MaoAnalyses::GetDominators(unit_, function_);
+    dom->Frontier(dom->root());
+    DominatorTree *post_dom = MaoAnalyses::GetPostDominators(unit_, function_);
+    post_dom->Frontier(post_dom->root());
+    if (tracing_level() >= 4) {
+      dom->Print(stderr);
+      post_dom->Print(stderr);
+    }
+  }
 
   return true;
 }
-REGISTER_FUNC_PASS("TEST", TestPass)
+REGISTER_SERIAL_FUNC_PASS("TEST", TestPass)
+
+// MaoPassManager
+//
+void MaoPassManager::LinkPass(MaoFunctionPassManager *pass) {
+  pass_list_.push_back(pass);
+  function_pass_managers_.push_back(pass);
+}
+
+bool MaoPassManager::HasSerialFunctionPasses() const {
+  for (std::list<MaoFunctionPassManager *>::const_iterator iter =
+           function_pass_managers_.begin();
+       iter != function_pass_managers_.end(); ++iter) {
+    if ((*iter)->HasSerialPasses())
+      return true;
+  }
+  return false;
+}
+
+void MaoPassManager::GetInputFiles(std::vector<std::string> *files) const {
+  for (std::list<MaoPass *>::const_iterator iter = pass_list_.begin();
+       iter != pass_list_.end(); ++iter)
+    files->insert(files->end(), (*iter)->input_files().begin(),
+                  (*iter)->input_files().end());
+}
 
 // MaoFunctionPassManager
 //
 // A pass to run function passes on all functions in the unit.
 //
 MAO_DEFINE_OPTIONS(PASSMAN, "A uber-pass that runs function passes on all "\
-                   "functions in a file", 0) {
+                   "functions in a file", 1) {
+  OPTION_INT("threads", 1, "Number of threads used to run the function "
+             "passes. Functions are processed concurrently, unless a pass "
+             "depends on other functions (e.g., uses the relaxer). The "
+             "labels MAO creates are then numbered per function."),
 };
 
 MaoFunctionPassManager::MaoFunctionPassManager(MaoOptionMap *options,
                                                MaoUnit *unit)
-    : MaoPass("PASSMAN", options, unit) { }
+    : MaoPass("PASSMAN", options, unit) {
+  // The function passes drop what they invalidate themselves.
+  PreservesAllAnalyses();
+}
+
+bool MaoFunctionPassManager::HasSerialPasses() const {
+  for (std::list<MaoFunctionPassManager::ConfiguredPass>::const_iterator
+           pass_iter = pass_list_.begin();
+       pass_iter != pass_list_.end(); ++pass_iter) {
+    if (IsSerialFunctionPass(pass_iter->first))
+      return true;
+  }
+  return false;
+}
 
 bool MaoFunctionPassManager::Go() {
+  int num_threads = GetOptionInt("threads");
+  if (num_threads > 1 && HasSerialPasses()) {
+    Trace(1, "A serial pass is linked, running on a single thread");
+    num_threads = 1;
+  }
+
+  if (num_threads > 1 && HasAdjacentFunctions()) {
+    Trace(1, "Functions are not separated, running on a single thread");
+    num_threads = 1;
+  }
+
+  // The function cache stores the labels of a function apart from the
+  // others, see MaoFunctionCache::Normalize().
+  MaoUnit::BBNameGen::SetNumberPerFunction(num_threads > 1 ||
+                                           unit_->function_cache() != NULL);
+  if (num_threads > 1) {
+    functions_.assign(unit_->ConstFunctionBegin(), unit_->ConstFunctionEnd());
+    traces_.assign(functions_.size(), std::string());
+    Trace(1, "Running function passes on %d threads", num_threads);
+    unit_->BeginParallelIDs();
+    MaoMutex::SetThreaded(true);
+    MaoWorkStealingPool::Run(num_threads, functions_.size(),
+                             RunPassesTask, this);
+    MaoMutex::SetThreaded(false);
+    unit_->EndParallelIDs();
+    for (std::vector<std::string>::const_iterator iter = traces_.begin();
+         iter != traces_.end(); ++iter)
+      fputs(iter->c_str(), stderr);
+    functions_.clear();
+    traces_.clear();
+    MaoUnit::BBNameGen::SetNumberPerFunction(false);
+    return true;
+  }
+
   // Run passes on functions.
   for (MaoUnit::ConstFunctionIterator func_iter = unit_->ConstFunctionBegin();
        func_iter != unit_->ConstFunctionEnd(); ++func_iter) {
-    Function *function = *func_iter;
-    for (std::list<MaoFunctionPassManager::ConfiguredPass>::iterator pass_iter =
-             pass_list_.begin();
-         pass_iter != pass_list_.end(); ++pass_iter) {
-      PassCreator creator = pass_iter->first;
-      MaoOptionMap *options = pass_iter->second;
-      MaoFunctionPass *pass = creator(options, unit_, function);
-      pass->TimerStart();
-      MAO_ASSERT(pass->Run());
-      pass->TimerStop();
-      delete pass;
-    }
+    RunPasses(*func_iter);
   }
+  MaoUnit::BBNameGen::SetNumberPerFunction(false);
   return true;
 }
 
+void MaoFunctionPassManager::RunPassesTask(int index, void *arg) {
+  MaoFunctionPassManager *pass_man = static_cast<MaoFunctionPassManager *>(arg);
+  MaoTraceBuffer::Set(&pass_man->traces_[index]);
+  pass_man->RunPasses(pass_man->functions_[index]);
+  MaoTraceBuffer::Set(NULL);
+}
+
+// The passes on a function edit the entries next to it, e.g., when they
+// insert an entry before its first one. Entries between functions are
+// edited under the lock of the unit, but the entries of a function are
+// only read and written by the thread running its passes. So functions
+// run on several threads only if none of them directly follows another.
+bool MaoFunctionPassManager::HasAdjacentFunctions() const {
+  for (MaoUnit::ConstFunctionIterator iter = unit_->ConstFunctionBegin();
+       iter != unit_->ConstFunctionEnd(); ++iter) {
+    MaoEntry *next = (*iter)->last_entry()->next();
+    if (next != NULL && next->function() != NULL && next->function() != *iter)
+      return true;
+  }
+  return false;
+}
+
+void MaoFunctionPassManager::RunPasses(Function *function) {
+  // The ASM pass prints the cached output instead.
+  if (unit_->function_cache() && unit_->function_cache()->IsCached(function))
+    return;
+  MaoUnit::BBNameGen::SetFunction(function);
+  for (std::list<MaoFunctionPassManager::ConfiguredPass>::iterator pass_iter =
+           pass_list_.begin();
+       pass_iter != pass_list_.end(); ++pass_iter) {
+    PassCreator creator = pass_iter->first;
+    MaoOptionMap *options = pass_iter->second;
+    MaoFunctionPass *pass = creator(options, unit_, function);
+    {
+      MaoTimerScope timer(pass->name(), function);
+      if (MaoMutex::threaded()) {
+        MAO_ASSERT(pass->Run());
+        // The timer of a pass is shared by all threads running it.
+        unit_->mao_options()->TimerAdd(pass->name(), timer.Elapsed());
+      } else {
+        // Only the main thread can read the performance counters.
+        pass->TimerStart();
+        MAO_ASSERT(pass->Run());
+        pass->TimerStop();
+      }
+    }
+    MaoMemory::SamplePass(pass->name());
+    delete pass;
+  }
+  // The passes may have changed the function, which makes the sizes
+  // computed by the relaxer out of date.
+  {
+    MaoMutexLock lock(unit_->mutex());
+    MaoRelaxer::InvalidateSizeMap(function->GetSection(), function);
+  }
+  MaoUnit::BBNameGen::SetFunction(NULL);
+}
+
 // Other utility methods
 //
 
@@ -442,6 +640,7 @@ bool MaoFunctionPassManager::Go() {
 void InitPasses() {
   // Static Option Passes
   RegisterStaticOptionPass("READ", new MaoOptionMap);
+  RegisterStaticOptionPass("PASSMAN", new MaoOptionMap);
   InitCFG();
   InitRelax();
   InitLoops();
@@ -474,6 +673,21 @@ void RegisterFunctionPass(const char *name,
   map[name] = creator;
 }
 
+static std::set<MaoFunctionPassManager::PassCreator> &
+GetSerialFunctionPasses() {
+  static std::set<MaoFunctionPassManager::PassCreator> *set =
+      new std::set<MaoFunctionPassManager::PassCreator>();
+  return *set;
+}
+
+void RegisterSerialFunctionPass(MaoFunctionPassManager::PassCreator creator) {
+  GetSerialFunctionPasses().insert(creator);
+}
+
+bool IsSerialFunctionPass(MaoFunctionPassManager::PassCreator creator) {
+  return GetSerialFunctionPasses().count(creator) != 0;
+}
+
 void RegisterStaticOptionPass(const char *name, MaoOptionMap *options) {
   registered_static_option_passes[name] = options;
 }
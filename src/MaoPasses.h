@@ -18,17 +18,20 @@
 // 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "Mao.h"
+#include "MaoAnalysis.h"
 
 #include <list>
 #include <map>
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 
 class MaoUnit;
 class Function;
 class CFG;
+class MaoFunctionPassManager;
 
 // MaoAction
 //
@@ -118,8 +121,48 @@ class MaoPass : public MaoAction {
   // Allow marking of Entries for deletion after exit from Go()
   void MarkInsnForDelete(MaoEntry *insn);
 
+  // The analyses the pass uses, which are computed before it runs.
+  MaoAnalysisSet used_analyses() const { return used_analyses_; }
+  // The analyses that are still valid after the pass has run.
+  MaoAnalysisSet preserved_analyses() const;
+  // The files other than the input the output of the pass depends on.
+  const std::vector<std::string> &input_files() const { return input_files_; }
+
+ protected:
+  // Declarations of the analyses a pass uses and keeps valid, for the
+  // constructors of the passes. See MaoAnalysis.h.
+  void UsesAnalysis(MaoAnalysisKind kind) { used_analyses_.Add(kind); }
+  // Declares that the pass keeps the analysis valid, even if it changes
+  // the IR.
+  void PreservesAnalysis(MaoAnalysisKind kind) {
+    preserved_analyses_.Add(kind);
+  }
+  // Declares that the pass leaves the analysis out of date, for the ones
+  // kept valid by default, see MaoPass::MaoPass.
+  void InvalidatesAnalysis(MaoAnalysisKind kind) {
+    preserved_analyses_.Remove(kind);
+  }
+  // Declares that the pass does not change the IR.
+  void PreservesAllAnalyses() { preserved_analyses_ = MaoAnalysisSet::All(); }
+  // Declares that the pass calls MarkIRChanged() whenever it changes the
+  // IR, so that nothing is dropped if it does not.
+  void ReportsIRChanges() { reports_ir_changes_ = true; }
+  // Reports that the pass has changed the IR.
+  void MarkIRChanged() { ir_changed_ = true; }
+  // Declares that the output of the pass depends on the file at path,
+  // e.g., a profile, for the function cache. Only unit passes can declare
+  // files, as function passes are created after the cache looks up the
+  // functions.
+  void ReadsFile(const char *path) { input_files_.push_back(path); }
+
  private:
   std::list<MaoEntry *> *redundants;
+  std::vector<std::string> input_files_;
+
+  MaoAnalysisSet used_analyses_;
+  MaoAnalysisSet preserved_analyses_;
+  bool reports_ir_changes_;
+  bool ir_changed_;
 };
 
 
@@ -170,6 +213,14 @@ class MaoPassManager {
   void LinkPass(MaoPass *pass) {
     pass_list_.push_back(pass);
   }
+  void LinkPass(MaoFunctionPassManager *pass);
+
+  // Returns true if a linked function pass must run serially, see
+  // RegisterSerialFunctionPass().
+  bool HasSerialFunctionPasses() const;
+
+  // Appends the files the linked passes read, see MaoPass::ReadsFile().
+  void GetInputFiles(std::vector<std::string> *files) const;
 
   template <class Pass>
   static MaoPass *GenericPassCreator(MaoOptionMap *options, MaoUnit *unit) {
@@ -180,15 +231,19 @@ class MaoPassManager {
     for (std::list<MaoPass *>::iterator pass_iter = pass_list_.begin();
          pass_iter != pass_list_.end(); ++pass_iter) {
       MaoPass *pass = (*pass_iter);
+      MaoTimerScope timer(pass->name());
       pass->TimerStart();
       MAO_ASSERT(pass->Run());
       pass->TimerStop();
+      MaoAnalyses::InvalidateAll(unit_, pass->preserved_analyses());
+      MaoMemory::SamplePass(pass->name());
     }
   }
 
  private:
   MaoUnit *unit_;
   std::list<MaoPass *> pass_list_;
+  std::list<MaoFunctionPassManager *> function_pass_managers_;
 };
 
 
@@ -202,6 +257,13 @@ class MaoPassManager {
 // pass and deletes the pass object.  MaoFunctionPassManager is a
 // MaoPass, so it can be linked to in a MaoPassManager.
 //
+// With the option threads[N], the passes are run on up to N functions
+// concurrently. Each function still sees the passes in the linked order,
+// so the result is the same as for the serial run. Passes that depend on
+// other functions than their own, e.g., on the relaxed layout of the whole
+// section, are registered as serial passes and make the pass manager fall
+// back to processing one function at a time.
+//
 class MaoFunctionPassManager : public MaoPass {
  public:
   typedef MaoFunctionPass *(*PassCreator)(MaoOptionMap *options, MaoUnit *unit,
@@ -224,8 +286,21 @@ class MaoFunctionPassManager : public MaoPass {
 
   bool Go();
 
+  // Returns true if a linked pass must run serially.
+  bool HasSerialPasses() const;
+
  private:
+  // Runs all linked passes on the given function.
+  void RunPasses(Function *function);
+  // Work item for the thread pool: runs the passes on one function.
+  static void RunPassesTask(int index, void *arg);
+  // Returns true if a function starts right after the end of another.
+  bool HasAdjacentFunctions() const;
+
   std::list<ConfiguredPass> pass_list_;
+  std::vector<Function *>   functions_;
+  // The trace output of each function while running on several threads.
+  std::vector<std::string>  traces_;
 };
 
 
@@ -243,6 +318,9 @@ void RegisterUnitPass(const char *name,
                       MaoPassManager::PassCreator creator);
 void RegisterFunctionPass(const char *name,
                           MaoFunctionPassManager::PassCreator creator);
+// Marks a function pass as not safe to run on several functions at once.
+void RegisterSerialFunctionPass(MaoFunctionPassManager::PassCreator creator);
+bool IsSerialFunctionPass(MaoFunctionPassManager::PassCreator creator);
 void RegisterStaticOptionPass(const char *name, MaoOptionMap *options);
 MaoPassManager::PassCreator          GetUnitPass(const char *name);
 MaoFunctionPassManager::PassCreator  GetFunctionPass(const char *name);
@@ -317,6 +395,8 @@ class TestPass : public MaoFunctionPass {
   bool cfg_;
   bool lsg_;
   bool relax_;
+  bool dom_;
+  bool verify_cfg_;
 };
 
 //
@@ -337,8 +417,11 @@ void InitLoops();
 class PassInitializer {
   public:
     PassInitializer(const char *name,
-                    MaoFunctionPassManager::PassCreator creator) {
+                    MaoFunctionPassManager::PassCreator creator,
+                    bool serial = false) {
       RegisterFunctionPass(name, creator);
+      if (serial)
+        RegisterSerialFunctionPass(creator);
     }
     PassInitializer(const char *name, MaoPassManager::PassCreator creator) {
       RegisterUnitPass(name, creator);
@@ -348,6 +431,11 @@ class PassInitializer {
 #define REGISTER_FUNC_PASS(name, classname)  \
     static PassInitializer classname##Init(name, MaoFunctionPassManager::GenericPassCreator<classname>);
 
+// Function passes that read or change state shared with other functions,
+// such as the size and offset maps of the relaxer, register with this macro.
+#define REGISTER_SERIAL_FUNC_PASS(name, classname)  \
+    static PassInitializer classname##Init(name, MaoFunctionPassManager::GenericPassCreator<classname>, true);
+
 #define REGISTER_UNIT_PASS(name, classname)  \
     static PassInitializer classname##Init(name, MaoPassManager::GenericPassCreator<classname>);
 
@@ -360,6 +448,13 @@ class PassInitializer {
       } \
    }
 
+#define REGISTER_PLUGIN_SERIAL_FUNC_PASS(name, classname) \
+   extern "C" { \
+      void MaoInit() {\
+         REGISTER_SERIAL_FUNC_PASS(name, classname ) \
+      } \
+   }
+
 #define REGISTER_PLUGIN_UNIT_PASS(name, classname) \
    extern "C" { \
       void MaoInit() {\
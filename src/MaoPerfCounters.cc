@@ -0,0 +1,136 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "MaoPerfCounters.h"
+
+//
+// Class: MaoPerfCounters
+//
+
+int MaoPerfCounters::group_fd_ = -1;
+int MaoPerfCounters::fds_[NUM_COUNTERS] = { -1, -1, -1, -1, -1 };
+int MaoPerfCounters::index_[NUM_COUNTERS] = { -1, -1, -1, -1, -1 };
+int MaoPerfCounters::num_open_ = 0;
+pid_t MaoPerfCounters::open_pid_ = 0;
+
+static const struct {
+  const char *name;
+  uint32_t    type;
+  uint64_t    config;
+} counter_events[MaoPerfCounters::NUM_COUNTERS] = {
+  { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "insns", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "l1d-misses", PERF_TYPE_HW_CACHE,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  { "llc-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+const char *MaoPerfCounters::name(Counter counter) {
+  return counter_events[counter].name;
+}
+
+bool MaoPerfCounters::Open() {
+  if (open_pid_ == getpid())
+    return enabled();
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    if (fds_[i] != -1)
+      close(fds_[i]);
+    fds_[i] = -1;
+    index_[i] = -1;
+  }
+  group_fd_ = -1;
+  num_open_ = 0;
+  open_pid_ = getpid();
+
+  int first_error = 0;
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_events[i].type;
+    attr.config = counter_events[i].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // The leader starts disabled and enables the whole group below.
+    attr.disabled = group_fd_ == -1;
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd_, 0);
+    if (fd == -1) {
+      if (first_error == 0)
+        first_error = errno;
+      continue;
+    }
+    if (group_fd_ == -1)
+      group_fd_ = fd;
+    fds_[i] = fd;
+    index_[i] = num_open_++;
+  }
+
+  if (!enabled()) {
+    fprintf(stderr, "Performance counters are not available (%s), "
+            "reporting times only\n", strerror(first_error));
+    return false;
+  }
+  ioctl(group_fd_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(group_fd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+}
+
+void MaoPerfCounters::Read(long long values[NUM_COUNTERS]) {
+  for (int i = 0; i < NUM_COUNTERS; ++i)
+    values[i] = 0;
+  if (!enabled())
+    return;
+
+  // Layout of a group read: nr, time_enabled, time_running, values[nr].
+  uint64_t data[3 + NUM_COUNTERS];
+  ssize_t size = read(group_fd_, data, sizeof(data));
+  if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+    return;
+  uint64_t time_enabled = data[1], time_running = data[2];
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    if (index_[i] == -1 || static_cast<uint64_t>(index_[i]) >= data[0])
+      continue;
+    uint64_t count = data[3 + index_[i]];
+    // Scale the count up if the group was not always on the PMU.
+    if (time_running != 0 && time_running < time_enabled)
+      count = static_cast<uint64_t>(
+          static_cast<double>(count) * time_enabled / time_running);
+    values[i] = count;
+  }
+}
+
+void MaoPerfCounters::Print(FILE *out, const long long values[NUM_COUNTERS]) {
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    if (available(static_cast<Counter>(i)))
+      fprintf(out, " %s=%lld", counter_events[i].name, values[i]);
+  }
+  if (available(CYCLES) && available(INSTRUCTIONS) && values[CYCLES] > 0)
+    fprintf(out, " ipc=%.2f",
+            static_cast<double>(values[INSTRUCTIONS]) / values[CYCLES]);
+}
@@ -0,0 +1,75 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Hardware performance counters.
+// Classes:
+//   MaoPerfCounters - A group of hardware counters for the main thread,
+//                     read around each pass.
+//
+// With --perf-counters, MAO opens a perf_event_open() group that counts
+// cycles, instructions, L1 data cache read misses, last level cache
+// misses and branch misses in user mode. MaoTimer reads the group when a
+// pass starts and stops, and -T prints the counts next to the times.
+// Counters the kernel or the machine does not provide are left out; if
+// none can be opened, MAO says so once and reports times only.
+//
+#ifndef MAOPERFCOUNTERS_H_
+#define MAOPERFCOUNTERS_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+class MaoPerfCounters {
+ public:
+  enum Counter {
+    CYCLES = 0,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    NUM_COUNTERS
+  };
+
+  // Opens the counters. Returns false, after printing why, if none of
+  // them is available. Counters inherited from the parent process count
+  // the parent, so a forked process reopens them.
+  static bool Open();
+  // Returns true if at least one counter is open.
+  static bool enabled() { return group_fd_ != -1; }
+  // Returns true if the given counter is open.
+  static bool available(Counter counter) { return fds_[counter] != -1; }
+  // Returns a short name for the counter.
+  static const char *name(Counter counter);
+
+  // Stores the current counts in values. Counters that are not open
+  // read as 0. Only valid on the thread that called Open().
+  static void Read(long long values[NUM_COUNTERS]);
+
+  // Prints the open counters of values, e.g., " cycles=100 insns=80".
+  static void Print(FILE *out, const long long values[NUM_COUNTERS]);
+
+ private:
+  static int group_fd_;
+  static int fds_[NUM_COUNTERS];
+  // Position of each open counter in the group read, or -1.
+  static int index_[NUM_COUNTERS];
+  static int num_open_;
+  // The process that last called Open(), or 0.
+  static pid_t open_pid_;
+};
+
+#endif  // MAOPERFCOUNTERS_H_
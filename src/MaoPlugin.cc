@@ -24,6 +24,8 @@
 
 #include "Mao.h"
 
+static std::vector<std::string> loaded_plugins;
+
 void LoadPlugin(const char *path, bool verbose) {
   if (verbose)
     fprintf(stderr, "  Loading plugin: %s\n", path);
@@ -56,6 +58,11 @@ void LoadPlugin(const char *path, bool verbose) {
     MAO_ASSERT_MSG(false, "%s", error);
 
   init();
+  loaded_plugins.push_back(path);
+}
+
+const std::vector<std::string> &GetLoadedPlugins() {
+  return loaded_plugins;
 }
 
 // Allow names like Mao*.so
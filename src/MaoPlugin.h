@@ -19,6 +19,9 @@
 #ifndef MAOPLUGIN_H_
 #define MAOPLUGIN_H_
 
+#include <string>
+#include <vector>
+
 #include "MaoUnit.h"
 
 struct PluginVersion {
@@ -34,6 +37,9 @@ struct PluginVersion {
 // Load single fully specified plugin.so file.
 void LoadPlugin(const char *path, bool verbose);
 
+// Returns the paths of the plugins loaded so far, in load order.
+const std::vector<std::string> &GetLoadedPlugins();
+
 // Given MAO's binary path, find and scan all possible
 // plugins, following this algorithm:
 //
@@ -210,7 +210,9 @@ class ProfileAnnotationPass : public MaoPass {
  public:
   ProfileAnnotationPass(MaoOptionMap *options, MaoUnit *mao)
       : MaoPass("PROFILE", options, mao),
-        sample_profile_(GetOptionString("sample_profile")) { }
+        sample_profile_(GetOptionString("sample_profile")) {
+    ReadsFile(sample_profile_);
+  }
   virtual ~ProfileAnnotationPass();
   virtual bool Go();
 
@@ -44,12 +44,11 @@ ReachingDefs::ReachingDefs(MaoUnit *unit,
 //  - The defs inside this basic block.
 BitString ReachingDefs::CreateGenSet(const BasicBlock& bb) {
   BitString current_set(num_bits_);
-  BitString defined = GetDefs(bb);
-  for (int regnum = 0; regnum < defined.number_of_bits(); ++regnum) {
-    if (defined.Get(regnum)) {
-      int index = index_map_.find(std::make_pair(&bb, regnum))->second;
-      current_set.Set(index);
-    }
+  RegisterMask defined = GetDefs(bb);
+  for (int regnum = defined.NextSetBit(0); regnum != -1;
+       regnum = defined.NextSetBit(regnum + 1)) {
+    int index = index_map_.find(std::make_pair(&bb, regnum))->second;
+    current_set.Set(index);
   }
   return current_set;
 }
@@ -58,29 +57,30 @@ BitString ReachingDefs::CreateGenSet(const BasicBlock& bb) {
 //  - Each def in the bb, kills the defs in all the other bbs.
 BitString ReachingDefs::CreateKillSet(const BasicBlock& bb) {
   BitString current_set(num_bits_);
-  BitString defined = GetDefs(bb);
-  for (int regnum = 0; regnum < defined.number_of_bits(); ++regnum) {
-    if (defined.Get(regnum)) {
-      // We should not kill the definition inside this bb, only all the others.
-      int index = index_map_.find(std::make_pair(&bb, regnum))->second;
-      BitString reg_string = GetAllDefsInFunction(regnum);
-      MAO_ASSERT(reg_string.Get(index) == true);
-      reg_string.Clear(index);
-      current_set = current_set | reg_string;
-    }
+  RegisterMask defined = GetDefs(bb);
+  for (int regnum = defined.NextSetBit(0); regnum != -1;
+       regnum = defined.NextSetBit(regnum + 1)) {
+    // We should not kill the definition inside this bb, only all the others.
+    // Each index belongs to a single register, so no other register of
+    // the loop sets it again.
+    int index = index_map_.find(std::make_pair(&bb, regnum))->second;
+    const BitString &reg_string = GetAllDefsInFunction(regnum);
+    MAO_ASSERT(reg_string.Get(index) == true);
+    current_set |= reg_string;
+    current_set.Clear(index);
   }
   return current_set;
 }
 
-BitString ReachingDefs::GetDefs(const BasicBlock& bb) const {
-  BitString defined;
+RegisterMask ReachingDefs::GetDefs(const BasicBlock& bb) const {
+  RegisterMask defined;
   // Find out all the defs in this basic block.
   for (EntryIterator entry = bb.EntryBegin();
        entry != bb.EntryEnd();
        ++entry) {
     if ((*entry)->IsInstruction()) {
       InstructionEntry *insn = (*entry)->AsInstruction();
-      defined = defined | GetRegisterDefMask(insn, true);
+      defined |= GetRegisterDefMask(insn, true);
     }
   }
   return defined;
@@ -96,14 +96,13 @@ void ReachingDefs::CreateIndexMaps() {
   FORALL_CFG_BB(cfg_, it) {
     const BasicBlock *bb = *it;
     // Look for definitions in bb.
-    BitString defined = GetDefs(*bb);
+    RegisterMask defined = GetDefs(*bb);
     // loop over the defined registers and update the map.
-    for (int regnum = 0; regnum < defined.number_of_bits(); ++regnum) {
-      if (defined.Get(regnum)) {
-        index_map_[std::make_pair(bb, regnum)] = current_index;
-        rev_index_map_[current_index] = std::make_pair(bb, regnum);
-        ++current_index;
-      }
+    for (int regnum = defined.NextSetBit(0); regnum != -1;
+         regnum = defined.NextSetBit(regnum + 1)) {
+      index_map_[std::make_pair(bb, regnum)] = current_index;
+      rev_index_map_[current_index] = std::make_pair(bb, regnum);
+      ++current_index;
     }
   }
 }
@@ -135,9 +134,7 @@ ReachingDefs::DefsMap ReachingDefs::CreateDefsMap(
 
   DefsMap defs_map;
 
-  // TODO(martint): Update 256 to the actual number of registers once
-  // the MaoDefs code has been updated.
-  for(int i = 0; i <  256; ++i) {
+  for (int i = 0; i < kMaxNumberOfRegisters; ++i) {
     defs_map.push_back(BitString(num_bits_));
   }
 
@@ -157,7 +154,7 @@ ReachingDefs::DefsMap ReachingDefs::CreateDefsMap(
 
 
 void ReachingDefs::DumpDefsMap(const DefsMap& defs_map) const {
-  for (int reg_num = 0; reg_num < 256; ++reg_num) {
+  for (int reg_num = 0; reg_num < kMaxNumberOfRegisters; ++reg_num) {
     fprintf(stderr, "%s -> ", GetRegName(reg_num));
     defs_map_[reg_num].Print();
   }
@@ -180,20 +177,17 @@ BitString ReachingDefs::GetReachingDefsAtInstruction(
 
       // if we have a def, remove all other defs to this variable,
       // then add the current.
-      BitString def_mask = GetRegisterDefMask(curr_insn, true);
-      MAO_ASSERT(def_mask.number_of_bits() == 256);
-      for (int regnum = 0; regnum < def_mask.number_of_bits(); ++regnum) {
-         if (def_mask.Get(regnum)) {
-           // We should not kill the definition inside this bb, only all the
-           // definitions from other bbs.
-           int index = index_map_.find(std::make_pair(&bb, regnum))->second;
-           BitString reg_string = GetAllDefsInFunction(regnum);
-           MAO_ASSERT(reg_string.Get(index) == true);
-           reg_string.Clear(index);
-           current_set = current_set - reg_string;
-           current_set.Set(index);
-         }
-       }
+      RegisterMask def_mask = GetRegisterDefMask(curr_insn, true);
+      for (int regnum = def_mask.NextSetBit(0); regnum != -1;
+           regnum = def_mask.NextSetBit(regnum + 1)) {
+        // We should not kill the definition inside this bb, only all the
+        // definitions from other bbs.
+        int index = index_map_.find(std::make_pair(&bb, regnum))->second;
+        const BitString &reg_string = GetAllDefsInFunction(regnum);
+        MAO_ASSERT(reg_string.Get(index) == true);
+        current_set -= reg_string;
+        current_set.Set(index);
+      }
     }
   }
   return current_set;
@@ -210,19 +204,18 @@ ReachingDefs::GetAllReachingDefs(const BasicBlock& bb,
 
   // Now we can create the result set.
   std::list<Definition> defs;
-  for (int i = 0; i < current_set.number_of_bits(); ++i) {
-    if (current_set.Get(i)) {
-      IndexMapKey key = rev_index_map_[i];
-      const InstructionEntry *ie =
-          GetDefiningInstruction(*key.first,
-                                 key.second,
-                                 key.first->last_entry());
-      if (ie == NULL) {
-        fprintf(stderr, "Failure, unable to find defining instruction.\n");
-      } else {
-        Definition def(ie, key.first, key.second);
-        defs.push_back(def);
-      }
+  for (int i = current_set.NextSetBit(0); i != -1;
+       i = current_set.NextSetBit(i + 1)) {
+    IndexMapKey key = rev_index_map_[i];
+    const InstructionEntry *ie =
+        GetDefiningInstruction(*key.first,
+                               key.second,
+                               key.first->last_entry());
+    if (ie == NULL) {
+      fprintf(stderr, "Failure, unable to find defining instruction.\n");
+    } else {
+      Definition def(ie, key.first, key.second);
+      defs.push_back(def);
     }
   }
   return defs;
@@ -238,35 +231,33 @@ ReachingDefs::GetReachingDefs(const BasicBlock& bb,
   MAO_ASSERT(solved_);
 
   // Get the definition string at the instruction.
-  BitString current_set = GetReachingDefsAtInstruction(bb, insn);
-  BitString reg_string = GetAllDefsInFunction(reg_number);
-  BitString current_set_for_reg = current_set & reg_string;
+  BitString current_set_for_reg = GetReachingDefsAtInstruction(bb, insn);
+  current_set_for_reg &= GetAllDefsInFunction(reg_number);
 
   // Resturn list of definitions.
   std::list<Definition> defs;
-  for (int i = 0; i < current_set_for_reg.number_of_bits(); ++i) {
-    if (current_set_for_reg.Get(i)) {
-      IndexMapKey key = rev_index_map_.find(i)->second;
-      const InstructionEntry *ie = NULL;
-      if (key.first == &bb) {
-        // If the definition is found in the same basic block, make
-        // sure we start looking for the defining instruction above
-        // the current instruction.
-        ie = GetDefiningInstruction(bb,
-                                    reg_number,
-                                    insn.prev());
-      } else {
-        // If the definition is found in another basic block, make sure
-        // we start looking from the last instruction in that basic block.
-        ie = GetDefiningInstruction(*key.first,
-                                    key.second,
-                                    key.first->last_entry());
-      }
-      if (ie == NULL) {
-        fprintf(stderr, "Failure, unable to find defining instruction.\n");
-      } else {
-        defs.push_back(Definition(ie, key.first, key.second));
-      }
+  for (int i = current_set_for_reg.NextSetBit(0); i != -1;
+       i = current_set_for_reg.NextSetBit(i + 1)) {
+    IndexMapKey key = rev_index_map_.find(i)->second;
+    const InstructionEntry *ie = NULL;
+    if (key.first == &bb) {
+      // If the definition is found in the same basic block, make
+      // sure we start looking for the defining instruction above
+      // the current instruction.
+      ie = GetDefiningInstruction(bb,
+                                  reg_number,
+                                  insn.prev());
+    } else {
+      // If the definition is found in another basic block, make sure
+      // we start looking from the last instruction in that basic block.
+      ie = GetDefiningInstruction(*key.first,
+                                  key.second,
+                                  key.first->last_entry());
+    }
+    if (ie == NULL) {
+      fprintf(stderr, "Failure, unable to find defining instruction.\n");
+    } else {
+      defs.push_back(Definition(ie, key.first, key.second));
     }
   }
   return defs;
@@ -284,7 +275,7 @@ ReachingDefs::GetDefiningInstruction(const BasicBlock& bb,
        entry != bb.RevEntryEnd(); ++entry) {
     if ((*entry)->IsInstruction()) {
       InstructionEntry *curr_insn = (*entry)->AsInstruction();
-      BitString defined = GetRegisterDefMask(curr_insn, true);
+      RegisterMask defined = GetRegisterDefMask(curr_insn, true);
       if (defined.Get(reg_number)) {
         return curr_insn;
       }
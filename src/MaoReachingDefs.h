@@ -26,6 +26,7 @@
 
 #include "MaoCFG.h"
 #include "MaoDataFlow.h"
+#include "MaoDefs.h"
 #include "MaoUnit.h"
 #include "MaoUtil.h"
 
@@ -81,12 +82,12 @@ class ReachingDefs : public DFProblem {
 
   BitString GetInitialEntryState() {return BitString(num_bits_);}
 
-  BitString Confluence(const std::set<BitString *> &dataset) const {
-    return Union(dataset);
+  void Confluence(BitString *result, const BitString &data) const {
+    Union(result, data);
   }
 
   // Returns all the registers defined in the basic block.
-  BitString GetDefs(const BasicBlock& bb) const;
+  RegisterMask GetDefs(const BasicBlock& bb) const;
 
   // Returns the last instruction in the basic block that defines the
   // register reg_num, and starts looking at entry start_entry. Returns NULL if
@@ -129,7 +130,7 @@ class ReachingDefs : public DFProblem {
 
   // Wrapper to access defs_map_. Need to provide a default
   // string if it not in the map.
-  BitString GetAllDefsInFunction(int reg_num) const {
+  const BitString &GetAllDefsInFunction(int reg_num) const {
     MAO_ASSERT(reg_num < (int)defs_map_.size());
     return defs_map_[reg_num];
   }
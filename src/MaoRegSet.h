@@ -0,0 +1,324 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Fixed size bit sets.
+// Classes:
+//   RegSet<N> - A set of N bits with inline storage.
+//
+// RegSet has the interface of BitString, but its size is a compile time
+// constant. It needs no heap memory, copies are plain word copies, and
+// the set operations work on 128 or 256 bits at a time when the compiler
+// targets SSE2 or AVX2. It is used for register masks, which are built
+// for every instruction by the dataflow and scheduling passes.
+//
+#ifndef MAOREGSET_H_
+#define MAOREGSET_H_
+
+#include <stdio.h>
+
+#include <cstdarg>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "MaoDebug.h"
+
+template <int N>
+class RegSet {
+ public:
+  static const int kNumBits = N;
+  static const int kBitsPerWord = sizeof(unsigned long long) * 8;
+  static const int kNumWords = (N + kBitsPerWord - 1) / kBitsPerWord;
+
+  RegSet() {
+    for (int i = 0; i < kNumWords; ++i)
+      word_[i] = 0;
+  }
+
+  // Creates a set from the given "unsigned long long" words, in the form
+  // printed by PrintInitializer(). The sizes must match those of the set.
+  RegSet(int number_of_bits, int number_of_words, ...) {
+    MAO_ASSERT(number_of_bits == N);
+    MAO_ASSERT(number_of_words == kNumWords);
+    va_list vl;
+    va_start(vl, number_of_words);
+    for (int i = 0; i < kNumWords; ++i)
+      word_[i] = va_arg(vl, unsigned long long);
+    va_end(vl);
+  }
+
+  void Set(int index) {
+    MAO_ASSERT(index >= 0 && index < N);
+    word_[index / kBitsPerWord] |= 1ULL << (index % kBitsPerWord);
+  }
+
+  void Clear(int index) {
+    MAO_ASSERT(index >= 0 && index < N);
+    word_[index / kBitsPerWord] &= ~(1ULL << (index % kBitsPerWord));
+  }
+
+  bool Get(int index) const {
+    MAO_ASSERT(index >= 0 && index < N);
+    return word_[index / kBitsPerWord] & (1ULL << (index % kBitsPerWord));
+  }
+
+  // Returns the index of the next set bit at or after from_index, or -1.
+  // from_index may be N, which always returns -1. To visit all bits:
+  //   for (int i = set.NextSetBit(0); i != -1; i = set.NextSetBit(i + 1))
+  int NextSetBit(int from_index) const {
+    MAO_ASSERT(from_index >= 0 && from_index <= N);
+    int word_pos = from_index / kBitsPerWord;
+    if (word_pos == kNumWords)
+      return -1;
+    unsigned long long bits =
+        word_[word_pos] & (~0ULL << (from_index % kBitsPerWord));
+    while (!bits) {
+      if (++word_pos == kNumWords)
+        return -1;
+      bits = word_[word_pos];
+    }
+    int index = word_pos * kBitsPerWord + __builtin_ctzll(bits);
+    // The unused bits of the last word are only set in undefined sets.
+    return index < N ? index : -1;
+  }
+
+  unsigned long long GetWord(int index) const {
+    MAO_ASSERT(index >= 0 && index < kNumWords);
+    return word_[index];
+  }
+
+  RegSet &operator |=(const RegSet &b) {
+    Apply<OrOp>(b);
+    return *this;
+  }
+
+  RegSet &operator &=(const RegSet &b) {
+    Apply<AndOp>(b);
+    return *this;
+  }
+
+  // Removes the bits set in b.
+  RegSet &operator -=(const RegSet &b) {
+    Apply<AndNotOp>(b);
+    return *this;
+  }
+
+  RegSet operator |(const RegSet &b) const {
+    RegSet result(*this);
+    return result |= b;
+  }
+
+  RegSet operator &(const RegSet &b) const {
+    RegSet result(*this);
+    return result &= b;
+  }
+
+  RegSet operator -(const RegSet &b) const {
+    RegSet result(*this);
+    return result -= b;
+  }
+
+  // Flips the bits. The unused bits stay zero.
+  RegSet operator ~() const {
+    RegSet all;
+    all.SetUndef();
+    all.ClearUnusedBits();
+    return all - *this;
+  }
+
+  bool operator ==(const RegSet &b) const {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= kNumWords; i += 4) {
+      __m256i diff = _mm256_xor_si256(Load256(word_ + i),
+                                      Load256(b.word_ + i));
+      if (!_mm256_testz_si256(diff, diff))
+        return false;
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 2 <= kNumWords; i += 2) {
+      __m128i eq = _mm_cmpeq_epi8(Load128(word_ + i), Load128(b.word_ + i));
+      if (_mm_movemask_epi8(eq) != 0xffff)
+        return false;
+    }
+#endif
+    for (; i < kNumWords; ++i) {
+      if (word_[i] != b.word_[i])
+        return false;
+    }
+    return true;
+  }
+
+  bool operator !=(const RegSet &b) const {
+    return !(*this == b);
+  }
+
+  bool IsNull() const {
+    unsigned long long bits = 0;
+    for (int i = 0; i < kNumWords; ++i)
+      bits |= word_[i];
+    return bits == 0;
+  }
+
+  bool IsNonNull() const {
+    return !IsNull();
+  }
+
+  bool IsUndef() const {
+    unsigned long long bits = -1ULL;
+    for (int i = 0; i < kNumWords; ++i)
+      bits &= word_[i];
+    return bits == -1ULL;
+  }
+
+  void SetUndef() {
+    for (int i = 0; i < kNumWords; ++i)
+      word_[i] = -1ULL;
+  }
+
+  int NumOfBitsSet() const {
+    int count = 0;
+    for (int i = 0; i < kNumWords; ++i)
+      count += __builtin_popcountll(word_[i]);
+    return count;
+  }
+
+  int number_of_bits() const { return N; }
+
+  void Print() const {
+    fprintf(stderr, "bits: ");
+    for (int i = 0; i < kNumWords; ++i)
+      fprintf(stderr, "%016llx ", word_[i]);
+    fprintf(stderr, "\n");
+  }
+
+  void ToString(char *s, int max_size) const {
+    MAO_ASSERT(s != NULL);
+    MAO_ASSERT(max_size > 0);
+    int n = snprintf(s, max_size, "bits: ");
+    for (int i = 0; i < kNumWords && n < max_size; ++i)
+      n += snprintf(s + n, max_size - n, "%016llx ", word_[i]);
+    if (n < max_size)
+      snprintf(s + n, max_size - n, "\n");
+  }
+
+  // Prints a constructor call that recreates the set. Empty sets are
+  // printed as BNULL, which the generated tables define.
+  void PrintInitializer(FILE *f) const {
+    if (IsNull()) {
+      fprintf(f, "BNULL");
+      return;
+    }
+    fprintf(f, "RegSet<%d>(%d, %d", N, N, kNumWords);
+    for (int i = 0; i < kNumWords; ++i)
+      fprintf(f, ", 0x%llxULL", word_[i]);
+    fprintf(f, ")");
+  }
+
+ private:
+  // Word, 128-bit and 256-bit forms of the binary set operations.
+  struct OrOp {
+    static unsigned long long Word(unsigned long long a,
+                                   unsigned long long b) { return a | b; }
+#if defined(__SSE2__)
+    static __m128i Vec(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+#endif
+#if defined(__AVX2__)
+    static __m256i Vec(__m256i a, __m256i b) {
+      return _mm256_or_si256(a, b);
+    }
+#endif
+  };
+  struct AndOp {
+    static unsigned long long Word(unsigned long long a,
+                                   unsigned long long b) { return a & b; }
+#if defined(__SSE2__)
+    static __m128i Vec(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+#endif
+#if defined(__AVX2__)
+    static __m256i Vec(__m256i a, __m256i b) {
+      return _mm256_and_si256(a, b);
+    }
+#endif
+  };
+  struct AndNotOp {
+    static unsigned long long Word(unsigned long long a,
+                                   unsigned long long b) { return a & ~b; }
+#if defined(__SSE2__)
+    static __m128i Vec(__m128i a, __m128i b) {
+      return _mm_andnot_si128(b, a);
+    }
+#endif
+#if defined(__AVX2__)
+    static __m256i Vec(__m256i a, __m256i b) {
+      return _mm256_andnot_si256(b, a);
+    }
+#endif
+  };
+
+#if defined(__SSE2__)
+  static __m128i Load128(const unsigned long long *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  }
+  static void Store128(unsigned long long *p, __m128i v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+  }
+#endif
+#if defined(__AVX2__)
+  static __m256i Load256(const unsigned long long *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  static void Store256(unsigned long long *p, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+#endif
+
+  // Sets this to Op(this, b), widest vectors first.
+  template <typename Op>
+  void Apply(const RegSet &b) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= kNumWords; i += 4)
+      Store256(word_ + i, Op::Vec(Load256(word_ + i), Load256(b.word_ + i)));
+#endif
+#if defined(__SSE2__)
+    for (; i + 2 <= kNumWords; i += 2)
+      Store128(word_ + i, Op::Vec(Load128(word_ + i), Load128(b.word_ + i)));
+#endif
+    for (; i < kNumWords; ++i)
+      word_[i] = Op::Word(word_[i], b.word_[i]);
+  }
+
+  void ClearUnusedBits() {
+    if (N % kBitsPerWord)
+      word_[kNumWords - 1] &= (1ULL << (N % kBitsPerWord)) - 1;
+  }
+
+  // Unused bits in the last word are zero, except in undefined sets,
+  // where all words are -1ULL.
+  unsigned long long word_[kNumWords];
+};
+
+template <int N> const int RegSet<N>::kNumBits;
+template <int N> const int RegSet<N>::kBitsPerWord;
+template <int N> const int RegSet<N>::kNumWords;
+
+#endif  // MAOREGSET_H_
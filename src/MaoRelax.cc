@@ -21,6 +21,7 @@
 #include <stdlib.h>
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -40,6 +41,9 @@ extern "C" {
   void convert_to_bignum(expressionS *exp);
   int output_big_leb128(char *p, LITTLENUM_TYPE *bignum, int size, int sign);
   extern i386_cpu_flags cpu_arch_flags;
+  int get_jump_growth(symbolS *symbol, segT segment, relax_substateT subtype,
+                      enum bfd_reloc_code_real reloc, int *growth);
+  const relax_typeS *get_relax_table();
 }
 
 
@@ -47,13 +51,23 @@ extern "C" {
 // Options
 // --------------------------------------------------------------------
 MAO_DEFINE_OPTIONS(RELAX, "Runs a relaxation algorithm to compute sizes and" \
-                   " offsets of all instructions", 3) {
+                   " offsets of all instructions", 8) {
   OPTION_BOOL("collect_stats", false,
               "Collect and print a table with statistics about relaxer "
               "from all the processed functions."),
   OPTION_BOOL("dump_sizemap", false, "Dump the sizemap to stderr"),
   OPTION_BOOL("dump_function_stat", false, "Dump information about each function"
               " to stderr"),
+  OPTION_BOOL("incremental", true, "Only re-relax the functions that changed "
+              "when possible"),
+  OPTION_BOOL("verify_incremental", false, "Check each incremental relaxation "
+              "against a relaxation of the whole section"),
+  OPTION_BOOL("native", false, "Relax without building gas fragments when "
+              "possible"),
+  OPTION_BOOL("verify_native", false, "Check each native relaxation against "
+              "the gas relaxer"),
+  OPTION_BOOL("verify_sizes", false, "Check that the cached size of each "
+              "instruction matches its current encoding"),
 };
 
 
@@ -65,7 +79,13 @@ MaoRelaxer::MaoRelaxer(MaoUnit *mao_unit, Section *section,
   collect_stat_ = GetOptionBool("collect_stats");
   dump_sizemap_ = GetOptionBool("dump_sizemap");
   dump_function_stat_ = GetOptionBool("dump_function_stat");
+  incremental_ = GetOptionBool("incremental");
+  verify_incremental_ = GetOptionBool("verify_incremental");
+  native_ = GetOptionBool("native");
+  verify_native_ = GetOptionBool("verify_native");
+  verify_sizes_ = GetOptionBool("verify_sizes");
   if (collect_stat_) {
+    MaoMutexLock lock(unit_->GetStats()->mutex());
     if (unit_->GetStats()->HasStat("RELAX")) {
       relax_stat_ =
           static_cast<RelaxStat *>(unit_->GetStats()->GetStat("RELAX"));
@@ -97,58 +117,59 @@ void MaoRelaxer::RestoreState(const struct frag *fragments, FragState *state) {
   }
 }
 
-bool MaoRelaxer::Go() {
-  // Build the fragments (and initial sizes)
-  FragToEntryMap relax_map;
+static bool IsAlignDirective(MaoEntry *entry) {
+  if (!entry->IsDirective())
+    return false;
+  DirectiveEntry::Opcode op = entry->AsDirective()->op();
+  return op == DirectiveEntry::P2ALIGN || op == DirectiveEntry::P2ALIGNW ||
+      op == DirectiveEntry::P2ALIGNL;
+}
+
+static void GetAlignment(DirectiveEntry *entry, int *alignment, int *max) {
+  MAO_ASSERT(entry->NumOperands() == 3);
+  const DirectiveEntry::Operand *alignment_opnd = entry->GetOperand(0);
+  const DirectiveEntry::Operand *max_opnd = entry->GetOperand(2);
+  MAO_ASSERT(alignment_opnd->type == DirectiveEntry::INT);
+  MAO_ASSERT(max_opnd->type == DirectiveEntry::INT);
+  *alignment = alignment_opnd->data.i;
+  *max = max_opnd->data.i;
+}
 
+// Returns true if the entry belongs to a function other than function.
+static bool InOtherFunction(MaoEntry *entry, Function *function) {
+  return entry->function() != NULL && entry->function() != function;
+}
+
+bool MaoRelaxer::Go() {
   // This makes sure that gas do not finalize syms after
   // its first relaxation. We want to keep the symbols
   // unresolved so that we can update the IR and still
   // get valid sizes from the relaxer.
   finalize_syms = 0;
 
-  asection *bfd_section = bfd_get_section_by_name(stdoutput,
-                                                  section_->name().c_str());
-  MAO_ASSERT(bfd_section);
-
-  struct frag *fragments =
-      BuildFragments(unit_, section_, size_map_, &relax_map);
-
-  // The relaxer updates the instruction through the fragment. The opcode
-  // will change. Since we want to be able to relax several times,
-  // we save the state here and restore it after the sizemap has been built.
-  FragState fragment_state;
-  SaveState(fragments, &fragment_state);
-
-  // Relaxation normally only changes the fr_var part of the
-  // fragment. There are some cases (see md_estimate_size_before_relax())
-  // where fr_fix is changed as well. Therefore we need to keep track
-  // of the fr_fix values before relaxation. We do that in old_fr_fix.
-  std::vector<int> old_fr_fix;
-  for (struct frag *frag = fragments; frag; frag = frag->fr_next) {
-    old_fr_fix.push_back(frag->fr_fix);
-  }
-
-  // Run relaxation
-  for (int change = 1, pass = 0; change; pass++)
-    change = relax_segment(fragments, bfd_section, pass);
-
-  // Update sizes based on relaxation
-  int frag_index = 0;
-  for (struct frag *frag = fragments; frag; frag = frag->fr_next) {
-    std::map<struct frag *, MaoEntry *>::iterator entry =
-        relax_map.find(frag);
-    if (entry == relax_map.end()) continue;
-
-    // fr_next is guaranteed to be non-null because frag was found in
-    // the relax map.
-    int var_size = frag->fr_next->fr_address - frag->fr_address - frag->fr_fix;
-    (*size_map_)[entry->second] += var_size;
-    // Check if fr_fix have changed in relaxation:
-    if (frag->fr_fix != old_fr_fix[frag_index]) {
-      (*size_map_)[entry->second] += (frag->fr_fix - old_fr_fix[frag_index]);
+  std::vector<MaoEntry *> relaxable;
+  RelaxEntries(section_->EntryBegin(), section_->EntryEnd(), 0, NULL,
+               size_map_, &relaxable);
+
+  // Remember the labels that are reached from other functions, or that
+  // are outside of functions. Their offsets must not change when a single
+  // function is re-relaxed. Entries whose size may depend on any label
+  // add NULL to the set.
+  std::set<MaoEntry *> *cross_targets = section_->cross_targets();
+  cross_targets->clear();
+  for (std::vector<MaoEntry *>::const_iterator iter = relaxable.begin();
+       iter != relaxable.end(); ++iter) {
+    MaoEntry *entry = *iter;
+    LabelEntry *target;
+    if (entry->IsInstruction()) {
+      if (!GetJumpTarget(unit_, entry->AsInstruction(), &target))
+        cross_targets->insert(NULL);
+      else if (target != NULL && (target->function() == NULL ||
+                                  target->function() != entry->function()))
+        cross_targets->insert(target);
+    } else if (!IsAlignDirective(entry)) {
+      cross_targets->insert(NULL);
     }
-    frag_index++;
   }
 
   // calculate offset map
@@ -159,13 +180,6 @@ bool MaoRelaxer::Go() {
     offset += (*size_map_)[*iter];
   }
 
-
-  // Restore fragments/instructions to the originial state.
-  RestoreState(fragments, &fragment_state);
-
-  // Throw away the fragments
-  FreeFragments(fragments);
-
   if (dump_sizemap_) {
     for (MaoEntryIntMap::const_iterator iter = size_map_->begin();
          iter != size_map_->end();
@@ -212,6 +226,521 @@ bool MaoRelaxer::Go() {
 }
 
 
+void MaoRelaxer::RelaxFragments(struct frag *fragments,
+                                const FragToEntryMap &relax_map,
+                                MaoEntryIntMap *size_map) {
+  asection *bfd_section = bfd_get_section_by_name(stdoutput,
+                                                  section_->name().c_str());
+  MAO_ASSERT(bfd_section);
+
+  // The relaxer updates the instruction through the fragment. The opcode
+  // will change. Since we want to be able to relax several times,
+  // we save the state here and restore it after the sizemap has been built.
+  FragState fragment_state;
+  SaveState(fragments, &fragment_state);
+
+  // Relaxation normally only changes the fr_var part of the
+  // fragment. There are some cases (see md_estimate_size_before_relax())
+  // where fr_fix is changed as well. Therefore we need to keep track
+  // of the fr_fix values before relaxation. We do that in old_fr_fix.
+  std::vector<int> old_fr_fix;
+  for (struct frag *frag = fragments; frag; frag = frag->fr_next) {
+    old_fr_fix.push_back(frag->fr_fix);
+  }
+
+  // Run relaxation
+  for (int change = 1, pass = 0; change; pass++)
+    change = relax_segment(fragments, bfd_section, pass);
+
+  // Update sizes based on relaxation
+  int frag_index = 0;
+  for (struct frag *frag = fragments; frag;
+       frag = frag->fr_next, ++frag_index) {
+    FragToEntryMap::const_iterator entry = relax_map.find(frag);
+    if (entry == relax_map.end()) continue;
+
+    // fr_next is guaranteed to be non-null because frag was found in
+    // the relax map.
+    int var_size = frag->fr_next->fr_address - frag->fr_address - frag->fr_fix;
+    (*size_map)[entry->second] += var_size;
+    // Check if fr_fix have changed in relaxation:
+    if (frag->fr_fix != old_fr_fix[frag_index]) {
+      (*size_map)[entry->second] += (frag->fr_fix - old_fr_fix[frag_index]);
+    }
+  }
+
+  // Restore fragments/instructions to the originial state.
+  RestoreState(fragments, &fragment_state);
+
+  // Throw away the fragments
+  FreeFragments(fragments);
+}
+
+
+// A fragment of the native relaxer corresponds to a gas fragment, and
+// ends with a relaxable jump, an alignment, or the last entry. Jumps that
+// gas makes big in md_estimate_size_before_relax() do not end fragments,
+// as their size is known up front.
+struct MaoRelaxer::NativeLayout {
+  enum Kind { FIXED, JUMP, ALIGN };
+
+  struct Fragment {
+    Fragment()
+        : kind(FIXED), entry(-1), address(0), fix(0), var(0), subtype(0),
+          label(-1), offset(0), region(0) {}
+    Kind            kind;
+    // The entry that ends the fragment, as an index into entries.
+    int             entry;
+    addressT        address;
+    offsetT         fix;
+    offsetT         var;
+    // The relax state of a jump, or the maximum padding of an alignment.
+    relax_substateT subtype;
+    // The target of a jump, as an index into labels.
+    int             label;
+    // The addend of a jump, or the alignment as a power of two.
+    offsetT         offset;
+    // As the region of a gas frag, the number of alignments before the
+    // fragment.
+    int             region;
+  };
+
+  // The position gas would give the symbol of a label.
+  struct Label {
+    int     fragment;
+    offsetT value;
+  };
+
+  void AddLabel(const char *name) {
+    Label label = { static_cast<int>(fragments.size()) - 1,
+                    fragments.back().fix };
+    label_ids[name] = labels.size();
+    labels.push_back(label);
+  }
+
+  std::vector<MaoEntry *>                   entries;
+  std::vector<int>                          sizes;
+  std::vector<Fragment>                     fragments;
+  std::vector<Label>                        labels;
+  StringHashMap<int>                        label_ids;
+  // Jumps as pairs of fragment index and target name, resolved once all
+  // labels are known.
+  std::vector<std::pair<int, const char *> > jumps;
+  std::vector<MaoEntry *>                   relaxable;
+};
+
+bool MaoRelaxer::RelaxEntries(EntryIterator begin, EntryIterator end,
+                              int start_address,
+                              const std::set<MaoEntry *> *labels,
+                              MaoEntryIntMap *size_map,
+                              std::vector<MaoEntry *> *relaxable) {
+  asection *bfd_section = bfd_get_section_by_name(stdoutput,
+                                                  section_->name().c_str());
+  MAO_ASSERT(bfd_section);
+
+  if (verify_sizes_) {
+    for (EntryIterator iter = begin; iter != end; ++iter) {
+      MAO_RASSERT_MSG(!(*iter)->IsInstruction() ||
+                      (*iter)->AsInstruction()->CachedSizeIsCurrent(),
+                      "Instruction %d changed without dropping its size",
+                      (*iter)->id());
+    }
+  }
+
+  NativeLayout layout;
+  if (!native_ || !BuildNativeLayout(unit_, bfd_section, begin, end,
+                                     start_address, &layout))
+    return RelaxWithFragments(begin, end, start_address, labels, size_map,
+                              relaxable);
+
+  if (labels != NULL) {
+    for (std::vector<MaoEntry *>::const_iterator iter =
+             layout.relaxable.begin();
+         iter != layout.relaxable.end(); ++iter) {
+      if (!IsLocalEntry(*iter, *labels))
+        return false;
+    }
+  }
+  RelaxNativeLayout(&layout, size_map);
+  relaxable->insert(relaxable->end(), layout.relaxable.begin(),
+                    layout.relaxable.end());
+
+  if (verify_native_) {
+    MaoEntryIntMap sizes;
+    std::vector<MaoEntry *> gas_relaxable;
+    RelaxWithFragments(begin, end, start_address, NULL, &sizes,
+                       &gas_relaxable);
+    for (EntryIterator iter = begin; iter != end; ++iter) {
+      MAO_RASSERT_MSG((*size_map)[*iter] == sizes[*iter],
+                      "Native relaxation differs from gas relaxation "
+                      "in section %s", section_->name().c_str());
+    }
+  }
+  return true;
+}
+
+bool MaoRelaxer::RelaxWithFragments(EntryIterator begin, EntryIterator end,
+                                    int start_address,
+                                    const std::set<MaoEntry *> *labels,
+                                    MaoEntryIntMap *size_map,
+                                    std::vector<MaoEntry *> *relaxable) {
+  FragToEntryMap relax_map;
+  struct frag *fragments =
+      BuildFragments(unit_, section_, begin, end, start_address, size_map,
+                     &relax_map);
+  for (FragToEntryMap::const_iterator iter = relax_map.begin();
+       iter != relax_map.end(); ++iter) {
+    if (labels != NULL && !IsLocalEntry(iter->second, *labels)) {
+      FreeFragments(fragments);
+      return false;
+    }
+    relaxable->push_back(iter->second);
+  }
+  RelaxFragments(fragments, relax_map, size_map);
+  return true;
+}
+
+bool MaoRelaxer::IsLocalEntry(MaoEntry *entry,
+                              const std::set<MaoEntry *> &labels) {
+  if (!entry->IsInstruction())
+    return IsAlignDirective(entry);
+  LabelEntry *target;
+  return GetJumpTarget(unit_, entry->AsInstruction(), &target) &&
+      (target == NULL || labels.find(target) != labels.end());
+}
+
+
+bool MaoRelaxer::BuildNativeLayout(MaoUnit *mao, asection *segment,
+                                   EntryIterator begin, EntryIterator end,
+                                   int start_address, NativeLayout *layout) {
+  layout->fragments.push_back(NativeLayout::Fragment());
+  layout->fragments.back().fix = start_address;
+
+  for (EntryIterator iter = begin; iter != end; ++iter) {
+    MaoEntry *entry = *iter;
+    int index = layout->entries.size();
+    layout->entries.push_back(entry);
+    layout->sizes.push_back(0);
+    NativeLayout::Fragment *frag = &layout->fragments.back();
+    switch (entry->Type()) {
+      case MaoEntry::INSTRUCTION: {
+        InstructionEntry *ientry = entry->AsInstruction();
+        std::pair<int, bool> size_pair = ientry->SizeOfInstruction();
+        int size = size_pair.first;
+        if (size_pair.second) {
+          layout->relaxable.push_back(entry);
+          i386_insn *insn = ientry->instruction();
+          MAO_ASSERT(insn->tm.opcode_modifier.jump);
+          const expressionS *disp = insn->op[0].disps;
+          // Jumps to constants and expressions are left to gas.
+          if (disp->X_op != O_symbol)
+            return false;
+          relax_substateT subtype = JumpRelaxState(ientry);
+          int growth;
+          if (get_jump_growth(disp->X_add_symbol, segment, subtype,
+                              insn->reloc[0], &growth)) {
+            size += growth;
+          } else {
+            frag->kind = NativeLayout::JUMP;
+            frag->entry = index;
+            frag->subtype = subtype;
+            frag->offset = disp->X_add_number;
+            frag->fix += size;
+            layout->sizes.back() = size;
+            layout->jumps.push_back(
+                std::make_pair(static_cast<int>(layout->fragments.size()) - 1,
+                               S_GET_NAME(disp->X_add_symbol)));
+            layout->fragments.push_back(NativeLayout::Fragment());
+            break;
+          }
+        }
+        frag->fix += size;
+        layout->sizes.back() = size;
+        break;
+      }
+      case MaoEntry::DIRECTIVE: {
+        DirectiveEntry *dentry = entry->AsDirective();
+        int size = DirectiveSize(dentry);
+        if (size >= 0) {
+          frag->fix += size;
+          layout->sizes.back() = size;
+          break;
+        }
+        // Directives of variable size other than alignments are left
+        // to gas.
+        if (!IsAlignDirective(entry))
+          return false;
+        layout->relaxable.push_back(entry);
+        int alignment, max;
+        GetAlignment(dentry, &alignment, &max);
+        frag->kind = NativeLayout::ALIGN;
+        frag->entry = index;
+        frag->subtype = static_cast<relax_substateT>(max);
+        frag->offset = alignment;
+        layout->fragments.push_back(NativeLayout::Fragment());
+        break;
+      }
+      case MaoEntry::LABEL: {
+        // As in BuildFragments(), only labels that have a symbol in the
+        // gas symbol table, and their "equal" symbols, get a position.
+        LabelEntry *le = entry->AsLabel();
+        if (le->from_assembly()) {
+          layout->AddLabel(le->name());
+          Symbol *s = mao->GetSymbolTable()->Find(le->name());
+          MAO_ASSERT(s != NULL);
+          for (Symbol::EqualIterator iter = s->EqualBegin();
+               iter != s->EqualEnd();
+               ++iter) {
+            layout->AddLabel((*iter)->name());
+          }
+        }
+        break;
+      }
+      case MaoEntry::UNDEFINED:
+        // Nothing to do
+      default:
+        MAO_ASSERT(0);
+    }
+  }
+
+  // The symbols of jumps to other labels in the section, e.g., labels
+  // defined by directives, are left to gas.
+  for (std::vector<std::pair<int, const char *> >::const_iterator iter =
+           layout->jumps.begin();
+       iter != layout->jumps.end(); ++iter) {
+    const int *label = layout->label_ids.Find(iter->second);
+    if (label == NULL)
+      return false;
+    layout->fragments[iter->first].label = *label;
+  }
+  return true;
+}
+
+// Returns the padding gas inserts for an alignment fragment whose
+// variable part starts at address.
+static addressT AlignPadding(addressT address, int alignment,
+                             relax_substateT max) {
+  addressT mask = ~((~static_cast<addressT>(0)) << alignment);
+  addressT padding = ((address + mask) & ~mask) - address;
+  return max != 0 && padding > max ? 0 : padding;
+}
+
+void MaoRelaxer::RelaxNativeLayout(NativeLayout *layout,
+                                   MaoEntryIntMap *size_map) {
+  const relax_typeS *table = get_relax_table();
+  std::vector<NativeLayout::Fragment> &fragments = layout->fragments;
+  int num_fragments = fragments.size();
+
+  // Initial sizes, as in the first loop of relax_segment(). Jumps start
+  // out short, and each alignment starts a new region.
+  addressT address = 0;
+  int region = 0;
+  for (int i = 0; i < num_fragments; ++i) {
+    NativeLayout::Fragment &frag = fragments[i];
+    frag.address = address;
+    frag.region = region;
+    address += frag.fix;
+    if (frag.kind == NativeLayout::JUMP) {
+      frag.var = table[frag.subtype].rlx_length;
+    } else if (frag.kind == NativeLayout::ALIGN) {
+      frag.var = AlignPadding(address, frag.offset, frag.subtype);
+      ++region;
+    }
+    address += frag.var;
+  }
+
+  // The passes of relax_segment(). Each pass moves the fragments by the
+  // growth of the ones before them, and jumps only ever grow, so the
+  // passes stop when one of them does not change any size.
+  bool stretched;
+  do {
+    offsetT stretch = 0;
+    stretched = false;
+    for (int i = 0; i < num_fragments; ++i) {
+      NativeLayout::Fragment &frag = fragments[i];
+      addressT was_address = frag.address;
+      frag.address += stretch;
+      offsetT growth = 0;
+      if (frag.kind == NativeLayout::ALIGN) {
+        growth = AlignPadding(frag.address + frag.fix, frag.offset,
+                              frag.subtype) -
+            AlignPadding(was_address + frag.fix, frag.offset, frag.subtype);
+      } else if (frag.kind == NativeLayout::JUMP) {
+        // As in relax_frag(), targets that have not been reached in this
+        // pass are assumed to move by stretch as well, unless an alignment
+        // in between may absorb a positive stretch. Such forward targets
+        // are only kept from falling behind the jump. gas compares them
+        // with the address as unsigned numbers.
+        const NativeLayout::Label &label = layout->labels[frag.label];
+        offsetT target = fragments[label.fragment].address + label.value +
+            frag.offset;
+        if (stretch != 0 && label.fragment > i) {
+          if (stretch < 0 || fragments[label.fragment].region == frag.region)
+            target += stretch;
+          else if (static_cast<addressT>(target) < frag.address)
+            target = fragments[i + 1].address + stretch;
+        }
+        offsetT aim = target - frag.address - frag.fix;
+
+        const relax_typeS *start_type = table + frag.subtype;
+        const relax_typeS *this_type = start_type;
+        if (aim < 0) {
+          while (aim < this_type->rlx_backward && this_type->rlx_more) {
+            frag.subtype = this_type->rlx_more;
+            this_type = table + frag.subtype;
+          }
+        } else {
+          while (aim > this_type->rlx_forward && this_type->rlx_more) {
+            frag.subtype = this_type->rlx_more;
+            this_type = table + frag.subtype;
+          }
+        }
+        growth = this_type->rlx_length - start_type->rlx_length;
+      }
+      if (growth != 0) {
+        frag.var += growth;
+        stretch += growth;
+        stretched = true;
+      }
+    }
+  } while (stretched);
+
+  for (int i = 0; i < num_fragments; ++i) {
+    if (fragments[i].entry >= 0)
+      layout->sizes[fragments[i].entry] += fragments[i].var;
+  }
+  for (int i = 0; i < static_cast<int>(layout->entries.size()); ++i)
+    (*size_map)[layout->entries[i]] = layout->sizes[i];
+}
+
+
+bool MaoRelaxer::GetJumpTarget(MaoUnit *mao, InstructionEntry *entry,
+                               LabelEntry **label) {
+  *label = NULL;
+  const expressionS *disp = entry->instruction()->op[0].disps;
+  if (disp->X_op == O_constant)
+    return true;
+  if (disp->X_op != O_symbol)
+    return false;
+  *label = mao->GetLabelEntry(S_GET_NAME(disp->X_add_symbol));
+  return *label != NULL || !S_IS_DEFINED(disp->X_add_symbol);
+}
+
+
+// Re-relaxes the function together with the entries that follow it, up
+// to and including the next alignment directive. The window stops before
+// the next function, as the jumps of that function to its own labels are
+// not remembered as cross targets. The result is the same as relaxing the
+// whole section if:
+//  - The entries before the window did not change. Their offsets give
+//    the start address of the window.
+//  - The jumps in the window only target labels inside it, or undefined
+//    symbols. The only other relaxable entries in the window are
+//    alignments.
+//  - Labels in the window that are jumped to from other functions keep
+//    their offsets.
+//  - The window ends at the same offset as before, i.e., the alignment
+//    at its end absorbs any change in size, or the window reaches the
+//    end of the section.
+// Otherwise nothing is updated and false is returned.
+bool MaoRelaxer::RelaxFunction(Function *function) {
+  MAO_ASSERT(function->GetSection() == section_);
+  MaoEntry *first = function->first_entry();
+  MaoEntry *last = function->last_entry();
+  while (last->next() != NULL && !IsAlignDirective(last->next()) &&
+         !InOtherFunction(last->next(), function))
+    last = last->next();
+  if (last->next() != NULL && !InOtherFunction(last->next(), function))
+    last = last->next();
+  MaoEntry *end = last->next();
+
+  int start_address = 0;
+  if (first->prev() != NULL) {
+    MaoEntry *prev = first->prev();
+    if (size_map_->find(prev) == size_map_->end() ||
+        offset_map_->find(prev) == offset_map_->end())
+      return false;
+    start_address = (*offset_map_)[prev] + (*size_map_)[prev];
+  }
+  int old_end_address = 0;
+  if (end != NULL) {
+    if (size_map_->find(last) == size_map_->end() ||
+        offset_map_->find(last) == offset_map_->end())
+      return false;
+    old_end_address = (*offset_map_)[last] + (*size_map_)[last];
+  }
+
+  std::set<MaoEntry *> labels;
+  for (EntryIterator iter(first); iter != EntryIterator(end); ++iter) {
+    if ((*iter)->IsLabel())
+      labels.insert(*iter);
+  }
+
+  // Jumps out of the window would use the fragments of the last full
+  // relaxation, which are gone, so they are checked before relaxing.
+  MaoEntryIntMap sizes;
+  std::vector<MaoEntry *> relaxable;
+  if (!RelaxEntries(EntryIterator(first), EntryIterator(end), start_address,
+                    &labels, &sizes, &relaxable))
+    return false;
+
+  MaoEntryIntMap offsets;
+  int offset = start_address;
+  for (EntryIterator iter(first); iter != EntryIterator(end); ++iter) {
+    offsets[*iter] = offset;
+    offset += sizes[*iter];
+  }
+  if (end != NULL && offset != old_end_address)
+    return false;
+
+  std::set<MaoEntry *> *cross_targets = section_->cross_targets();
+  for (std::set<MaoEntry *>::const_iterator iter = labels.begin();
+       iter != labels.end(); ++iter) {
+    if (cross_targets->find(*iter) != cross_targets->end() &&
+        (offset_map_->find(*iter) == offset_map_->end() ||
+         (*offset_map_)[*iter] != offsets[*iter]))
+      return false;
+  }
+
+  for (EntryIterator iter(first); iter != EntryIterator(end); ++iter) {
+    (*size_map_)[*iter] = sizes[*iter];
+    (*offset_map_)[*iter] = offsets[*iter];
+  }
+  return true;
+}
+
+bool MaoRelaxer::RelaxFunctions() {
+  // The statistics and dumps are produced by full relaxations only.
+  if (!incremental_ || collect_stat_ || dump_sizemap_ || dump_function_stat_)
+    return false;
+  std::set<MaoEntry *> *cross_targets = section_->cross_targets();
+  if (cross_targets->find(NULL) != cross_targets->end())
+    return false;
+
+  finalize_syms = 0;
+  std::set<Function *> *dirty = section_->dirty_functions();
+  for (std::set<Function *>::const_iterator iter = dirty->begin();
+       iter != dirty->end(); ++iter) {
+    if (!RelaxFunction(*iter))
+      return false;
+  }
+  dirty->clear();
+
+  if (verify_incremental_) {
+    MaoEntryIntMap sizes, offsets;
+    Relax(unit_, section_, &sizes, &offsets);
+    for (EntryIterator iter = section_->EntryBegin();
+         iter != section_->EntryEnd(); ++iter) {
+      MAO_RASSERT_MSG((*size_map_)[*iter] == sizes[*iter] &&
+                      (*offset_map_)[*iter] == offsets[*iter],
+                      "Incremental relaxation differs from full relaxation "
+                      "in section %s", section_->name().c_str());
+    }
+  }
+  return true;
+}
+
+
 MaoEntryIntMap *MaoRelaxer::GetSizeMap(MaoUnit *mao, Section *section) {
   CacheSizeAndOffsetMap(mao, section);
   return section->sizes();
@@ -224,11 +753,19 @@ MaoEntryIntMap *MaoRelaxer::GetOffsetMap(MaoUnit *mao, Section *section) {
 
 void MaoRelaxer::CacheSizeAndOffsetMap(MaoUnit *mao, Section *section) {
   MAO_ASSERT(section);
+  if (section->sizes() != NULL && !section->dirty_functions()->empty()) {
+    MaoTimerScope timer("RELAX");
+    MaoRelaxer relaxer(mao, section, section->sizes(), section->offsets());
+    if (!relaxer.RelaxFunctions())
+      InvalidateSizeMap(section);
+  }
+
   MaoEntryIntMap *offsets, *sizes = section->sizes();
   if (sizes == NULL) {
     sizes   = new MaoEntryIntMap();
     offsets = new MaoEntryIntMap();
 
+    MaoTimerScope timer("RELAX");
     Relax(mao, section, sizes, offsets);
 
     section->set_sizes(sizes);
@@ -244,27 +781,46 @@ bool MaoRelaxer::HasSizeMap(Section *section) {
 void MaoRelaxer::InvalidateSizeMap(Section *section) {
   section->set_sizes(NULL);
   section->set_offsets(NULL);
+  section->dirty_functions()->clear();
+  section->cross_targets()->clear();
+}
+
+void MaoRelaxer::InvalidateSizeMap(Section *section, Function *function) {
+  MAO_ASSERT(function->GetSection() == section);
+  if (HasSizeMap(section))
+    section->dirty_functions()->insert(function);
+}
+
+void MaoRelaxer::EraseEntry(Section *section, Function *function,
+                            MaoEntry *entry) {
+  if (!HasSizeMap(section))
+    return;
+  // Entries added since the last relaxation are not in the maps yet.
+  section->sizes()->erase(entry);
+  section->offsets()->erase(entry);
+  InvalidateSizeMap(section, function);
 }
 
 
 struct frag *MaoRelaxer::BuildFragments(MaoUnit *mao, Section *section,
+                                        EntryIterator begin, EntryIterator end,
+                                        int start_address,
                                         MaoEntryIntMap *size_map,
                                         FragToEntryMap *relax_map) {
   struct frag *fragments, *frag;
   fragments = frag = NewFragment();
+  // Addresses in the fragments are relative to the first one, which
+  // therefore takes up the space before begin.
+  frag->fr_fix = start_address;
 
   bool is_text = !section->name().compare(".text");
 
-  for (EntryIterator iter = section->EntryBegin();
-       iter != section->EntryEnd(); ++iter) {
+  for (EntryIterator iter = begin; iter != end; ++iter) {
     MaoEntry *entry = *iter;
     switch (entry->Type()) {
       case MaoEntry::INSTRUCTION: {
         InstructionEntry *ientry = static_cast<InstructionEntry*>(entry);
-        X86InstructionSizeHelper size_helper(
-            ientry->instruction());
-        std::pair<int, bool> size_pair =
-            size_helper.SizeOfInstruction(ientry->GetFlag());
+        std::pair<int, bool> size_pair = ientry->SizeOfInstruction();
         frag->fr_fix += size_pair.first;
         (*size_map)[entry] = size_pair.first;
 
@@ -277,192 +833,14 @@ struct frag *MaoRelaxer::BuildFragments(MaoUnit *mao, Section *section,
       }
       case MaoEntry::DIRECTIVE: {
         DirectiveEntry *dentry = static_cast<DirectiveEntry*>(entry);
-        switch (dentry->op()) {
-          case DirectiveEntry::P2ALIGN:
-          case DirectiveEntry::P2ALIGNW:
-          case DirectiveEntry::P2ALIGNL: {
-            MAO_ASSERT(dentry->NumOperands() == 3);
-            const DirectiveEntry::Operand *alignment = dentry->GetOperand(0);
-            const DirectiveEntry::Operand *max = dentry->GetOperand(2);
-
-            MAO_ASSERT(alignment->type == DirectiveEntry::INT);
-            MAO_ASSERT(max->type == DirectiveEntry::INT);
-
-            (*size_map)[entry] = 0;
-            (*relax_map)[frag] = entry;
-            frag = EndFragmentAlign(is_text, alignment->data.i,
-                                    max->data.i, frag, true);
-            break;
-          }
-          case DirectiveEntry::SLEB128:
-          case DirectiveEntry::ULEB128: {
-            bool is_signed = dentry->op() == DirectiveEntry::SLEB128;
-            MAO_ASSERT(dentry->NumOperands() == 1);
-            const DirectiveEntry::Operand *value = dentry->GetOperand(0);
-            MAO_ASSERT(value->type == DirectiveEntry::EXPRESSION);
-            expressionS *expr = value->data.expr;
-
-            if (expr->X_op == O_constant && is_signed &&
-                (expr->X_add_number < 0) != !expr->X_unsigned) {
-              // TODO(nvachhar): Should we assert instead of changing the IR?
-              // We're outputting a signed leb128 and the sign of X_add_number
-              // doesn't reflect the sign of the original value.  Convert EXP
-              // to a correctly-extended bignum instead.
-              convert_to_bignum(expr);
-            }
-
-            if (expr->X_op == O_constant) {
-              // If we've got a constant, compute its size right now
-              int size =
-                  sizeof_leb128(expr->X_add_number, is_signed ? 1 : 0);
-              frag->fr_fix += size;
-              (*size_map)[entry] = size;
-            } else if (expr->X_op == O_big) {
-              // O_big is a different sort of constant.
-              int size =
-                  output_big_leb128(NULL, generic_bignum,
-                                    expr->X_add_number, is_signed ? 1 : 0);
-              (*size_map)[entry] = size;
-              frag->fr_fix += size;
-            } else {
-              // Otherwise, end the fragment
-              (*size_map)[entry] = 0;
-              (*relax_map)[frag] = entry;
-              frag = EndFragmentLeb128(value, is_signed, frag, true);
-            }
-            break;
-          }
-          case DirectiveEntry::BYTE:
-            frag->fr_fix++;
-            (*size_map)[entry] = 1;
-            break;
-          case DirectiveEntry::WORD:
-            frag->fr_fix += 2;
-            (*size_map)[entry] = 2;
-            break;
-          case DirectiveEntry::RVA:
-          case DirectiveEntry::LONG:
-            frag->fr_fix += 4;
-            (*size_map)[entry] = 4;
-            break;
-          case DirectiveEntry::QUAD:
-            frag->fr_fix += 8;
-            (*size_map)[entry] = 8;
-            break;
-          case DirectiveEntry::ASCII:
-            HandleString(dentry, 1, false, frag, size_map);
-            break;
-          case DirectiveEntry::STRING8:
-            HandleString(dentry, 1, true, frag, size_map);
-            break;
-          case DirectiveEntry::STRING16:
-            HandleString(dentry, 2, true, frag, size_map);
-            break;
-          case DirectiveEntry::STRING32:
-            HandleString(dentry, 4, true, frag, size_map);
-            break;
-          case DirectiveEntry::STRING64:
-            HandleString(dentry, 8, true, frag, size_map);
-            break;
-          case DirectiveEntry::SPACE:
-            frag = HandleSpace(dentry, 0, frag, true, size_map, relax_map);
-            break;
-          case DirectiveEntry::DS_B:
-            frag = HandleSpace(dentry, 1, frag, true, size_map, relax_map);
-            break;
-          case DirectiveEntry::DS_W:
-            frag = HandleSpace(dentry, 2, frag, true, size_map, relax_map);
-            break;
-          case DirectiveEntry::DS_L:
-            frag = HandleSpace(dentry, 4, frag, true, size_map, relax_map);
-            break;
-          case DirectiveEntry::DS_D:
-            frag = HandleSpace(dentry, 8, frag, true, size_map, relax_map);
-            break;
-          case DirectiveEntry::DS_X:
-            frag = HandleSpace(dentry, 12, frag, true, size_map, relax_map);
-            break;
-          case DirectiveEntry::COMM:
-            // TODO(martint): verify that its safe to handle COMM this way
-            (*size_map)[entry] = 0;
-            // Nothing to do
-            break;
-          case DirectiveEntry::IDENT:
-            // TODO(martint): Update relaxer to handle the comment section
-            // properly for the ident directive
-            (*size_map)[entry] = 0;
-            break;
-          case DirectiveEntry::SET:
-          case DirectiveEntry::FILE:
-          case DirectiveEntry::SECTION:
-          case DirectiveEntry::GLOBAL:
-          case DirectiveEntry::LOCAL:
-          case DirectiveEntry::WEAK:
-          case DirectiveEntry::TYPE:
-          case DirectiveEntry::SIZE:
-          case DirectiveEntry::EQUIV:
-          case DirectiveEntry::WEAKREF:
-          case DirectiveEntry::ARCH:
-          case DirectiveEntry::LINEFILE:
-          case DirectiveEntry::LOC:
-          case DirectiveEntry::ALLOW_INDEX_REG:
-          case DirectiveEntry::DISALLOW_INDEX_REG:
-            (*size_map)[entry] = 0;
-            break;
-          case DirectiveEntry::ORG:
-            // TODO(martint): Add support for ORG directives in the relaxer.
-            MAO_ASSERT_MSG(false, ".org directive unsupported in relaxer.");
-          case DirectiveEntry::CODE16:
-          case DirectiveEntry::CODE16GCC:
-          case DirectiveEntry::CODE32:
-          case DirectiveEntry::CODE64:
-            (*size_map)[entry] = 0;
-            break;
-          case DirectiveEntry::DC_D:
-          case DirectiveEntry::DC_S:
-          case DirectiveEntry::DC_X:
-            (*size_map)[entry] = SizeOfFloat(dentry);
-            break;
-          case DirectiveEntry::HIDDEN:
-            (*size_map)[entry] = 0;
-            break;
-          case DirectiveEntry::FILL:
-            frag = HandleFill(dentry, frag, true, size_map, relax_map);
-            break;
-          case DirectiveEntry::STRUCT:
-            // TODO(martint): Add support for .struct/.offset directives
-            MAO_ASSERT_MSG(false, ".struct directive unsupported in relaxer.");
-          case DirectiveEntry::INCBIN:
-            // TODO(martint): Add support for .struct/.offset directives
-            MAO_ASSERT_MSG(false, ".struct directive unsupported in relaxer.");
-          case DirectiveEntry::SYMVER:
-          case DirectiveEntry::LOC_MARK_LABELS:
-          case DirectiveEntry::CFI_STARTPROC:
-          case DirectiveEntry::CFI_ENDPROC:
-          case DirectiveEntry::CFI_DEF_CFA:
-          case DirectiveEntry::CFI_DEF_CFA_REGISTER:
-          case DirectiveEntry::CFI_DEF_CFA_OFFSET:
-          case DirectiveEntry::CFI_ADJUST_CFA_OFFSET:
-          case DirectiveEntry::CFI_OFFSET:
-          case DirectiveEntry::CFI_REL_OFFSET:
-          case DirectiveEntry::CFI_REGISTER:
-          case DirectiveEntry::CFI_RETURN_COLUMN:
-          case DirectiveEntry::CFI_RESTORE:
-          case DirectiveEntry::CFI_UNDEFINED:
-          case DirectiveEntry::CFI_SAME_VALUE:
-          case DirectiveEntry::CFI_REMEMBER_STATE:
-          case DirectiveEntry::CFI_RESTORE_STATE:
-          case DirectiveEntry::CFI_WINDOW_SAVE:
-          case DirectiveEntry::CFI_ESCAPE:
-          case DirectiveEntry::CFI_SIGNAL_FRAME:
-          case DirectiveEntry::CFI_PERSONALITY:
-          case DirectiveEntry::CFI_LSDA:
-          case DirectiveEntry::CFI_VAL_ENCODED_ADDR:
-            (*size_map)[entry] = 0;
-            break;
-          case DirectiveEntry::NUM_OPCODES: // should never happen..
-          default:
-            MAO_ASSERT_MSG(0, "Unhandled directive: %d", dentry->op());
+        int size = DirectiveSize(dentry);
+        if (size >= 0) {
+          frag->fr_fix += size;
+          (*size_map)[entry] = size;
+        } else {
+          (*size_map)[entry] = 0;
+          (*relax_map)[frag] = entry;
+          frag = EndFragmentDirective(dentry, is_text, frag, true);
         }
         break;
       }
@@ -499,6 +877,173 @@ struct frag *MaoRelaxer::BuildFragments(MaoUnit *mao, Section *section,
 }
 
 
+int MaoRelaxer::DirectiveSize(DirectiveEntry *entry) {
+  switch (entry->op()) {
+    case DirectiveEntry::P2ALIGN:
+    case DirectiveEntry::P2ALIGNW:
+    case DirectiveEntry::P2ALIGNL:
+      return -1;
+    case DirectiveEntry::SLEB128:
+    case DirectiveEntry::ULEB128: {
+      bool is_signed = entry->op() == DirectiveEntry::SLEB128;
+      MAO_ASSERT(entry->NumOperands() == 1);
+      const DirectiveEntry::Operand *value = entry->GetOperand(0);
+      MAO_ASSERT(value->type == DirectiveEntry::EXPRESSION);
+      expressionS *expr = value->data.expr;
+
+      if (expr->X_op == O_constant && is_signed &&
+          (expr->X_add_number < 0) != !expr->X_unsigned) {
+        // TODO(nvachhar): Should we assert instead of changing the IR?
+        // We're outputting a signed leb128 and the sign of X_add_number
+        // doesn't reflect the sign of the original value.  Convert EXP
+        // to a correctly-extended bignum instead.
+        convert_to_bignum(expr);
+      }
+
+      if (expr->X_op == O_constant) {
+        // If we've got a constant, compute its size right now
+        return sizeof_leb128(expr->X_add_number, is_signed ? 1 : 0);
+      } else if (expr->X_op == O_big) {
+        // O_big is a different sort of constant.
+        return output_big_leb128(NULL, generic_bignum,
+                                 expr->X_add_number, is_signed ? 1 : 0);
+      }
+      // Otherwise, end the fragment
+      return -1;
+    }
+    case DirectiveEntry::BYTE:
+      return 1;
+    case DirectiveEntry::WORD:
+      return 2;
+    case DirectiveEntry::RVA:
+    case DirectiveEntry::LONG:
+      return 4;
+    case DirectiveEntry::QUAD:
+      return 8;
+    case DirectiveEntry::ASCII:
+      return StringSize(entry, 1, false);
+    case DirectiveEntry::STRING8:
+      return StringSize(entry, 1, true);
+    case DirectiveEntry::STRING16:
+      return StringSize(entry, 2, true);
+    case DirectiveEntry::STRING32:
+      return StringSize(entry, 4, true);
+    case DirectiveEntry::STRING64:
+      return StringSize(entry, 8, true);
+    case DirectiveEntry::SPACE:
+      return SpaceSize(entry, 0);
+    case DirectiveEntry::DS_B:
+      return SpaceSize(entry, 1);
+    case DirectiveEntry::DS_W:
+      return SpaceSize(entry, 2);
+    case DirectiveEntry::DS_L:
+      return SpaceSize(entry, 4);
+    case DirectiveEntry::DS_D:
+      return SpaceSize(entry, 8);
+    case DirectiveEntry::DS_X:
+      return SpaceSize(entry, 12);
+    case DirectiveEntry::COMM:
+      // TODO(martint): verify that its safe to handle COMM this way
+      return 0;
+    case DirectiveEntry::IDENT:
+      // TODO(martint): Update relaxer to handle the comment section
+      // properly for the ident directive
+      return 0;
+    case DirectiveEntry::SET:
+    case DirectiveEntry::FILE:
+    case DirectiveEntry::SECTION:
+    case DirectiveEntry::GLOBAL:
+    case DirectiveEntry::LOCAL:
+    case DirectiveEntry::WEAK:
+    case DirectiveEntry::TYPE:
+    case DirectiveEntry::SIZE:
+    case DirectiveEntry::EQUIV:
+    case DirectiveEntry::WEAKREF:
+    case DirectiveEntry::ARCH:
+    case DirectiveEntry::LINEFILE:
+    case DirectiveEntry::LOC:
+    case DirectiveEntry::ALLOW_INDEX_REG:
+    case DirectiveEntry::DISALLOW_INDEX_REG:
+      return 0;
+    case DirectiveEntry::ORG:
+      // TODO(martint): Add support for ORG directives in the relaxer.
+      MAO_ASSERT_MSG(false, ".org directive unsupported in relaxer.");
+    case DirectiveEntry::CODE16:
+    case DirectiveEntry::CODE16GCC:
+    case DirectiveEntry::CODE32:
+    case DirectiveEntry::CODE64:
+      return 0;
+    case DirectiveEntry::DC_D:
+    case DirectiveEntry::DC_S:
+    case DirectiveEntry::DC_X:
+      return SizeOfFloat(entry);
+    case DirectiveEntry::HIDDEN:
+      return 0;
+    case DirectiveEntry::FILL: {
+      MAO_ASSERT(entry->NumOperands() == 3);
+      const DirectiveEntry::Operand *repeat_opnd = entry->GetOperand(0);
+      const DirectiveEntry::Operand *size_opnd = entry->GetOperand(1);
+      MAO_ASSERT(repeat_opnd->type == DirectiveEntry::EXPRESSION);
+      MAO_ASSERT(size_opnd->type == DirectiveEntry::INT);
+      MAO_ASSERT(size_opnd->data.i >= 1);
+      if (repeat_opnd->data.expr->X_op == O_constant)
+        return size_opnd->data.i * repeat_opnd->data.expr->X_add_number;
+      return -1;
+    }
+    case DirectiveEntry::STRUCT:
+      // TODO(martint): Add support for .struct/.offset directives
+      MAO_ASSERT_MSG(false, ".struct directive unsupported in relaxer.");
+    case DirectiveEntry::INCBIN:
+      // TODO(martint): Add support for .struct/.offset directives
+      MAO_ASSERT_MSG(false, ".struct directive unsupported in relaxer.");
+    case DirectiveEntry::SYMVER:
+    case DirectiveEntry::LOC_MARK_LABELS:
+    case DirectiveEntry::CFI_STARTPROC:
+    case DirectiveEntry::CFI_ENDPROC:
+    case DirectiveEntry::CFI_DEF_CFA:
+    case DirectiveEntry::CFI_DEF_CFA_REGISTER:
+    case DirectiveEntry::CFI_DEF_CFA_OFFSET:
+    case DirectiveEntry::CFI_ADJUST_CFA_OFFSET:
+    case DirectiveEntry::CFI_OFFSET:
+    case DirectiveEntry::CFI_REL_OFFSET:
+    case DirectiveEntry::CFI_REGISTER:
+    case DirectiveEntry::CFI_RETURN_COLUMN:
+    case DirectiveEntry::CFI_RESTORE:
+    case DirectiveEntry::CFI_UNDEFINED:
+    case DirectiveEntry::CFI_SAME_VALUE:
+    case DirectiveEntry::CFI_REMEMBER_STATE:
+    case DirectiveEntry::CFI_RESTORE_STATE:
+    case DirectiveEntry::CFI_WINDOW_SAVE:
+    case DirectiveEntry::CFI_ESCAPE:
+    case DirectiveEntry::CFI_SIGNAL_FRAME:
+    case DirectiveEntry::CFI_PERSONALITY:
+    case DirectiveEntry::CFI_LSDA:
+    case DirectiveEntry::CFI_VAL_ENCODED_ADDR:
+      return 0;
+    case DirectiveEntry::NUM_OPCODES: // should never happen..
+    default:
+      MAO_ASSERT_MSG(0, "Unhandled directive: %d", entry->op());
+  }
+  return 0;
+}
+
+
+int MaoRelaxer::SpaceSize(DirectiveEntry *entry, int mult) {
+  MAO_ASSERT(entry->NumOperands() == 2);
+  const DirectiveEntry::Operand *size_opnd = entry->GetOperand(0);
+  MAO_ASSERT(size_opnd->type == DirectiveEntry::EXPRESSION);
+  expressionS *size = size_opnd->data.expr;
+
+  if (size->X_op != O_constant) {
+    MAO_ASSERT(mult == 0 || mult == 1);
+    return -1;
+  }
+  int increment = size->X_add_number * (mult ? mult : 1);
+  MAO_ASSERT(increment > 0);
+  return increment;
+}
+
+
 int MaoRelaxer::SizeOfFloat(DirectiveEntry *entry) {
   MAO_ASSERT(entry->NumOperands() == 1);
   const DirectiveEntry::Operand *size_opnd = entry->GetOperand(0);
@@ -552,9 +1097,7 @@ void MaoRelaxer::UpdateSymbol(const char *symbol_name,
   S_SET_VALUE(symbolP, frag->fr_fix);  //  / OCTETS_PER_BYTE
 }
 
-struct frag *MaoRelaxer::EndFragmentInstruction(InstructionEntry *entry,
-                                                struct frag *frag,
-                                                bool new_frag) {
+relax_substateT MaoRelaxer::JumpRelaxState(InstructionEntry *entry) {
 /* Types.  */
 #define UNCOND_JUMP 0
 #define COND_JUMP 1
@@ -572,9 +1115,6 @@ struct frag *MaoRelaxer::EndFragmentInstruction(InstructionEntry *entry,
 
   i386_insn *insn = entry->instruction();
 
-  // Only jumps should end fragments
-  MAO_ASSERT(insn->tm.opcode_modifier.jump);
-
   int code16 = 0;
   if (entry->GetFlag() == CODE_16BIT)
     code16 = CODE16;
@@ -589,7 +1129,30 @@ struct frag *MaoRelaxer::EndFragmentInstruction(InstructionEntry *entry,
     subtype = ENCODE_RELAX_STATE(COND_JUMP, SMALL);
   else
     subtype = ENCODE_RELAX_STATE(COND_JUMP86, SMALL);
-  subtype |= code16;
+  return subtype | code16;
+
+#undef UNCOND_JUMP
+#undef COND_JUMP
+#undef COND_JUMP86
+
+#undef CODE16
+#undef SMALL
+#undef SMALL16
+#undef BIG
+#undef BIG16
+
+#undef ENCODE_RELAX_STATE
+}
+
+struct frag *MaoRelaxer::EndFragmentInstruction(InstructionEntry *entry,
+                                                struct frag *frag,
+                                                bool new_frag) {
+  i386_insn *insn = entry->instruction();
+
+  // Only jumps should end fragments
+  MAO_ASSERT(insn->tm.opcode_modifier.jump);
+
+  relax_substateT subtype = JumpRelaxState(entry);
 
   symbolS *sym = insn->op[0].disps->X_add_symbol;
   offsetT off = insn->op[0].disps->X_add_number;
@@ -605,18 +1168,6 @@ struct frag *MaoRelaxer::EndFragmentInstruction(InstructionEntry *entry,
                  subtype, sym, off,
                  reinterpret_cast<char*>(&insn->tm.base_opcode),
                  frag, new_frag);
-
-#undef UNCOND_JUMP
-#undef COND_JUMP
-#undef COND_JUMP86
-
-#undef CODE16
-#undef SMALL
-#undef SMALL16
-#undef BIG
-#undef BIG16
-
-#undef ENCODE_RELAX_STATE
 }
 
 
@@ -650,98 +1201,84 @@ struct frag *MaoRelaxer::EndFragmentLeb128(
 }
 
 
-struct frag *MaoRelaxer::HandleSpace(DirectiveEntry *entry,
-                                     int mult,
-                                     struct frag *frag,
-                                     bool new_frag,
-                                     MaoEntryIntMap *size_map,
-                                     FragToEntryMap *relax_map) {
-  MAO_ASSERT(entry->NumOperands() == 2);
-  const DirectiveEntry::Operand *size_opnd = entry->GetOperand(0);
-  MAO_ASSERT(size_opnd->type == DirectiveEntry::EXPRESSION);
-  expressionS *size = size_opnd->data.expr;
-
-  if (size->X_op == O_constant) {
-    int increment = size->X_add_number * (mult ? mult : 1);
-    MAO_ASSERT(increment > 0);
-    frag->fr_fix += increment;
-    (*size_map)[entry] = increment;
-  } else {
-    MAO_ASSERT(mult == 0 || mult == 1);
-    // TODO(nvachhar): Ugh... we have to create a symbol
-    // here to store in the fragment.  This means each
-    // execution of relaxation allocates memory that will
-    // never be freed.  Let's hope relaxation doesn't run
-    // too often.
-    (*size_map)[entry] = 0;
-    (*relax_map)[frag] = entry;
-    frag = FragVar(rs_space, 1, (relax_substateT) 0, make_expr_symbol(size),
-                   (offsetT) 0, NULL, frag, new_frag);
+struct frag *MaoRelaxer::EndFragmentDirective(DirectiveEntry *entry,
+                                              bool code,
+                                              struct frag *frag,
+                                              bool new_frag) {
+  switch (entry->op()) {
+    case DirectiveEntry::P2ALIGN:
+    case DirectiveEntry::P2ALIGNW:
+    case DirectiveEntry::P2ALIGNL: {
+      int alignment, max;
+      GetAlignment(entry, &alignment, &max);
+      return EndFragmentAlign(code, alignment, max, frag, new_frag);
+    }
+    case DirectiveEntry::SLEB128:
+    case DirectiveEntry::ULEB128:
+      return EndFragmentLeb128(entry->GetOperand(0),
+                               entry->op() == DirectiveEntry::SLEB128,
+                               frag, new_frag);
+    case DirectiveEntry::SPACE:
+    case DirectiveEntry::DS_B:
+      return EndFragmentSpace(entry, entry->op() == DirectiveEntry::DS_B,
+                              frag, new_frag);
+    case DirectiveEntry::FILL:
+      return EndFragmentFill(entry, frag, new_frag);
+    default:
+      MAO_ASSERT_MSG(0, "Directive does not end a fragment: %d", entry->op());
   }
-
   return frag;
 }
 
 
-struct frag *MaoRelaxer::HandleFill(DirectiveEntry *entry,
-                                    struct frag *frag,
-                                    bool new_frag,
-                                    MaoEntryIntMap *size_map,
-                                    FragToEntryMap *relax_map) {
-  MAO_ASSERT(entry->NumOperands() == 3);
-  const DirectiveEntry::Operand *repeat_opnd = entry->GetOperand(0);
-  const DirectiveEntry::Operand *size_opnd = entry->GetOperand(1);
-  MAO_ASSERT(repeat_opnd->type == DirectiveEntry::EXPRESSION);
-  MAO_ASSERT(size_opnd->type == DirectiveEntry::INT);
-
-  expressionS *repeat_exp = repeat_opnd->data.expr;
-  int size = size_opnd->data.i;
-  MAO_ASSERT(size >= 1);
-
-  if (repeat_exp->X_op == O_constant) {
-    frag->fr_fix +=  size * repeat_exp->X_add_number;
-    (*size_map)[entry] = size * repeat_exp->X_add_number;
-  } else {
-    // TODO(nvachhar): Ugh... we have to create a symbol
-    // here to store in the fragment.  This means each
-    // execution of relaxation allocates memory that will
-    // never be freed.  Let's hope relaxation doesn't run
-    // too often.
-
-    symbol *rep_sym = make_expr_symbol(repeat_exp);
-    if (size != 1) {
-      // simple case
-      rep_sym = make_expr_symbol (repeat_exp);
-    } else {
-      // Need to create temporary expression. Ugh... (again)
-      // The size is repeat * size
-      expressionS size_exp;
-      size_exp.X_op = O_constant;
-      size_exp.X_add_number = size;
-
-      repeat_exp->X_op = O_multiply;
-      repeat_exp->X_add_symbol = rep_sym;
-      repeat_exp->X_op_symbol = make_expr_symbol (&size_exp);
-      repeat_exp->X_add_number = 0;
-      rep_sym = make_expr_symbol (repeat_exp);
-    }
-
-    (*size_map)[entry] = 0;
-    (*relax_map)[frag] = entry;
-    frag = FragVar(rs_space, 1, (relax_substateT) 0, rep_sym,
-                     (offsetT) 0, NULL, frag, new_frag);
-  }
-  return frag;
+struct frag *MaoRelaxer::EndFragmentSpace(DirectiveEntry *entry,
+                                          int mult,
+                                          struct frag *frag,
+                                          bool new_frag) {
+  MAO_ASSERT(mult == 0 || mult == 1);
+  expressionS *size = entry->GetOperand(0)->data.expr;
+  // TODO(nvachhar): Ugh... we have to create a symbol
+  // here to store in the fragment.  This means each
+  // execution of relaxation allocates memory that will
+  // never be freed.  Let's hope relaxation doesn't run
+  // too often.
+  return FragVar(rs_space, 1, (relax_substateT) 0, make_expr_symbol(size),
+                 (offsetT) 0, NULL, frag, new_frag);
 }
 
 
+struct frag *MaoRelaxer::EndFragmentFill(DirectiveEntry *entry,
+                                         struct frag *frag,
+                                         bool new_frag) {
+  expressionS *repeat_exp = entry->GetOperand(0)->data.expr;
+  int size = entry->GetOperand(1)->data.i;
+
+  // TODO(nvachhar): Ugh... we have to create a symbol
+  // here to store in the fragment.  This means each
+  // execution of relaxation allocates memory that will
+  // never be freed.  Let's hope relaxation doesn't run
+  // too often.
+
+  symbol *rep_sym = make_expr_symbol(repeat_exp);
+  if (size != 1) {
+    // simple case
+    rep_sym = make_expr_symbol (repeat_exp);
+  } else {
+    // Need to create temporary expression. Ugh... (again)
+    // The size is repeat * size
+    expressionS size_exp;
+    size_exp.X_op = O_constant;
+    size_exp.X_add_number = size;
+
+    repeat_exp->X_op = O_multiply;
+    repeat_exp->X_add_symbol = rep_sym;
+    repeat_exp->X_op_symbol = make_expr_symbol (&size_exp);
+    repeat_exp->X_add_number = 0;
+    rep_sym = make_expr_symbol (repeat_exp);
+  }
 
-void MaoRelaxer::HandleString(DirectiveEntry *entry, int multiplier,
-                              bool null_terminate, struct frag *frag,
-                              MaoEntryIntMap *size_map) {
-  int size = StringSize(entry, multiplier, null_terminate);
-  (*size_map)[entry] = size;
-  frag->fr_fix += size;
+  return FragVar(rs_space, 1, (relax_substateT) 0, rep_sym,
+                 (offsetT) 0, NULL, frag, new_frag);
 }
 
 
@@ -22,6 +22,18 @@
 // section).  Results are cached, and the results must be invalidated
 // using InvalidateSizeMap() if the IR is changed.
 //
+// A function pass that only changed its own function should invalidate
+// with InvalidateSizeMap(section, function). The next query then only
+// re-relaxes that function, as long as the result is guaranteed to match
+// relaxing the whole section, and falls back to a full relaxation
+// otherwise. See MaoRelaxer::RelaxFunction() for the conditions.
+//
+// By default the sizes are computed natively, on flat arrays that mirror
+// the fragments gas would build, without running the gas relaxer. The
+// native relaxer follows relax_segment() pass by pass, so the results are
+// the same. Sections it can not handle, e.g., with .space directives of
+// non constant size, are relaxed by gas.
+//
 // The name comes from the algorithm used.
 // Usage:
 //   MaoEntryIntMap *sizes = MaoRelaxer::GetSizeMap(unit_,
@@ -32,9 +44,11 @@
 #define MAORELAX_H_
 
 #include <map>
+#include <set>
 #include <vector>
 
 #include "MaoDebug.h"
+#include "MaoMemory.h"
 #include "MaoPasses.h"
 #include "MaoUnit.h"
 #include "tc-i386-helper.h"
@@ -61,22 +75,87 @@ class MaoRelaxer : public MaoPass {
   static bool HasSizeMap(Section *section);
   // Invalidates the sizemap and offsetmap for the section.
   static void InvalidateSizeMap(Section *section);
+  // Invalidates the sizes and offsets of the entries in function, which
+  // must be the only part of the section that changed.
+  static void InvalidateSizeMap(Section *section, Function *function);
+  // Removes an entry of function that is being deleted from the maps.
+  static void EraseEntry(Section *section, Function *function,
+                         MaoEntry *entry);
 
  private:
   typedef std::map<struct frag *, MaoEntry *> FragToEntryMap;
 
+  // Computes the sizes of the entries in [begin, end), which start at
+  // start_address, and adds the entries whose size depends on their
+  // address to relaxable. If labels is not NULL, nothing is relaxed and
+  // false is returned unless each of those entries is an alignment, or a
+  // jump to one of the labels or to an undefined symbol.
+  bool RelaxEntries(EntryIterator begin, EntryIterator end, int start_address,
+                    const std::set<MaoEntry *> *labels,
+                    MaoEntryIntMap *size_map,
+                    std::vector<MaoEntry *> *relaxable);
+  // Same as RelaxEntries(), using the gas fragments and relaxer.
+  bool RelaxWithFragments(EntryIterator begin, EntryIterator end,
+                          int start_address,
+                          const std::set<MaoEntry *> *labels,
+                          MaoEntryIntMap *size_map,
+                          std::vector<MaoEntry *> *relaxable);
+  bool IsLocalEntry(MaoEntry *entry, const std::set<MaoEntry *> &labels);
+
+  // The fragments of the native relaxer.
+  struct NativeLayout;
+  // Builds the native fragments for the entries in [begin, end). Returns
+  // false if the entries need the gas relaxer.
+  static bool BuildNativeLayout(MaoUnit *mao, asection *segment,
+                                EntryIterator begin, EntryIterator end,
+                                int start_address, NativeLayout *layout);
+  // Grows the jumps and alignments the way relax_segment() does, and
+  // stores the sizes of the entries in size_map.
+  static void RelaxNativeLayout(NativeLayout *layout,
+                                MaoEntryIntMap *size_map);
+
+  // Builds the fragments for the entries in [begin, end). The first
+  // fragment starts at start_address.
   static struct frag *BuildFragments(
-      MaoUnit *mao, Section *section, MaoEntryIntMap *size_map,
-      FragToEntryMap *relax_map);
+      MaoUnit *mao, Section *section, EntryIterator begin, EntryIterator end,
+      int start_address, MaoEntryIntMap *size_map, FragToEntryMap *relax_map);
+
+  // Runs the gas relaxation on the fragments, adds the variable part of
+  // each fragment to the size of its entry, and frees the fragments.
+  void RelaxFragments(struct frag *fragments, const FragToEntryMap &relax_map,
+                      MaoEntryIntMap *size_map);
+
+  // Finds the label a relaxable jump branches to. *label is set to NULL
+  // for jumps to undefined symbols. Returns false if the size of the jump
+  // may depend on other parts of the section, e.g., for jumps to
+  // expressions.
+  static bool GetJumpTarget(MaoUnit *mao, InstructionEntry *entry,
+                            LabelEntry **label);
+
+  // Re-relaxes the dirty functions of the section, updating the cached
+  // maps. Returns false if a full relaxation is needed instead.
+  bool RelaxFunctions();
+  bool RelaxFunction(Function *function);
 
   static int SizeOfFloat(DirectiveEntry *entry);
 
+  // Returns the size of the directive, or -1 if it depends on the address
+  // of the directive, in which case the directive ends a fragment.
+  static int DirectiveSize(DirectiveEntry *entry);
+  static int SpaceSize(DirectiveEntry *entry, int mult);
+
+  // Returns the initial relax state of a relaxable jump.
+  static relax_substateT JumpRelaxState(InstructionEntry *entry);
+
   static void UpdateSymbol(const char *symbol_name,
                            struct frag *frag);
 
   static struct frag *EndFragmentInstruction(
       InstructionEntry *entry, struct frag *frag, bool new_frag);
 
+  static struct frag *EndFragmentDirective(
+      DirectiveEntry *entry, bool code, struct frag *frag, bool new_frag);
+
   static struct frag *EndFragmentAlign(
       bool code, int alignment, int max, struct frag *frag, bool new_frag);
 
@@ -84,17 +163,11 @@ class MaoRelaxer : public MaoPass {
       const DirectiveEntry::Operand *value, bool is_signed,
       struct frag *frag, bool new_frag);
 
-  static struct frag *HandleSpace(
-      DirectiveEntry *entry, int mult, struct frag *frag,
-      bool new_frag, MaoEntryIntMap *size_map, FragToEntryMap *relax_map);
-
-  static struct frag *HandleFill(
-      DirectiveEntry *entry, struct frag *frag,
-      bool new_frag, MaoEntryIntMap *size_map, FragToEntryMap *relax_map);
+  static struct frag *EndFragmentSpace(
+      DirectiveEntry *entry, int mult, struct frag *frag, bool new_frag);
 
-  static void HandleString(
-      DirectiveEntry *entry, int multiplier, bool null_terminate,
-      struct frag *frag, MaoEntryIntMap *size_map);
+  static struct frag *EndFragmentFill(
+      DirectiveEntry *entry, struct frag *frag, bool new_frag);
 
   static int StringSize(
       DirectiveEntry *entry, int multiplier, bool null_terminate);
@@ -110,6 +183,7 @@ class MaoRelaxer : public MaoPass {
     struct frag *frag =
         static_cast<struct frag *>(calloc(1, sizeof(struct frag)));
     MAO_ASSERT(frag);
+    MaoMemory::Allocated(MaoMemory::FRAG, sizeof(struct frag));
     return frag;
   }
 
@@ -118,6 +192,7 @@ class MaoRelaxer : public MaoPass {
     for (next = fragments->fr_next; fragments; fragments = next) {
       next = fragments->fr_next;
       free(fragments);
+      MaoMemory::Freed(MaoMemory::FRAG, sizeof(struct frag));
     }
   }
 
@@ -141,27 +216,37 @@ class MaoRelaxer : public MaoPass {
   bool collect_stat_;
   bool dump_sizemap_;
   bool dump_function_stat_;
+  bool incremental_;
+  bool verify_incremental_;
+  bool native_;
+  bool verify_native_;
+  bool verify_sizes_;
 
-  class RelaxStat : public Stat {
+  class RelaxStat : public GroupStat {
    public:
-    RelaxStat()  {}
+    RelaxStat()
+        : GroupStat("RELAX"),
+          function_sizes_(Table("function_size")),
+          size_histogram_(Histogram("function_size_histogram",
+                                    StatHistogram::POWER_OF_TWO)) {}
     ~RelaxStat() {}
     void AddFunction(const Function *func, int size) {
-      function_sizes_.push_back(std::make_pair(func, size));
+      function_sizes_->Add(func->name(), size);
+      size_histogram_->Add(size);
     }
     virtual void Print(FILE *out) {
       // Iterate over the functions
-       for (std::vector<std::pair<const Function *, int> >::const_iterator iter
-                = function_sizes_.begin();
-            iter != function_sizes_.end();
-            ++iter) {
-         fprintf(out, "MaoRelax functionsize %-60s %4d\n",
-                 iter->first->name().c_str(), iter->second);
-       }
+      const StatTable::Rows &rows = function_sizes_->rows();
+      for (StatTable::Rows::const_iterator iter = rows.begin();
+           iter != rows.end(); ++iter) {
+        fprintf(out, "MaoRelax functionsize %-60s %4lld\n",
+                iter->first.c_str(), iter->second);
+      }
     }
 
    private:
-    std::vector<std::pair<const Function *, int> > function_sizes_;
+    StatTable     *function_sizes_;
+    StatHistogram *size_histogram_;
   };
 
   RelaxStat *relax_stat_;
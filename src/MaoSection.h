@@ -29,6 +29,7 @@
 #define MAOSECTION_H_
 
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -39,6 +40,7 @@
 // Forward declarations
 class MaoEntry;
 class EntryIterator;
+class Function;
 
 // Global Map Types
 typedef std::map<MaoEntry *, int> MaoEntryIntMap;
@@ -131,7 +133,7 @@ class Section {
   // Returns the last subsection in the section or NULL if section is empty.
   SubSection *GetLastSubSection() const;
 
-  // The next 4 methods are only to be used by MaoRelaxer.  Others
+  // The next 6 methods are only to be used by MaoRelaxer.  Others
   // should invoke the utility functions there to get access to the
   // size and offset.
   MaoEntryIntMap *sizes() {return sizes_;}
@@ -146,6 +148,11 @@ class Section {
       delete offsets_;
     offsets_ = offsets;
   }
+  // Functions changed since the sizes and offsets were computed.
+  std::set<Function *> *dirty_functions() {return &dirty_functions_;}
+  // Labels that are the target of a relaxable jump from outside their
+  // function. Holds NULL if other entries may depend on any label.
+  std::set<MaoEntry *> *cross_targets() {return &cross_targets_;}
 
  private:
   const std::string name_;  // e.g. ".text", ".data", etc.
@@ -159,6 +166,9 @@ class Section {
 
   // Store corresponding entry offsets
   MaoEntryIntMap *offsets_;
+
+  std::set<Function *> dirty_functions_;
+  std::set<MaoEntry *> cross_targets_;
 };
 
 // Iterator wrapper for iterating over all the Sections in a MaoUnit.
@@ -0,0 +1,164 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+#include "MaoSourceFile.h"
+
+//
+// Class: MaoSourceFile
+//
+
+MaoSourceFile *MaoSourceFile::Map(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat status;
+  if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) ||
+      status.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  void *data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return NULL;
+  // gas reads the file front to back.
+  madvise(data, status.st_size, MADV_SEQUENTIAL);
+  return new MaoSourceFile(static_cast<const char *>(data), status.st_size);
+}
+
+MaoSourceFile::~MaoSourceFile() {
+  munmap(const_cast<char *>(data_), size_);
+}
+
+bool MaoSourceFile::FindLine(unsigned int line_number, const char **line,
+                             size_t *length) {
+  if (line_number == 0)
+    return false;
+  if (line_number < cursor_line_) {
+    cursor_line_ = 1;
+    cursor_offset_ = 0;
+  }
+  while (cursor_line_ < line_number) {
+    const void *newline = memchr(data_ + cursor_offset_, '\n',
+                                 size_ - cursor_offset_);
+    if (newline == NULL)
+      return false;
+    cursor_offset_ = static_cast<const char *>(newline) - data_ + 1;
+    ++cursor_line_;
+  }
+  if (cursor_offset_ == size_)
+    return false;
+
+  const void *newline = memchr(data_ + cursor_offset_, '\n',
+                               size_ - cursor_offset_);
+  size_t end = newline ? static_cast<const char *>(newline) - data_ : size_;
+  *line = data_ + cursor_offset_;
+  *length = end - cursor_offset_;
+  return true;
+}
+
+//
+// Class: MaoSourceFiles
+//
+
+static bool IsLabelChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' ||
+      c == '$';
+}
+
+static const char *SkipSpace(const char *p, const char *end) {
+  while (p < end && isspace(*p))
+    ++p;
+  return p;
+}
+
+MaoSourceFiles::~MaoSourceFiles() {
+  for (std::map<std::string, MaoSourceFile *>::iterator iter = files_.begin();
+       iter != files_.end(); ++iter)
+    delete iter->second;
+}
+
+bool MaoSourceFiles::FindStatement(const char *name, unsigned int line_number,
+                                   const char *text, const char **line,
+                                   size_t *length) {
+  if (name == NULL || text == NULL)
+    return false;
+  std::map<std::string, MaoSourceFile *>::iterator iter = files_.find(name);
+  if (iter == files_.end())
+    iter = files_.insert(std::make_pair(std::string(name),
+                                        MaoSourceFile::Map(name))).first;
+  if (iter->second == NULL ||
+      !iter->second->FindLine(line_number, line, length))
+    return false;
+
+  // The line may only hold the statement, after any labels, and a
+  // comment. Other statements after a ';', or in a /* */ comment, make
+  // it unclear which one gas passed.
+  const char *start = *line;
+  const char *end = *line + *length;
+  if (memchr(start, ';', end - start) != NULL)
+    return false;
+  for (const char *p = start; p + 1 < end; ++p) {
+    if (p[0] == '/' && p[1] == '*')
+      return false;
+  }
+  const char *comment = static_cast<const char *>(
+      memchr(start, '#', end - start));
+  if (comment != NULL)
+    end = comment;
+  while (end > start && isspace(end[-1]))
+    --end;
+  for (;;) {
+    start = SkipSpace(start, end);
+    const char *p = start;
+    while (p < end && IsLabelChar(*p))
+      ++p;
+    if (p == start || p == end || *p != ':')
+      break;
+    start = p + 1;
+  }
+
+  // gas has removed the comment and extra white space from text, so the
+  // statement has to match it up to white space.
+  const char *p = start;
+  while (true) {
+    p = SkipSpace(p, end);
+    while (isspace(*text))
+      ++text;
+    if (p == end || *text == '\0')
+      break;
+    if (*p != *text)
+      return false;
+    ++p;
+    ++text;
+  }
+  if (p != end || *text != '\0' || start == end)
+    return false;
+  *line = start;
+  *length = end - start;
+  return true;
+}
@@ -0,0 +1,90 @@
+//
+// Copyright 2009 Google Inc.
+//
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Memory mapped input files.
+// Classes:
+//   MaoSourceFile  - A read only mapping of one input file.
+//   MaoSourceFiles - The mapped input files of a unit, by name.
+//
+// With --mao=--mmap-input, instructions refer to their line in a mapping
+// of the input file instead of keeping a copy of the text gas passed to
+// them. The text is copied only if a pass asks for a NUL terminated
+// string, see MaoEntry::line_verbatim().
+//
+#ifndef MAOSOURCEFILE_H_
+#define MAOSOURCEFILE_H_
+
+#include <stddef.h>
+
+#include <map>
+#include <string>
+
+class MaoSourceFile {
+ public:
+  // Maps the file at path. Returns NULL if it cannot be mapped.
+  static MaoSourceFile *Map(const char *path);
+  ~MaoSourceFile();
+
+  // Finds line line_number, counting from 1. Sets line and length to the
+  // line without its newline, and returns false if there is no such line.
+  // Lines are found by scanning on from the last line found, so asking
+  // for lines in increasing order, as gas reads them, is linear in the
+  // size of the file.
+  bool FindLine(unsigned int line_number, const char **line, size_t *length);
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MaoSourceFile(const char *data, size_t size)
+      : data_(data), size_(size), cursor_line_(1), cursor_offset_(0) { }
+
+  const char *data_;
+  size_t size_;
+  // The start of line cursor_line_.
+  unsigned int cursor_line_;
+  size_t cursor_offset_;
+
+  MaoSourceFile(const MaoSourceFile &);
+  MaoSourceFile &operator=(const MaoSourceFile &);
+};
+
+class MaoSourceFiles {
+ public:
+  MaoSourceFiles() { }
+  ~MaoSourceFiles();
+
+  // Finds the statement text, as gas passed it, in line line_number of
+  // file name. Sets line and length to the statement without the labels
+  // before it and the comment after it, which is text up to white space.
+  // Returns false if the file cannot be mapped, or if the line does not
+  // hold just the statement, e.g., because it comes from a macro, a .line
+  // directive changed the line numbers, or the line holds several
+  // statements.
+  bool FindStatement(const char *name, unsigned int line_number,
+                     const char *text, const char **line, size_t *length);
+
+ private:
+  // Files that cannot be mapped are kept as NULL, to try them only once.
+  std::map<std::string, MaoSourceFile *> files_;
+
+  MaoSourceFiles(const MaoSourceFiles &);
+  MaoSourceFiles &operator=(const MaoSourceFiles &);
+};
+
+#endif  // MAOSOURCEFILE_H_
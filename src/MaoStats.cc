@@ -0,0 +1,235 @@
+//
+// Copyright 2009 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+#include <stdlib.h>
+
+#include "MaoStats.h"
+
+//
+// Class: Stat
+//
+
+void Stat::PrintJSON(FILE *out) {
+  char *text = NULL;
+  size_t size = 0;
+  FILE *text_out = open_memstream(&text, &size);
+  MAO_RASSERT(text_out);
+  Print(text_out);
+  fclose(text_out);
+  fprintf(out, "{\"text\": ");
+  MaoUtil::WriteJSONString(out, std::string(text, size));
+  fprintf(out, "}");
+  free(text);
+}
+
+//
+// Class: StatHistogram
+//
+
+void StatHistogram::Add(long long value) {
+  long long key = value;
+  if (buckets_ == POWER_OF_TWO && value > 0) {
+    key = 1;
+    while (key < value)
+      key <<= 1;
+  }
+  MaoMutexLock lock(&mutex_);
+  if (count_ == 0 || value < min_)
+    min_ = value;
+  if (count_ == 0 || value > max_)
+    max_ = value;
+  ++count_;
+  sum_ += value;
+  ++counts_[key];
+}
+
+void StatHistogram::PrintJSON(FILE *out) const {
+  MaoMutexLock lock(&mutex_);
+  fprintf(out, "{\"count\": %lld, \"sum\": %lld, \"min\": %lld, "
+          "\"max\": %lld, \"buckets\": {", count_, sum_, min_, max_);
+  for (std::map<long long, long long>::const_iterator iter = counts_.begin();
+       iter != counts_.end(); ++iter) {
+    fprintf(out, "%s\"%lld\": %lld", iter == counts_.begin() ? "" : ", ",
+            iter->first, iter->second);
+  }
+  fprintf(out, "}}");
+}
+
+//
+// Class: StatTable
+//
+
+void StatTable::PrintJSON(FILE *out) const {
+  MaoMutexLock lock(&mutex_);
+  fprintf(out, "[");
+  for (Rows::const_iterator iter = rows_.begin(); iter != rows_.end();
+       ++iter) {
+    fprintf(out, "%s{\"name\": ", iter == rows_.begin() ? "" : ", ");
+    MaoUtil::WriteJSONString(out, iter->first);
+    fprintf(out, ", \"value\": %lld}", iter->second);
+  }
+  fprintf(out, "]");
+}
+
+//
+// Class: GroupStat
+//
+
+// Returns the part with the given name, or NULL.
+template <typename T>
+static T *FindPart(const std::vector<std::pair<std::string, T *> > &parts,
+                   const char *name) {
+  for (typename std::vector<std::pair<std::string, T *> >::const_iterator
+           iter = parts.begin(); iter != parts.end(); ++iter) {
+    if (iter->first == name)
+      return iter->second;
+  }
+  return NULL;
+}
+
+template <typename T>
+static void DeleteParts(std::vector<std::pair<std::string, T *> > *parts) {
+  for (typename std::vector<std::pair<std::string, T *> >::iterator iter =
+           parts->begin(); iter != parts->end(); ++iter) {
+    delete iter->second;
+  }
+}
+
+GroupStat::~GroupStat() {
+  DeleteParts(&counters_);
+  DeleteParts(&histograms_);
+  DeleteParts(&tables_);
+}
+
+StatCounter *GroupStat::Counter(const char *name) {
+  MaoMutexLock lock(&mutex_);
+  StatCounter *counter = FindPart(counters_, name);
+  if (counter == NULL) {
+    counter = new StatCounter();
+    counters_.push_back(std::make_pair(std::string(name), counter));
+  }
+  return counter;
+}
+
+StatHistogram *GroupStat::Histogram(const char *name,
+                                    StatHistogram::Buckets buckets) {
+  MaoMutexLock lock(&mutex_);
+  StatHistogram *histogram = FindPart(histograms_, name);
+  if (histogram == NULL) {
+    histogram = new StatHistogram(buckets);
+    histograms_.push_back(std::make_pair(std::string(name), histogram));
+  }
+  return histogram;
+}
+
+StatTable *GroupStat::Table(const char *name) {
+  MaoMutexLock lock(&mutex_);
+  StatTable *table = FindPart(tables_, name);
+  if (table == NULL) {
+    table = new StatTable();
+    tables_.push_back(std::make_pair(std::string(name), table));
+  }
+  return table;
+}
+
+void GroupStat::Print(FILE *out) {
+  MaoMutexLock lock(&mutex_);
+  for (CounterList::const_iterator iter = counters_.begin();
+       iter != counters_.end(); ++iter) {
+    fprintf(out, "%s: %-24s %7lld\n", name_, iter->first.c_str(),
+            iter->second->value());
+  }
+  for (HistogramList::const_iterator iter = histograms_.begin();
+       iter != histograms_.end(); ++iter) {
+    const StatHistogram *histogram = iter->second;
+    fprintf(out, "%s: %-24s count %lld, sum %lld, min %lld, max %lld\n",
+            name_, iter->first.c_str(), histogram->count(), histogram->sum(),
+            histogram->min(), histogram->max());
+  }
+  for (TableList::const_iterator iter = tables_.begin();
+       iter != tables_.end(); ++iter) {
+    const StatTable::Rows &rows = iter->second->rows();
+    for (StatTable::Rows::const_iterator row = rows.begin();
+         row != rows.end(); ++row) {
+      fprintf(out, "%s: %s %-60s %4lld\n", name_, iter->first.c_str(),
+              row->first.c_str(), row->second);
+    }
+  }
+}
+
+void GroupStat::PrintJSON(FILE *out) {
+  MaoMutexLock lock(&mutex_);
+  const char *separator = "";
+  fprintf(out, "{");
+  for (CounterList::const_iterator iter = counters_.begin();
+       iter != counters_.end(); ++iter, separator = ", ") {
+    fprintf(out, "%s", separator);
+    MaoUtil::WriteJSONString(out, iter->first);
+    fprintf(out, ": %lld", iter->second->value());
+  }
+  for (HistogramList::const_iterator iter = histograms_.begin();
+       iter != histograms_.end(); ++iter, separator = ", ") {
+    fprintf(out, "%s", separator);
+    MaoUtil::WriteJSONString(out, iter->first);
+    fprintf(out, ": ");
+    iter->second->PrintJSON(out);
+  }
+  for (TableList::const_iterator iter = tables_.begin();
+       iter != tables_.end(); ++iter, separator = ", ") {
+    fprintf(out, "%s", separator);
+    MaoUtil::WriteJSONString(out, iter->first);
+    fprintf(out, ": ");
+    iter->second->PrintJSON(out);
+  }
+  fprintf(out, "}");
+}
+
+//
+// Class: Stats
+//
+
+GroupStat *Stats::GetGroupStat(const char *name) {
+  MaoMutexLock lock(&mutex_);
+  if (HasStat(name)) {
+    GroupStat *stat = GetStat(name)->AsGroupStat();
+    MAO_RASSERT_MSG(stat != NULL, "Stat %s is not a GroupStat", name);
+    return stat;
+  }
+  GroupStat *stat = new GroupStat(name);
+  Add(name, stat);
+  return stat;
+}
+
+void Stats::PrintJSON(FILE *out) {
+  MaoMutexLock lock(&mutex_);
+  fprintf(out, "{\n  \"stats\": {");
+  for (std::map<const char *, Stat *, ltstr>::iterator iter = stats_.begin();
+       iter != stats_.end(); ++iter) {
+    fprintf(out, "%s\n    ", iter == stats_.begin() ? "" : ",");
+    MaoUtil::WriteJSONString(out, iter->first);
+    fprintf(out, ": ");
+    iter->second->PrintJSON(out);
+  }
+  fprintf(out, "\n  }\n}\n");
+}
+
+bool Stats::WriteJSON(const char *file_name) {
+  FILE *out = fopen(file_name, "w");
+  if (out == NULL)
+    return false;
+  PrintJSON(out);
+  return fclose(out) == 0;
+}
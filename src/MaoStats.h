@@ -15,19 +15,144 @@
 // You should have received a copy of the GNU General Public License
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
-
+// Statistics collected by passes.
+// Classes:
+//   Stat          - Base class of all statistics.
+//   StatCounter   - A counter that can be incremented from any thread.
+//   StatHistogram - A distribution of values.
+//   StatTable     - A list of named values, e.g., one per function.
+//   GroupStat     - A Stat made of named counters, histograms and tables.
+//   Stats         - The statistics of a unit, by name.
+//
+// Passes print their statistics as text at the end of the run. With
+// --stats-json, they are written to a file as JSON instead, in the form
+//   {"stats": {"CFG": {"direct_jumps": 12, ...}, ...}}
+// Stats built from GroupStat export their counters, histograms and tables
+// as such; other stats export their text output as {"text": "..."}.
+//
 #ifndef MAOSTATS_H_
 #define MAOSTATS_H_
 
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MaoDebug.h"
+#include "MaoThreads.h"
+#include "MaoUtil.h"
+
+class GroupStat;
+
 class Stat {
  public:
   virtual ~Stat() {}
   virtual void Print(FILE *out) = 0;
   void Print() {Print(stdout);}
+  // Writes the stat as a JSON value.
+  virtual void PrintJSON(FILE *out);
+  // Returns the stat as a GroupStat, or NULL if it is not one.
+  virtual GroupStat *AsGroupStat() { return NULL; }
+ private:
+};
+
+class StatCounter {
+ public:
+  StatCounter() : value_(0) { }
+  void Inc() { Add(1); }
+  void Add(long long n) { __sync_fetch_and_add(&value_, n); }
+  long long value() const { return value_; }
+ private:
+  long long value_;
+};
+
+class StatHistogram {
+ public:
+  // EXACT keeps a bucket per value, POWER_OF_TWO a bucket per power of
+  // two, which is keyed by the largest value that falls into it.
+  enum Buckets { EXACT, POWER_OF_TWO };
+
+  explicit StatHistogram(Buckets buckets)
+      : buckets_(buckets), count_(0), sum_(0), min_(0), max_(0) { }
+
+  void Add(long long value);
+
+  long long count() const { return count_; }
+  long long sum() const { return sum_; }
+  long long min() const { return min_; }
+  long long max() const { return max_; }
+  // Maps the key of each bucket to the number of values in it.
+  const std::map<long long, long long> &buckets() const { return counts_; }
+
+  void PrintJSON(FILE *out) const;
+
  private:
+  const Buckets buckets_;
+  long long count_;
+  long long sum_;
+  long long min_;
+  long long max_;
+  std::map<long long, long long> counts_;
+  mutable MaoMutex mutex_;
+};
+
+class StatTable {
+ public:
+  typedef std::vector<std::pair<std::string, long long> > Rows;
+
+  void Add(const std::string &name, long long value) {
+    MaoMutexLock lock(&mutex_);
+    rows_.push_back(std::make_pair(name, value));
+  }
+  // Only use once all passes are done.
+  const Rows &rows() const { return rows_; }
+
+  void PrintJSON(FILE *out) const;
+
+ private:
+  Rows rows_;
+  mutable MaoMutex mutex_;
+};
+
+// A stat made of named parts. Passes usually look up their parts once,
+// in the constructor, and keep the pointers. Parts are exported in the
+// order they were created. The default text output prints one line per
+// counter and histogram, prefixed with the name of the stat.
+class GroupStat : public Stat {
+ public:
+  explicit GroupStat(const char *name) : name_(name) { }
+  virtual ~GroupStat();
+
+  // Return the part with the given name, creating it if needed.
+  StatCounter   *Counter(const char *name);
+  StatHistogram *Histogram(const char *name,
+                           StatHistogram::Buckets buckets =
+                           StatHistogram::EXACT);
+  StatTable     *Table(const char *name);
+
+  virtual void Print(FILE *out);
+  virtual void PrintJSON(FILE *out);
+  virtual GroupStat *AsGroupStat() { return this; }
+
+ private:
+  typedef std::vector<std::pair<std::string, StatCounter *> > CounterList;
+  typedef std::vector<std::pair<std::string, StatHistogram *> > HistogramList;
+  typedef std::vector<std::pair<std::string, StatTable *> > TableList;
+
+  const char *name_;
+  CounterList counters_;
+  HistogramList histograms_;
+  TableList tables_;
+  MaoMutex mutex_;
 };
 
 // Print all stats to the same file.
+// The registry is guarded by a mutex, since function passes running on
+// different threads may look up and add stats concurrently. Passes that
+// look up a stat and add it if it is missing should hold mutex() while
+// doing so.
 class Stats {
  public:
   Stats() {
@@ -40,19 +165,28 @@ class Stats {
     }
   }
   void Add(const char *name, Stat *stat) {
+    MaoMutexLock lock(&mutex_);
     MAO_ASSERT(!HasStat(name));
     stats_[name] = stat;
   }
 
   bool HasStat(const char *name) const {
+    MaoMutexLock lock(&mutex_);
     return stats_.find(name) != stats_.end();
   }
 
   Stat *GetStat(const char *name)  {
+    MaoMutexLock lock(&mutex_);
     MAO_ASSERT(HasStat(name));
     return stats_[name];
   }
 
+  // Returns the GroupStat with the given name, creating it if needed.
+  // Asserts that a stat already registered under the name is a GroupStat.
+  GroupStat *GetGroupStat(const char *name);
+
+  MaoMutex *mutex() { return &mutex_; }
+
   void Print(FILE *out) {
     for (std::map<const char *, Stat *, ltstr>::iterator iter = stats_.begin();
         iter != stats_.end(); ++iter) {
@@ -60,8 +194,15 @@ class Stats {
     }
   }
   void Print() {Print(stdout);}
+
+  // Writes all stats to out as a JSON object.
+  void PrintJSON(FILE *out);
+  // Writes all stats to the named file. Returns false on errors.
+  bool WriteJSON(const char *file_name);
+
  private:
   std::map<const char *, Stat *, ltstr> stats_;
+  mutable MaoMutex mutex_;
 };
 
 #endif  // MAOSTATS_H_
@@ -0,0 +1,47 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include "MaoStrings.h"
+
+//
+// Class: MaoStringTable
+//
+
+const char *MaoStringTable::Intern(const char *str) {
+  MaoMutexLock lock(&mutex_);
+  return strings_[GetId(str)];
+}
+
+int MaoStringTable::GetId(const char *str) {
+  MAO_ASSERT(str);
+  MaoMutexLock lock(&mutex_);
+  int *id = ids_.Find(str);
+  if (id)
+    return *id;
+  const char *copy = arena_->StrDup(str);
+  int new_id = strings_.size();
+  strings_.push_back(copy);
+  ids_.Insert(copy, new_id);
+  return new_id;
+}
+
+int MaoStringTable::FindId(const char *str) const {
+  MAO_ASSERT(str);
+  MaoMutexLock lock(&mutex_);
+  const int *id = ids_.Find(str);
+  return id ? *id : -1;
+}
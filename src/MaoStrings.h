@@ -0,0 +1,217 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Hashed string lookup.
+// Classes:
+//   StringHashMap  - An open addressing hash map keyed by C strings.
+//   MaoStringTable - Interns strings and gives each a stable id.
+//
+#ifndef MAOSTRINGS_H_
+#define MAOSTRINGS_H_
+
+#include <string.h>
+#include <vector>
+
+#include "MaoArena.h"
+#include "MaoDebug.h"
+#include "MaoThreads.h"
+
+// Returns the FNV-1a hash of a NUL terminated string.
+inline unsigned int HashString(const char *str) {
+  unsigned int hash = 2166136261u;
+  for (const unsigned char *p = reinterpret_cast<const unsigned char *>(str);
+       *p; ++p) {
+    hash ^= *p;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// StringHashMap
+//
+// Maps C strings to values of type T using open addressing with linear
+// probing. The full hash of each key is kept in its slot, so a lookup only
+// calls strcmp() on an actual match, and not at all if the key pointer is
+// the stored one (as it is for interned strings).
+// Keys are not copied and must outlive the map, as with the
+// std::map<const char *, T, ltstr> maps this replaces. The map does not
+// support iteration; use it where only lookups are needed.
+template <typename T>
+class StringHashMap {
+ public:
+  StringHashMap() : size_(0), used_(0) { }
+
+  // Returns a pointer to the value stored for key, or NULL.
+  T *Find(const char *key) {
+    int slot = Lookup(key, HashString(key));
+    return slot < 0 ? NULL : &slots_[slot].value;
+  }
+  const T *Find(const char *key) const {
+    int slot = Lookup(key, HashString(key));
+    return slot < 0 ? NULL : &slots_[slot].value;
+  }
+
+  // Adds key with the given value. Returns false, and leaves the map
+  // unchanged, if the key is already present.
+  bool Insert(const char *key, const T &value) {
+    unsigned int hash = HashString(key);
+    if (Lookup(key, hash) >= 0)
+      return false;
+    Add(key, hash, value);
+    return true;
+  }
+
+  // Returns the value stored for key, adding a default value if needed.
+  T &operator[](const char *key) {
+    unsigned int hash = HashString(key);
+    int slot = Lookup(key, hash);
+    if (slot < 0)
+      slot = Add(key, hash, T());
+    return slots_[slot].value;
+  }
+
+  // Removes key. Returns false if it was not present.
+  bool Erase(const char *key) {
+    int slot = Lookup(key, HashString(key));
+    if (slot < 0)
+      return false;
+    slots_[slot].state = kDeleted;
+    slots_[slot].value = T();
+    --size_;
+    return true;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  void clear() {
+    slots_.clear();
+    size_ = used_ = 0;
+  }
+
+ private:
+  enum SlotState { kEmpty = 0, kFull, kDeleted };
+  struct Slot {
+    Slot() : key(NULL), hash(0), state(kEmpty), value() { }
+    const char   *key;
+    unsigned int  hash;
+    SlotState     state;
+    T             value;
+  };
+
+  static const size_t kInitialCapacity = 16;
+
+  // Returns the index of the slot holding key, or -1.
+  int Lookup(const char *key, unsigned int hash) const {
+    if (slots_.empty())
+      return -1;
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+      const Slot &slot = slots_[i];
+      if (slot.state == kEmpty)
+        return -1;
+      if (slot.state == kFull && slot.hash == hash &&
+          (slot.key == key || strcmp(slot.key, key) == 0))
+        return i;
+    }
+  }
+
+  // Places a key known not to be in the map. Returns the slot index.
+  int Add(const char *key, unsigned int hash, const T &value) {
+    // Keep the load, including deleted slots, at or below one half so
+    // that probe sequences stay short and always end in an empty slot.
+    if ((used_ + 1) * 2 > slots_.size())
+      Rehash(size_ * 4 > kInitialCapacity ? size_ * 4 : kInitialCapacity);
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i].state == kFull)
+      i = (i + 1) & mask;
+    if (slots_[i].state == kEmpty)
+      ++used_;
+    slots_[i].key = key;
+    slots_[i].hash = hash;
+    slots_[i].state = kFull;
+    slots_[i].value = value;
+    ++size_;
+    return i;
+  }
+
+  // Moves all entries to a table with at least min_capacity slots.
+  void Rehash(size_t min_capacity) {
+    size_t capacity = kInitialCapacity;
+    while (capacity < min_capacity)
+      capacity *= 2;
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+    size_ = used_ = 0;
+    for (typename std::vector<Slot>::const_iterator iter = old_slots.begin();
+         iter != old_slots.end(); ++iter) {
+      if (iter->state == kFull)
+        Add(iter->key, iter->hash, iter->value);
+    }
+  }
+
+  std::vector<Slot> slots_;
+  // Number of keys in the map.
+  size_t size_;
+  // Number of slots that are not empty, i.e., full or deleted.
+  size_t used_;
+};
+
+template <typename T>
+const size_t StringHashMap<T>::kInitialCapacity;
+
+// MaoStringTable
+//
+// Keeps a single copy of each string added to it. Interned strings can be
+// compared by pointer, and are numbered densely in the order they were
+// first added. The copies live in the arena given to the constructor.
+class MaoStringTable {
+ public:
+  explicit MaoStringTable(MaoArena *arena) : arena_(arena) { }
+
+  // Returns the interned copy of str, adding it if needed.
+  const char *Intern(const char *str);
+  // Returns the id of str, adding it if needed.
+  int GetId(const char *str);
+  // Returns the id of str, or -1 if it has not been interned.
+  int FindId(const char *str) const;
+  // Returns the interned string with the given id.
+  const char *GetString(int id) const {
+    MaoMutexLock lock(&mutex_);
+    MAO_ASSERT(id >= 0 && id < static_cast<int>(strings_.size()));
+    return strings_[id];
+  }
+
+  int size() const {
+    MaoMutexLock lock(&mutex_);
+    return strings_.size();
+  }
+
+ private:
+  MaoArena *arena_;
+  // Maps an interned string to its id.
+  StringHashMap<int> ids_;
+  // Maps an id to the interned string.
+  std::vector<const char *> strings_;
+  // Labels may be created by function passes running on several threads.
+  mutable MaoMutex mutex_;
+
+  MaoStringTable(const MaoStringTable &);
+  MaoStringTable &operator=(const MaoStringTable &);
+};
+
+#endif  // MAOSTRINGS_H_
@@ -0,0 +1,176 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <vector>
+
+#include "MaoDebug.h"
+#include "MaoThreads.h"
+
+//
+// Class: MaoMutex
+//
+
+bool MaoMutex::threaded_ = false;
+
+MaoMutex::MaoMutex() {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  MAO_RASSERT(pthread_mutex_init(&mutex_, &attr) == 0);
+  pthread_mutexattr_destroy(&attr);
+}
+
+MaoMutex::~MaoMutex() {
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+//
+// Class: MaoWorkStealingPool
+//
+
+namespace {
+
+// The range [begin, end) of task indices still owned by one thread.
+struct WorkQueue {
+  pthread_mutex_t mutex;
+  int             begin;
+  int             end;
+};
+
+struct PoolState {
+  std::vector<WorkQueue>    queues;
+  MaoWorkStealingPool::Task task;
+  void                     *arg;
+};
+
+struct WorkerArg {
+  PoolState *state;
+  int        id;
+};
+
+// Takes the next task from the front of the queue.
+bool PopFront(WorkQueue *queue, int *index) {
+  bool found = false;
+  pthread_mutex_lock(&queue->mutex);
+  if (queue->begin < queue->end) {
+    *index = queue->begin++;
+    found = true;
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return found;
+}
+
+// Moves the back half of the victims range to the (empty) thief queue.
+bool StealHalf(WorkQueue *victim, WorkQueue *thief) {
+  int begin = 0, end = 0;
+  pthread_mutex_lock(&victim->mutex);
+  if (victim->begin < victim->end) {
+    int num_stolen = (victim->end - victim->begin + 1) / 2;
+    end = victim->end;
+    begin = end - num_stolen;
+    victim->end = begin;
+  }
+  pthread_mutex_unlock(&victim->mutex);
+  if (begin == end)
+    return false;
+
+  pthread_mutex_lock(&thief->mutex);
+  thief->begin = begin;
+  thief->end = end;
+  pthread_mutex_unlock(&thief->mutex);
+  return true;
+}
+
+void *Worker(void *p) {
+  WorkerArg *worker = static_cast<WorkerArg *>(p);
+  PoolState *state = worker->state;
+  int num_queues = state->queues.size();
+  WorkQueue *own = &state->queues[worker->id];
+
+  while (true) {
+    int index;
+    if (PopFront(own, &index)) {
+      state->task(index, state->arg);
+      continue;
+    }
+    // Tasks never create new tasks, so once a full sweep over the other
+    // queues comes up empty, all work has been handed out.
+    bool stolen = false;
+    for (int i = 1; i < num_queues && !stolen; ++i)
+      stolen = StealHalf(&state->queues[(worker->id + i) % num_queues], own);
+    if (!stolen)
+      break;
+  }
+  return NULL;
+}
+
+}  // namespace
+
+void MaoWorkStealingPool::Run(int num_threads, int num_tasks,
+                              Task task, void *arg) {
+  MAO_ASSERT(num_threads > 0);
+  MAO_ASSERT(task);
+  if (num_threads > num_tasks)
+    num_threads = num_tasks;
+  if (num_threads <= 1) {
+    for (int i = 0; i < num_tasks; ++i)
+      task(i, arg);
+    return;
+  }
+
+  PoolState state;
+  state.queues.resize(num_threads);
+  state.task = task;
+  state.arg = arg;
+  for (int i = 0; i < num_threads; ++i) {
+    pthread_mutex_init(&state.queues[i].mutex, NULL);
+    state.queues[i].begin = (long long)num_tasks * i / num_threads;
+    state.queues[i].end = (long long)num_tasks * (i + 1) / num_threads;
+  }
+
+  std::vector<WorkerArg> workers(num_threads);
+  std::vector<pthread_t> threads(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers[i].state = &state;
+    workers[i].id = i;
+  }
+  // The calling thread acts as worker 0.
+  for (int i = 1; i < num_threads; ++i)
+    MAO_RASSERT(pthread_create(&threads[i], NULL, Worker, &workers[i]) == 0);
+  Worker(&workers[0]);
+  for (int i = 1; i < num_threads; ++i)
+    pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < num_threads; ++i)
+    pthread_mutex_destroy(&state.queues[i].mutex);
+}
+
+
+//
+// Class: MaoTraceBuffer
+//
+
+__thread std::string *MaoTraceBuffer::buffer_ = NULL;
+
+void MaoTraceBuffer::Write(FILE *out, const std::string &text) {
+  if (buffer_ != NULL && out == stderr) {
+    buffer_->append(text);
+    return;
+  }
+  fwrite(text.data(), 1, text.size(), out);
+}
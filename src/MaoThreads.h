@@ -0,0 +1,116 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Threading support for running function passes concurrently.
+// Classes:
+//   MaoMutex            - A recursive mutex that is only active while
+//                         MAO runs passes on more than one thread.
+//   MaoMutexLock        - Scoped locking of a MaoMutex.
+//   MaoWorkStealingPool - Runs a fixed set of independent tasks on a
+//                         number of threads.
+//   MaoTraceBuffer      - Collects the trace output of a thread.
+//
+#ifndef MAOTHREADS_H_
+#define MAOTHREADS_H_
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <string>
+
+// MaoMutex
+//
+// The IR is shared between all functions of a unit, so the pieces of it
+// that more than one function can touch (symbols, caches, statistics)
+// are guarded by a MaoMutex. In the default, single threaded, mode the
+// locks are skipped altogether. The mutex is recursive since the guarded
+// methods often call each other, e.g., MaoUnit::DeleteEntry() calls
+// MaoUnit::GetFunction().
+class MaoMutex {
+ public:
+  MaoMutex();
+  ~MaoMutex();
+
+  void Lock() {
+    if (threaded_)
+      pthread_mutex_lock(&mutex_);
+  }
+  void Unlock() {
+    if (threaded_)
+      pthread_mutex_unlock(&mutex_);
+  }
+
+  // Turns locking on or off for all mutexes. Must only be called while
+  // a single thread is running.
+  static void SetThreaded(bool value) { threaded_ = value; }
+  static bool threaded() { return threaded_; }
+
+ private:
+  pthread_mutex_t mutex_;
+  static bool     threaded_;
+
+  MaoMutex(const MaoMutex &);
+  MaoMutex &operator=(const MaoMutex &);
+};
+
+// Locks the mutex for the lifetime of the object.
+class MaoMutexLock {
+ public:
+  explicit MaoMutexLock(MaoMutex *mutex) : mutex_(mutex) {
+    mutex_->Lock();
+  }
+  ~MaoMutexLock() {
+    mutex_->Unlock();
+  }
+
+ private:
+  MaoMutex *mutex_;
+};
+
+// MaoWorkStealingPool
+//
+// Runs task(0, arg) ... task(num_tasks - 1, arg) on num_threads threads,
+// including the calling thread, and returns when all tasks are done.
+// Each thread starts out owning a contiguous range of the task indices and
+// works through it front to back. A thread that runs out of work steals
+// the back half of the range of another thread.
+class MaoWorkStealingPool {
+ public:
+  typedef void (*Task)(int index, void *arg);
+
+  static void Run(int num_threads, int num_tasks, Task task, void *arg);
+};
+
+// MaoTraceBuffer
+//
+// While a thread has a buffer set, the trace output it writes with
+// Write() is appended to the buffer instead of going to stderr. The
+// function pass manager gives each function its own buffer and prints
+// them in function order once all threads are done, so the traces look
+// the same as in a serial run.
+class MaoTraceBuffer {
+ public:
+  static void Set(std::string *buffer) { buffer_ = buffer; }
+
+  // Writes text to out, or to the buffer of the thread if out is stderr.
+  static void Write(FILE *out, const std::string &text);
+
+ private:
+  static __thread std::string *buffer_;
+};
+
+#endif  // MAOTHREADS_H_
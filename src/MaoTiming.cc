@@ -0,0 +1,152 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+#include <stdio.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include "Mao.h"
+#include "MaoTiming.h"
+
+// Time spent in one scope path on one function.
+struct TimingRecord {
+  TimingRecord() : calls(0), total_ns(0), self_ns(0) { }
+  long long calls;
+  long long total_ns;
+  long long self_ns;
+};
+
+// Maps (path, function name) to the time spent there.
+typedef std::map<std::pair<std::string, std::string>, TimingRecord>
+    TimingRecordMap;
+
+static TimingRecordMap timing_records;
+static MaoMutex timing_mutex;
+
+// The innermost recording scope of the thread.
+static __thread MaoTimerScope *current_scope = NULL;
+
+//
+// Class: MaoTiming
+//
+
+bool MaoTiming::enabled_ = false;
+
+long long MaoTiming::Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void MaoTiming::Record(const char *path, const Function *function,
+                       long long total_ns, long long self_ns) {
+  std::pair<std::string, std::string> key(path,
+                                          function ? function->name() : "");
+  MaoMutexLock lock(&timing_mutex);
+  TimingRecord &record = timing_records[key];
+  ++record.calls;
+  record.total_ns += total_ns;
+  record.self_ns += self_ns;
+}
+
+bool MaoTiming::WriteJSON(const char *file_name) {
+  FILE *out = fopen(file_name, "w");
+  if (out == NULL)
+    return false;
+  MaoMutexLock lock(&timing_mutex);
+  fprintf(out, "{\n  \"timing\": [");
+  for (TimingRecordMap::const_iterator iter = timing_records.begin();
+       iter != timing_records.end(); ++iter) {
+    fprintf(out, "%s\n    {\"path\": ",
+            iter == timing_records.begin() ? "" : ",");
+    MaoUtil::WriteJSONString(out, iter->first.first);
+    fprintf(out, ", \"function\": ");
+    MaoUtil::WriteJSONString(out, iter->first.second);
+    fprintf(out, ", \"calls\": %lld, \"total_ns\": %lld, \"self_ns\": %lld}",
+            iter->second.calls, iter->second.total_ns, iter->second.self_ns);
+  }
+  fprintf(out, "\n  ]\n}\n");
+  return fclose(out) == 0;
+}
+
+// Writes str as a CSV field, quoted if needed.
+static void WriteCSVField(FILE *out, const std::string &str) {
+  if (str.find_first_of(",\"\n") == std::string::npos) {
+    fputs(str.c_str(), out);
+    return;
+  }
+  fputc('"', out);
+  for (std::string::const_iterator iter = str.begin(); iter != str.end();
+       ++iter) {
+    if (*iter == '"')
+      fputc('"', out);
+    fputc(*iter, out);
+  }
+  fputc('"', out);
+}
+
+bool MaoTiming::WriteCSV(const char *file_name) {
+  FILE *out = fopen(file_name, "w");
+  if (out == NULL)
+    return false;
+  MaoMutexLock lock(&timing_mutex);
+  fprintf(out, "path,function,calls,total_ns,self_ns\n");
+  for (TimingRecordMap::const_iterator iter = timing_records.begin();
+       iter != timing_records.end(); ++iter) {
+    WriteCSVField(out, iter->first.first);
+    fputc(',', out);
+    WriteCSVField(out, iter->first.second);
+    fprintf(out, ",%lld,%lld,%lld\n", iter->second.calls,
+            iter->second.total_ns, iter->second.self_ns);
+  }
+  return fclose(out) == 0;
+}
+
+//
+// Class: MaoTimerScope
+//
+
+MaoTimerScope::MaoTimerScope(const char *name, const Function *function)
+    : name_(name), function_(function), child_ns_(0), parent_(NULL),
+      recording_(MaoTiming::enabled()) {
+  if (recording_) {
+    parent_ = current_scope;
+    if (function_ == NULL && parent_ != NULL)
+      function_ = parent_->function_;
+    current_scope = this;
+  }
+  start_ = MaoTiming::Now();
+}
+
+MaoTimerScope::~MaoTimerScope() {
+  if (!recording_)
+    return;
+  long long total_ns = Elapsed();
+  MAO_ASSERT(current_scope == this);
+  current_scope = parent_;
+  if (parent_ != NULL)
+    parent_->child_ns_ += total_ns;
+
+  std::string path(name_);
+  for (const MaoTimerScope *scope = parent_; scope != NULL;
+       scope = scope->parent_)
+    path = std::string(scope->name_) + "/" + path;
+  MaoTiming::Record(path.c_str(), function_, total_ns, total_ns - child_ns_);
+}
@@ -0,0 +1,88 @@
+//
+// Copyright 2012 Google Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, 5th Floor, Boston, MA 02110-1301, USA.
+
+// Timing of passes and analyses.
+// Classes:
+//   MaoTiming     - Reads the clock, and keeps and reports the time spent
+//                   per pass and function.
+//   MaoTimerScope - Measures the time spent in a scope.
+//
+// Time is taken from the monotonic clock in nanoseconds. The pass
+// managers open a MaoTimerScope for every pass they run, and the
+// analyses that passes trigger (CFG, loop finder, relaxer) open one
+// while they build their results. Scopes nest per thread: a CFG built
+// while ZEE runs is recorded under the path "ZEE/CFG", and its time is
+// taken out of the self time of ZEE.
+//
+// The records are only kept once set_enabled(true) has been called, which
+// the --timing-json and --timing-csv options do. The per pass totals
+// printed by -T are kept by MaoTimer in either case.
+//
+#ifndef MAOTIMING_H_
+#define MAOTIMING_H_
+
+class Function;
+
+class MaoTiming {
+ public:
+  // Returns the time of the monotonic clock, in nanoseconds.
+  static long long Now();
+
+  static bool enabled() { return enabled_; }
+  static void set_enabled(bool value) { enabled_ = value; }
+
+  // Writes all records to file_name, as JSON or as CSV. Returns false
+  // if the file cannot be written.
+  static bool WriteJSON(const char *file_name);
+  static bool WriteCSV(const char *file_name);
+
+ private:
+  friend class MaoTimerScope;
+
+  // Adds a run of the scope with the given path on function to the
+  // records. function may be NULL for scopes outside of functions.
+  static void Record(const char *path, const Function *function,
+                     long long total_ns, long long self_ns);
+
+  static bool enabled_;
+};
+
+class MaoTimerScope {
+ public:
+  // Starts timing a scope called name. If function is NULL, the scope
+  // belongs to the function of the enclosing scope, if any.
+  explicit MaoTimerScope(const char *name, const Function *function = NULL);
+  ~MaoTimerScope();
+
+  // Returns the nanoseconds since the scope was entered.
+  long long Elapsed() const { return MaoTiming::Now() - start_; }
+
+ private:
+  const char     *name_;
+  const Function *function_;
+  long long       start_;
+  // Time spent in nested scopes.
+  long long       child_ns_;
+  // The enclosing scope on this thread, if recording.
+  MaoTimerScope  *parent_;
+  bool            recording_;
+
+  MaoTimerScope(const MaoTimerScope &);
+  MaoTimerScope &operator=(const MaoTimerScope &);
+};
+
+#endif  // MAOTIMING_H_
@@ -17,6 +17,7 @@
 //   51 Franklin Street, Fifth Floor,
 //   Boston, MA  02110-1301, USA.
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -36,13 +37,13 @@
 // Default to no subsection selected
 // A default will be generated if necessary later on.
 MaoUnit::MaoUnit(MaoOptions *mao_options)
-    : arch_(UNKNOWN), current_subsection_(0), mao_options_(mao_options) {
+    : arch_(UNKNOWN), parallel_first_id_(0), current_subsection_(0),
+      mao_options_(mao_options),
+      strings_(&arena_), function_cache_(NULL) {
   entry_vector_.clear();
   sub_sections_.clear();
   sections_.clear();
   functions_.clear();
-  entry_to_function_.clear();
-  entry_to_subsection_.clear();
 }
 
 MaoUnit::~MaoUnit() {
@@ -67,11 +68,13 @@ MaoUnit::~MaoUnit() {
     delete iter->second;
   }
 
-  // Remove entries and free allocated memory
+  // Entries live in arena_, which releases them in one go. Only directives
+  // own memory outside of the arena, their operands.
   for (VectorEntryIterator iter = entry_vector_.begin();
        iter != entry_vector_.end();
        ++iter) {
-    delete *iter;
+    if (*iter && (*iter)->IsDirective())
+      delete *iter;
   }
 }
 
@@ -123,6 +126,33 @@ void MaoUnit::PrintMaoUnit(FILE *out) const {
   }
 }
 
+void MaoUnit::PrintMaoUnit(MaoOutputBuffer *out) const {
+  std::string *buffer = out->buffer();
+  for (std::vector<SubSection *>::const_iterator iter = sub_sections_.begin();
+       iter != sub_sections_.end(); ++iter) {
+    SubSection *ss = *iter;
+    for (EntryIterator e_iter = ss->EntryBegin();
+         e_iter != ss->EntryEnd();
+         ++e_iter) {
+      MaoEntry *entry = *e_iter;
+      if (function_cache_ && InFunction(entry) &&
+          entry == entry->function()->first_entry() &&
+          MaoFunctionCache::InOneSubSection(entry->function())) {
+        Function *function = entry->function();
+        function_cache_->PrintFunction(function, buffer);
+        // The function ends in this subsection.
+        while (*e_iter != function->last_entry()) {
+          ++e_iter;
+          MAO_ASSERT(e_iter != ss->EntryEnd());
+        }
+      } else {
+        entry->EntryToString(buffer);
+      }
+      out->FlushIfFull();
+    }
+  }
+}
+
 void MaoUnit::PrintIR(bool print_entries, bool print_sections,
                       bool print_subsections, bool print_functions) const {
   PrintIR(stdout, print_entries, print_sections, print_subsections);
@@ -132,7 +162,7 @@ void MaoUnit::PrintIR(bool print_entries, bool print_sections,
 const char *MaoUnit::FunctionName(MaoEntry *entry) const {
   const char *function = "";
   if (InFunction(entry)) {
-    function = (*(entry_to_function_.find(entry))).second->name().c_str();
+    function = entry->function()->name().c_str();
   }
   return function;
 }
@@ -140,7 +170,7 @@ const char *MaoUnit::FunctionName(MaoEntry *entry) const {
 const char *MaoUnit::SectionName(MaoEntry *entry) const {
   const char *section = "";
   if (InSubSection(entry)) {
-    SubSection *ss = (*(entry_to_subsection_.find(entry))).second;
+    SubSection *ss = entry->subsection();
     section = ss->section()->name().c_str();
   }
   return section;
@@ -220,14 +250,9 @@ void MaoUnit::PrintIR(FILE *out, bool print_entries, bool print_sections,
 }
 
 Section *MaoUnit::GetSection(const std::string &section_name) const {
-  Section *section = NULL;
   // See if section already have been created.
-  std::map<const char *, Section *, ltstr>::const_iterator it =
-      sections_.find(section_name.c_str());
-  if (it != sections_.end()) {
-    section = it->second;
-  }
-  return section;
+  Section *const *section = section_index_.Find(section_name.c_str());
+  return section ? *section : NULL;
 }
 
 std::pair<bool, Section *> MaoUnit::FindOrCreateAndFind(
@@ -235,16 +260,16 @@ std::pair<bool, Section *> MaoUnit::FindOrCreateAndFind(
   bool new_section = false;
   Section *section;
   // See if section already have been created.
-  std::map<const char *, Section *, ltstr>::const_iterator it =
-      sections_.find(section_name);
-  if (it == sections_.end()) {
+  Section **found = section_index_.Find(section_name);
+  if (found == NULL) {
     // Create it.
     // TODO(martint): Use an ID factory for the ID
     section = new Section(section_name, sections_.size());
     sections_[section->name().c_str()] = section;
+    section_index_.Insert(section->name().c_str(), section);
     new_section = true;
   } else {
-    section = it->second;
+    section = *found;
   }
   MAO_ASSERT(section);
   return std::make_pair(new_section, section);
@@ -287,13 +312,9 @@ SubSection *MaoUnit::AddNewSubSection(const char *section_name,
 
 
 LabelEntry *MaoUnit::GetLabelEntry(const char *label_name) const {
-  std::map<const char *, LabelEntry *>::const_iterator iter =
-      labels_.find(label_name);
-  if (iter == labels_.end()) {
-    return NULL;
-  } else {
-    return iter->second;
-  }
+  MaoMutexLock lock(&mutex_);
+  LabelEntry *const *label = labels_.Find(label_name);
+  return label ? *label : NULL;
 }
 
 
@@ -325,21 +346,13 @@ InstructionEntry *MaoUnit::CreateInstruction(i386_insn *instruction,
       return NULL;  // Quells a warning about flag used without being defined
   }
 
-  InstructionEntry *e = new InstructionEntry(instruction, flag, 0, NULL, this);
-  // next free ID for the entry
-  EntryID entry_index = entry_vector_.size();
-  e->set_id(entry_index);
-
-  // Add the entry to the compilation unit
-  entry_vector_.push_back(e);
+  InstructionEntry *e =
+      new (&arena_) InstructionEntry(instruction, flag, 0, NULL, this);
+  AddCreatedEntry(e);
 
   SubSection *subsection = function->GetSubSection();
-  if (function) {
-    entry_to_function_[e] = function;
-  }
-  if (subsection) {
-    entry_to_subsection_[e] = subsection;
-  }
+  e->set_function(function);
+  e->set_subsection(subsection);
   return e;
 }
 
@@ -367,21 +380,13 @@ InstructionEntry *MaoUnit::CreateInstruction(const char *opcode_str,
       return NULL;  // Quells a warning about flag used without being defined
   }
 
-  InstructionEntry *e = new InstructionEntry(&insn, flag, 0, NULL, this);
-  // next free ID for the entry
-  EntryID entry_index = entry_vector_.size();
-  e->set_id(entry_index);
-
-  // Add the entry to the compilation unit
-  entry_vector_.push_back(e);
+  InstructionEntry *e =
+      new (&arena_) InstructionEntry(&insn, flag, 0, NULL, this);
+  AddCreatedEntry(e);
 
   SubSection *subsection = function->GetSubSection();
-  if (function) {
-    entry_to_function_[e] = function;
-  }
-  if (subsection) {
-    entry_to_subsection_[e] = subsection;
-  }
+  e->set_function(function);
+  e->set_subsection(subsection);
   return e;
 }
 
@@ -485,7 +490,7 @@ InstructionEntry *MaoUnit::CreateUncondJump(LabelEntry *label,
                                             Function *function) {
   InstructionEntry *e = CreateInstruction("jmp", 0xeb, function);
   expressionS *disp_expression =
-      static_cast<expressionS *>(xmalloc(sizeof(expressionS)));
+      static_cast<expressionS *>(arena_.Allocate(sizeof(expressionS)));
   symbolS *symbolP;
 
   i386_insn *insn = e->instruction();
@@ -500,7 +505,10 @@ InstructionEntry *MaoUnit::CreateUncondJump(LabelEntry *label,
   for (int j = 0; j < MAX_OPERANDS; j++)
     insn->reloc[j] = NO_RELOC;
 
+  // The gas symbol table is shared by all functions.
+  mutex_.Lock();
   symbolP = symbol_find_or_make(label->name());
+  mutex_.Unlock();
 
   disp_expression->X_op = O_symbol;
   disp_expression->X_add_symbol = symbolP;
@@ -515,6 +523,27 @@ InstructionEntry *MaoUnit::CreateUncondJump(LabelEntry *label,
   return e;
 }
 
+void MaoUnit::SetBranchTarget(InstructionEntry *branch, LabelEntry *label) {
+  i386_insn *insn = branch->instruction();
+  for (unsigned int i = 0; i < insn->operands; i++) {
+    if (!branch->IsMemOperand(i) || insn->op[i].disps == NULL ||
+        insn->op[i].disps->X_op != O_symbol)
+      continue;
+    // The old expression may be shared with a copy of the instruction, so
+    // give the branch its own.
+    expressionS *disp_expression =
+        static_cast<expressionS *>(arena_.Allocate(sizeof(expressionS)));
+    *disp_expression = *insn->op[i].disps;
+    mutex_.Lock();
+    disp_expression->X_add_symbol = symbol_find_or_make(label->name());
+    mutex_.Unlock();
+    branch->SetDisplacement(i, disp_expression);
+    return;
+  }
+  MAO_RASSERT_MSG(false, "Branch has no symbolic target: %s",
+                  branch->GetTarget());
+}
+
 InstructionEntry *MaoUnit::CreateIncFromOperand(Function *function,
                                                 InstructionEntry *insn2,
                                                 int op2) {
@@ -540,21 +569,11 @@ InstructionEntry *MaoUnit::CreateDecFromOperand(Function *function,
 LabelEntry *MaoUnit::CreateLabel(const char *labelname,
                                  Function *function,
                                  SubSection *subsection) {
-  LabelEntry *l = new LabelEntry(labelname, 0, NULL, this);
+  LabelEntry *l = new (&arena_) LabelEntry(labelname, 0, NULL, this);
+  AddCreatedEntry(l);
 
-  // next free ID for the entry
-  EntryID entry_index = entry_vector_.size();
-  l->set_id(entry_index);
-
-  // Add the entry to the compilation unit
-  entry_vector_.push_back(l);
-
-  if (function) {
-    entry_to_function_[l] = function;
-  }
-  if (subsection) {
-    entry_to_subsection_[l] = subsection;
-  }
+  l->set_function(function);
+  l->set_subsection(subsection);
 
   return l;
 }
@@ -565,23 +584,57 @@ DirectiveEntry *MaoUnit::CreateDirective(
     Function *function,
     SubSection *subsection) {
   DirectiveEntry *directive =
-      new DirectiveEntry(op, operands,
-                         0, NULL, this);
+      new (&arena_) DirectiveEntry(op, operands, 0, NULL, this);
+  AddCreatedEntry(directive);
+
+  directive->set_function(function);
+  directive->set_subsection(subsection);
+
+  return directive;
+}
+
+static bool CreatedForEarlierFunction(const std::pair<int, MaoEntry *> &a,
+                                      const std::pair<int, MaoEntry *> &b) {
+  return a.first < b.first;
+}
+
+void MaoUnit::AddCreatedEntry(MaoEntry *entry) {
+  MaoMutexLock lock(&mutex_);
   // next free ID for the entry
   EntryID entry_index = entry_vector_.size();
-  directive->set_id(entry_index);
+  entry->set_id(entry_index);
 
   // Add the entry to the compilation unit
-  entry_vector_.push_back(directive);
+  entry_vector_.push_back(entry);
+  if (MaoMutex::threaded()) {
+    Function *function = BBNameGen::function();
+    parallel_functions_.push_back(function ? function->id() : -1);
+  }
+}
+
+void MaoUnit::BeginParallelIDs() {
+  parallel_first_id_ = entry_vector_.size();
+  parallel_functions_.clear();
+}
 
-  if (function) {
-    entry_to_function_[directive] = function;
+void MaoUnit::EndParallelIDs() {
+  EntryID end_id = entry_vector_.size();
+  MAO_ASSERT(parallel_first_id_ +
+             static_cast<EntryID>(parallel_functions_.size()) == end_id);
+  // Entries deleted since have a NULL slot, which keeps its place too.
+  std::vector<std::pair<int, MaoEntry *> > created;
+  for (EntryID id = parallel_first_id_; id < end_id; ++id) {
+    created.push_back(std::make_pair(
+        parallel_functions_[id - parallel_first_id_], entry_vector_[id]));
   }
-  if (subsection) {
-    entry_to_subsection_[directive] = subsection;
+  std::stable_sort(created.begin(), created.end(), CreatedForEarlierFunction);
+  for (size_t i = 0; i < created.size(); ++i) {
+    EntryID id = parallel_first_id_ + i;
+    entry_vector_[id] = created[i].second;
+    if (created[i].second != NULL)
+      created[i].second->set_id(id);
   }
-
-  return directive;
+  parallel_functions_.clear();
 }
 
 // Add an entry to the MaoUnit list
@@ -624,8 +677,7 @@ bool MaoUnit::AddEntry(MaoEntry *entry,
     case MaoEntry::LABEL:
       // A Label will generate in a new symbol in the symbol table
       label_entry = static_cast<LabelEntry *>(entry);
-      MAO_ASSERT(labels_.insert(std::make_pair(label_entry->name(),
-                                               label_entry)).second);
+      MAO_ASSERT(labels_.Insert(label_entry->name(), label_entry));
       symbol = symbol_table_.FindOrCreateAndFind(label_entry->name(),
                                                 current_subsection_->section());
       MAO_ASSERT(symbol);
@@ -707,7 +759,7 @@ bool MaoUnit::AddEntry(MaoEntry *entry,
   // Update subsection information
   if (current_subsection_) {
     current_subsection_->set_last_entry(entry);
-    entry_to_subsection_[entry] = current_subsection_;
+    entry->set_subsection(current_subsection_);
   }
 
   return true;
@@ -748,8 +800,17 @@ bool MaoUnit::AddCommSymbol(const char *name, unsigned int common_size,
 }
 
 long MaoUnit::BBNameGen::i = 0;
+__thread Function *MaoUnit::BBNameGen::function_ = NULL;
+bool MaoUnit::BBNameGen::per_function_ = false;
+MaoMutex MaoUnit::BBNameGen::mutex_;
 const char *MaoUnit::BBNameGen::GetUniqueName() {
   char buff[512];
+  if (per_function_ && function_) {
+    sprintf(buff, ".L__mao_label_%d_%d", function_->id(),
+            function_->NextLabelNumber());
+    return strdup(buff);
+  }
+  MaoMutexLock lock(&mutex_);
   MAO_ASSERT(i <= LONG_MAX);
   sprintf(buff, ".L__mao_label_%ld", i);
   char *buff2 = strdup(buff);
@@ -806,7 +867,7 @@ void MaoUnit::FindFunctions(bool create_anonymous) {
       Function *function = new Function(symbol->name(), functions_.size(),
                                         GetSubSection(entry));
       function->set_first_entry(entry);
-      entry_to_function_[entry] = function;
+      entry->set_function(function);
 
       // Find the last entry in this function:
       // A function ends when you find one of the following
@@ -854,12 +915,12 @@ void MaoUnit::FindFunctions(bool create_anonymous) {
             break;
           }
         }
-        entry_to_function_[entry_tail] = function;
+        entry_tail->set_function(function);
         entry_tail = entry_tail->next();
       }
 
       // Now entry_tail can not move more forward.
-      entry_to_function_[entry_tail] = function;
+      entry_tail->set_function(function);
       function->set_last_entry(entry_tail);
       functions_.push_back(function);
     }
@@ -901,7 +962,7 @@ void MaoUnit::FindFunctions(bool create_anonymous) {
           while (entry &&
                  !InFunction(entry)) {
             function->set_last_entry(entry);
-            entry_to_function_[entry] = function;
+            entry->set_function(function);
             if (entry->IsInstruction())
               ++instruciton_entries;
             entry = entry->next();
@@ -922,6 +983,7 @@ void MaoUnit::FindFunctions(bool create_anonymous) {
 
 
 Symbol *MaoUnit::AddSymbol(const char *name) {
+  MaoMutexLock lock(&mutex_);
   Section *section = current_subsection_?
       (current_subsection_->section()):
       NULL;
@@ -931,6 +993,7 @@ Symbol *MaoUnit::AddSymbol(const char *name) {
 
 
 Symbol *MaoUnit::FindOrCreateAndFindSymbol(const char *name) {
+  MaoMutexLock lock(&mutex_);
   Section *section = current_subsection_?
       (current_subsection_->section()):
       NULL;
@@ -939,31 +1002,24 @@ Symbol *MaoUnit::FindOrCreateAndFindSymbol(const char *name) {
 
 
 Function *MaoUnit::GetFunction(MaoEntry *entry) {
-  if (entry_to_function_.find(entry) == entry_to_function_.end()) {
-    return NULL;
-  } else {
-    return entry_to_function_[entry];
-  }
+  return entry ? entry->function() : NULL;
 }
 
 bool MaoUnit::InFunction(MaoEntry *entry) const {
-  return entry_to_function_.find(entry) != entry_to_function_.end();
+  return entry && entry->function() != NULL;
 }
 
 
 SubSection *MaoUnit::GetSubSection(MaoEntry *entry) {
-  if (entry_to_subsection_.find(entry) == entry_to_subsection_.end()) {
-    return NULL;
-  } else {
-    return entry_to_subsection_[entry];
-  }
+  return entry ? entry->subsection() : NULL;
 }
 
 bool MaoUnit::InSubSection(MaoEntry *entry) const {
-  return entry_to_subsection_.find(entry) != entry_to_subsection_.end();
+  return entry && entry->subsection() != NULL;
 }
 
 void MaoUnit::DeleteEntry(MaoEntry *entry) {
+  MaoMutexLock lock(&mutex_);
   // 1. Prev/next pointers around the entry
   MaoEntry *prev_entry = entry->prev();  // Possibly null
   MaoEntry *next_entry = entry->next();  // Possibly null
@@ -997,13 +1053,7 @@ void MaoUnit::DeleteEntry(MaoEntry *entry) {
     // TODO(martint): Deallocate memory!
     // function->set_cfg(NULL);
 
-    Section *section = function->GetSection();
-    if (MaoRelaxer::HasSizeMap(section)) {
-        std::map<MaoEntry *, int> *sizes =
-            MaoRelaxer::GetSizeMap(this, section);
-        MAO_ASSERT(sizes->find(entry) != sizes->end());
-        sizes->erase(sizes->find(entry));
-    }
+    MaoRelaxer::EraseEntry(function->GetSection(), function, entry);
   }
 
   // 4. Update subsection if needed
@@ -1024,20 +1074,14 @@ void MaoUnit::DeleteEntry(MaoEntry *entry) {
     }
   }
 
-  // 5. Update entry_to_*_ maps
-  if (InFunction(entry)) {
-    entry_to_function_.erase(entry_to_function_.find(entry));
-    MAO_ASSERT(!InFunction(entry));
-  }
-  if (InSubSection(entry)) {
-    entry_to_subsection_.erase(entry_to_subsection_.find(entry));
-    MAO_ASSERT(!InSubSection(entry));
-  }
+  // 5. Detach the entry from its function and subsection
+  entry->set_function(NULL);
+  entry->set_subsection(NULL);
 
   // 6. Update labels map
   if (entry->IsLabel()) {
     LabelEntry *le = entry->AsLabel();
-    labels_.erase(labels_.find(le->name()));
+    labels_.Erase(le->name());
   }
 }
 
@@ -1062,8 +1106,8 @@ void MaoUnit::PopSubSection(int line_number) {
   operands.push_back(new DirectiveEntry::Operand(
                          ss->name().c_str()));
   DirectiveEntry *directive =
-      new DirectiveEntry(DirectiveEntry::SECTION, operands,
-                         line_number, NULL, this);
+      new (&arena_) DirectiveEntry(DirectiveEntry::SECTION, operands,
+                                   line_number, NULL, this);
 
   // AddEntry will change current_subserction_
   AddEntry(directive, false);
@@ -1075,8 +1119,8 @@ void MaoUnit::PopSubSection(int line_number) {
     DirectiveEntry::OperandVector ss_operand;
     ss_operand.push_back(new DirectiveEntry::Operand(ss->number()));
     DirectiveEntry *ss_directive =
-        new DirectiveEntry(DirectiveEntry::SUBSECTION, ss_operand,
-                           line_number, NULL, this);
+        new (&arena_) DirectiveEntry(DirectiveEntry::SUBSECTION,
+                                     ss_operand, line_number, NULL, this);
     AddEntry(ss_directive, false);
   }
 
@@ -1092,7 +1136,7 @@ void MaoUnit::SetPreviousSubSection(int line_number) {
   operands.push_back(new DirectiveEntry::Operand(
                          prev_subsection_->name().c_str()));
   DirectiveEntry *directive =
-      new DirectiveEntry(DirectiveEntry::SECTION, operands,
-                         line_number, NULL, this);
+      new (&arena_) DirectiveEntry(DirectiveEntry::SECTION, operands,
+                                   line_number, NULL, this);
   AddEntry(directive, false);
 }
@@ -37,13 +37,18 @@ extern "C" {
 
 #include "gen-opcodes.h"
 
+#include "MaoArena.h"
 #include "MaoDebug.h"
 #include "MaoDefs.h"
 #include "MaoEntry.h"
 #include "MaoFunction.h"
 #include "MaoOptions.h"
+#include "MaoOutput.h"
 #include "MaoSection.h"
+#include "MaoSourceFile.h"
 #include "MaoStats.h"
+#include "MaoStrings.h"
+#include "MaoThreads.h"
 
 #include "ir.h"
 #include "SymbolTable.h"
@@ -54,6 +59,7 @@ extern "C" {
 #define DEFAULT_SECTION_NAME ".text"
 
 class Function;
+class MaoFunctionCache;
 class MaoUnit;
 class Symbol;
 class SymbolTable;
@@ -136,6 +142,10 @@ class MaoUnit {
   // the given function.
   InstructionEntry *CreateUncondJump(LabelEntry *l, Function *function);
 
+  // Makes the direct branch jump to the given label instead of its current
+  // target.
+  void SetBranchTarget(InstructionEntry *branch, LabelEntry *label);
+
   // Create an inc reg instruction with a given operand from another insn
   InstructionEntry *CreateIncFromOperand(Function *function,
                                          InstructionEntry *insn2,
@@ -185,6 +195,8 @@ class MaoUnit {
   void PrintMaoUnit() const;
   // Prints this MAO unit to FILE *out.
   void PrintMaoUnit(FILE *out) const;
+  // Writes this MAO unit to out, in the same format.
+  void PrintMaoUnit(MaoOutputBuffer *out) const;
   // Prints the IR of this unit. The flags controls what gets printed.
   void PrintIR(bool print_entries = true,
                bool print_sections = true,
@@ -204,11 +216,25 @@ class MaoUnit {
   Section * GetSection(const std::string &section_name) const;
 
   // Simple class for generating unique names for mao-created labels.
+  // While a function pass manager runs passes on a function, that function
+  // is set as the current function of the thread. Names are numbered
+  // through the unit, as they always were, unless the function passes run
+  // on several threads or their output is cached. Then they are numbered
+  // per function, so they do not depend on the order in which the
+  // functions are processed.
   class BBNameGen {
    public:
     static const char *GetUniqueName();
+    static void SetFunction(Function *function) { function_ = function; }
+    static Function *function() { return function_; }
+    static void SetNumberPerFunction(bool per_function) {
+      per_function_ = per_function;
+    }
    private:
     static long i;
+    static __thread Function *function_;
+    static bool per_function_;
+    static MaoMutex mutex_;
   };
 
   // Returns the pointer to the MaoOptions object that contains the options
@@ -265,6 +291,34 @@ class MaoUnit {
   // Returns statistics about the unit.
   Stats *GetStats() {return &stats_;}
 
+  // Returns the arena holding the entries, instructions, expressions and
+  // strings of this unit.
+  MaoArena *arena() { return &arena_; }
+
+  // Returns the table of strings interned for this unit, e.g., label names.
+  MaoStringTable *strings() { return &strings_; }
+
+  // Returns the mapped input files, used with --mmap-input.
+  MaoSourceFiles *source_files() { return &source_files_; }
+
+  // Returns the cache of optimized functions, or NULL if it is not used.
+  // The unit does not own the cache.
+  MaoFunctionCache *function_cache() const { return function_cache_; }
+  void set_function_cache(MaoFunctionCache *cache) { function_cache_ = cache; }
+
+  // Returns the mutex guarding the entry list and the maps of the unit
+  // when function passes run on several threads.
+  MaoMutex *mutex() const { return &mutex_; }
+
+  // Entries created while function passes run on several threads get
+  // their IDs in the order the threads happen to create them. Call
+  // BeginParallelIDs() before the threads start and EndParallelIDs() once
+  // they are done, to give the entries created in between the IDs a
+  // serial run would have given them: ordered by the function they were
+  // created for (see BBNameGen::SetFunction()), then by creation order.
+  void BeginParallelIDs();
+  void EndParallelIDs();
+
 
   // Returns true if the code is in 64 bit mode.
   bool Is64BitMode() const { return arch_ == X86_64; }
@@ -306,6 +360,14 @@ class MaoUnit {
   // Vector of the entries in the unit. The id of the entry
   // is also the index into this vector.
   EntryVector entry_vector_;
+  // Between BeginParallelIDs() and EndParallelIDs(), the first ID handed
+  // out and, for each entry created since, the ID of the function it was
+  // created for.
+  EntryID parallel_first_id_;
+  std::vector<int> parallel_functions_;
+
+  // Gives entry the next free ID and adds it to entry_vector_.
+  void AddCreatedEntry(MaoEntry *entry);
 
   // A list of all subsections found in the unit.
   // Each subsection should have a pointer to the first and last
@@ -313,8 +375,10 @@ class MaoUnit {
   std::vector<SubSection *> sub_sections_;
 
   // List of sections_ found in the program. Each subsection has a pointer to
-  // its section.
+  // its section. The map gives the iteration order, the hash map is used
+  // for lookups.
   std::map<const char *, Section *, ltstr> sections_;
+  StringHashMap<Section *> section_index_;
 
   // Holds the function identified in the MaoUnit.
   FunctionVector  functions_;
@@ -331,11 +395,7 @@ class MaoUnit {
   SymbolTable symbol_table_;
 
   // Maps label-names to the corresponding label entry.
-  std::map<const char *, LabelEntry *, ltstr> labels_;
-
-  // Maps an entry to the corresponding Function and SubSection.
-  std::map<MaoEntry *, Function *>   entry_to_function_;
-  std::map<MaoEntry *, SubSection *> entry_to_subsection_;
+  StringHashMap<LabelEntry *> labels_;
 
   // Given an entry, return the name of the function it belongs to,
   // or "" if it is not in any function.
@@ -354,6 +414,13 @@ class MaoUnit {
                                unsigned int subsection_number, MaoEntry *entry);
 
   Stats stats_;
+
+  MaoArena arena_;
+  MaoStringTable strings_;
+  MaoSourceFiles source_files_;
+  MaoFunctionCache *function_cache_;
+
+  mutable MaoMutex mutex_;
 };  // MaoUnit
 
 
@@ -36,3 +36,18 @@ void MaoUtil::Tokenize(const std::string& str,
     pos = str.find_first_of(delimiters, lastPos);
   }
 }
+
+void MaoUtil::WriteJSONString(FILE *out, const std::string& str) {
+  fputc('"', out);
+  for (std::string::const_iterator iter = str.begin(); iter != str.end();
+       ++iter) {
+    unsigned char c = *iter;
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
@@ -18,6 +18,7 @@
 #ifndef MAOUTIL_H_
 #define MAOUTIL_H_
 
+#include <stdio.h>
 #include <string.h>
 
 #include <cstdarg>
@@ -25,6 +26,7 @@
 #include <string>
 
 #include "MaoDebug.h"
+#include "MaoMemory.h"
 
 // Used by the STL-maps of sections and subsections.
 struct ltstr {
@@ -39,7 +41,12 @@ struct ltstr {
 
 // BitString implementation.
 //
-class BitString {
+// Strings of up to kInlineWords words (256 bits) keep their words inside
+// the object, so creating and copying them does not touch the heap.
+// Longer strings allocate their words. With C++11, temporaries are moved
+// instead of copied.
+class BitString
+    : public MaoMemoryTracked<BitString, MaoMemory::BITSTRING> {
  public:
   explicit BitString(int number_of_bits) {
     InitObj(number_of_bits);
@@ -57,11 +64,8 @@ class BitString {
   // the last word must be zero, or the function will exit.
   BitString(int number_of_bits, int number_of_words, ...) {
      va_list vl;
-
-     number_of_words_ = number_of_words;
-     number_of_bits_ = number_of_bits;
-
-     word_ = new unsigned long long[number_of_words_];
+     InitObj(number_of_bits);
+     MAO_ASSERT(number_of_words == number_of_words_);
 
      va_start(vl, number_of_words);
      for (int i = 0; i < number_of_words_; ++i) {
@@ -78,36 +82,67 @@ class BitString {
     CopyObj(b);
   }
 
-  // Assignment performs a deep copy.
+  // Assignment performs a deep copy. The words are reused when both
+  // strings have the same size.
   BitString& operator = (const BitString& other) {
-    CopyObj(other);
+    if (this == &other)
+      return *this;
+    if (number_of_words_ != other.number_of_words_) {
+      FreeObj();
+      CopyObj(other);
+      return *this;
+    }
+    number_of_bits_ = other.number_of_bits_;
+    for (int i = 0; i < number_of_words_; ++i)
+      word_[i] = other.word_[i];
+    return *this;
+  }
+
+#if __cplusplus >= 201103L
+  // Moving takes over the words of long strings. The moved-from string
+  // may only be destroyed or assigned to.
+  BitString(BitString&& other) {
+    MoveObj(&other);
+  }
+
+  BitString& operator = (BitString&& other) {
+    if (this != &other) {
+      FreeObj();
+      MoveObj(&other);
+    }
     return *this;
   }
+#endif
 
   ~BitString() {
-    MAO_ASSERT(word_);
-    delete[] word_;
+    FreeObj();
+  }
+
+  // Exchanges the contents of two bitstrings.
+  void Swap(BitString *other) {
+    if (other == this)
+      return;
+    BitString tmp(0, this);
+    MoveObj(other);
+    other->MoveObj(&tmp);
   }
 
   void Set(int index) {
     MAO_ASSERT(index >= 0);
     MAO_ASSERT(index < number_of_bits_);
-    word_[index / (sizeof(unsigned long long) * 8)] |=
-        1ULL << (index % (sizeof(unsigned long long) * 8));
+    word_[index / kBitsPerWord] |= 1ULL << (index % kBitsPerWord);
   }
 
   void Clear(int index) {
     MAO_ASSERT(index >= 0);
     MAO_ASSERT(index < number_of_bits_);
-    word_[index / (sizeof(unsigned long long) * 8)] &=
-        ~(1ULL << (index % (sizeof(unsigned long long) * 8)));
+    word_[index / kBitsPerWord] &= ~(1ULL << (index % kBitsPerWord));
   }
 
   bool Get(int index) const {
     MAO_ASSERT(index >= 0);
     MAO_ASSERT(index < number_of_bits_);
-    return word_[index / (sizeof(unsigned long long) * 8)] &
-        (1ULL << (index % (sizeof(unsigned long long) * 8)));
+    return word_[index / kBitsPerWord] & (1ULL << (index % kBitsPerWord));
   }
 
   // Return the index of the next bit set, starting (and including)
@@ -116,46 +151,69 @@ class BitString {
   // (that is the range of values is the number of bits in the string
   // plus one).  If the input value is set to the number of bits in
   // the string, return -1.
-  int NextSetBit(int from_index) {
+  int NextSetBit(int from_index) const {
     MAO_ASSERT(from_index >= 0);
     MAO_ASSERT(from_index <= number_of_bits_);
-    unsigned int word_pos = from_index/(sizeof(unsigned long long) * 8);
-    unsigned int bit_pos = from_index%(sizeof(unsigned long long) * 8);
-    while ((int) word_pos < number_of_words_) {
-      while (word_[word_pos] && (bit_pos < (sizeof(unsigned long long) * 8))) {
-        if (word_[word_pos]&(1ULL << bit_pos))
-          return word_pos*sizeof(unsigned long long)*8+bit_pos;
-        bit_pos++;
-      }
-      word_pos++;
-      bit_pos = 0;
+    int word_pos = from_index / kBitsPerWord;
+    if (word_pos == number_of_words_)
+      return -1;
+    // Skip whole zero words, then find the lowest set bit in the word.
+    unsigned long long bits =
+        word_[word_pos] & (~0ULL << (from_index % kBitsPerWord));
+    while (!bits) {
+      if (++word_pos == number_of_words_)
+        return -1;
+      bits = word_[word_pos];
     }
-    return -1;
+    int index = word_pos * kBitsPerWord + __builtin_ctzll(bits);
+    // The unused bits are only set in undefined strings.
+    return index < number_of_bits_ ? index : -1;
   }
 
-  unsigned long long GetWord(int index) {
+  unsigned long long GetWord(int index) const {
     MAO_ASSERT(index >= 0);
     MAO_ASSERT(index < number_of_words_);
     return word_[index];
   }
 
-  // Union
-  BitString operator |(const BitString &b) const {
+  // In-place union
+  BitString &operator |=(const BitString &b) {
     MAO_ASSERT(b.number_of_bits() == number_of_bits_);
-    BitString bs_new(number_of_bits_);
     for (int i = 0; i < number_of_words_; ++i) {
-      bs_new.word_[i] = word_[i] | b.word_[i];
+      word_[i] |= b.word_[i];
     }
-    return bs_new;
+    return *this;
   }
 
-  // Intersect
-  BitString operator &(const BitString &b) const {
+  // In-place intersect
+  BitString &operator &=(const BitString &b) {
     MAO_ASSERT(b.number_of_bits() == number_of_bits_);
-    BitString bs_new(number_of_bits_);
     for (int i = 0; i < number_of_words_; ++i) {
-      bs_new.word_[i] = word_[i] & b.word_[i];
+      word_[i] &= b.word_[i];
     }
+    return *this;
+  }
+
+  // In-place removal of bits
+  BitString &operator -=(const BitString &b) {
+    MAO_ASSERT(b.number_of_bits() == number_of_bits_);
+    for (int i = 0; i < number_of_words_; ++i) {
+      word_[i] &= ~b.word_[i];
+    }
+    return *this;
+  }
+
+  // Union
+  BitString operator |(const BitString &b) const {
+    BitString bs_new(*this);
+    bs_new |= b;
+    return bs_new;
+  }
+
+  // Intersect
+  BitString operator &(const BitString &b) const {
+    BitString bs_new(*this);
+    bs_new &= b;
     return bs_new;
   }
 
@@ -173,11 +231,8 @@ class BitString {
 
   // Remove bits
   BitString operator -(const BitString &b) const {
-    MAO_ASSERT(b.number_of_bits() == number_of_bits_);
-    BitString bs_new(number_of_bits_);
-    for (int i = 0; i < number_of_words_; ++i) {
-      bs_new.word_[i] = word_[i] & ~b.word_[i];
-    }
+    BitString bs_new(*this);
+    bs_new -= b;
     return bs_new;
   }
 
@@ -270,15 +325,8 @@ class BitString {
   // Return the number of set bits in the bitstring.
   int NumOfBitsSet() const {
     int c = 0; // c accumulates the total bits set.
-    // Process one byte at the time.
     for (int i = 0; i < number_of_words_; ++i) {
-      unsigned long long v = word_[i];
-      // Loop one iteration for each bit set in v.
-      for (; v; c++)
-      {
-        // Clear the least significant set bit in v.
-        v &= v - 1;
-      }
+      c += __builtin_popcountll(word_[i]);
     }
     return c;
   }
@@ -286,59 +334,100 @@ class BitString {
   int number_of_bits() const {return number_of_bits_;}
 
  private:
+  static const int kBitsPerWord = sizeof(unsigned long long) * 8;
+  // Number of words stored inside the object.
+  static const int kInlineWords = 4;
+
   // Implementation assumes that unused bits in word_ are always set to 0.
   // Special case is the Undefined value, then all words are set to -1ULL.
+  // Points to inline_words_ or to a heap array.
   unsigned long long *word_;
   // Number of bits in the bit-string.
   int number_of_bits_;
   // Number of words used to represent the bit-string.
   int number_of_words_;
+  unsigned long long inline_words_[kInlineWords];
+
+  // Used by Swap() to move from source without copying the words.
+  BitString(int, BitString *source) {
+    MoveObj(source);
+  }
+
+  // Points word_ at storage for number_of_words_ words.
+  void AllocateWords() {
+    if (number_of_words_ <= kInlineWords)
+      word_ = inline_words_;
+    else {
+      word_ = new unsigned long long[number_of_words_];
+      MaoMemory::Allocated(MaoMemory::BITSTRING,
+                           number_of_words_ * sizeof(*word_), 0);
+    }
+  }
+
+  void FreeObj() {
+    if (word_ != inline_words_) {
+      delete[] word_;
+      MaoMemory::Freed(MaoMemory::BITSTRING,
+                       number_of_words_ * sizeof(*word_), 0);
+    }
+    word_ = inline_words_;
+    number_of_words_ = 0;
+    number_of_bits_ = 0;
+  }
 
   void CopyObj(const BitString& b) {
     number_of_bits_ = b.number_of_bits_;
     number_of_words_ = b.number_of_words_;
-    word_ = new unsigned long long[number_of_words_];
+    AllocateWords();
     for (int i = 0; i < number_of_words_; ++i)
       word_[i] = b.word_[i];
   }
 
+  // Takes over the contents of source, which is left empty.
+  void MoveObj(BitString *source) {
+    number_of_bits_ = source->number_of_bits_;
+    number_of_words_ = source->number_of_words_;
+    if (source->word_ == source->inline_words_) {
+      word_ = inline_words_;
+      for (int i = 0; i < number_of_words_; ++i)
+        word_[i] = source->word_[i];
+    } else {
+      word_ = source->word_;
+    }
+    source->word_ = source->inline_words_;
+    source->number_of_words_ = 0;
+    source->number_of_bits_ = 0;
+  }
+
   void InitObj(int number_of_bits) {
     MAO_ASSERT(number_of_bits > 0);
     number_of_bits_ = number_of_bits;
-    number_of_words_ = (number_of_bits-1)/(sizeof(unsigned long long) * 8)
-        + 1;
-    word_ = new unsigned long long[number_of_words_];
+    number_of_words_ = (number_of_bits - 1) / kBitsPerWord + 1;
+    AllocateWords();
     for (int i = 0; i < number_of_words_; i++)
       word_[i] = 0;
   }
 
+  // Returns the mask of the used bits in the last word.
+  unsigned long long LastWordMask() const {
+    int used_bits = number_of_bits_ % kBitsPerWord;
+    return used_bits == 0 ? -1ULL : (1ULL << used_bits) - 1;
+  }
+
   // This makes sure that unused bits in the array are set to zero.
   // Keeping them zero simplifies the implementation of the following functions:
   //  - NextSetBit(), ==, IsNull(), IsNonNull()
   void ClearUnusedBits() {
-    // Zero the unused bits.
-    int unused_bits = sizeof(unsigned long long)*8 -
-        number_of_bits_ % (sizeof(unsigned long long)*8);
-    for (int i = 0; i < unused_bits; ++i) {
-      Clear(number_of_bits_ + i);
-    }
+    word_[number_of_words_ - 1] &= LastWordMask();
   }
 
   void VerifyBitString() {
     // Check relation between number_of_bits_ and number_of_words_.
-#ifndef NDEBUG
-    int bits_per_word = sizeof(unsigned long long) * 8;
-    MAO_ASSERT(((number_of_words_ * bits_per_word) >= number_of_bits_)
-               && (((number_of_words_ - 1) * bits_per_word) < number_of_bits_));
-#endif
+    MAO_ASSERT(((number_of_words_ * kBitsPerWord) >= number_of_bits_)
+               && (((number_of_words_ - 1) * kBitsPerWord) < number_of_bits_));
     if (!IsUndef()) {
       // Assert that all unused bits are zero.
-      int unused_bits = sizeof(unsigned long long)*8 -
-          number_of_bits_ % (sizeof(unsigned long long)*8);
-      unused_bits = unused_bits % (sizeof(unsigned long long)*8);
-      for (int i = 0; i < unused_bits; ++i) {
-        MAO_ASSERT(Get(number_of_bits_ + i) == false);
-      }
+      MAO_ASSERT((word_[number_of_words_ - 1] & ~LastWordMask()) == 0);
     }
   }
 };
@@ -349,6 +438,9 @@ void Tokenize(const std::string& str,
               std::set<std::string>& tokens,
               const std::string& delimiters);
 
+// Writes str to out as a JSON string literal, with quotes.
+void WriteJSONString(FILE *out, const std::string& str);
+
 }
 
 #endif  // MAOUTIL_H_
@@ -111,21 +111,25 @@ std::pair<int, bool> X86InstructionSizeHelper::SizeOfIntersegJump(
   return std::make_pair(size, false);
 }
 
+// The size in bytes of a displacement or an immediate, indexed by
+// OperandSizeIndex(). As in gas, the 64 bit width is checked first, then
+// the 8 and 16 bit widths, and the size is 4 bytes otherwise.
+static const unsigned char kOperandSize[8] = { 4, 2, 1, 1, 8, 8, 8, 8 };
+
+static inline int OperandSizeIndex(bool width64, bool width8, bool width16) {
+  return (width64 << 2) | (width8 << 1) | width16;
+}
+
 std::pair<int, bool> X86InstructionSizeHelper::SizeOfDisp() {
   unsigned int n;
   int size = 0;
 
   for (n = 0; n < insn_->operands; n++) {
-    if (operand_type_check(insn_->types[n], disp)) {
-      if (insn_->types[n].bitfield.disp64)
-        size += 8;
-      else if (insn_->types[n].bitfield.disp8)
-        size += 1;
-      else if (insn_->types[n].bitfield.disp16)
-        size += 2;
-      else
-        size = 4;
-    }
+    const i386_operand_type &type = insn_->types[n];
+    if (operand_type_check(type, disp))
+      size += kOperandSize[OperandSizeIndex(type.bitfield.disp64,
+                                            type.bitfield.disp8,
+                                            type.bitfield.disp16)];
   }
   return std::make_pair(size, false);
 }
@@ -135,16 +139,12 @@ std::pair<int, bool> X86InstructionSizeHelper::SizeOfImm() {
   int size = 0;
 
   for (n = 0; n < insn_->operands; n++) {
-    if (operand_type_check(insn_->types[n], imm)) {
-      if (insn_->types[n].bitfield.imm64)
-        size += 8;
-      else if (insn_->types[n].bitfield.imm8 || insn_->types[n].bitfield.imm8s)
-        size += 1;
-      else if (insn_->types[n].bitfield.imm16)
-        size += 2;
-      else
-        size += 4;
-    }
+    const i386_operand_type &type = insn_->types[n];
+    if (operand_type_check(type, imm))
+      size += kOperandSize[OperandSizeIndex(type.bitfield.imm64,
+                                            type.bitfield.imm8 ||
+                                            type.bitfield.imm8s,
+                                            type.bitfield.imm16)];
   }
   return std::make_pair(size, false);
 }
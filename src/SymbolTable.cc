@@ -33,12 +33,12 @@ SymbolTable::~SymbolTable() {
 }
 
 bool SymbolTable::Exists(const char *name) {
-  std::map<const char*, Symbol *, ltstr>::const_iterator it = table_.find(name);
-  return it != table_.end();
+  return index_.Find(name) != NULL;
 }
 
 Symbol *SymbolTable::Add(Symbol *symbol) {
   table_[symbol->name()] = symbol;
+  index_[symbol->name()] = symbol;
   return symbol;
 }
 
@@ -80,20 +80,20 @@ void SymbolTable::Print(FILE *out) const {
 
 
 Symbol *SymbolTable::Find(const char *name) {
-  std::map<const char*, Symbol *, ltstr>::const_iterator it = table_.find(name);
-  MAO_ASSERT(it != table_.end() );
-  return it->second;
+  Symbol **symbol = index_.Find(name);
+  MAO_ASSERT(symbol != NULL);
+  return *symbol;
 }
 
 Symbol *SymbolTable::FindOrCreateAndFind(const char *name,
                                          const Section *section) {
-  if (!Exists(name)) {
+  Symbol **symbol = index_.Find(name);
+  if (symbol == NULL) {
     // TODO(martint): use ID factory
     return Add(new Symbol(name, Size(), section));
   } else {
-    return Find(name);
+    return *symbol;
   }
-  MAO_RASSERT(1);
 }
 
 SymbolIterator SymbolTable::Begin() {
@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "irlink.h"
+#include "MaoStrings.h"
 
 class SymbolIterator;
 
@@ -130,8 +131,10 @@ class SymbolTable {
   ConstSymbolIterator ConstEnd() const;
 
  private:
-  // Used for the map of symbols
+  // Used for the map of symbols. The map gives the iteration order, the
+  // hash map is used for lookups.
   SymbolMap table_;
+  StringHashMap<Symbol *> index_;
 };
 
 
@@ -70,8 +70,9 @@ static void link_directive_tail(
     DirectiveEntry::OperandVector operands) {
   struct link_context_s link_context = get_link_context();
   DirectiveEntry *directive =
-      new DirectiveEntry(opcode, operands,
-                         link_context.line_number, NULL, maounit_);
+      new (maounit_->arena()) DirectiveEntry(opcode, operands,
+                                             link_context.line_number, NULL,
+                                             maounit_);
   maounit_->AddEntry(directive, false);
   // This makes sure that we only catch relocs that happen in the current entry.
   reloc_ = _dummy_first_bfd_reloc_code_real;
@@ -84,9 +85,20 @@ void link_insn(i386_insn *insn, size_t SizeOfInsn, int code_flag,
 
   struct link_context_s link_context = get_link_context();
   MAO_ASSERT(maounit_);
-  maounit_->AddEntry(new InstructionEntry(inst, (enum flag_code)code_flag,
-                                          link_context.line_number,
-                                          line_verbatim, maounit_), true);
+  // Refer to the line in the input file rather than copying the text, if
+  // the line can be found.
+  const char *line;
+  size_t length;
+  bool mapped = maounit_->mao_options()->mmap_input() &&
+      maounit_->source_files()->FindStatement(link_context.filename,
+                                              link_context.line_number,
+                                              line_verbatim, &line, &length);
+  InstructionEntry *entry = new (maounit_->arena()) InstructionEntry(
+      inst, (enum flag_code)code_flag, link_context.line_number,
+      mapped ? NULL : line_verbatim, maounit_);
+  if (mapped)
+    entry->set_line_verbatim_span(line, length);
+  maounit_->AddEntry(entry, true);
   reloc_ = _dummy_first_bfd_reloc_code_real;
 }
 
@@ -96,8 +108,9 @@ void link_label(const char *name, const char *line_verbatim) {
   MAO_ASSERT(symbol_table);
   struct link_context_s link_context = get_link_context();
   MAO_ASSERT(maounit_);
-  maounit_->AddEntry(new LabelEntry(name, link_context.line_number,
-                                    line_verbatim, maounit_), true);
+  maounit_->AddEntry(new (maounit_->arena()) LabelEntry(
+                         name, link_context.line_number,
+                         line_verbatim, maounit_), true);
 }
 
 void link_symbol(const char *name, enum SymbolVisibility symbol_visibility,
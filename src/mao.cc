@@ -19,6 +19,83 @@
 #include <string.h>
 
 #include "Mao.h"
+#include "MaoBatch.h"
+
+// Reads the unit given on the gas command line.
+static MaoUnit *ParseMaoUnit(MaoOptions *mao_options,
+                             int argc, const char **argv) {
+  // Counters count the calling thread only, so they are opened here, by
+  // the process that runs the unit, and not before batch mode forks.
+  if (mao_options->perf_counters())
+    MaoPerfCounters::Open();
+
+  MaoUnit *mao_unit = new MaoUnit(mao_options);
+  RegisterMaoUnit(mao_unit);
+
+  MaoPassManager mao_pass_man(mao_unit);
+  mao_pass_man.LinkPass(new ReadInputPass(argc, argv,
+                                          GetStaticOptionPass("READ"),
+                                          mao_unit));
+  mao_pass_man.Run();
+  return mao_unit;
+}
+
+// Runs the passes on a unit returned by ParseMaoUnit, and prints the
+// statistics and reports.
+static int OptimizeMaoUnit(MaoOptions *mao_options, MaoUnit *mao_unit) {
+  // In server mode with the IR cache, the unit was read by the parent of
+  // this process, which has its own counters.
+  if (mao_options->perf_counters())
+    MaoPerfCounters::Open();
+
+  MaoPassManager mao_pass_man(mao_unit);
+
+  // Reparse the arguments now that all the dynamic passes have been
+  // loaded.  This will initialize the pass manager with the desired
+  // passes for execution.
+  mao_options->Reparse(mao_unit, &mao_pass_man);
+
+  // Serial passes may depend on the layout of the whole unit, or on the
+  // state of rand(), so their output for a function cannot be reused.
+  MaoFunctionCache *function_cache = NULL;
+  if (mao_options->function_cache_dir() &&
+      !mao_pass_man.HasSerialFunctionPasses()) {
+    std::vector<std::string> input_files;
+    mao_pass_man.GetInputFiles(&input_files);
+    function_cache = new MaoFunctionCache(mao_unit,
+                                          mao_options->function_cache_dir(),
+                                          mao_options->function_cache_size(),
+                                          input_files);
+    function_cache->LookUp();
+    mao_unit->set_function_cache(function_cache);
+  }
+
+  // run the passes
+  mao_pass_man.Run();
+
+  if (function_cache)
+    function_cache->Evict();
+
+  if (mao_options->stats_json_file()) {
+    if (!mao_unit->GetStats()->WriteJSON(mao_options->stats_json_file()))
+      fprintf(stderr, "Unable to write %s\n", mao_options->stats_json_file());
+  } else {
+    mao_unit->GetStats()->Print(stdout);
+  }
+  if (mao_options->timer_print())
+    mao_options->TimerPrint();
+  if (mao_options->memory_report())
+    MaoMemory::PrintReport(stderr);
+  if (mao_options->timing_json_file() &&
+      !MaoTiming::WriteJSON(mao_options->timing_json_file()))
+    fprintf(stderr, "Unable to write %s\n", mao_options->timing_json_file());
+  if (mao_options->timing_csv_file() &&
+      !MaoTiming::WriteCSV(mao_options->timing_csv_file()))
+    fprintf(stderr, "Unable to write %s\n", mao_options->timing_csv_file());
+  delete mao_unit;
+  delete function_cache;
+  return 0;
+}
 
 //==================================
 // MAO Main Entry
@@ -59,24 +136,19 @@ int main(int argc, const char *argv[]) {
 
   InitRegisters();
 
-  MaoUnit mao_unit(&mao_options);
-  RegisterMaoUnit(&mao_unit);
-
-  MaoPassManager mao_pass_man(&mao_unit);
-  mao_pass_man.LinkPass(new ReadInputPass(new_argc, new_argv,
-                                          GetStaticOptionPass("READ"),
-                                          &mao_unit));
-
-  // Reparse the arguments now that all the dynamic passes have been
-  // loaded.  This will initialize the pass manager with the desired
-  // passes for execution.
-  mao_options.Reparse(&mao_unit, &mao_pass_man);
-
-  // run the passes
-  mao_pass_man.Run();
+  // In batch and server mode, the units run in processes forked from
+  // this one, which has done all of the above.
+  if (mao_options.server_socket()) {
+    MaoBatch batch(&mao_options, ParseMaoUnit, OptimizeMaoUnit,
+                   new_argc, new_argv);
+    return batch.Serve(mao_options.server_socket());
+  }
+  if (mao_options.batch_file()) {
+    MaoBatch batch(&mao_options, ParseMaoUnit, OptimizeMaoUnit,
+                   new_argc, new_argv);
+    return batch.RunList(mao_options.batch_file());
+  }
 
-  mao_unit.GetStats()->Print(stdout);
-  if (mao_options.timer_print())
-    mao_options.TimerPrint();
-  return 0;
+  return OptimizeMaoUnit(&mao_options,
+                         ParseMaoUnit(&mao_options, new_argc, new_argv));
 }
@@ -70,11 +70,11 @@ class AddAddElimPass : public MaoFunctionPass {
         // at previuos entries.
         if (IsAddIOrSubI(insn)) {
           // Get the def mask of the instructions
-          BitString imask = GetRegisterDefMask(insn);
+          RegisterMask imask = GetRegisterDefMask(insn);
 
           InstructionEntry *prev = insn->prevInstruction();
           while (prev) {
-            BitString pmask = GetRegisterDefMask(prev);
+            RegisterMask pmask = GetRegisterDefMask(prev);
             if (pmask.IsUndef()) {  // insn with unknown side effects, break
               break;
             }
@@ -93,7 +93,7 @@ class AddAddElimPass : public MaoFunctionPass {
                     MAO_ASSERT_MSG(false,
                                    "Unable to update immediate value.");
                   }
-                  unit_->DeleteEntry(prev);
+                  cfg->DeleteInstruction(*it, prev);
                   Trace(2, "Removed redundant add/sub instruction and updated "
                         "immediate value.");
                 }
@@ -153,40 +153,31 @@ class AddAddElimPass : public MaoFunctionPass {
     }
 
     // Now get the immediate value
-    expressionS *imm1 = inst1->instruction()->op[0].imms;
-    expressionS *imm2 = inst2->instruction()->op[0].imms;
+    const expressionS *imm1 = inst1->instruction()->op[0].imms;
+    expressionS imm2 = *inst2->instruction()->op[0].imms;
 
     // supported variants:
-    if (imm1->X_op == O_constant && imm2->X_op == O_constant) {
-      imm2->X_add_number = imm1->X_add_number + imm2->X_add_number;
-      return true;
-    }
-
-    if (imm1->X_op == O_symbol && imm2->X_op == O_constant) {
-      imm2->X_op = O_symbol;
-      imm2->X_add_number = imm1->X_add_number + imm2->X_add_number;
-      imm2->X_add_symbol = imm1->X_add_symbol;
-      return true;
-    }
-
-    if (imm1->X_op == O_symbol && imm2->X_op == O_symbol) {
-      imm2->X_op = O_add;
-      imm2->X_add_number = imm1->X_add_number + imm2->X_add_number;
-      imm2->X_op_symbol  = imm1->X_add_symbol;
-      return true;
-    }
-
-
-    if (imm1->X_op == O_constant && imm2->X_op == O_symbol) {
-      imm2->X_add_number = imm1->X_add_number + imm2->X_add_number;
-      return true;
+    if (imm1->X_op == O_constant && imm2.X_op == O_constant) {
+      imm2.X_add_number = imm1->X_add_number + imm2.X_add_number;
+    } else if (imm1->X_op == O_symbol && imm2.X_op == O_constant) {
+      imm2.X_op = O_symbol;
+      imm2.X_add_number = imm1->X_add_number + imm2.X_add_number;
+      imm2.X_add_symbol = imm1->X_add_symbol;
+    } else if (imm1->X_op == O_symbol && imm2.X_op == O_symbol) {
+      imm2.X_op = O_add;
+      imm2.X_add_number = imm1->X_add_number + imm2.X_add_number;
+      imm2.X_op_symbol  = imm1->X_add_symbol;
+    } else if (imm1->X_op == O_constant && imm2.X_op == O_symbol) {
+      imm2.X_add_number = imm1->X_add_number + imm2.X_add_number;
+    } else {
+      return false;
     }
-
-    return false;
+    inst2->SetImmediateExpression(0, imm2);
+    return true;
   }
 
   // Stores the mask for the e-flag.
-  const BitString emask_;
+  const RegisterMask emask_;
 };
 
 REGISTER_PLUGIN_FUNC_PASS("ADDADD", AddAddElimPass)
@@ -285,7 +285,7 @@ class BackBranchAlign : public MaoFunctionPass {
 
       if ((*offsets)[(*iter)->min_bb()->GetFirstInstruction()] % 8) {
         (*iter)->min_bb()->first_entry()->AlignTo(3,-1,7);
-        MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+        MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
         sizes = MaoRelaxer::GetSizeMap(unit_, function_->GetSection());
         offsets = MaoRelaxer::GetOffsetMap(unit_, function_->GetSection());
 
@@ -308,7 +308,7 @@ class BackBranchAlign : public MaoFunctionPass {
         (*iter)->min_bb()->first_entry()->LinkBefore(nop);
       }
 
-      MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+      MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
       sizes = MaoRelaxer::GetSizeMap(unit_, function_->GetSection());
       offsets = MaoRelaxer::GetOffsetMap(unit_, function_->GetSection());
 
@@ -347,5 +347,5 @@ class BackBranchAlign : public MaoFunctionPass {
   int       align_limit_;
 };
 
-REGISTER_PLUGIN_FUNC_PASS("BACKBRALIGN", BackBranchAlign)
+REGISTER_PLUGIN_SERIAL_FUNC_PASS("BACKBRALIGN", BackBranchAlign)
 }  // namespace
@@ -55,54 +55,51 @@ class BranchSeparatorPass : public MaoFunctionPass {
   bool profitable;
 
 
-  class BranchSeparatorStat : public Stat {
+  class BranchSeparatorStat : public GroupStat {
    public:
-    BranchSeparatorStat(int distance) : num_branches_(0), num_branches_realigned_(0),
-                             relaxations_(0), distance_(distance) {
-      nop_counts_ = new int[distance];
-      memset (nop_counts_, 0, sizeof(int)*distance_);
+    BranchSeparatorStat()
+        : GroupStat("BRSEP"),
+          num_branches_(Counter("branches")),
+          num_branches_realigned_(Counter("branches_realigned")),
+          relaxations_(Counter("relaxations")),
+          nop_sizes_(Histogram("nop_bytes")) {
     }
 
-    ~BranchSeparatorStat() {delete [] nop_counts_;}
-
     void FoundBranch() {
-      num_branches_++;
+      num_branches_->Inc();
     }
     void Relaxed() {
-      relaxations_++;
+      relaxations_->Inc();
     }
 
     void RealigningBranch(int nops) {
-      num_branches_realigned_++;
-      nop_counts_[nops]++;
+      num_branches_realigned_->Inc();
+      nop_sizes_->Add(nops);
     }
 
     virtual void Print(FILE *out) {
-      int bytes=0;
       fprintf(out, "Branch Separator stats\n");
-      fprintf(out, "  # Branches: %d\n",
-              num_branches_);
-      fprintf(out, "  # Branches realigned : %d\n",
-              num_branches_realigned_);
-      for(int i=0; i<distance_; i++) {
-        if (nop_counts_[i] != 0) {
-          fprintf(out, "  # %d byte nops inserted: %d\n",
-                i, nop_counts_[i]);
-          bytes += i*nop_counts_[i];
-        }
+      fprintf(out, "  # Branches: %lld\n",
+              num_branches_->value());
+      fprintf(out, "  # Branches realigned : %lld\n",
+              num_branches_realigned_->value());
+      for (std::map<long long, long long>::const_iterator iter =
+               nop_sizes_->buckets().begin();
+           iter != nop_sizes_->buckets().end(); ++iter) {
+        fprintf(out, "  # %lld byte nops inserted: %lld\n",
+                iter->first, iter->second);
       }
-      fprintf(out, "  # additional bytes: %d\n",
-              bytes);
-      fprintf(out, "  # Relaxations: %d\n",
-              relaxations_);
+      fprintf(out, "  # additional bytes: %lld\n",
+              nop_sizes_->sum());
+      fprintf(out, "  # Relaxations: %lld\n",
+              relaxations_->value());
     }
 
    private:
-    int                num_branches_;
-    int                num_branches_realigned_;
-    int                relaxations_;
-    int                *nop_counts_;
-    int                distance_;
+    StatCounter   *num_branches_;
+    StatCounter   *num_branches_realigned_;
+    StatCounter   *relaxations_;
+    StatHistogram *nop_sizes_;
   };
 
   BranchSeparatorStat *branch_separator_stat_;
@@ -148,7 +145,7 @@ BranchSeparatorPass::BranchSeparatorPass(MaoOptionMap *options, MaoUnit *mao,
       branch_separator_stat_ = static_cast<BranchSeparatorStat *>(
           unit_->GetStats()->GetStat("BRSEP"));
     } else {
-      branch_separator_stat_ = new BranchSeparatorStat(min_branch_distance_);
+      branch_separator_stat_ = new BranchSeparatorStat();
       unit_->GetStats()->Add("BRSEP", branch_separator_stat_);
     }
   }
@@ -203,7 +200,7 @@ bool BranchSeparatorPass::Go() {
       //If we have separated a branch and then we see a directive,
       //we need to re-relax 
       if (rerelax) {
-        MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+        MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
         sizes_ = MaoRelaxer::GetSizeMap(unit_, function_->GetSection());
         Trace (2, "Re-relaxing");
         rerelax=false;
@@ -216,7 +213,7 @@ bool BranchSeparatorPass::Go() {
   if(change) {
     if(rerelax)
       //Relaxation has to be performed again
-      MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+      MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
     //Align function begining based on min_branch_distance
     AlignEntry(function_, *(function_->EntryBegin()), false);
     if (collect_stat_)
@@ -317,5 +314,5 @@ bool BranchSeparatorPass::IsProfitable(Function *function) {
     }
 }
 
-REGISTER_PLUGIN_FUNC_PASS("BRSEP", BranchSeparatorPass)
+REGISTER_PLUGIN_SERIAL_FUNC_PASS("BRSEP", BranchSeparatorPass)
 }  // namespace
@@ -58,6 +58,9 @@ class DeadCodeElimPass : public MaoFunctionPass {
  public:
   DeadCodeElimPass(MaoOptionMap *options, MaoUnit *mao, Function *function)
       : MaoFunctionPass("DCE", options, mao, function) {
+    UsesAnalysis(ANALYSIS_CFG);
+    // Dead blocks are only reported.
+    PreservesAllAnalyses();
   }
 
   bool Go() {
@@ -33,6 +33,8 @@
 // compilers won't model the flags at this level of granularity
 // anyways, so this is more a theoreritical concern.
 //
+#include <vector>
+
 #include "Mao.h"
 
 namespace {
@@ -62,27 +64,35 @@ class Inc2AddPass : public MaoFunctionPass {
     // Find instructions that have 1 operand and a register as
     // the 1st operand.
     // Then, convert this instruction to an add or sub of 1 to that
-    // register.
+    // register. The edits go through the CFG, which stays valid.
     //
-    FORALL_FUNC_ENTRY(function_, iter) {
-      if (!iter->IsInstruction()) continue;
-      InstructionEntry *insn = iter->AsInstruction();
+    CFG *cfg = CFG::GetCFG(unit_, function_);
+    FORALL_CFG_BB(cfg, it) {
+      std::vector<InstructionEntry *> replaced;
+      FORALL_BB_ENTRY(it, iter) {
+        if (!iter->IsInstruction()) continue;
+        InstructionEntry *insn = iter->AsInstruction();
 
-      if (insn->NumOperands() != 1 ||
-          !insn->IsRegisterOperand(0))
-        continue;
+        if (insn->NumOperands() != 1 ||
+            !insn->IsRegisterOperand(0))
+          continue;
 
-      if (insn->op() == OP_inc || insn->op() == OP_dec) {
-        InstructionEntry *i = insn->op() == OP_inc ?
-          unit_->CreateAdd(function_) : unit_->CreateSub(function_);
-        i->instruction()->operands = 2;
-        i->SetImmediateIntOperand(0, 32, 1);
-        i->SetOperand(1, insn, 0);
+        if (insn->op() == OP_inc || insn->op() == OP_dec) {
+          InstructionEntry *i = insn->op() == OP_inc ?
+            unit_->CreateAdd(function_) : unit_->CreateSub(function_);
+          i->instruction()->operands = 2;
+          i->SetImmediateIntOperand(0, 32, 1);
+          i->SetOperand(1, insn, 0);
 
-        insn->LinkBefore(i);
-        MarkInsnForDelete(insn);
-        TraceReplace(1, insn, i);
+          cfg->InsertBefore(*it, insn, i);
+          replaced.push_back(insn);
+          TraceReplace(1, insn, i);
+        }
       }
+      // Deleting the current entry would break the iteration above.
+      for (std::vector<InstructionEntry *>::iterator insn = replaced.begin();
+           insn != replaced.end(); ++insn)
+        cfg->DeleteInstruction(*it, *insn);
     }
 
     return true;
@@ -205,7 +205,9 @@ class InsertPrefetchNtaPass : public MaoPass {
  public:
   InsertPrefetchNtaPass(MaoOptionMap *options, MaoUnit *mao)
       : MaoPass("INSPREFNTA", options, mao),
-        sample_profile_(GetOptionString("instn_list")) { }
+        sample_profile_(GetOptionString("instn_list")) {
+    ReadsFile(sample_profile_);
+  }
   virtual ~InsertPrefetchNtaPass();
   virtual bool Go();
 
@@ -225,7 +225,7 @@ class AlignTinyLoops16 : public MaoFunctionPass {
           // check how alignment changed for loops at higher
           // addresses (after this current loop in the list)
           //
-          MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+          MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
           sizes = MaoRelaxer::GetSizeMap(unit_, function_->GetSection());
           offsets = MaoRelaxer::GetOffsetMap(unit_, function_->GetSection());
         }
@@ -260,5 +260,5 @@ class AlignTinyLoops16 : public MaoFunctionPass {
   int       limit_;
 };
 
-REGISTER_PLUGIN_FUNC_PASS("LOOP16", AlignTinyLoops16)
+REGISTER_PLUGIN_SERIAL_FUNC_PASS("LOOP16", AlignTinyLoops16)
 }  // namespace
@@ -19,6 +19,8 @@
 
 // random nop insertion - nopinizer
 //
+#include <map>
+
 #include "Mao.h"
 
 namespace {
@@ -48,11 +50,26 @@ class NopInizerPass : public MaoFunctionPass {
   }
 
   // Randomly insert nops into the code stream, based
-  // on some distribution density.
+  // on some distribution density. The nops are inserted through the CFG,
+  // which stays valid.
   //
   bool Go() {
+    // The entries are visited in program order, which is not the order of
+    // the basic blocks, so look up the block each one starts.
+    CFG *cfg = CFG::GetCFG(unit_, function_);
+    std::map<MaoEntry *, BasicBlock *> block_starts;
+    FORALL_CFG_BB(cfg, it) {
+      if ((*it)->first_entry() != NULL)
+        block_starts[(*it)->first_entry()] = *it;
+    }
+
+    BasicBlock *bb = NULL;
     int count_down = (int) (1.0 * density_ * (rand() / (RAND_MAX + 1.0)));
     FORALL_FUNC_ENTRY(function_,entry) {
+      std::map<MaoEntry *, BasicBlock *>::iterator start =
+          block_starts.find(*entry);
+      if (start != block_starts.end())
+        bb = start->second;
       if (!entry->IsInstruction())
         continue;
       MaoEntry *prev_entry =  entry->prev();
@@ -69,9 +86,10 @@ class NopInizerPass : public MaoFunctionPass {
         --count_down;
       } else {
         int num = (int) (1.0 * thick_ * (rand() / (RAND_MAX + 1.0)));
+        MAO_ASSERT(bb != NULL);
         for (int i = 0; i < num; i++) {
           InstructionEntry *nop = unit_->CreateNop(function_);
-          entry->LinkBefore(nop);
+          cfg->InsertBefore(bb, *entry, nop);
         }
         count_down = (int) (1.0 * density_ * (rand() / (RAND_MAX + 1.0)));
         TraceC(1, "Inserted %d nops, before:", num);
@@ -80,7 +98,6 @@ class NopInizerPass : public MaoFunctionPass {
       }
     }
 
-    CFG::InvalidateCFG(function_);
     return true;
   }
 
@@ -90,5 +107,8 @@ class NopInizerPass : public MaoFunctionPass {
   int             thick_;
 };
 
-REGISTER_PLUGIN_FUNC_PASS("NOPIN", NopInizerPass)
+// The nops inserted depend on the state of rand(), which is shared by all
+// functions. Running serially keeps the output reproducible, and keeps the
+// function cache from reusing it.
+REGISTER_PLUGIN_SERIAL_FUNC_PASS("NOPIN", NopInizerPass)
 }  // namespace
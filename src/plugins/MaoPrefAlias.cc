@@ -100,7 +100,7 @@ class PrefAlias : public MaoFunctionPass {
     if (!cfg->IsWellFormed()) return true;
 
     MaoEntryIntMap *offsets;
-    MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+    MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
     offsets = MaoRelaxer::GetOffsetMap(unit_, function_->GetSection());
 
     FORALL_CFG_BB(cfg, it)
@@ -158,5 +158,5 @@ class PrefAlias : public MaoFunctionPass {
   std::map<BasicBlock *, bool> bb_map;
 };
 
-REGISTER_PLUGIN_FUNC_PASS("PREFALIAS", PrefAlias )
+REGISTER_PLUGIN_SERIAL_FUNC_PASS("PREFALIAS", PrefAlias )
 } // namespace
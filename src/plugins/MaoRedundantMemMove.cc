@@ -69,11 +69,11 @@ class RedMemMovElimPass : public MaoFunctionPass {
           if (insn->GetBaseRegister() == GetIP())
             continue;
           int checked = 0;
-          BitString mask = GetRegisterDefMask(insn);
+          RegisterMask mask = GetRegisterDefMask(insn);
 
           // eliminate this pattern:
           //     movq    (%rax), %rax
-          BitString base_index_mask =
+          RegisterMask base_index_mask =
             GetMaskForRegister(insn->GetBaseRegister()) |
             GetMaskForRegister(insn->GetIndexRegister());
 
@@ -94,7 +94,7 @@ class RedMemMovElimPass : public MaoFunctionPass {
               break;
             }
 
-            BitString defs = GetRegisterDefMask(next);
+            RegisterMask defs = GetRegisterDefMask(next);
             if (defs.IsNull() || defs.IsUndef())
               break;  // defines something other than registers
 
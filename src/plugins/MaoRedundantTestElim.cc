@@ -36,7 +36,11 @@ MAO_DEFINE_OPTIONS(REDTEST, "Eliminates redundant tests",  0) {
 class RedTestElimPass : public MaoFunctionPass {
  public:
   RedTestElimPass(MaoOptionMap *options, MaoUnit *mao, Function *function)
-      : MaoFunctionPass("REDTEST", options, mao, function) { }
+      : MaoFunctionPass("REDTEST", options, mao, function) {
+    UsesAnalysis(ANALYSIS_CFG);
+    // The redundant tests are deleted with MarkInsnForDelete().
+    ReportsIRChanges();
+  }
 
   // Find patterns like these in a single basic block:
   //
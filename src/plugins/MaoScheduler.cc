@@ -219,6 +219,8 @@ class SchedulerPass : public MaoFunctionPass {
       // parent registers differently when computing dependences, it is ok to
       // assign rsp_pointer_ to cfa_reg_
       cfa_reg_ = rsp_pointer_;
+      // Moving instructions within their blocks keeps the CFG.
+      ReportsIRChanges();
   }
 
   bool Go() {
@@ -321,8 +323,8 @@ class SchedulerPass : public MaoFunctionPass {
   const reg_entry *rsp_pointer_;
   const reg_entry *cfa_reg_;
 
-  BitString GetSrcRegisters(SchedulerNode *node);
-  BitString GetDestRegisters(SchedulerNode *node);
+  RegisterMask GetSrcRegisters(SchedulerNode *node);
+  RegisterMask GetDestRegisters(SchedulerNode *node);
   DependenceDag *FormDependenceDag(BasicBlock *bb);
   bool HasMemOperation(SchedulerNode *node) const;
   bool IsMemOperation(InstructionEntry *insn) const;
@@ -479,6 +481,7 @@ void SchedulerPass::ScheduleNode(int node_index, MaoEntry **head,
   }
   node->first->Unlink(node->last);
   (*head)->LinkAfter(node->first);
+  MarkIRChanged();
   if (prev_entry->IsDirective()) {
     DirectiveEntry *insn = prev_entry->AsDirective();
     if (insn->op() == DirectiveEntry::P2ALIGN ||
@@ -582,13 +585,13 @@ int *SchedulerPass::ComputeDependenceHeights(DependenceDag *dag) {
 }
 
 
-BitString SchedulerPass::GetSrcRegisters(SchedulerNode *node) {
-  BitString use_mask;
+RegisterMask SchedulerPass::GetSrcRegisters(SchedulerNode *node) {
+  RegisterMask use_mask;
   for (MaoEntry *entry = node->first; entry != node->last->next();
        entry = entry->next()) {
     if (entry->IsInstruction()) {
       InstructionEntry *insn = entry->AsInstruction();
-      use_mask = use_mask | GetRegisterUseMask(insn, true);
+      use_mask |= GetRegisterUseMask(insn, true);
     } else if (entry->IsDirective()) { // Handle .cfi directives
       DirectiveEntry *de = entry->AsDirective();
       DirectiveEntry::Opcode opcode = de->op();
@@ -601,7 +604,7 @@ BitString SchedulerPass::GetSrcRegisters(SchedulerNode *node) {
           // All these directives are assumed to use the *current* cfa_reg_ to
           // prevent scheduling across instructions that write to the current
           // cfa_reg_
-          use_mask = use_mask | GetMaskForRegister(cfa_reg_);
+          use_mask |= GetMaskForRegister(cfa_reg_);
           if (opcode != DirectiveEntry::CFI_OFFSET) {
             // For .cfi_def_cfa and .cfi_def_cfa_register, add the new cfa
             // register (which is the first operand of these directives) to the
@@ -619,7 +622,7 @@ BitString SchedulerPass::GetSrcRegisters(SchedulerNode *node) {
             MAO_RASSERT_MSG( (*endptr == 0),
                              "Not a valid dwarf2 register number");
             reg = GetRegFromDwarfNumber(reg_num, is_64_bit);
-            use_mask = use_mask | GetMaskForRegister(reg);
+            use_mask |= GetMaskForRegister(reg);
             cfa_reg_ = reg;
           }
           break;
@@ -631,13 +634,13 @@ BitString SchedulerPass::GetSrcRegisters(SchedulerNode *node) {
   return use_mask;
 }
 
-BitString SchedulerPass::GetDestRegisters(SchedulerNode *node) {
-  BitString def_mask;
+RegisterMask SchedulerPass::GetDestRegisters(SchedulerNode *node) {
+  RegisterMask def_mask;
   for (MaoEntry *entry = node->first; entry != node->last->next();
        entry = entry->next()) {
     if (entry->IsInstruction()) {
       InstructionEntry *insn = entry->AsInstruction();
-      def_mask = def_mask | GetRegisterDefMask(insn, true);
+      def_mask |= GetRegisterDefMask(insn, true);
     } else if (entry->IsDirective()) {
       DirectiveEntry *de = entry->AsDirective();
       DirectiveEntry::Opcode opcode = de->op();
@@ -660,7 +663,7 @@ BitString SchedulerPass::GetDestRegisters(SchedulerNode *node) {
             if (entry->GetFlag() == CODE_64BIT)
               is_64_bit = true;
             reg = GetRegFromDwarfNumber(reg_num, is_64_bit);
-            def_mask = def_mask | GetMaskForRegister(reg);
+            def_mask |= GetMaskForRegister(reg);
           }
           break;
         default:
@@ -677,7 +680,7 @@ void SchedulerPass::InitializeLastWriter(int *last_writer) {
       entry_iter != entries_.end(); ++entry_iter) {
     SchedulerNode *sn = *entry_iter;
 
-    BitString dest_regs_mask = GetDestRegisters(sn);
+    RegisterMask dest_regs_mask = GetDestRegisters(sn);
     int index = 0;
     while ((index = dest_regs_mask.NextSetBit(index)) != -1) {
       // Trace (2, "dest reg = %d", index);
@@ -840,7 +843,7 @@ SchedulerPass::DependenceDag *SchedulerPass::FormDependenceDag(BasicBlock *bb) {
     // This BB forms a straightline loop
     InitializeLastWriter(last_writer);
   }
-  BitString rsp_mask = GetMaskForRegister(rsp_pointer_);
+  RegisterMask rsp_mask = GetMaskForRegister(rsp_pointer_);
 
   for (SchedulerNodeIterator entry_iter = entries_.begin();
        entry_iter != entries_.end(); entry_iter++) {
@@ -848,8 +851,8 @@ SchedulerPass::DependenceDag *SchedulerPass::FormDependenceDag(BasicBlock *bb) {
     sn->ToString(&insn_str_[nodes_in_bb]);
     Trace(2, "Instruction %d: %s\n",
           nodes_in_bb, insn_str_[nodes_in_bb].c_str());
-    BitString src_regs_mask = GetSrcRegisters(sn);
-    BitString dest_regs_mask = GetDestRegisters(sn);
+    RegisterMask src_regs_mask = GetSrcRegisters(sn);
+    RegisterMask dest_regs_mask = GetDestRegisters(sn);
     /* Predicate operations require stricter WAW dependence enforcement.
      * Consider the sequence:
      *   mov  %edx, %ebx (1)
@@ -864,7 +867,7 @@ SchedulerPass::DependenceDag *SchedulerPass::FormDependenceDag(BasicBlock *bb) {
      *  (1) and (2) never gets reordered.
      */
     if (HasPredicateOperation(sn)) {
-      src_regs_mask = src_regs_mask | dest_regs_mask;
+      src_regs_mask |= dest_regs_mask;
     }
     char src_str[128], dest_str[128];
     src_regs_mask.ToString(src_str, 128);
@@ -954,8 +957,8 @@ SchedulerPass::DependenceDag *SchedulerPass::FormDependenceDag(BasicBlock *bb) {
            entry_iter != entries_.rend(); ++entry_iter) {
     nodes_in_bb--;
     SchedulerNode *sn = *entry_iter;
-    BitString src_regs_mask = GetSrcRegisters(sn);
-    BitString dest_regs_mask = GetDestRegisters(sn);
+    RegisterMask src_regs_mask = GetSrcRegisters(sn);
+    RegisterMask dest_regs_mask = GetDestRegisters(sn);
     int index = 0;
     sn->ToString(&insn_str);
     while ((index = src_regs_mask.NextSetBit(index)) != -1) {
@@ -18,6 +18,8 @@
 //   Boston, MA  02110-1301, USA.
 
 // Zero Extension Elimination
+#include <sys/time.h>
+
 #include "Mao.h"
 #include "MaoPlugin.h"
 
@@ -29,9 +31,12 @@ PLUGIN_VERSION
 // Options
 // --------------------------------------------------------------------
 MAO_DEFINE_OPTIONS(TESTDF, "Implements example analysis that uses MAO's "\
-                   "dataflow analysis framework", 2) {
+                   "dataflow analysis framework", 3) {
   OPTION_BOOL("liveness", true, "Run liveness analysis."),
   OPTION_BOOL("reachingdef", true, "Run reaching def. analysis."),
+  OPTION_BOOL("bench", false, "Solve each problem with the worklist and the "
+              "round-robin solver, and report iterations and time instead "
+              "of the results."),
 };
 
 class TestDataFlowPass : public MaoFunctionPass {
@@ -39,8 +44,15 @@ class TestDataFlowPass : public MaoFunctionPass {
   TestDataFlowPass(MaoOptionMap *options, MaoUnit *mao, Function *function)
       : MaoFunctionPass("TESTDF", options, mao, function),
         liveness_(GetOptionBool("liveness")),
-        reachingdef_(GetOptionBool("reachingdef")) {
+        reachingdef_(GetOptionBool("reachingdef")),
+        bench_(GetOptionBool("bench")) {
     MAO_ASSERT_MSG(liveness_ || reachingdef_, "TESTDF has nothing to do.");
+    // The benchmark solves fresh problems.
+    if (liveness_ && !bench_)
+      UsesAnalysis(ANALYSIS_LIVENESS);
+    if (reachingdef_ && !bench_)
+      UsesAnalysis(ANALYSIS_REACHING_DEFS);
+    PreservesAllAnalyses();
   }
 
   bool Go() {
@@ -48,15 +60,22 @@ class TestDataFlowPass : public MaoFunctionPass {
 
     CFG *cfg = CFG::GetCFG(unit_, function_);
 
+    if (bench_) {
+      if (liveness_) {
+        Bench<Liveness>("liveness", cfg, DFProblem::DF_RoundRobin);
+        Bench<Liveness>("liveness", cfg, DFProblem::DF_Worklist);
+      }
+      if (reachingdef_) {
+        Bench<ReachingDefs>("reachingdef", cfg, DFProblem::DF_RoundRobin);
+        Bench<ReachingDefs>("reachingdef", cfg, DFProblem::DF_Worklist);
+      }
+      return true;
+    }
+
     if (liveness_) {
       Trace(1, "Test liveness:");
-      // Create the problem instance
-      Liveness liveness = Liveness(unit_,
-                                   function_,
-                                   cfg);
-
-      // Now we can solve it.
-      liveness.Solve();
+      // Get the solved problem instance.
+      Liveness *liveness = MaoAnalyses::GetLiveness(unit_, function_);
 
       // Print the live registers for each instruction.
       FORALL_CFG_BB(cfg, it) {
@@ -68,7 +87,7 @@ class TestDataFlowPass : public MaoFunctionPass {
             std::string insn_str;
             insn->ToString(&insn_str);
             fprintf(stderr, "insn: %s\n", insn_str.c_str());
-            BitString live_regs = liveness.GetLive(*bb, *insn);
+            RegisterMask live_regs = liveness->GetLive(*bb, *insn);
             fprintf(stderr, "live: ");
             for (int i = 0; i < live_regs.number_of_bits(); ++i) {
               if (live_regs.Get(i)) {
@@ -91,12 +110,9 @@ class TestDataFlowPass : public MaoFunctionPass {
 
     if (reachingdef_) {
       Trace(1, "Test reaching defs:");
-      // Create the problem instance
-      ReachingDefs rd_problem = ReachingDefs(unit_,
-                                             function_,
-                                             cfg);
-      // Now we can solve it.
-      rd_problem.Solve();
+      // Get the solved problem instance.
+      ReachingDefs *rd_problem = MaoAnalyses::GetReachingDefs(unit_,
+                                                              function_);
 
       // Print out the results!
       // For each instruction, print out the reaching definitions.
@@ -111,16 +127,16 @@ class TestDataFlowPass : public MaoFunctionPass {
            fprintf(stderr, "\ninsn: %s\n", insn_str.c_str());
           // Get the list of definitions:
           // TODO(martint): Create macros to iterate over defined registers.
-          BitString used_registers = GetRegisterUseMask(insn, true);
+          RegisterMask used_registers = GetRegisterUseMask(insn, true);
           // Loop over them:
           for (int reg_num = 0; reg_num < used_registers.number_of_bits();
                ++reg_num) {
             if (used_registers.Get(reg_num)) {
               fprintf(stderr, "Uses: %s\n", GetRegName(reg_num));
               // Regnum was defined!
-              std::list<Definition> defs = rd_problem.GetReachingDefs(*bb,
-                                                                      *insn,
-                                                                      reg_num);
+              std::list<Definition> defs = rd_problem->GetReachingDefs(*bb,
+                                                                       *insn,
+                                                                       reg_num);
               if (defs.size() == 0) {
                 fprintf(stderr, "%5s: No definitions found\n",
                         GetRegName(reg_num));
@@ -144,8 +160,28 @@ class TestDataFlowPass : public MaoFunctionPass {
     return true;
   }
  private:
+  // Solves a fresh instance of Problem with the given solver and reports
+  // the effort it took.
+  template <typename Problem>
+  void Bench(const char *problem_name, CFG *cfg,
+             DFProblem::DFSolver solver) {
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    Problem problem(unit_, function_, cfg);
+    problem.Solve(solver);
+    gettimeofday(&end, NULL);
+    long usecs = (end.tv_sec - start.tv_sec) * 1000000L +
+        (end.tv_usec - start.tv_usec);
+    Trace(0, "%s: %s: %s: %d blocks, %d iterations, %d visits, %ld us",
+          function_->name().c_str(), problem_name,
+          solver == DFProblem::DF_Worklist ? "worklist" : "round-robin",
+          cfg->GetNumOfNodes(), problem.num_iterations(),
+          problem.num_visits(), usecs);
+  }
+
   bool liveness_;
   bool reachingdef_;
+  bool bench_;
 };
 
 REGISTER_PLUGIN_FUNC_PASS("TESTDF", TestDataFlowPass)
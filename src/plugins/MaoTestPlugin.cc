@@ -17,6 +17,10 @@
 //   51 Franklin Street, Fifth Floor,
 //   Boston, MA  02110-1301, USA.
 
+#include <map>
+#include <utility>
+#include <vector>
+
 #include "Mao.h"
 
 namespace {
@@ -26,8 +30,11 @@ PLUGIN_VERSION
 // --------------------------------------------------------------------
 // Options
 // --------------------------------------------------------------------
-MAO_DEFINE_OPTIONS(TESTPLUG, "A test plugin pass", 1) {
+MAO_DEFINE_OPTIONS(TESTPLUG, "A test plugin pass", 2) {
   OPTION_STR("prefix", "plugin", "Prefix for messages"),
+  OPTION_BOOL("retarget", false, "Split the target of each direct branch "
+              "before its first instruction, and retarget the branch to "
+              "the new block, through the CFG"),
 };
 
 class TestPlugin : public MaoFunctionPass {
@@ -37,8 +44,64 @@ class TestPlugin : public MaoFunctionPass {
 
   bool Go() {
     printf("%s: %s\n", GetOptionString("prefix"), function_->name().c_str());
+    if (GetOptionBool("retarget"))
+      Retarget();
     return true;
   }
+
+ private:
+  // The new block starts with a label created by SplitBasicBlock, and the
+  // block it is split from falls through to it, so the code does the same.
+  void Retarget() {
+    CFG *cfg = CFG::GetCFG(unit_, function_);
+    // Splitting adds blocks, so collect the branches first.
+    std::vector<std::pair<BasicBlock *, BasicBlock *> > branches;
+    FORALL_CFG_BB(cfg, it) {
+      InstructionEntry *branch = (*it)->GetLastInstruction();
+      if (!branch || branch != (*it)->last_entry() || !branch->HasTarget() ||
+          branch->IsIndirectJump())
+        continue;
+      BasicBlock *target = TakenSuccessor(*it);
+      if (target && target != *it && target->first_entry() &&
+          target->first_entry()->IsLabel())
+        branches.push_back(std::make_pair(*it, target));
+    }
+
+    // Maps each split block to the block split off it, which holds the
+    // branch ending the original block.
+    std::map<BasicBlock *, BasicBlock *> split;
+    for (std::vector<std::pair<BasicBlock *, BasicBlock *> >::iterator iter =
+             branches.begin(); iter != branches.end(); ++iter) {
+      BasicBlock *bb = iter->first;
+      if (split.count(bb))
+        bb = split[bb];
+      BasicBlock *target = iter->second;
+      if (!split.count(target)) {
+        InstructionEntry *first = target->GetFirstInstruction();
+        if (!first)
+          continue;
+        split[target] = cfg->SplitBasicBlock(target, first);
+      }
+      Trace(1, "Retargeted branch from %s to %s", target->label(),
+            split[target]->label());
+      cfg->RetargetBranch(bb, target, split[target]);
+    }
+  }
+
+  // Returns the block the branch ending bb goes to, or NULL if there is
+  // not exactly one.
+  static BasicBlock *TakenSuccessor(BasicBlock *bb) {
+    BasicBlock *target = NULL;
+    for (BasicBlock::EdgeIterator edge = bb->BeginOutEdges();
+         edge != bb->EndOutEdges(); ++edge) {
+      if ((*edge)->fall_through())
+        continue;
+      if (target)
+        return NULL;
+      target = (*edge)->dest();
+    }
+    return target;
+  }
 };
 
 REGISTER_PLUGIN_FUNC_PASS("TESTPLUG", TestPlugin );
@@ -73,7 +73,7 @@ class UOpsCmpJmp : public MaoFunctionPass {
 
     // Relax and compute offsets
     //
-    MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+    MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
     sizes = MaoRelaxer::GetSizeMap(unit_, function_->GetSection());
     offsets = MaoRelaxer::GetOffsetMap(unit_, function_->GetSection());
 
@@ -110,7 +110,7 @@ class UOpsCmpJmp : public MaoFunctionPass {
 
       // Relax and compute offsets
       //
-      MaoRelaxer::InvalidateSizeMap(function_->GetSection());
+      MaoRelaxer::InvalidateSizeMap(function_->GetSection(), function_);
       sizes = MaoRelaxer::GetSizeMap(unit_, function_->GetSection());
       offsets = MaoRelaxer::GetOffsetMap(unit_, function_->GetSection());
 
@@ -186,5 +186,5 @@ class UOpsCmpJmp : public MaoFunctionPass {
   bool align_cmp_;
 };
 
-REGISTER_PLUGIN_FUNC_PASS("UOPSCMPJMP", UOpsCmpJmp )
+REGISTER_PLUGIN_SERIAL_FUNC_PASS("UOPSCMPJMP", UOpsCmpJmp )
 } // namespace
@@ -36,7 +36,11 @@ MAO_DEFINE_OPTIONS(ZEE, "Eliminates unnecessary zero extension instructions", \
 class ZeroExtentElimPass : public MaoFunctionPass {
  public:
   ZeroExtentElimPass(MaoOptionMap *options, MaoUnit *mao, Function *function)
-      : MaoFunctionPass("ZEE", options, mao, function) { }
+      : MaoFunctionPass("ZEE", options, mao, function) {
+    UsesAnalysis(ANALYSIS_CFG);
+    // The redundant moves are deleted with MarkInsnForDelete().
+    ReportsIRChanges();
+  }
 
   bool IsZeroExtent(InstructionEntry *insn) {
     if (insn->IsOpMov() &&
@@ -66,10 +70,10 @@ class ZeroExtentElimPass : public MaoFunctionPass {
         if (first == insn) continue;
 
         if (IsZeroExtent(insn)) {
-          BitString imask = GetRegisterDefMask(insn);
+          RegisterMask imask = GetRegisterDefMask(insn);
           InstructionEntry *prev = insn->prevInstruction();
           while (prev) {
-            BitString pmask = GetRegisterDefMask(prev);
+            RegisterMask pmask = GetRegisterDefMask(prev);
             if (pmask.IsUndef())  // insn with unknown side effects, break
               break;
 
@@ -92,7 +96,7 @@ class ZeroExtentElimPass : public MaoFunctionPass {
               break;
             }
 
-            BitString ip = imask & pmask;
+            RegisterMask ip = imask & pmask;
             if (ip.IsNonNull()) {
               if (prev->op() == OP_movq &&
                   RegistersOverlap(prev->GetRegisterOperand(1),
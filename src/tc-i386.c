@@ -6831,26 +6831,82 @@ i386_att_operand (char *operand_string)
    we do to grow the fixed or variable part contributes to our
    returned value.  */
 
-int
-md_estimate_size_before_relax (fragS *fragP, segT segment)
+/* Return nonzero if a jump to SYMBOL can not be relaxed in SEGMENT.
+   On an ELF system, we can't relax an externally visible symbol,
+   because it may be overridden by a shared library.  */
+
+static int
+jump_needs_reloc (symbolS *symbol, segT segment)
 {
-  /* We've already got fragP->fr_subtype right;  all we have to do is
-     check for un-relaxable symbols.  On an ELF system, we can't relax
-     an externally visible symbol, because it may be overridden by a
-     shared library.  */
-  if (S_GET_SEGMENT (fragP->fr_symbol) != segment
+  return (S_GET_SEGMENT (symbol) != segment
 #if defined (OBJ_ELF) || defined (OBJ_MAYBE_ELF)
-      || (IS_ELF
-	  && (S_IS_EXTERNAL (fragP->fr_symbol)
-	      || S_IS_WEAK (fragP->fr_symbol)
-	      || ((symbol_get_bfdsym (fragP->fr_symbol)->flags
-		   & BSF_GNU_INDIRECT_FUNCTION))))
+	  || (IS_ELF
+	      && (S_IS_EXTERNAL (symbol)
+		  || S_IS_WEAK (symbol)
+		  || ((symbol_get_bfdsym (symbol)->flags
+		       & BSF_GNU_INDIRECT_FUNCTION))))
 #endif
 #if defined (OBJ_COFF) && defined (TE_PE)
-      || (OUTPUT_FLAVOR == bfd_target_coff_flavour
-	  && S_IS_WEAK (fragP->fr_symbol))
+	  || (OUTPUT_FLAVOR == bfd_target_coff_flavour
+	      && S_IS_WEAK (symbol))
 #endif
-      )
+	  );
+}
+
+// Allows MAO to size jumps without building frags. Returns nonzero if
+// md_estimate_size_before_relax would turn a jump with the given relax
+// state and reloc into a (d)word jump right away, and sets *growth to the
+// number of bytes it adds to the fixed part of the frag.
+int
+get_jump_growth (symbolS *symbol, segT segment, relax_substateT subtype,
+		 enum bfd_reloc_code_real reloc, int *growth)
+{
+  int size = (subtype & CODE16) ? 2 : 4;
+
+  if (!jump_needs_reloc (symbol, segment))
+    return 0;
+
+  switch (TYPE_FROM_RELAX_STATE (subtype))
+    {
+    case UNCOND_JUMP:
+      *growth = size;
+      break;
+
+    case COND_JUMP86:
+      if (size == 2 && (!no_cond_jump_promotion || reloc != NO_RELOC))
+	{
+	  *growth = 2 + 2;
+	  break;
+	}
+      /* Fall through.  */
+
+    case COND_JUMP:
+      if (no_cond_jump_promotion && reloc == NO_RELOC)
+	*growth = 1;
+      else
+	*growth = 1 + size;
+      break;
+
+    default:
+      BAD_CASE (subtype);
+      break;
+    }
+  return 1;
+}
+
+// Allows MAO to walk the relax states of jumps the way relax_frag does.
+const relax_typeS *
+get_relax_table (void)
+{
+  return md_relax_table;
+}
+
+int
+md_estimate_size_before_relax (fragS *fragP, segT segment)
+{
+  /* We've already got fragP->fr_subtype right;  all we have to do is
+     check for un-relaxable symbols.  */
+  if (jump_needs_reloc (fragP->fr_symbol, segment))
     {
       /* Symbol is undefined in this segment, or we need to keep a
 	 reloc so that weak symbols can be overridden.  */
@@ -0,0 +1,54 @@
+#Option: --mao=PASSMAN=threads[4]+trace[1] --mao=ADD2INC=trace[2]
+#grep Replaced 20
+#grep on 4 threads 1
+#
+# The functions end with .size, so that the passes can run on several
+# threads, and the traces are printed in function order.
+
+.globl add0
+.type	add0, @function
+
+add0:
+ add    $1, %ah
+ add    $1, %al
+ addl   $1, %eax
+ sub    $1, %ax
+ sub    $1, %rax
+ ret
+.size add0, .-add0
+
+.globl add1
+.type	add1, @function
+
+add1:
+ add    $1, %ah
+ add    $1, %al
+ addl   $1, %eax
+ sub    $1, %ax
+ sub    $1, %rax
+ ret
+.size add1, .-add1
+
+.globl add2
+.type	add2, @function
+
+add2:
+ add    $1, %ah
+ add    $1, %al
+ addl   $1, %eax
+ sub    $1, %ax
+ sub    $1, %rax
+ ret
+.size add2, .-add2
+
+.globl add3
+.type	add3, @function
+
+add3:
+ add    $1, %ah
+ add    $1, %al
+ addl   $1, %eax
+ sub    $1, %ax
+ sub    $1, %rax
+ ret
+.size add3, .-add3
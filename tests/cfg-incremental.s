@@ -0,0 +1,35 @@
+#Option: --mao=RELAX=verify_sizes[1] --mao=TEST=dom[1] --mao=INC2ADD --mao=ADDADD --mao=NOPIN=density[2] --mao=TESTPLUG=retarget[1]+trace[1] --mao=TEST=verify_cfg[1]+dom[1]+trace[1]
+#grep Retargeted branch 5
+#grep CFG of function thread matches a rebuilt one 1
+#
+# INC2ADD, ADDADD and NOPIN insert and delete instructions through the
+# CFG built by the first TEST. TESTPLUG then splits the target of each of
+# the five branches before its first instruction, which inserts a label,
+# and retargets the branch to the new block. The second TEST checks the
+# CFG against a rebuilt one, and rebuilds the dominator trees the first
+# one computed, which the splits dropped. It also relaxes the function
+# again, checking that the changed instructions dropped the sizes the
+# first TEST cached. The block after the jne has no label, so its first
+# entry changes.
+#
+	.text
+	.globl	thread
+	.type	thread, @function
+thread:
+	testl	%eax, %eax
+	jne	.L2
+	addl	$1, %ebx
+	addl	$2, %ebx
+	incl	%edx
+	jmp	.L4
+.L2:
+	jmp	.L3
+.L4:
+	decl	%ecx
+	cmpl	%ecx, %ebx
+	jg	.L5
+.L3:
+	ret
+.L5:
+	jmp	.L2
+	.size	thread, .-thread
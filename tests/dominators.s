@@ -0,0 +1,47 @@
+#Option: --mao=TEST=lsg[0]+relax[0]+dom[1]+trace[4]
+#grep Dominator tree: 1
+#grep Post-dominator tree: 1
+#grep bb1: idom 8, 1
+#grep bb2: idom 0, 1
+#grep bb3: idom 2, frontier: 5 1
+#grep bb4: idom 2, frontier: 5 1
+#grep bb5: idom 2, frontier: 5 1
+#grep bb6: idom 5, 1
+#grep bb7: idom 6, frontier: 7 1
+#grep bb8: idom 6, 1
+#grep bb0: idom 2, 1
+#grep bb2: idom 5, 1
+#grep bb3: idom 5, frontier: 2 1
+#grep bb4: idom 5, frontier: 2 1
+#grep bb5: idom 6, frontier: 5 1
+#grep bb6: idom 8, 1
+#grep bb7: unreachable 1
+#grep bb8: idom 1, 1
+#grep unreachable 1
+#grep frontier: [0-9] 7
+#grep frontier: [0-9]+ [0-9] 0
+#
+# The blocks are bb0 and bb1, the source and the sink, then bb2 (dom),
+# bb3 (.L2), bb4, bb5 (.L3), bb6, bb7 (.L5) and bb8. bb2 to bb5 form a
+# diamond, bb5 is a loop and bb7 an endless loop, which cannot reach
+# the sink and so is unreachable in the post-dominator tree.
+#
+	.text
+	.globl	dom
+	.type	dom, @function
+dom:
+	testl	%eax, %eax
+	je	.L2
+	addl	$1, %ebx
+	jmp	.L3
+.L2:
+	subl	$1, %ebx
+.L3:
+	decl	%ecx
+	jne	.L3
+	testl	%edx, %edx
+	je	.L5
+	ret
+.L5:
+	jmp	.L5
+	.size	dom, .-dom
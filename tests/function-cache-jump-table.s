@@ -0,0 +1,49 @@
+#Option: --mao=--function-cache=/tmp/mao-function-cache-jump-table --mao=ASM
+#grep \.L9: 1
+#grep \.quad\s+\.L8 1
+#grep \.L8: 1
+#grep plain: 1
+#grep FUNCTION_CACHE: (?:hits|misses) +1\b 1
+#
+# The jump table of f2 splits it over two subsections of .text, so f2 is
+# printed entry by entry, once, with the table in .rodata. Only plain is
+# looked up in the cache, and hits or misses depending on earlier runs.
+#
+	.text
+	.p2align 4,,15
+	.globl	f2
+	.type	f2, @function
+f2:
+	cmpl	$3, %edi
+	jbe	.L13
+.L4:
+	movl	%edi, %eax
+	ret
+.L13:
+	mov	%edi, %eax
+	jmp	*.L9(,%rax,8)
+	.section	.rodata
+	.align 8
+.L9:
+	.quad	.L5
+	.quad	.L6
+	.quad	.L4
+	.quad	.L8
+	.text
+.L8:
+	movl	$3, %eax
+	ret
+.L5:
+	movl	$1, %eax
+	ret
+.L6:
+	movl	$2, %eax
+	ret
+	.size	f2, .-f2
+	.p2align 4,,15
+	.globl	plain
+	.type	plain, @function
+plain:
+	leal	1(%rdi), %eax
+	ret
+	.size	plain, .-plain
@@ -0,0 +1,31 @@
+#Option: --mao=RELAX=verify_incremental[1] --mao=UOPSCMPJMP=trace[2]+offset_min[25]
+#grep Insert 1
+#grep Found 2
+#
+# crossb starts before the alignment that ends the window of crossa. The
+# nops inserted before the cmp in crossa move .Lb by 4 bytes, and the jump
+# back to .Lb after the alignment becomes short. Re-relaxing crossa alone
+# must not hide that change.
+#
+	.type	crossa, @function
+crossa:
+	movabsq	$0x123456789, %rax
+	movabsq	$0x123456789, %rax
+	movabsq	$0x123456789, %rax
+	movabsq	$0x123456789, %rax
+	movabsq	$0x123456789, %rax
+	movabsq	$0x123456789, %rax
+	cmp	%dl, %r8b
+	jne	.La
+.La:
+	ret
+	.size	crossa, .-crossa
+	.type	crossb, @function
+crossb:
+.Lb:
+	nop
+	.p2align 7
+	.space	66
+	jmp	.Lb
+	ret
+	.size	crossb, .-crossb
@@ -0,0 +1,35 @@
+#Option:  --mao=RELAX=native[1]+collect_stats[1]+verify_native[1] --mao=TEST
+#grep MaoRelax.*stretch.*246 1
+#
+# The first jmp grows by 3 bytes in the first relaxation pass. gas does
+# not move .L2, which is behind the .p2align, by that stretch when it
+# sizes the second jmp, as the alignment absorbs it. The second jmp is
+# 125 bytes short of .L2 and stays short; with the stretch it would be
+# 128 bytes away and made long. verify_native checks the sizes against
+# gas.
+#
+	.globl	stretch
+	.type	stretch, @function
+stretch:
+	jmp	.L3
+	nop
+	nop
+	nop
+	nop
+	nop
+	nop
+	nop
+	nop
+	nop
+	nop
+	nop
+	nop
+	jmp	.L2
+	.space	120
+	.p2align 4
+.L2:
+	nop
+	.space	100
+.L3:
+	ret
+	.size	stretch, .-stretch
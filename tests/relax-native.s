@@ -0,0 +1,21 @@
+#Option:  --mao=RELAX=native[1]+collect_stats[1]+verify_native[1] --mao=TEST
+#grep MaoRelax.*native.*153 1
+#
+# The native relaxer must agree with gas: the first jump is one byte out
+# of reach of a short jump (5 bytes), the alignment pads 133 to 144, the
+# backward jne stays short, and the jump to an undefined symbol is always
+# 5 bytes.
+#
+	.globl	native
+	.type	native, @function
+native:
+	jmp	.L2
+	.space	128
+.L2:
+	.p2align 4
+.L3:
+	nop
+	jne	.L3
+	jmp	external_function
+	ret
+	.size	native, .-native